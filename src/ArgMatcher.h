@@ -0,0 +1,294 @@
+#if not defined(ARG_MATCHER_H)
+#define ARG_MATCHER_H
+
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * \class MockArgs
+ * \brief The arguments of a mocked call, rendered to text for matching.
+ *
+ * Each argument is appended as text followed by a separator: strings as they
+ * are, integers and enums in decimal, booleans as `true` / `false`. Anything
+ * with a `c_str()` method (Arduino's String) counts as a string. Rendering
+ * reuses one buffer per thread, so matching a call does not allocate.
+ */
+class MockArgs {
+public:
+  static const char kSeparator = '\x1f';
+
+  MockArgs() {}
+  ~MockArgs() {}
+
+  /**
+   * \brief Replaces the arguments.
+   */
+  template<typename... Args>
+  void assign(const Args&... args) {
+    _text.clear();
+    _ends.clear();
+    (append(args), ...);
+  }
+
+  /**
+   * \brief Returns the number of arguments.
+   */
+  size_t size() const { return _ends.size(); }
+
+  /**
+   * \brief Returns an argument as text, or an empty view if there is no such argument.
+   *
+   * \param index   size_t - Position of the argument, from 0.
+   */
+  std::string_view str(size_t index) const {
+    if (index >= _ends.size()) {
+      return std::string_view();
+    }
+    size_t start = (index == 0) ? 0 : _ends[index - 1] + 1;
+    return std::string_view(_text).substr(start, _ends[index] - start);
+  }
+
+  /**
+   * \brief Returns an argument parsed as an integer, or 0 if it is not one.
+   *
+   * \param index   size_t - Position of the argument, from 0.
+   */
+  long long integer(size_t index) const {
+    std::string_view text = str(index);
+    long long value = 0;
+    std::from_chars(text.data(), text.data() + text.size(), value);
+    return value;
+  }
+
+  /**
+   * \brief Returns every argument as one key, the form exact and prefix rules match against.
+   */
+  std::string_view key() const { return _text; }
+
+  /**
+   * \brief Returns the arguments as readable text, e.g. `"/config", 80`.
+   */
+  std::string describe() const {
+    std::string text;
+    for (size_t i = 0; i < size(); ++i) {
+      text += (i == 0) ? "" : ", ";
+      text += std::string(str(i));
+    }
+    return text;
+  }
+
+  /**
+   * \brief Returns the calling thread's reusable instance.
+   */
+  static MockArgs& scratch() {
+    thread_local MockArgs args;
+    return args;
+  }
+
+private:
+  template<typename T, typename = void>
+  struct HasCStr : std::false_type {};
+
+  template<typename T>
+  struct HasCStr<T, std::void_t<decltype(std::declval<const T&>().c_str())>> : std::true_type {};
+
+  template<typename T>
+  void append(const T& value) {
+    if constexpr (std::is_same<T, bool>::value) {
+      _text += value ? "true" : "false";
+    } else if constexpr (std::is_same<T, char>::value) {
+      _text += value;
+    } else if constexpr (std::is_integral<T>::value) {
+      char digits[24];
+      auto result = std::to_chars(digits, digits + sizeof(digits), value);
+      _text.append(digits, result.ptr - digits);
+    } else if constexpr (std::is_enum<T>::value) {
+      append((long long)value);
+    } else if constexpr (std::is_floating_point<T>::value) {
+      char digits[32];
+      int length = snprintf(digits, sizeof(digits), "%g", (double)value);
+      _text.append(digits, length);
+    } else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+      _text += std::string_view(value);
+    } else if constexpr (std::is_convertible<const T&, const char*>::value) {
+      const char* text = value;
+      _text += (text != nullptr) ? text : "";
+    } else if constexpr (HasCStr<T>::value) {
+      _text += value.c_str();
+    } else if constexpr (std::is_pointer<T>::value) {
+      char digits[24];
+      int length = snprintf(digits, sizeof(digits), "%p", (const void*)value);
+      _text.append(digits, length);
+    } else {
+      _text += '?';
+    }
+    _ends.push_back(_text.size());
+    _text += kSeparator;
+  }
+
+  std::string _text;              // Every argument followed by kSeparator.
+  std::vector<size_t> _ends;      // Offset of each argument's separator.
+};
+
+/**
+ * \brief A condition on the arguments of a mocked call, see `Emulator::withArgsMatching()`.
+ */
+typedef std::function<bool(const MockArgs&)> ArgPredicate;
+
+/**
+ * \class ArgRules
+ * \brief The argument conditions of one mocked method, indexed for fast matching.
+ *
+ * Exact rules are found with one hash lookup of the rendered arguments.
+ * Prefix rules are grouped by length, and matched longest first with one hash
+ * lookup per distinct prefix length. Only predicate rules are tried one by
+ * one. A call therefore costs a few hash lookups however many distinct
+ * arguments a method has been configured for.
+ */
+class ArgRules {
+public:
+  static const size_t kNone = (size_t)-1;
+
+  ArgRules() {}
+  ~ArgRules() {}
+
+  /**
+   * \brief Adds a rule matching calls whose rendered arguments equal a key.
+   *
+   * \param key       const std::string& - The rendered arguments, see `MockArgs::key()`.
+   * \param profile   size_t - The profile the rule selects.
+   */
+  void addExact(const std::string& key, size_t profile) { _count += add(_exact, key, profile) ? 1 : 0; }
+
+  /**
+   * \brief Adds a rule matching calls whose first argument starts with a prefix.
+   *
+   * \param prefix    const std::string& - The prefix.
+   * \param profile   size_t - The profile the rule selects.
+   */
+  void addPrefix(const std::string& prefix, size_t profile) { _count += add(_prefixes[prefix.size()], prefix, profile) ? 1 : 0; }
+
+  /**
+   * \brief Adds a rule matching calls a predicate accepts.
+   *
+   * \param predicate   ArgPredicate - The condition.
+   * \param profile     size_t - The profile the rule selects.
+   */
+  void addPredicate(ArgPredicate predicate, size_t profile) {
+    _predicates.push_back(std::make_pair(predicate, profile));
+    ++_count;
+  }
+
+  /**
+   * \brief Returns true if there are no rules.
+   */
+  bool empty() const { return _count == 0; }
+
+  /**
+   * \brief Removes every rule.
+   *
+   * The hash buckets and their vectors are kept for `add()` to reuse, so
+   * declaring the same rules after a reset does not allocate for them.
+   */
+  void clear() {
+    for (auto& rules : _exact) {
+      rules.second.clear();
+    }
+    for (auto& length : _prefixes) {
+      for (auto& rules : length.second) {
+        rules.second.clear();
+      }
+    }
+    _predicates.clear();
+    _count = 0;
+  }
+
+  /**
+   * \brief Returns the profile selected for a call: the exact rule, else the
+   * longest prefix, else the first predicate to accept it.
+   *
+   * \param args    const MockArgs& - The call's arguments.
+   * \return size_t The profile, or kNone if no rule matches.
+   */
+  size_t match(const MockArgs& args) const {
+    std::string_view key = args.key();
+    size_t found = find(_exact, key);
+    if (found != kNone) {
+      return found;
+    }
+    std::string_view first = args.str(0);
+    for (auto it = _prefixes.rbegin(); it != _prefixes.rend(); ++it) {
+      if (it->first <= first.size()) {
+        found = find(it->second, first.substr(0, it->first));
+        if (found != kNone) {
+          return found;
+        }
+      }
+    }
+    for (const auto& predicate : _predicates) {
+      if (predicate.first(args)) {
+        return predicate.second;
+      }
+    }
+    return kNone;
+  }
+
+private:
+  struct Rule {
+    std::string key;
+    size_t profile;
+  };
+
+  /**
+   * \brief Rules by the hash of their key, colliding keys chained in a vector.
+   */
+  typedef std::unordered_map<uint64_t, std::vector<Rule>> Index;
+
+  static uint64_t hash(std::string_view text) {
+    uint64_t value = 14695981039346656037ULL;
+    for (char c : text) {
+      value = (value ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    return value;
+  }
+
+  static bool add(Index& index, const std::string& key, size_t profile) {
+    std::vector<Rule>& rules = index[hash(key)];
+    for (const auto& rule : rules) {
+      if (rule.key == key) {
+        return false;   // The first rule declared for a key wins, as for returns().
+      }
+    }
+    rules.push_back(Rule{ key, profile });
+    return true;
+  }
+
+  static size_t find(const Index& index, std::string_view key) {
+    auto rules = index.find(hash(key));
+    if (rules == index.end()) {
+      return kNone;
+    }
+    for (const auto& rule : rules->second) {
+      if (rule.key == key) {
+        return rule.profile;
+      }
+    }
+    return kNone;
+  }
+
+  Index _exact;                                             // Exact rules.
+  std::map<size_t, Index> _prefixes;                        // Prefix rules by prefix length.
+  std::vector<std::pair<ArgPredicate, size_t>> _predicates; // Predicate rules in declaration order.
+  size_t _count = 0;                                        // Rules of every kind.
+};
+
+#endif // end of ARG_MATCHER_H
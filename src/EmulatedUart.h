@@ -0,0 +1,267 @@
+#if not defined(EMULATED_UART_H)
+#define EMULATED_UART_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <cstdint>
+#include "RingBuffer.h"
+#include "VirtualClock.h"
+
+#if not defined(EMULATED_UART_RX_BUFFER)
+#define EMULATED_UART_RX_BUFFER   256
+#endif
+
+#if not defined(EMULATED_UART_TX_BUFFER)
+#define EMULATED_UART_TX_BUFFER   128
+#endif
+
+class EmulatedUart;
+
+/**
+ * \brief Capacity of the in-transit ring: a full TX buffer in flight plus several
+ * RX buffers of arrivals between polls, rounded up to a power of two.
+ */
+constexpr size_t emulatedUartWireCapacity() {
+  size_t capacity = 1;
+  while (capacity < 4 * (EMULATED_UART_RX_BUFFER + EMULATED_UART_TX_BUFFER)) {
+    capacity <<= 1;
+  }
+  return capacity;
+}
+
+/**
+ * \class UartDevice
+ * \brief An emulated component sitting on the far end of an EmulatedUart.
+ *
+ * A device attached to a port is serviced whenever the host side of the link
+ * polls for data, giving it the chance to consume what has arrived and answer.
+ */
+class UartDevice {
+public:
+  virtual ~UartDevice() {}
+
+  /**
+   * \brief Processes whatever has arrived on the device's port.
+   *
+   * \param port    EmulatedUart& - The port the device is attached to.
+   */
+  virtual void service(EmulatedUart& port) = 0;
+};
+
+/**
+ * \brief Counters accumulated by one EmulatedUart endpoint.
+ *
+ * \param bytesWritten    uint64_t - Bytes accepted by write().
+ * \param bytesReceived   uint64_t - Bytes that arrived into the RX buffer.
+ * \param overflows       uint64_t - Bytes lost because the RX buffer was full on arrival.
+ * \param blockedMicros   uint64_t - Virtual time write() and flush() spent waiting for TX space.
+ */
+struct UartStats {
+  uint64_t bytesWritten = 0;
+  uint64_t bytesReceived = 0;
+  uint64_t overflows = 0;
+  uint64_t blockedMicros = 0;
+};
+
+/**
+ * \class EmulatedUart
+ * \brief One endpoint of an emulated serial link, usable anywhere a Stream is.
+ *
+ * Two endpoints are joined with `connect()`. Bytes written to one endpoint are
+ * paced at the configured baud rate (10 bit times per byte, 8N1) in virtual
+ * time and arrive in the peer's RX buffer only once their transmission has
+ * completed.
+ *
+ * Buffers mirror a microcontroller UART driver:
+ * - At most EMULATED_UART_TX_BUFFER bytes may be awaiting transmission. A write
+ *   beyond that blocks, advancing the virtual clock until space frees up.
+ * - At most EMULATED_UART_RX_BUFFER received bytes may be waiting to be read.
+ *   Bytes arriving while it is full are dropped and counted as overflows, which
+ *   is how slow readers show up.
+ *
+ * Bytes in transit live in a fixed-capacity, lock-free SPSC ring per direction,
+ * so each endpoint may be driven from its own thread.
+ *
+ * Example:
+ * \code{.cpp}
+ * EmulatedUart host(115200), modemSide(115200);
+ * host.connect(modemSide);
+ * atModem.attach(modemSide);
+ * TinyGsm driver(host);
+ * driver.useAtCommands();
+ * \endcode
+ */
+class EmulatedUart : public Stream {
+public:
+  /**
+   * \brief Constructs an endpoint.
+   *
+   * \param baud    uint32_t - The baud rate both directions are paced at.
+   */
+  explicit EmulatedUart(uint32_t baud = 115200) { begin(baud); }
+  ~EmulatedUart() {}
+
+  /**
+   * \brief Sets the baud rate, as HardwareSerial::begin() does.
+   *
+   * \param baud    uint32_t - Bits per second on the wire.
+   */
+  void begin(uint32_t baud) {
+    _baud = (baud == 0) ? 1 : baud;
+    _byteNanos = 10ULL * 1000000000ULL / _baud;
+  }
+
+  void end() {}
+
+  /**
+   * \brief Returns the configured baud rate.
+   */
+  uint32_t baudRate() const { return _baud; }
+
+  /**
+   * \brief Joins this endpoint to another, in both directions.
+   *
+   * \param peer    EmulatedUart& - The far endpoint.
+   */
+  void connect(EmulatedUart& peer) {
+    _peer = &peer;
+    peer._peer = this;
+  }
+
+  /**
+   * \brief Attaches an emulated device to this endpoint.
+   *
+   * The device is serviced whenever the peer endpoint polls for data.
+   *
+   * \param device    UartDevice* - The device, or nullptr to detach.
+   */
+  void attachDevice(UartDevice* device) { _device = device; }
+
+  // Stream
+  size_t write(uint8_t byte) override {
+    if (_peer == nullptr) {
+      return 0;
+    }
+    uint64_t now = VirtualClock::current().nowMicros() * 1000;
+    uint64_t start = (_lineFreeAt > now) ? _lineFreeAt : now;
+
+    // Bytes still on the wire occupy the TX buffer; wait for room.
+    uint64_t window = (uint64_t)EMULATED_UART_TX_BUFFER * _byteNanos;
+    if (start >= now + window) {
+      uint64_t waitUntil = start - window + _byteNanos;
+      block(waitUntil - now);
+      now = waitUntil;
+    }
+
+    Transit transit = { start + _byteNanos, byte };
+    if (!_peer->_wire.push(transit)) {
+      // The receiver has not polled for longer than its buffers can cover.
+      _peer->_wireOverflows.fetch_add(1, std::memory_order_relaxed);
+    }
+    _lineFreeAt = transit.due;
+    ++_stats.bytesWritten;
+    return 1;
+  }
+
+  size_t write(const uint8_t *buf, size_t size) override {
+    size_t n = 0;
+    while (n < size && write(buf[n]) == 1) {
+      ++n;
+    }
+    return n;
+  }
+
+  int available() override {
+    poll();
+    return (int)_rx.size();
+  }
+
+  int read() override {
+    poll();
+    uint8_t byte;
+    return _rx.pop(byte) ? byte : -1;
+  }
+
+  int peek() override {
+    poll();
+    const uint8_t* byte = _rx.front();
+    return (byte == nullptr) ? -1 : *byte;
+  }
+
+  /**
+   * \brief Blocks until every written byte has left the wire.
+   */
+  void flush() override {
+    uint64_t now = VirtualClock::current().nowMicros() * 1000;
+    if (_lineFreeAt > now) {
+      block(_lineFreeAt - now);
+    }
+  }
+
+  /**
+   * \brief Returns how many bytes can be written without blocking.
+   */
+  int availableForWrite() {
+    uint64_t now = VirtualClock::current().nowMicros() * 1000;
+    uint64_t onWire = (_lineFreeAt > now) ? (_lineFreeAt - now + _byteNanos - 1) / _byteNanos : 0;
+    return (onWire >= EMULATED_UART_TX_BUFFER) ? 0 : (int)(EMULATED_UART_TX_BUFFER - onWire);
+  }
+
+  /**
+   * \brief Returns this endpoint's counters.
+   */
+  UartStats stats() const {
+    UartStats stats = _stats;
+    stats.overflows += _wireOverflows.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+private:
+  struct Transit {
+    uint64_t due;   // Virtual time in ns at which the byte finishes arriving.
+    uint8_t byte;
+  };
+
+  /**
+   * \brief Lets an attached far-end device respond, then moves arrived bytes into RX.
+   */
+  void poll() {
+    if (_peer != nullptr && _peer->_device != nullptr && !_servicing) {
+      _servicing = true;
+      _peer->_device->service(*_peer);
+      _servicing = false;
+    }
+    uint64_t now = VirtualClock::current().nowMicros() * 1000;
+    const Transit* transit;
+    while ((transit = _wire.front()) != nullptr && transit->due <= now) {
+      if (_rx.push(transit->byte)) {
+        ++_stats.bytesReceived;
+      } else {
+        ++_stats.overflows;
+      }
+      Transit discard;
+      _wire.pop(discard);
+    }
+  }
+
+  void block(uint64_t nanos) {
+    uint64_t micros = (nanos + 999) / 1000;
+    VirtualClock::wait(micros);
+    _stats.blockedMicros += micros;
+  }
+
+  // Bytes in transit towards this endpoint: produced by the peer, consumed here.
+  RingBuffer<Transit, emulatedUartWireCapacity()> _wire;
+  // Bytes that have arrived and await read(): only touched by this endpoint.
+  RingBuffer<uint8_t, EMULATED_UART_RX_BUFFER> _rx;
+  std::atomic<uint64_t> _wireOverflows{0};  // Bytes the peer could not hand over.
+  EmulatedUart* _peer = nullptr;            // The far endpoint.
+  UartDevice* _device = nullptr;            // Device serviced when the peer polls.
+  bool _servicing = false;                  // Guards against re-entrant servicing.
+  uint32_t _baud = 115200;
+  uint64_t _byteNanos = 86805;              // Time one byte occupies the wire.
+  uint64_t _lineFreeAt = 0;                 // Virtual ns at which the TX line goes idle.
+  UartStats _stats;
+};
+
+#endif // end of EMULATED_UART_H
@@ -93,6 +93,15 @@ public:
    */
   template<typename T>
   T mock(std::string func) {}
+
+  /**
+   * \brief           A mock method whose return value may depend on its arguments.
+   * \param func      The method's name.
+   * \param args      The arguments the method was called with.
+   * \return          A value of type T.
+   */
+  template<typename T, typename... Args>
+  T mock(std::string func, const Args&... args) {}
   
   /**
    * \brief           Determines the return value for a method. Should be overridden by derived classes.
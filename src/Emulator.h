@@ -5,12 +5,24 @@
 
 #include <string>
 #include <vector>
+#include <atomic>
 #include <map>
+#include <unordered_map>
 #include <any>
 #include <EmulationInterface.h>
+#include <ArgMatcher.h>
+#include <VirtualClock.h>
+#include <TraceRecorder.h>
+#include <SleepLedger.h>
+#include <Expectations.h>
+#include <EmulatorMemory.h>
+#include <FaultInjector.h>
+#include <FuzzInput.h>
 #include <Exceptions/NoReturnValueException.h>
 #include <iostream>
 #include <ostream>
+#include <stdexcept>
+#include <typeinfo>
 #include <unistd.h>
 
 static const unsigned int microseconds = 1000000;
@@ -25,6 +37,15 @@ static const unsigned int microseconds = 1000000;
 #define EMULATION_LOG(x)
 #endif
 
+#ifdef EMULATOR_HISTOGRAMS
+#include <chrono>
+#define EMULATION_TIME_CALL(timing)         CallTiming timing(_methods);
+#define EMULATION_TIME_METHOD(timing, i)    timing.track(i);
+#else
+#define EMULATION_TIME_CALL(timing)
+#define EMULATION_TIME_METHOD(timing, i)
+#endif
+
 /**
  * \class Emulator
  * \brief Provides emulation capabilities for various functionalities.
@@ -40,9 +61,14 @@ public:
    * \brief Default constructor for the Emulator class.
    * 
    * Initializes an instance of the Emulator. Any setup needed for 
-   * the basic emulation capabilities can be added here.
+   * the basic emulation capabilities can be added here. Its containers
+   * allocate from the memory resource bound to the thread, see EmulatorMemory.
    */
-  Emulator() {}
+  Emulator() : _epoch(epoch()), _memory(EmulatorMemory::resource()) {
+    rebindContainer(_methods, _memory);
+    rebindContainer(_spare, _memory);
+    rebindContainer(_exceptionRules, _memory);
+  }
 
     /**
    * \brief Destructor for the Emulator class.
@@ -52,7 +78,11 @@ public:
    * holds resources like memory allocations or open file handles, ensure they are 
    * freed or closed here.
    */
-  virtual ~Emulator() {}
+  virtual ~Emulator() {
+    if (EmulatorArena* arena = dynamic_cast<EmulatorArena*>(_memory)) {
+      arena->detach(this);
+    }
+  }
 
   /**
    * \brief Sets the inactive period for this class instance.
@@ -62,7 +92,7 @@ public:
    *
    * \param seconds   int  - The duration of the inactivity period in seconds.
    */
-  void waits(int seconds) { _wait = seconds; }
+  void waits(int seconds) { refresh(); _wait = seconds; }
 
   /**
    * \brief Pauses the emulator for the previously set wait time.
@@ -73,11 +103,13 @@ public:
    * causing any delay.
    */
   void await() {
+    refresh();
     if (_wait <= 0) {
       return;
     }
 
-    usleep(_wait * 1000000);
+    static const std::string method = "await";
+    SleepLedger::sleep((uint64_t)_wait * 1000000, typeid(*this).name(), method);
   }
 
   /**
@@ -88,11 +120,15 @@ public:
    * Useful for debugging or getting an overview of the current emulator state.
    */
   void dumpMethods() {
+    refresh();
     for (const auto& method : _methods) {
       std::cout << "Method Name: " << method.methodName << std::endl;
       std::cout << "Return Value (count): " << method.retVal.first 
                 << ", Value: " << std::any_cast<std::string>(method.retVal.second) << std::endl;
       std::cout << "Number of times method invoked: " << method.invoked << std::endl;
+#ifdef EMULATOR_HISTOGRAMS
+      method.latency.report(std::cout, "");
+#endif
 
       if (!method.then.empty()) {
         std::cout << "Then values:" << std::endl;
@@ -121,11 +157,73 @@ public:
    *                   method chaining.
    */
   virtual Emulator& returns(std::string func, any var_t, int delay_ms = 0) {
-    _lastFunc = func;
-    RetVal retVal = { 1, var_t };
-    vector<RetVal> then = {};
-    MethodProfile method = { func, retVal, then, 0, delay_ms };
-    _methods.push_back(method);
+    MethodProfile& method = addProfile(func);
+    method.retVal = { 1, var_t };
+    method.delay = delay_ms;
+    return *this;
+  }
+
+  /**
+   * \brief Configures an action that computes a mocked method's return value on every call.
+   *
+   * The action receives the call's arguments (empty if the mock passes none)
+   * and returns the value, which must be of the type the mock returns, or an
+   * empty std::any to return the next value configured with `then()`. This
+   * models stateful devices without pre-generating long `then()` sequences:
+   * 
+   * \code{.cpp}
+   * uint32_t counter = 0;
+   * mockSensor.does("readRegister", [&counter](const MockArgs&) -> std::any { return counter++; });
+   * \endcode
+   *
+   * Actions are stored in place (see InplaceFunction), so configuring and
+   * calling them never allocates. The arguments are only valid until the
+   * action makes another mocked call.
+   *
+   * \param func        std::string - The name of the method/function being mocked.
+   * \param action      MockAction - The action to run on each call.
+   * \param delay_ms    int - An optional delay in milliseconds to be applied before
+   *                   running the action. Default is 0, meaning no delay.
+   *
+   * \return Emulator&  A reference to the current Emulator instance, allowing for
+   *                   method chaining, e.g. with `withArgs()`.
+   */
+  Emulator& does(std::string func, MockAction action, int delay_ms = 0) {
+    returns(func, any(), delay_ms);
+    if (_lastIndex < _methods.size()) {
+      _methods[_lastIndex].action = std::move(action);
+    }
+    return *this;
+  }
+
+  /**
+   * \brief Configures a method to return a sequence of values owned elsewhere.
+   *
+   * Used by Scenario to attach its compiled tables: the profile only points at
+   * the values, which must outlive it and must not change, so many emulators
+   * and tests share one copy and only the cursor is per test. Extending the
+   * sequence with `times()` or `then()` copies it into the profile first.
+   *
+   * \param func        std::string - The name of the method/function being mocked.
+   * \param values      const RetVal* - The sequence, as `returns()` and `then()` would build it.
+   * \param count       size_t - The number of values, at least one.
+   * \param delay_ms    int - An optional delay in milliseconds to be applied before
+   *                   returning a value. Default is 0, meaning no delay.
+   *
+   * \return Emulator&  A reference to the current Emulator instance, allowing for
+   *                   method chaining.
+   *
+   * \throw std::invalid_argument if `count` is zero.
+   */
+  Emulator& returnsShared(std::string func, const RetVal* values, size_t count, int delay_ms = 0) {
+    if (count == 0) {
+      throw std::invalid_argument("Emulator: returnsShared() needs at least one value for " + func);
+    }
+    MethodProfile& method = addProfile(func);
+    method.shared = values;
+    method.sharedCount = count;
+    method.delay = delay_ms;
+    method.returned.assign((count + 63) / 64, 0);
     return *this;
   }
 
@@ -149,15 +247,14 @@ public:
    *       `then`, it sets the repetition count for the last `then` value.
    */
   Emulator& times(int n) {     
-    for (auto method_It = _methods.begin(); method_It != _methods.end(); ++method_It) {
-      if (method_It->methodName == _lastFunc) {
-        if (method_It->then.size() == 0) {
-          method_It->retVal.first = n;
-        } else {
-          RetVal retVal = method_It->then.back();
-          retVal.first = n;
-        }
-        break;
+    refresh();
+    if (_lastIndex < _methods.size()) {
+      MethodProfile& method = _methods[_lastIndex];
+      unshareMethodProfile(method);
+      if (method.then.size() == 0) {
+        method.retVal.first = n;
+      } else {
+        method.then.back().first = n;
       }
     }
     return *this;
@@ -182,16 +279,85 @@ public:
    *       the initial return behavior of the mocked method.
    */
   Emulator& then(any var_t) {
-    for (auto method_It = _methods.begin(); method_It != _methods.end(); ++method_It) {
-      if (method_It->methodName == _lastFunc) {
-        RetVal retVal = { 1, var_t };
-        method_It->then.push_back(retVal);
-        break;
-      }
+    refresh();
+    if (_lastIndex < _methods.size()) {
+      MethodProfile& method = _methods[_lastIndex];
+      unshareMethodProfile(method);
+      RetVal retVal = { 1, var_t };
+      method.then.push_back(retVal);
+      method.returned.resize((retValCount(method) + 63) / 64, 0);
     }
     return *this; 
   }
 
+  /**
+   * \brief Makes the last configured return value apply only to calls with the given arguments.
+   *
+   * Arguments are compared as text, so `withArgs("/config", 80)` matches a call
+   * passing a `const char*`, `std::string` or `String` path and any integer
+   * type of port. Calls with arguments no rule matches get the method's
+   * unconditional `returns()` value.
+   *
+   * \code{.cpp}
+   * http.returns("get", 200);                       // Any other path.
+   * http.returns("get", 404).withArgs("/missing");
+   * \endcode
+   *
+   * \param args      Args... - The arguments, in the order the mocked method takes them.
+   *
+   * \return Emulator&  A reference to the current Emulator instance, allowing for
+   *                   method chaining.
+   */
+  template<typename... Args>
+  Emulator& withArgs(const Args&... args) {
+    thread_local MockArgs values;   // Reused, so redeclaring rules after a reset does not allocate.
+    values.assign(args...);
+    if (MethodProfile* method = conditionLast(values.describe())) {
+      _argRules[std::string(method->methodName)].addExact(std::string(values.key()), _lastIndex);
+    }
+    return *this;
+  }
+
+  /**
+   * \brief Makes the last configured return value apply only to calls whose first argument starts with a prefix.
+   *
+   * Exact rules take priority, then the longest matching prefix.
+   *
+   * \param prefix    std::string - The start of the first argument, e.g. "/api/".
+   *
+   * \return Emulator&  A reference to the current Emulator instance, allowing for
+   *                   method chaining.
+   */
+  Emulator& withArgPrefix(std::string prefix) {
+    if (MethodProfile* method = conditionLast(prefix + "*")) {
+      _argRules[std::string(method->methodName)].addPrefix(prefix, _lastIndex);
+    }
+    return *this;
+  }
+
+  /**
+   * \brief Makes the last configured return value apply only to calls a predicate accepts.
+   *
+   * Predicates are tried in the order they were declared, after exact and
+   * prefix rules have failed to match.
+   *
+   * \code{.cpp}
+   * client.returns("connect", 0).withArgsMatching([](const MockArgs& args) { return args.integer(1) != 443; });
+   * \endcode
+   *
+   * \param predicate     ArgPredicate - The condition on the call's arguments.
+   * \param description   std::string - How to show the condition in reports.
+   *
+   * \return Emulator&  A reference to the current Emulator instance, allowing for
+   *                   method chaining.
+   */
+  Emulator& withArgsMatching(ArgPredicate predicate, std::string description = "<predicate>") {
+    if (MethodProfile* method = conditionLast(description)) {
+      _argRules[std::string(method->methodName)].addPredicate(predicate, _lastIndex);
+    }
+    return *this;
+  }
+
   /**
    * \brief Configures a mock method to throw an exception.
    * 
@@ -203,38 +369,183 @@ public:
    * \param exception     uint16_t - The numeric exception code to be thrown 
    *                     when the mock method is called.
    * 
-   * \note The current implementation uses a map for storing exception 
-   *       configurations, but future versions might use a pair for 
-   *       improved efficiency.
-   * 
-   * \todo Refactor the method to move the logic into the 'Invokable' class.
-   * \todo Consider changing the data structure from std::map to std::pair 
-   *       for better performance.
+   * \note The exception is an unconditional fault rule, see `injectFault()`
+   *       for faults that only fail some calls.
    */
   void setException(std::string func, uint16_t exception) {     
-    std::map<std::string, uint16_t> exceptionMap { { func, exception } };
-    _exceptions.push_back(exceptionMap);
+    refresh();
+    _exceptionRules.push_back(_faults.size());
+    _faults.add(func).throws(exception);
+  }
+
+  /**
+   * \brief Adds a fault rule, making some calls to a mocked method fail.
+   *
+   * Rules are checked on every call after the method's delay, in the order they
+   * were added together with those of `setException()`; the first that fires
+   * fails the call. Random decisions are reproducible from the run seed, see
+   * FaultInjector.
+   *
+   * \code{.cpp}
+   * mockClient.injectFault("connect").probability(0.05).returns(0);
+   * mockClient.injectFault("write").afterBytes(3 * 1024 * 1024).throws(-1);
+   * \endcode
+   *
+   * \param func        std::string - The name of the mocked method.
+   *
+   * \return FaultRule&  The rule, failing every call by throwing FAULT_DEFAULT_EXCEPTION
+   *                     until refined.
+   */
+  FaultRule& injectFault(std::string func) { refresh(); return _faults.add(func); }
+
+  /**
+   * \brief Returns the fault rules of this emulator.
+   */
+  const FaultInjector& faults() const { return _faults; }
+
+  /**
+   * \brief Counts bytes transferred by a mocked method, for `FaultRule::afterBytes()`.
+   *
+   * Mocks pass the byte counts of their writes through this.
+   *
+   * \param func      const std::string& - The name of the mocked method.
+   * \param bytes     size_t - Bytes the call transferred.
+   * \return size_t   bytes, unchanged.
+   */
+  size_t countBytes(const std::string& func, size_t bytes) {
+    refresh();
+    if (!_faults.empty()) {
+      _faults.countBytes(func, bytes);
+    }
+    return bytes;
+  }
+
+  /**
+   * \brief Fills the buffer of a mocked read from the bound fuzz input, if it drives this emulator.
+   *
+   * Mocks pass the count their read returns through this. While fuzzing, the
+   * count is clamped to the buffer and that many bytes are taken from the
+   * input; otherwise the count is returned unchanged and the buffer untouched.
+   *
+   * \param count     N - Bytes the mocked read returned, or -1.
+   * \param buffer    uint8_t* - The caller's buffer.
+   * \param size      size_t - Its size.
+   * \return N        The count the read returns.
+   */
+  template<typename N>
+  N fuzzBuffer(N count, uint8_t* buffer, size_t size) {
+    FuzzInput* fuzz = FuzzInput::active();
+    if (fuzz == nullptr || !fuzz->drives(this) || count <= 0 || buffer == nullptr) {
+      return count;
+    }
+    size_t wanted = ((size_t)count < size) ? (size_t)count : size;
+    size_t filled = fuzz->consumeBytes(buffer, wanted);
+    memset(buffer + filled, 0, wanted - filled);
+    return (N)wanted;
+  }
+
+  /**
+   * \brief Returns the exceptions configured with `setException()`, in order.
+   */
+  vector<std::map<std::string, uint16_t>> exceptions() const {
+    vector<std::map<std::string, uint16_t>> configured;
+    for (size_t index : _exceptionRules) {
+      const FaultRule& rule = _faults.rule(index);
+      configured.push_back({ { rule.method(), (uint16_t)rule.code() } });
+    }
+    return configured;
   }
 
+  /**
+   * \brief Returns how many times a configured exception has been thrown.
+   *
+   * \param index     size_t - Position of the exception in `exceptions()`.
+   */
+  int exceptionThrows(size_t index) const { return (index < _exceptionRules.size()) ? (int)_faults.rule(_exceptionRules[index]).fired() : 0; }
+
+  /**
+   * \brief Declares how a mocked method is expected to be called.
+   *
+   * Expectations are checked as each call happens: a call beyond the expected
+   * number, or out of the declared order, throws an ExpectationException at
+   * that call. Calls that never happened are reported by `verifyExpectations()`.
+   *
+   * \param func        std::string - The name of the mocked method.
+   *
+   * \return Expectation&  The expectation, requiring at least one call until refined
+   *                      with `times()`, `atLeast()`, `atMost()`, `never()`,
+   *                      `before()` or `after()`.
+   */
+  Expectation& expect(std::string func) { refresh(); return _expected.expect(func); }
+
+  /**
+   * \brief Checks that every expected method was called at least as often as expected.
+   *
+   * Call at the end of a test, e.g. in `tearDown()`.
+   *
+   * \throw ExpectationException naming the first expectation not met.
+   */
+  void verifyExpectations() { refresh(); _expected.verify(typeid(*this).name()); }
+
   /**
    * \brief Resets the state of the emulator to its default state.
    * 
    * This function restores the emulator to its initial state by:
    * 1. Setting the wait time back to zero.
-   * 2. Clearing all stored mock method profiles.
-   * 3. Clearing all stored exceptions associated with mock methods.
+   * 2. Recycling all stored mock method profiles.
+   * 3. Clearing all stored exceptions and fault rules associated with mock methods.
+   * 4. Clearing all expectations and argument rules.
    * 
    * This method is typically used between tests or scenarios to ensure
    * that previous configurations don't influence subsequent operations.
+   * Profiles and argument rules are kept for reuse by later `returns()`
+   * and `withArgs()` calls rather than freed, so a test reconfiguring the
+   * same methods does not allocate for them.
    * 
    * \note Subclasses can override this method to provide additional reset functionality.
+   *       It also runs on an emulator's first use after `resetAll()`.
    */
   virtual void reset() {
     _wait = 0;
+    for (auto& method : _methods) {
+      _spare.push_back(std::move(method));
+    }
     _methods.clear();
-    _exceptions.clear();
+    _exceptionRules.clear();
+    _faults.clear();
+    _expected.clear();
+    for (auto& rules : _argRules) {
+      rules.second.clear();
+    }
+    _lastFunc.clear();
+    _lastIndex = (size_t)-1;
+    _epoch = epoch();
   }
 
+  /**
+   * \brief Resets every emulator in the process in constant time.
+   *
+   * Bumps a generation counter shared by all emulators instead of visiting
+   * them. Each emulator compares its generation with the counter on its next
+   * use and, if it is behind, runs its `reset()` first, so the cost of a reset
+   * falls on emulators that are used again and none is paid for the rest.
+   * `resetEmulators()` calls this between tests. The counter is process wide,
+   * so it must not be bumped while emulators are in use on other threads, such
+   * as during `Fleet::run()`.
+   */
+  static void resetAll() { epochCounter().fetch_add(1, std::memory_order_release); }
+
+  /**
+   * \brief Returns true if `resetAll()` has been called since this emulator was last reset,
+   * so its configuration and counters belong to an earlier test.
+   */
+  bool stale() const { return _epoch != epoch(); }
+
+  /**
+   * \brief Returns the resource the emulator's containers allocate from.
+   */
+  std::pmr::memory_resource* memory() const { return _memory; }
+
   /**
    * \brief Record the last exception throw by the class
    * 
@@ -245,41 +556,42 @@ public:
 
   /**
    * \brief Stores the provided method in the _methods vector.
+   *
+   * The function is run as a side effect of every call to the mocked method,
+   * which then returns `var_t`.
    * 
    * \param methodName   std::string - The name of the method.
-   * \param method       void (*method)() - A pointer to the method function.
+   * \param method       void (*method)() - A pointer to the method function, or nullptr.
    * \param var_t        std::any - A value of any type that the method should return.
    */
   void setMethod(std::string methodName, void (*method)(), std::any var_t) {
-    RetVal retVal = { 1, var_t };
-    vector<RetVal> then = {};
-    MethodProfile invokableMethod = { methodName, retVal, then, 0, 0 };
-    _methods.push_back(invokableMethod);
+    MethodProfile& invokableMethod = addProfile(methodName);
+    invokableMethod.retVal = { 1, var_t };
+    if (method != nullptr) {
+      invokableMethod.action = [method](const MockArgs&) -> std::any { method(); return std::any(); };
+    }
   }
 
 
   /**
    * \brief Records a call to a specified mock method.
    * 
-   * Iterates through the list of available mock methods to find the 
-   * specified one, then increments its call count to indicate it has 
-   * been invoked. This function is useful for tracking how many times 
-   * a mock method is called during testing.
+   * Finds the method's unconditional profile, increments its call count to
+   * indicate it has been invoked and runs its action, if it has one, with no
+   * arguments. This function is useful for tracking how many times a mock
+   * method is called during testing.
    * 
    * \param methodName    std::string - The name of the mock method 
    *                      that is being invoked.
-   * 
-   * \note Currently, the actual method is commented out and only the 
-   *       invocation count is incremented. If there are future plans 
-   *       to actually call the method or do more, remember to modify 
-   *       this doc-block accordingly.
    */
   void invokeMethod(std::string methodName) {
-    for(auto method : _methods) {
-      if (method.methodName == methodName) {    
-        method.invoked += 1;
-        // method.method();
-        break;
+    refresh();
+    size_t index = findMethod(methodName);
+    if (index < _methods.size()) {
+      MethodProfile& method = _methods[index];
+      method.invoked += 1;
+      if (method.action) {
+        method.action(MockArgs());
       }
     }
   }
@@ -304,28 +616,48 @@ public:
    */
   template<typename T>
   T mock(std::string func) {
-    string logMsg = string("Entered mock method for ") + string(func);
-    EMULATION_LOG(logMsg.c_str());
-    
-    // Find the method in _methods and if found, delay by its specific delay amount
-    for (auto &method : _methods) {
-      if (method.methodName == func) {
-        logMsg = "Delaying method " + func + " by " + std::to_string(method.delay) + " milliseconds";
-        EMULATION_LOG(logMsg.c_str());
-        usleep(method.delay * 1000);
-        break;
+    refresh();
+    return dispatch<T>(func, findMethod(func));
+  }
+
+  /**
+   * \brief Emulates a mock method whose return value may depend on its arguments.
+   *
+   * As `mock(func)`, but the profile is chosen by the argument rules declared
+   * with `withArgs()`, `withArgPrefix()` and `withArgsMatching()`: an exact
+   * match first, then the longest prefix, then the first predicate to accept
+   * the arguments, and otherwise the method's unconditional profile. Arguments
+   * are only rendered when the method has argument rules.
+   *
+   * \tparam T       typename - Expected return type of the mock method.
+   * \param func     std::string - The name of the mock method that is being emulated.
+   * \param args     Args... - The arguments the mocked method was called with.
+   *
+   * \return T       Returns the emulated output (return value) of the mock method.
+   *
+   * \throw int      Throws an exception if one is predefined for the mock method.
+   */
+  template<typename T, typename... Args>
+  T mock(std::string func, const Args&... args) {
+    refresh();
+    MockArgs* values = nullptr;
+    size_t index = ArgRules::kNone;
+    if (!_argRules.empty()) {
+      auto rules = _argRules.find(func);
+      if (rules != _argRules.end() && !rules->second.empty()) {
+        values = &MockArgs::scratch();
+        values->assign(args...);
+        index = rules->second.match(*values);
       }
     }
-
-    int exception = throwException(func);
-    if (exception > -1) {
-      logMsg = "Found expected exception for method " + func + ": Exception Code " + std::to_string(exception);
-      EMULATION_LOG(logMsg.c_str());
-      EMULATION_LOG("Throwing expected exception");
-      throw exception;
+    if (index == ArgRules::kNone) {
+      index = findMethod(func);
     }
-    EMULATION_LOG("Calling doReturn method");
-    return doReturn<T>(func);
+    if (values == nullptr && index < _methods.size() && _methods[index].action) {
+      values = &MockArgs::scratch();
+      values->assign(args...);
+    }
+    return dispatch<T>(func, index, values);
   }
 
   /**
@@ -346,31 +678,27 @@ public:
    */
   template<typename T>
   T doReturn(std::string func) { 
-    T value;
-    for (auto &method : _methods) {
-      if (method.methodName == func) {
-        value = this->findRetVal<T>(method);
-        method.invoked += 1;
-        break;
-      }
-    }
-    return value;
+    refresh();
+    return returnAt<T>(findMethod(func), nullptr);
   }
 
   /**
    * \brief Finds the return value for the given method based on its configured behavior.
    *
-   * This method determines the appropriate return value for a mocked method by evaluating
-   * the return value count and the sequence of alternate return values. 
+   * This method determines the appropriate return value for a mocked method by walking
+   * its return sequence: the `returns()` value followed by each `then()` value.
    *
    * \details The behavior is determined as follows:
-   * - If the return count `n` is greater than 0, the method decrements `n` and returns the associated value.
-   * - If `n` is 0, and there are no alternate return values (`then` is empty), the current value is returned.
-   * - If `n` is 0 and there are alternate return values, the method picks the next value in sequence.
-   *   It replaces the current return value with the next one and removes the next value from the sequence.
+   * - The value at the method's cursor is returned and marked as returned for coverage.
+   * - Once it has been returned as many times as set with `times()` (once by default),
+   *   the cursor moves on to the next value in the sequence.
+   * - The last value in the sequence is returned for every call after that.
+   *
+   * The configured sequence is never modified, so what a test configured and which of
+   * it was consumed remain visible to coverage reports (see ScenarioCoverage).
    *
-   * If no valid return value can be determined, a `NoReturnValueException` is thrown indicating the 
-   * need to call `.returns()` for the method.
+   * If the value cannot be cast to T, a `NoReturnValueException` is raised indicating
+   * the need to call `.returns()` for the method with a value of the right type.
    *
    * \tparam T         The type of the expected return value.
    * \param method     A reference to the MethodProfile of the method being called.
@@ -380,73 +708,380 @@ public:
   template<typename T>
   T findRetVal(MethodProfile &method) {
     T value;
-    // if n > 0 return and decrement n
-    if (method.retVal.first > 0) {
-      --method.retVal.first;
-      try {
-        value = std::any_cast<T>(method.retVal.second); 
-      } catch (std::bad_any_cast e) {
-        EMULATION_LOG(e.what());
-      }
+    size_t count = retValCount(method);
+    if (method.cursor >= count) {
+      method.cursor = count - 1;
     }
-    // answer if then vector contains elements 
-    bool thenIsEmpty = false;
-    if (method.then.size() == 0) {
-      thenIsEmpty = true;
-    }
-    if (method.retVal.first == 0) {
-      // if then is empty and n is 0 return value anyway
-      if (thenIsEmpty) {            
-        try {
-          value = std::any_cast<T>(method.retVal.second); 
-          return value;
-        } catch (std::bad_any_cast e) {
-          std::string eMessage = "Return value for " + std::string(method.methodName) + " found, casting failed: " + e.what();
-          EMULATION_LOG(eMessage.c_str());
-          NoReturnValueException(eMessage.c_str());
-        }
-      } else { // if then not empty and n is 0 move onto to then
-        method.retVal = method.then[0];
-        method.then.erase(method.then.begin()); 
-        return this->findRetVal<T>(method);
-      }
+    const RetVal& current = retValAt(method, method.cursor);
+    try {
+      value = std::any_cast<T>(current.second);
+    } catch (const std::bad_any_cast& e) {
+      std::string eMessage = "Return value for " + std::string(method.methodName) + " found, casting failed: " + e.what();
+      EMULATION_LOG(eMessage.c_str());
+      NoReturnValueException(eMessage.c_str());
+    }
+    markRetValReturned(method, method.cursor);
+    ++method.consumed;
+    if (++method.repeats >= current.first && method.cursor + 1 < count) {
+      ++method.cursor;
+      method.repeats = 0;
     }
-    std::string eMessage = "Could not find a return value for " + std::string(method.methodName) + ", .returns() must be called for this method.";
-    EMULATION_LOG(eMessage.c_str());
-    NoReturnValueException(eMessage.c_str());
     return value;
   }
 
   /**
    * \brief Attempts to throw a pre-configured exception based on the function's name.
    *
-   * This method searches through a list of exceptions mapped to function names. If a match 
-   * is found, the associated exception code is returned, indicating that the exception 
-   * should be thrown. If no exception is configured for the given function name, a default 
+   * This method checks the fault rules of the function, counting the call. If a rule
+   * that throws fires, its exception code is returned, indicating that the exception 
+   * should be thrown. If no exception is due for the given function name, a default 
    * exception code (PSUEDO_EXCEPTION_NO_EXCEPT) is set internally.
    *
    * \param func      The name of the function for which an exception should be checked.
-   * \return int      The exception code if one is mapped to the function. If no exception is found, 
+   * \return int      The exception code if one is due for the function. If no exception is found, 
    *                  -1 is returned.
    */
   int throwException(std::string func) {
-    for (auto exception : _exceptions) {
-      if (auto part = exception.find(func); part != exception.end()) {
-        return part->second;
-      }
+    refresh();
+    const FaultRule* fault = _faults.empty() ? nullptr : _faults.check(func);
+    if (fault != nullptr && fault->throwing()) {
+      return fault->code();
     }
     setInternalException(PSUEDO_EXCEPTION_NO_EXCEPT);
     return -1;
   }
 
+  /**
+   * \brief Signature of a hook observing every mocked call, see `bindCallHook()`.
+   */
+  typedef void (*CallHook)(Emulator& emulator, const std::string& func);
+
+  /**
+   * \brief Installs a hook run on entry to every `mock()` call made on the calling thread.
+   *
+   * Used by tools that treat mocked calls as events, such as the interleaving
+   * explorer making each one a scheduling point.
+   *
+   * \param hook    CallHook - The hook, or nullptr to remove it.
+   * \return CallHook  The previously installed hook, so callers can restore it.
+   */
+  static CallHook bindCallHook(CallHook hook) {
+    CallHook previous = callHook();
+    callHook() = hook;
+    return previous;
+  }
+
+  /**
+   * \brief Returns the position of a method's unconditional profile in `_methods`.
+   *
+   * \param func     const std::string& - The name of the mock method.
+   * \return size_t  The first profile for the method without argument rules,
+   *                 or `_methods.size()` if there is none.
+   */
+  size_t findMethod(const std::string& func) const {
+    for (size_t i = 0; i < _methods.size(); ++i) {
+      if (_methods[i].methodName.size() == func.size() && std::string_view(_methods[i].methodName) == func && _methods[i].args.empty()) {
+        return i;
+      }
+    }
+    return _methods.size();
+  }
+
+  /**
+   * \brief The profiles of the mocked methods, in the order they were configured.
+   *
+   * Reads as empty when the emulator is stale, since its profiles belong to an
+   * earlier test until it is used again.
+   */
+  const MethodProfiles& methods() const {
+    static const MethodProfiles none;
+    return stale() ? none : _methods;
+  }
+
+protected:
+  /**
+   * \brief Resets the emulator if `resetAll()` has been called since it was last reset.
+   */
+  void refresh() {
+    if (_epoch != epoch()) {
+      reset();
+      _epoch = epoch();   // Also for subclasses whose reset() does not reach Emulator::reset().
+    }
+    if (_memory != EmulatorMemory::resource() && EmulatorMemory::bound()) {
+      adopt(EmulatorMemory::resource());
+    }
+  }
+
+  /**
+   * \brief Moves the emulator's containers onto another memory resource, keeping their contents.
+   *
+   * Runs when the emulator is used on a thread with a different resource
+   * bound. Subclasses with containers of their own override this, move them
+   * with `rebindContainer()` and call the base version.
+   *
+   * \param memory   std::pmr::memory_resource* - The resource to move onto.
+   */
+  virtual void adopt(std::pmr::memory_resource* memory) {
+    if (EmulatorArena* arena = dynamic_cast<EmulatorArena*>(_memory)) {
+      arena->detach(this);
+    }
+    _spare.clear();   // Only kept for reuse, not worth moving.
+    rebindContainer(_methods, memory);
+    rebindContainer(_spare, memory);
+    rebindContainer(_exceptionRules, memory);
+    _memory = memory;
+    if (EmulatorArena* arena = dynamic_cast<EmulatorArena*>(memory)) {
+      arena->attach(this, evict);
+    }
+  }
+
+private:
   /**
    * \brief A store of methods for the mock class.
    * Methods are stored as a vector of function pointers.
    * 
    */
-  vector<MethodProfile> _methods;
+  MethodProfiles _methods;
+
+#ifdef EMULATOR_HISTOGRAMS
+  /**
+   * \brief Times one `mock()` call into its method's histograms as it goes out of scope.
+   *
+   * The method is held by index, as a call may add methods and move the vector.
+   */
+  class CallTiming {
+  public:
+    explicit CallTiming(MethodProfiles& methods)
+      : _methods(methods), _started(std::chrono::steady_clock::now()), _virtualStart(VirtualClock::current().nowMicros()) {}
+
+    ~CallTiming() {
+      auto finished = std::chrono::steady_clock::now();
+      if (_index < _methods.size()) {
+        MethodProfile& method = _methods[_index];
+        method.latency.wall.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(finished - _started).count());
+        // An unbound process clock does not move while the host sleeps, so fall back to the configured delay.
+        uint64_t emulated = VirtualClock::current().nowMicros() - _virtualStart;
+        method.latency.emulated.record((emulated > 0) ? emulated : (uint64_t)method.delay * 1000);
+        if (lastReturn() != std::chrono::steady_clock::time_point()) {
+          method.latency.between.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(_started - lastReturn()).count());
+        }
+      }
+      lastReturn() = finished;
+    }
+
+    void track(size_t index) { _index = index; }
+
+  private:
+    static std::chrono::steady_clock::time_point& lastReturn() {
+      thread_local std::chrono::steady_clock::time_point returned;
+      return returned;
+    }
+
+    MethodProfiles& _methods;
+    std::chrono::steady_clock::time_point _started;
+    uint64_t _virtualStart;
+    size_t _index = (size_t)-1;
+  };
+#endif
+
+  /**
+   * \brief Empties an emulator whose arena is being released, leaving it on the heap.
+   */
+  static void evict(void* self) {
+    Emulator& emulator = *static_cast<Emulator*>(self);
+    emulator.reset();
+    emulator._memory = nullptr;   // Detached already by the arena.
+    emulator.adopt(&EmulatorMemory::heap());
+  }
+
+  static std::atomic<uint64_t>& epochCounter() {
+    static std::atomic<uint64_t> counter(0);
+    return counter;
+  }
+
+  static uint64_t epoch() { return epochCounter().load(std::memory_order_acquire); }
+
+  /**
+   * \brief Appends a profile for a method, recycled from an earlier test when one is spare,
+   * and makes it the target of `times()`, `then()` and the argument rules.
+   */
+  MethodProfile& addProfile(const std::string& func) {
+    refresh();
+    _lastFunc = func;
+    _lastIndex = _methods.size();
+    if (_spare.empty()) {
+      _methods.emplace_back();
+    } else {
+      _methods.push_back(std::move(_spare.back()));
+      _spare.pop_back();
+    }
+    recycleMethodProfile(_methods.back(), func);
+    return _methods.back();
+  }
+
+  static CallHook& callHook() {
+    thread_local CallHook hook = nullptr;
+    return hook;
+  }
+
+  /**
+   * \brief Runs a mocked call against the profile at `index`: hooks, expectations,
+   * the profile's delay, any configured exception, then its return value.
+   *
+   * \param func     const std::string& - The name of the mock method.
+   * \param index    size_t - The profile in `_methods`, or `_methods.size()` if the method has none.
+   * \param args     const MockArgs* - The call's arguments for the profile's action, or nullptr if not rendered.
+   */
+  template<typename T>
+  T dispatch(const std::string& func, size_t index, const MockArgs* args = nullptr) {
+    EMULATION_LOG((string("Entered mock method for ") + func).c_str());
+    if (callHook() != nullptr) {
+      callHook()(*this, func);
+    }
+    if (!_expected.empty()) {
+      _expected.check(typeid(*this).name(), func);
+    }
+    
+    EMULATION_TIME_CALL(timing);
+    TraceSpan span(this, typeid(*this).name(), "mock", func);
+
+    // Delay by the method's specific delay amount
+    if (index < _methods.size()) {
+      EMULATION_TIME_METHOD(timing, index);
+      EMULATION_LOG(("Delaying method " + func + " by " + std::to_string(_methods[index].delay) + " milliseconds").c_str());
+      SleepLedger::sleep((uint64_t)_methods[index].delay * 1000, typeid(*this).name(), func);
+    }
+
+    const FaultRule* fault = _faults.empty() ? nullptr : _faults.check(func);
+    if (fault != nullptr) {
+      if (TraceRecorder* recorder = TraceRecorder::active()) {
+        recorder->instant(this, typeid(*this).name(), "fault", func, "code", fault->throwing() ? fault->code() : 0);
+      }
+      if (!fault->throwing()) {
+        EMULATION_LOG(("Injected fault for method " + func + ": returning fault value").c_str());
+        T value = faultValue<T>(func, *fault);
+        if (index < _methods.size()) {
+          _methods[index].invoked += 1;
+        }
+        return value;
+      }
+      int exception = fault->code();
+      EMULATION_LOG(("Found expected exception for method " + func + ": Exception Code " + std::to_string(exception)).c_str());
+      EMULATION_LOG("Throwing expected exception");
+      if (index < _methods.size()) {
+        _methods[index].thrown += 1;
+      }
+      throw exception;
+    }
+    if (FuzzInput* fuzz = FuzzInput::active()) {
+      if (fuzz->drives(this)) {
+        return fuzzed<T>(*fuzz, func, index, args);
+      }
+    }
+    setInternalException(PSUEDO_EXCEPTION_NO_EXCEPT);
+    EMULATION_LOG("Calling doReturn method");
+    return returnAt<T>(index, args);
+  }
+
+  /**
+   * \brief Responds to a mocked call from the bound fuzz input: the configured value,
+   * a decoded one or an exception, as its selector byte chooses, see FuzzInput.
+   */
+  template<typename T>
+  T fuzzed(FuzzInput& fuzz, const std::string& func, size_t index, const MockArgs* args) {
+    FuzzInput::Response response = fuzz.select(func);
+    if (response == FuzzInput::Fault) {
+      int exception = fuzz.consumeIntegral<uint16_t>();
+      if (index < _methods.size()) {
+        _methods[index].thrown += 1;
+      }
+      throw exception;
+    }
+    setInternalException(PSUEDO_EXCEPTION_NO_EXCEPT);
+    T value;
+    if (response == FuzzInput::Decoded && fuzz.decode<T>(value)) {
+      if (index < _methods.size()) {
+        _methods[index].invoked += 1;
+      }
+      return value;
+    }
+    return returnAt<T>(index, args);
+  }
+
+  /**
+   * \brief Returns the next value of the profile at `index`, from its action if it has one,
+   * counting the invocation.
+   */
+  template<typename T>
+  T returnAt(size_t index, const MockArgs* args) {
+    T value{};
+    if (index < _methods.size()) {
+      MethodProfile& method = _methods[index];
+      value = method.action ? this->runAction<T>(method, args) : this->findRetVal<T>(method);
+      method.invoked += 1;
+    }
+    return value;
+  }
+
+  /**
+   * \brief Returns the value a fault rule fails a call with.
+   *
+   * \throws NoReturnValueException if the value cannot be cast to T.
+   */
+  template<typename T>
+  T faultValue(const std::string& func, const FaultRule& fault) {
+    T value;
+    try {
+      value = std::any_cast<T>(fault.value());
+    } catch (const std::bad_any_cast& e) {
+      std::string eMessage = "Fault value for " + func + " found, casting failed: " + e.what();
+      EMULATION_LOG(eMessage.c_str());
+      NoReturnValueException(eMessage.c_str());
+    }
+    return value;
+  }
+
+  /**
+   * \brief Runs a profile's action, falling back to its return sequence if the action returns nothing.
+   *
+   * \throws NoReturnValueException if the action's value cannot be cast to T.
+   */
+  template<typename T>
+  T runAction(MethodProfile& method, const MockArgs* args) {
+    std::any result = method.action((args != nullptr) ? *args : MockArgs());
+    if (!result.has_value()) {
+      if (method.cursor == 0 && !method.retVal.second.has_value() && !method.then.empty()) {
+        method.cursor = 1;    // does() has no returns() value, start at the first then().
+      }
+      return this->findRetVal<T>(method);
+    }
+    T value;
+    try {
+      value = std::any_cast<T>(result);
+    } catch (const std::bad_any_cast& e) {
+      std::string eMessage = "Action for " + std::string(method.methodName) + " returned a value, casting failed: " + e.what();
+      EMULATION_LOG(eMessage.c_str());
+      NoReturnValueException(eMessage.c_str());
+    }
+    return value;
+  }
+
+  /**
+   * \brief Marks the last configured profile as conditional on its arguments.
+   *
+   * \param description   const std::string& - The condition, as text for reports.
+   * \return MethodProfile*  The profile, or nullptr if nothing has been configured.
+   */
+  MethodProfile* conditionLast(const std::string& description) {
+    refresh();
+    if (_lastIndex >= _methods.size()) {
+      return nullptr;
+    }
+    MethodProfile& method = _methods[_lastIndex];
+    method.args += method.args.empty() ? description : " | " + description;
+    return &method;
+  }
 
-private:
   /**
    * \brief The amount of time the emulator will wait (in seconds) before executing a method.
    * 
@@ -470,12 +1105,45 @@ private:
   std::string _lastFunc = "";
 
   /**
-   * \brief Throwable exceptions for this mock instance. Stored as a std::map
-   * of function name (std::string) and exception (int).
-   * Currently only integer supported.
-   * 
+   * \brief Position in _methods of the profile last configured, which `times()`,
+   * `then()` and the argument rules apply to.
+   */
+  size_t _lastIndex = (size_t)-1;
+
+  /**
+   * \brief Profiles of earlier tests, kept with their capacity for `returns()` to reuse.
+   */
+  MethodProfiles _spare;
+
+  /**
+   * \brief The `resetAll()` generation this emulator was last reset in.
+   */
+  uint64_t _epoch = 0;
+
+  /**
+   * \brief The resource the profiles and exception rules are allocated from.
+   */
+  std::pmr::memory_resource* _memory;
+
+  /**
+   * \brief Argument rules per method name, see `withArgs()`.
+   */
+  std::unordered_map<std::string, ArgRules> _argRules;
+
+  /**
+   * \brief Position in _faults of the rule made by each `setException()` call.
+   */
+  std::pmr::vector<size_t> _exceptionRules;
+
+  /**
+   * \brief Fault rules, those of `setException()` included, checked on every mocked call.
+   */
+  FaultInjector _faults;
+
+  /**
+   * \brief Expectations declared with `expect()`, checked on every mocked call.
    */
-  vector<std::map<std::string, uint16_t>> _exceptions;
+  ExpectationSet _expected;
 };
 
 #endif
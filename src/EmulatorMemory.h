@@ -0,0 +1,278 @@
+#if not defined(EMULATOR_MEMORY_H)
+#define EMULATOR_MEMORY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <new>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#if not defined(EMULATOR_ARENA_BYTES)
+#define EMULATOR_ARENA_BYTES   (64 * 1024)
+#endif
+
+/**
+ * \class MemoryMeter
+ * \brief A memory resource passing allocations to another while counting them.
+ *
+ * Keeps the bytes in use, their peak and the number of allocations. The
+ * counters are atomic, so a meter can serve several threads if its upstream
+ * resource can.
+ */
+class MemoryMeter : public std::pmr::memory_resource {
+public:
+  explicit MemoryMeter(std::pmr::memory_resource* upstream = std::pmr::new_delete_resource()) : _upstream(upstream) {}
+  ~MemoryMeter() {}
+
+  /**
+   * \brief Returns the bytes allocated and not yet deallocated.
+   */
+  size_t inUse() const { return _inUse.load(std::memory_order_relaxed); }
+
+  /**
+   * \brief Returns the most bytes in use at once since construction or `resetPeak()`.
+   */
+  size_t peak() const { return _peak.load(std::memory_order_relaxed); }
+
+  /**
+   * \brief Returns the number of allocations since construction or `resetPeak()`.
+   */
+  uint64_t allocations() const { return _allocations.load(std::memory_order_relaxed); }
+
+  /**
+   * \brief Starts a new measurement: the peak drops to the bytes now in use.
+   */
+  void resetPeak() {
+    _peak.store(inUse(), std::memory_order_relaxed);
+    _allocations.store(0, std::memory_order_relaxed);
+  }
+
+  std::pmr::memory_resource* upstream() const { return _upstream; }
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    void* memory = _upstream->allocate(bytes, alignment);
+    size_t used = _inUse.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    size_t peak = _peak.load(std::memory_order_relaxed);
+    while (used > peak && !_peak.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {}
+    _allocations.fetch_add(1, std::memory_order_relaxed);
+    return memory;
+  }
+
+  void do_deallocate(void* memory, size_t bytes, size_t alignment) override {
+    _upstream->deallocate(memory, bytes, alignment);
+    _inUse.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+  std::pmr::memory_resource* _upstream;
+  std::atomic<size_t> _inUse{0};
+  std::atomic<size_t> _peak{0};
+  std::atomic<uint64_t> _allocations{0};
+};
+
+/**
+ * \class EmulatorMemory
+ * \brief Chooses where emulators keep their method profiles and captured calls.
+ *
+ * Emulator containers are `std::pmr` containers built on the resource bound
+ * to the calling thread, or on the metered process heap when none is. An
+ * emulator created before a resource is bound moves onto it the next time it
+ * is used on that thread, so global mocks follow a per-test arena or a fleet
+ * device's meter without being recreated.
+ */
+class EmulatorMemory {
+public:
+  /**
+   * \brief Returns the metered heap emulators use when no resource is bound.
+   */
+  static MemoryMeter& heap() {
+    static MemoryMeter meter;
+    return meter;
+  }
+
+  /**
+   * \brief Returns the resource bound to the calling thread, or `heap()`.
+   */
+  static std::pmr::memory_resource* resource() { return (slot() != nullptr) ? slot() : &heap(); }
+
+  /**
+   * \brief Returns true if a resource is bound to the calling thread.
+   */
+  static bool bound() { return slot() != nullptr; }
+
+  /**
+   * \brief Binds a resource to the calling thread for emulators to allocate from.
+   *
+   * \param resource    std::pmr::memory_resource* - The resource, or nullptr to return to `heap()`.
+   * \return std::pmr::memory_resource*  The resource bound before, nullptr if none was.
+   */
+  static std::pmr::memory_resource* bind(std::pmr::memory_resource* resource) {
+    std::pmr::memory_resource* previous = slot();
+    slot() = resource;
+    return previous;
+  }
+
+private:
+  static std::pmr::memory_resource*& slot() {
+    thread_local std::pmr::memory_resource* bound = nullptr;
+    return bound;
+  }
+};
+
+/**
+ * \brief Moves a `std::pmr` container onto another resource, keeping its elements.
+ *
+ * Elements are moved one by one if the resources differ; an empty container
+ * is moved without allocating.
+ */
+template<typename Container>
+void rebindContainer(Container& container, std::pmr::memory_resource* resource) {
+  Container moved(std::move(container), resource);
+  container.~Container();
+  new (&container) Container(std::move(moved));
+}
+
+/**
+ * \class EmulatorArena
+ * \brief A monotonic arena for the emulators of one test, released in one step.
+ *
+ * Constructing an arena binds it to the calling thread (see EmulatorMemory).
+ * Emulators used on that thread move onto it and allocate from it, which
+ * never frees: every profile, `then()` value, method name and captured call
+ * of a test is bump-allocated from a few large blocks. `release()` resets
+ * the emulators living in the arena, leaving them empty on the heap, and
+ * hands the blocks back upstream at once instead of freeing each allocation.
+ *
+ * \code{.cpp}
+ * EmulatorArena arena;
+ *
+ * void tearDown() {
+ *   arena.report(std::cout, Unity.CurrentTestName);   // peak emulator memory of the test
+ *   resetEmulators();
+ *   arena.release();
+ * }
+ * \endcode
+ *
+ * An arena is not thread-safe: use its emulators on the thread it is bound to.
+ */
+class EmulatorArena : public std::pmr::memory_resource {
+public:
+  /**
+   * \brief Constructs an arena and binds it to the calling thread.
+   *
+   * \param blockBytes  size_t - Size of the first block taken from upstream (default EMULATOR_ARENA_BYTES).
+   * \param upstream    std::pmr::memory_resource* - Where blocks come from.
+   */
+  explicit EmulatorArena(size_t blockBytes = EMULATOR_ARENA_BYTES, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+    : _meter(upstream), _blocks(blockBytes, &_meter) {
+    _previous = EmulatorMemory::bind(this);
+  }
+
+  ~EmulatorArena() {
+    release();
+    if (EmulatorMemory::resource() == this) {
+      EmulatorMemory::bind(_previous);
+    }
+  }
+
+  EmulatorArena(const EmulatorArena&) = delete;
+  EmulatorArena& operator=(const EmulatorArena&) = delete;
+
+  /**
+   * \brief Empties the emulators living in the arena and frees all of its memory at once.
+   *
+   * The arena stays bound, so the next test's emulators move back onto it.
+   */
+  void release() {
+    while (!_residents.empty()) {
+      Resident resident = _residents.back();
+      _residents.pop_back();
+      resident.evict(resident.owner);
+    }
+    _blocks.release();
+    _used = 0;
+    _allocations = 0;
+  }
+
+  /**
+   * \brief Returns the bytes emulators took from the arena since the last `release()`.
+   *
+   * The arena never frees, so this is also their peak for the test.
+   */
+  size_t used() const { return _used; }
+
+  /**
+   * \brief Returns the allocations made from the arena since the last `release()`.
+   */
+  uint64_t allocations() const { return _allocations; }
+
+  /**
+   * \brief Returns the bytes of blocks the arena holds from upstream.
+   */
+  size_t reserved() const { return _meter.inUse(); }
+
+  /**
+   * \brief Writes the emulator memory of the current test, e.g.
+   * `Emulator memory in test_upload: 11872 bytes peak in 64 allocations (65536 reserved)`.
+   *
+   * \param out     std::ostream& - The stream to write to.
+   * \param test    const char* - The test's name.
+   */
+  void report(std::ostream& out, const char* test) const {
+    out << "Emulator memory in " << test << ": " << _used << " bytes peak in " << _allocations
+        << " allocations (" << reserved() << " reserved)" << std::endl;
+  }
+
+  /**
+   * \brief Registers an object holding memory of the arena, to be emptied by `release()`.
+   *
+   * \param owner   void* - The object.
+   * \param evict   void (*)(void*) - Moves the object off the arena, dropping its contents.
+   */
+  void attach(void* owner, void (*evict)(void*)) { _residents.push_back(Resident{ owner, evict }); }
+
+  /**
+   * \brief Forgets an object registered with `attach()`, e.g. as it is destroyed.
+   */
+  void detach(void* owner) {
+    for (size_t i = 0; i < _residents.size(); ++i) {
+      if (_residents[i].owner == owner) {
+        _residents[i] = _residents.back();
+        _residents.pop_back();
+        return;
+      }
+    }
+  }
+
+protected:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    _used += bytes;
+    ++_allocations;
+    return _blocks.allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void*, size_t, size_t) override {}
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+private:
+  struct Resident {
+    void* owner;
+    void (*evict)(void*);
+  };
+
+  MemoryMeter _meter;                             // Counts the blocks taken from upstream.
+  std::pmr::monotonic_buffer_resource _blocks;    // Bump allocation within the blocks.
+  std::pmr::memory_resource* _previous = nullptr; // Bound before this arena.
+  std::vector<Resident> _residents;               // Emulators holding memory of the arena.
+  size_t _used = 0;
+  uint64_t _allocations = 0;
+};
+
+#endif // end of EMULATOR_MEMORY_H
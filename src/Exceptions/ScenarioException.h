@@ -0,0 +1,46 @@
+#if not defined(SCENARIO_EXCEPTION_H)
+#define SCENARIO_EXCEPTION_H
+
+#include "Exception.h"
+
+class ScenarioException : public Exception {
+public:
+  /** 
+   * @brief Constructor (C strings).
+   * 
+   * @param message C-style string error message
+   * @param file from __FILE__ macro
+   * @param line from __LINE__ macro
+   */
+  explicit ScenarioException(const char* message, const char *file, unsigned int line)
+    : Exception(string(file) + ":" + to_string(line) + ":" + message) {
+      this->msg_ = message;
+      this->file_ = file;
+      this->line_ = line;
+  }
+
+  /** 
+   * @brief Constructor (C strings).
+   * 
+   * @param message C-style string error message
+   * @param int exception code
+   * @param file from __FILE__ macro
+   * @param line from __LINE__ macro
+   */
+  explicit ScenarioException(const char* message, int code, const char *file, unsigned int line)
+    : Exception(string(file) + ":" + to_string(line) + ":" + message) {
+      this->msg_ = message;
+      this->code_ = code;
+      this->file_ = file;
+      this->line_ = line;
+  }
+
+  /** 
+   * @brief Destructor. Virtual to allow for subclassing.
+   */
+  virtual ~ScenarioException() noexcept {}
+};
+
+#define ScenarioException(arg) throw ScenarioException(arg, __FILE__, __LINE__);
+
+#endif
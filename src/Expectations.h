@@ -0,0 +1,291 @@
+#if not defined(EXPECTATIONS_H)
+#define EXPECTATIONS_H
+
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "TypeName.h"
+#include "VirtualClock.h"
+#include "Exceptions/ExpectationException.h"
+
+class ExpectationSet;
+
+/**
+ * \class Expectation
+ * \brief Declares how a mocked method is expected to be called, see `Emulator::expect()`.
+ *
+ * A new expectation requires at least one call. The bounds and ordering
+ * rules chain:
+ * \code{.cpp}
+ * http.expect("post").times(3).before("responseStatusCode");
+ * http.expect("stop").never();
+ * \endcode
+ */
+class Expectation {
+public:
+  /**
+   * \brief Expects exactly n calls.
+   */
+  Expectation& times(int n) { _min = n; _max = n; _minSet = true; return *this; }
+
+  /**
+   * \brief Expects at least n calls.
+   */
+  Expectation& atLeast(int n) { _min = n; _minSet = true; if (_max < n) { _max = n; } return *this; }
+
+  /**
+   * \brief Expects at most n calls, none included unless `atLeast()` set a minimum.
+   */
+  Expectation& atMost(int n) {
+    _max = n;
+    if (!_minSet) {
+      _min = 0;
+    } else if (_min > n) {
+      _min = n;
+    }
+    return *this;
+  }
+
+  /**
+   * \brief Expects no calls at all.
+   */
+  Expectation& never() { return times(0); }
+
+  /**
+   * \brief Expects this method's calls to happen before any call to another.
+   *
+   * When the other method is first called, this one must already have been
+   * called its minimum number of times; once it has been called, this one may
+   * not be called again.
+   *
+   * \param func    const std::string& - The method that must come later.
+   */
+  Expectation& before(const std::string& func);
+
+  /**
+   * \brief Expects this method's calls to happen after any call to another, see `before()`.
+   *
+   * \param func    const std::string& - The method that must come first.
+   */
+  Expectation& after(const std::string& func);
+
+private:
+  friend class ExpectationSet;
+
+  /**
+   * \brief Returns the rule as text, e.g. "exactly 3 times".
+   */
+  std::string describe() const {
+    if (_max == INT_MAX) {
+      return "at least " + std::to_string(_min) + ((_min == 1) ? " time" : " times");
+    }
+    if (_min == _max) {
+      return (_max == 0) ? "never" : "exactly " + std::to_string(_max) + ((_max == 1) ? " time" : " times");
+    }
+    if (_min == 0) {
+      return "at most " + std::to_string(_max) + ((_max == 1) ? " time" : " times");
+    }
+    return "between " + std::to_string(_min) + " and " + std::to_string(_max) + " times";
+  }
+
+  ExpectationSet* _set = nullptr;
+  std::string _func;
+  int _min = 0;                         // Fewest calls that satisfy the expectation.
+  int _max = INT_MAX;                   // Most calls allowed.
+  int _calls = 0;                       // Calls so far.
+  bool _minSet = false;                 // The minimum was set by times() or atLeast(), not implied by expect().
+  bool _declared = false;               // Declared with expect(), rather than only named by an ordering rule.
+  bool _closed = false;                 // A method this one must precede has been called.
+  std::string _closedBy;                // That method, for the failure message.
+  std::vector<size_t> _predecessors;    // Methods that must be satisfied before this one's first call.
+};
+
+/**
+ * \class ExpectationSet
+ * \brief The expectations of one emulator, checked as each mocked call happens.
+ *
+ * Each method named in an expectation is compiled to a small automaton: a
+ * call counter with its bounds, plus the methods it must precede or follow.
+ * `check()` runs on every `mock()` call and costs one hash lookup and a
+ * handful of comparisons, so a call that breaks an upper bound or an ordering
+ * rule throws ExpectationException immediately, naming the call, rather than
+ * the failure surfacing in a scan of the call history at the end of the test.
+ * Lower bounds can only be judged once the test is over, by `verify()`.
+ */
+class ExpectationSet {
+public:
+  ExpectationSet() {}
+  ExpectationSet(const ExpectationSet& other) : _expectations(other._expectations), _index(other._index), _live(other._live) { adopt(); }
+  ~ExpectationSet() {}
+
+  ExpectationSet& operator=(const ExpectationSet& other) {
+    _expectations = other._expectations;
+    _index = other._index;
+    _live = other._live;
+    adopt();
+    return *this;
+  }
+
+  /**
+   * \brief Declares an expectation for a method, replacing any earlier bounds for it.
+   *
+   * \param func    const std::string& - The mocked method.
+   * \return Expectation&  The expectation, requiring at least one call until refined.
+   */
+  Expectation& expect(const std::string& func) {
+    Expectation& expectation = _expectations[indexOf(func)];
+    expectation._declared = true;
+    expectation._min = 1;
+    expectation._max = INT_MAX;
+    expectation._minSet = false;
+    return expectation;
+  }
+
+  /**
+   * \brief Returns true if no expectations have been declared.
+   */
+  bool empty() const { return _live == 0; }
+
+  /**
+   * \brief Checks a call against the expectations, before it runs.
+   *
+   * \param emulator    const char* - The emulator's type, as from `typeid().name()`, for the failure message.
+   * \param func        const std::string& - The method being called.
+   * \throw ExpectationException if the call breaks an expectation.
+   */
+  void check(const char* emulator, const std::string& func) {
+    auto found = _index.find(func);
+    if (found == _index.end() || !live(found->first, found->second)) {
+      return;
+    }
+    Expectation& expectation = _expectations[found->second];
+    int call = ++expectation._calls;
+    if (call > expectation._max) {
+      fail(emulator, func, call, "expected " + expectation.describe());
+    }
+    if (expectation._closed) {
+      fail(emulator, func, call, "expected before any call to " + expectation._closedBy);
+    }
+    if (call > 1) {
+      return;
+    }
+    for (size_t predecessor : expectation._predecessors) {
+      Expectation& earlier = _expectations[predecessor];
+      if (earlier._calls < earlier._min || earlier._calls == 0) {
+        fail(emulator, func, call, "expected after " + earlier._func + ", which had been called "
+             + std::to_string(earlier._calls) + " of " + std::to_string((earlier._min > 0) ? earlier._min : 1) + " times");
+      }
+    }
+    for (size_t predecessor : expectation._predecessors) {
+      _expectations[predecessor]._closed = true;
+      _expectations[predecessor]._closedBy = func;
+    }
+  }
+
+  /**
+   * \brief Checks that every expectation's minimum number of calls was met.
+   *
+   * \param emulator    const char* - The emulator's type, as from `typeid().name()`, for the failure message.
+   * \throw ExpectationException naming the first unmet expectation.
+   */
+  void verify(const char* emulator) const {
+    for (size_t i = 0; i < _live; ++i) {
+      const Expectation& expectation = _expectations[i];
+      if (expectation._declared && expectation._calls < expectation._min) {
+        std::string message = demangledTypeName(emulator) + "::" + expectation._func + "() called " + std::to_string(expectation._calls)
+                            + ((expectation._calls == 1) ? " time" : " times") + ", expected " + expectation.describe();
+        ExpectationException(message.c_str());
+      }
+    }
+  }
+
+  /**
+   * \brief Removes every expectation.
+   *
+   * The automata and the index are kept for later expectations to reuse, so
+   * declaring the same expectations after a reset does not allocate.
+   */
+  void clear() { _live = 0; }
+
+private:
+  friend class Expectation;
+
+  size_t indexOf(const std::string& func) {
+    auto found = _index.find(func);
+    if (found != _index.end() && live(found->first, found->second)) {
+      return found->second;
+    }
+    size_t index = _live++;
+    if (index == _expectations.size()) {
+      _expectations.emplace_back();
+    }
+    Expectation& expectation = _expectations[index];
+    expectation._set = this;
+    expectation._func = func;
+    expectation._min = 0;
+    expectation._max = INT_MAX;
+    expectation._calls = 0;
+    expectation._minSet = false;
+    expectation._declared = false;
+    expectation._closed = false;
+    expectation._closedBy.clear();
+    expectation._predecessors.clear();
+    if (found != _index.end()) {
+      found->second = index;
+    } else {
+      _index.emplace(func, index);
+    }
+    return index;
+  }
+
+  /**
+   * \brief Returns true if an index entry refers to an automaton in use since the last
+   * `clear()`, rather than one left from before it or since reused for another method.
+   */
+  bool live(const std::string& func, size_t index) const {
+    return index < _live && _expectations[index]._func == func;
+  }
+
+  /**
+   * \brief Points copied expectations back at this set, so their ordering rules extend it.
+   */
+  void adopt() {
+    for (auto& expectation : _expectations) {
+      expectation._set = this;
+    }
+  }
+
+  /**
+   * \brief Records that the method at `earlier` must be called before the one at `later`.
+   */
+  void order(size_t earlier, size_t later) {
+    _expectations[later]._predecessors.push_back(earlier);
+  }
+
+  [[noreturn]] static void fail(const char* emulator, const std::string& func, int call, const std::string& rule) {
+    std::string message = demangledTypeName(emulator) + "::" + func + "() call #" + std::to_string(call) + " at "
+                        + std::to_string(VirtualClock::current().nowMillis()) + " ms: " + rule;
+    ExpectationException(message.c_str());
+  }
+
+  std::deque<Expectation> _expectations;          // One automaton per method, stable references.
+  std::unordered_map<std::string, size_t> _index; // Position of each method's automaton.
+  size_t _live = 0;                               // Automata in use, the rest kept for reuse.
+};
+
+inline Expectation& Expectation::before(const std::string& func) {
+  size_t self = _set->indexOf(_func);
+  _set->order(self, _set->indexOf(func));
+  return *this;
+}
+
+inline Expectation& Expectation::after(const std::string& func) {
+  size_t self = _set->indexOf(_func);
+  _set->order(_set->indexOf(func), self);
+  return *this;
+}
+
+#endif // end of EXPECTATIONS_H
@@ -0,0 +1,396 @@
+#if not defined(FAULT_INJECTOR_H)
+#define FAULT_INJECTOR_H
+
+#include <any>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "SeededRandom.h"
+#include "VirtualClock.h"
+
+#if not defined(FAULT_DEFAULT_EXCEPTION)
+#define FAULT_DEFAULT_EXCEPTION     (30000)
+#endif
+
+class FaultInjector;
+
+/**
+ * \class FaultRule
+ * \brief When and how a mocked method fails, see `Emulator::injectFault()`.
+ *
+ * A new rule fails every call by throwing FAULT_DEFAULT_EXCEPTION. Each
+ * condition narrows it and all of them must hold for a call to fail:
+ * \code{.cpp}
+ * client.injectFault("connect").probability(0.05).returns(0);        // 5% of connects fail
+ * client.injectFault("write").afterBytes(3 * 1024 * 1024).throws(-1); // after 3 MB written
+ * modem.injectFault("gprsConnect").bursts(0.02, 0.25).returns(false); // outages of ~4 calls
+ * \endcode
+ */
+class FaultRule {
+public:
+  /**
+   * \brief Fails calls with the given probability.
+   */
+  FaultRule& probability(double p) { _probability = p; return *this; }
+
+  /**
+   * \brief Fails only the nth call to the method, counting from 1.
+   */
+  FaultRule& onCall(uint64_t n) { _nth = n; return *this; }
+
+  /**
+   * \brief Fails every nth call to the method.
+   */
+  FaultRule& every(uint64_t n) { _every = n; return *this; }
+
+  /**
+   * \brief Fails only calls after the first n.
+   */
+  FaultRule& afterCalls(uint64_t n) { _afterCalls = n; return *this; }
+
+  /**
+   * \brief Fails only once the method has transferred at least n bytes, see `Emulator::countBytes()`.
+   */
+  FaultRule& afterBytes(uint64_t n) { _afterBytes = n; return *this; }
+
+  /**
+   * \brief Fails only calls made within a window of virtual time.
+   *
+   * \param fromMs    uint64_t - Start of the window, in virtual milliseconds.
+   * \param toMs      uint64_t - End of the window, exclusive.
+   */
+  FaultRule& between(uint64_t fromMs, uint64_t toMs) { _fromMs = fromMs; _toMs = toMs; return *this; }
+
+  /**
+   * \brief Fails calls in bursts, using a two state (Gilbert-Elliott) model.
+   *
+   * Before each call a healthy method starts a burst with probability `enter`,
+   * and a method in a burst recovers with probability `exit`, so bursts last
+   * 1 / exit calls on average. Only calls in a burst fail.
+   *
+   * \param enter   double - Probability per call of a burst starting.
+   * \param exit    double - Probability per call of a burst ending.
+   */
+  FaultRule& bursts(double enter, double exit) { _bursty = true; _burstEnter = enter; _burstExit = exit; return *this; }
+
+  /**
+   * \brief Fails at most n calls in total.
+   */
+  FaultRule& limit(uint64_t n) { _limit = n; return *this; }
+
+  /**
+   * \brief Fails calls by throwing an exception code, as `Emulator::setException()` does.
+   */
+  FaultRule& throws(int code) { _throws = true; _code = code; return *this; }
+
+  /**
+   * \brief Fails calls by returning a value, such as 0 from `connect()`, instead of the configured one.
+   *
+   * \param value   std::any - The value, of the type the mock returns.
+   */
+  FaultRule& returns(std::any value) { _throws = false; _value = value; return *this; }
+
+  /**
+   * \brief Returns the mocked method the rule applies to.
+   */
+  const std::string& method() const { return _func; }
+
+  /**
+   * \brief Returns true if a failing call throws, false if it returns `value()`.
+   */
+  bool throwing() const { return _throws; }
+
+  /**
+   * \brief Returns the exception code failing calls throw.
+   */
+  int code() const { return _code; }
+
+  /**
+   * \brief Returns the value failing calls return.
+   */
+  const std::any& value() const { return _value; }
+
+  /**
+   * \brief Returns the number of calls the rule has failed.
+   */
+  uint64_t fired() const { return _fired; }
+
+  /**
+   * \brief Returns true if the rule fails every call, as one made by `Emulator::setException()`.
+   */
+  bool unconditional() const {
+    return _probability >= 1.0 && _nth == 0 && _every == 0 && _afterCalls == 0 && _afterBytes == 0
+        && _fromMs == 0 && _toMs == UINT64_MAX && !_bursty && _limit == UINT64_MAX;
+  }
+
+  /**
+   * \brief Returns the rule as text, e.g. "p=0.05 after 3145728 bytes throws -1".
+   */
+  std::string describe() const {
+    if (unconditional() && _throws) {
+      return std::to_string(_code);
+    }
+    std::string text;
+    if (_probability < 1.0) text += "p=" + std::to_string(_probability) + " ";
+    if (_nth > 0) text += "call " + std::to_string(_nth) + " ";
+    if (_every > 0) text += "every " + std::to_string(_every) + " ";
+    if (_afterCalls > 0) text += "after " + std::to_string(_afterCalls) + " calls ";
+    if (_afterBytes > 0) text += "after " + std::to_string(_afterBytes) + " bytes ";
+    if (_fromMs > 0 || _toMs < UINT64_MAX) text += "in [" + std::to_string(_fromMs) + ", " + std::to_string(_toMs) + ") ms ";
+    if (_bursty) text += "bursts " + std::to_string(_burstEnter) + "/" + std::to_string(_burstExit) + " ";
+    if (_limit < UINT64_MAX) text += "at most " + std::to_string(_limit) + " ";
+    return text + (_throws ? "throws " + std::to_string(_code) : std::string("returns a value"));
+  }
+
+private:
+  friend class FaultInjector;
+
+  /**
+   * \brief Returns the rule to its initial state for a method, keeping its string's capacity.
+   */
+  void recycle(const std::string& func) {
+    _func = func;
+    _probability = 1.0;
+    _nth = 0;
+    _every = 0;
+    _afterCalls = 0;
+    _afterBytes = 0;
+    _fromMs = 0;
+    _toMs = UINT64_MAX;
+    _bursty = false;
+    _inBurst = false;
+    _burstEnter = 0.0;
+    _burstExit = 1.0;
+    _limit = UINT64_MAX;
+    _fired = 0;
+    _throws = true;
+    _code = FAULT_DEFAULT_EXCEPTION;
+    _value.reset();
+  }
+
+  /**
+   * \brief Decides whether the call numbered `call` fails, advancing the burst state.
+   */
+  bool fires(uint64_t call, uint64_t bytes, uint64_t nowMs) {
+    if (_bursty) {
+      _inBurst = _inBurst ? !_rng.chance(_burstExit) : _rng.chance(_burstEnter);
+      if (!_inBurst) {
+        return false;
+      }
+    }
+    if (_fired >= _limit || (_nth > 0 && call != _nth) || (_every > 0 && call % _every != 0)
+        || call <= _afterCalls || bytes < _afterBytes || nowMs < _fromMs || nowMs >= _toMs) {
+      return false;
+    }
+    if (_probability < 1.0 && !_rng.chance(_probability)) {
+      return false;
+    }
+    ++_fired;
+    return true;
+  }
+
+  std::string _func;
+  double _probability = 1.0;
+  uint64_t _nth = 0;                  // Only this call fails, 0 for any.
+  uint64_t _every = 0;                // Only multiples of this call fail, 0 for any.
+  uint64_t _afterCalls = 0;           // Calls up to this one never fail.
+  uint64_t _afterBytes = 0;           // Bytes the method must have transferred first.
+  uint64_t _fromMs = 0;               // Virtual time window.
+  uint64_t _toMs = UINT64_MAX;
+  bool _bursty = false;
+  bool _inBurst = false;
+  double _burstEnter = 0.0;
+  double _burstExit = 1.0;
+  uint64_t _limit = UINT64_MAX;       // Most calls the rule may fail.
+  uint64_t _fired = 0;                // Calls failed so far.
+  bool _throws = true;
+  int _code = FAULT_DEFAULT_EXCEPTION;
+  std::any _value;
+  SeededRandom _rng;
+};
+
+/**
+ * \class FaultInjector
+ * \brief The fault rules of one emulator, evaluated on every mocked call.
+ *
+ * Rules are indexed by method name, so a call to a method without rules costs
+ * one hash lookup, and a method's rules are tried in the order they were
+ * declared until one fires. Every random decision is drawn from the rule's own
+ * SeededRandom, seeded from the run seed, the method name and the rule's
+ * position, so the same calls fail in the same places on every run with the
+ * same seed, however the tests are ordered.
+ *
+ * The run seed is taken from the EMULATION_FAULT_SEED environment variable
+ * when set, and otherwise chosen at random. If any random fault fired, it is written
+ * to stderr when the process exits so a failing run can be replayed exactly;
+ * defining FAULT_INJECTION_QUIET suppresses the message.
+ */
+class FaultInjector {
+public:
+  FaultInjector() {}
+  ~FaultInjector() {}
+
+  /**
+   * \brief Adds a rule for a method, seeded for reproducibility.
+   *
+   * \param func    const std::string& - The mocked method.
+   * \return FaultRule&  The rule, failing every call until refined.
+   */
+  FaultRule& add(const std::string& func) {
+    Method& method = _methods[func];
+    method.rules.push_back(_count);
+    if (_count == _rules.size()) {
+      _rules.emplace_back();
+    }
+    FaultRule& rule = _rules[_count++];
+    rule.recycle(func);
+    rule._rng.reseed(runSeed() ^ hash(func) ^ (method.rules.size() * 0x9E3779B97F4A7C15ULL));
+    return rule;
+  }
+
+  /**
+   * \brief Returns true if there are no rules.
+   */
+  bool empty() const { return _count == 0; }
+
+  /**
+   * \brief Counts a call to a method and returns the first of its rules that fails it.
+   *
+   * \param func    const std::string& - The method being called.
+   * \return const FaultRule*  The rule, or nullptr if the call goes ahead.
+   */
+  const FaultRule* check(const std::string& func) {
+    auto found = _methods.find(func);
+    if (found == _methods.end()) {
+      return nullptr;
+    }
+    Method& method = found->second;
+    uint64_t call = ++method.calls;
+    uint64_t nowMs = VirtualClock::current().nowMillis();
+    for (size_t index : method.rules) {
+      FaultRule& rule = _rules[index];
+      if (rule.fires(call, method.bytes, nowMs)) {
+        if (rule._probability < 1.0 || rule._bursty) {
+          randomFaults().fetch_add(1, std::memory_order_relaxed);
+        }
+        return &rule;
+      }
+    }
+    return nullptr;
+  }
+
+  /**
+   * \brief Adds to the bytes a method has transferred, for `FaultRule::afterBytes()`.
+   */
+  void countBytes(const std::string& func, uint64_t bytes) {
+    auto found = _methods.find(func);
+    if (found != _methods.end()) {
+      found->second.bytes += bytes;
+    }
+  }
+
+  /**
+   * \brief Returns the rule at a position, in the order rules were added.
+   */
+  const FaultRule& rule(size_t index) const { return _rules[index]; }
+
+  /**
+   * \brief Returns the number of rules.
+   */
+  size_t size() const { return _count; }
+
+  /**
+   * \brief Removes every rule and forgets call and byte counts.
+   *
+   * The rules and per-method entries are kept for `add()` to reuse, so
+   * reconfiguring the same faults after a reset does not allocate.
+   */
+  void clear() {
+    _count = 0;
+    for (auto& method : _methods) {
+      method.second.calls = 0;
+      method.second.bytes = 0;
+      method.second.rules.clear();
+    }
+  }
+
+  /**
+   * \brief Returns the seed every rule's random stream is derived from.
+   */
+  static uint64_t runSeed() {
+    return seedSlot().load(std::memory_order_relaxed);
+  }
+
+  /**
+   * \brief Replaces the run seed for rules added from now on.
+   *
+   * \param seed    uint64_t - The seed, e.g. one reported by a failing run.
+   */
+  static void setRunSeed(uint64_t seed) {
+    seedSlot().store(seed, std::memory_order_relaxed);
+  }
+
+private:
+  struct Method {
+    uint64_t calls = 0;             // Calls so far.
+    uint64_t bytes = 0;             // Bytes transferred so far.
+    std::vector<size_t> rules;      // Positions in _rules, in declaration order.
+  };
+
+  /**
+   * \brief The run seed and the random faults fired with it, reported at exit
+   * if any fired. Both counters are members, so they outlive the report.
+   */
+  struct RunState {
+    std::atomic<uint64_t> seed{ initialSeed() };
+    std::atomic<uint64_t> randomFaults{ 0 };
+
+    ~RunState() {
+#if not defined(FAULT_INJECTION_QUIET)
+      uint64_t fired = randomFaults.load();
+      if (fired > 0) {
+        fprintf(stderr, "Fault injection: %llu random faults with seed 0x%llx, replay with EMULATION_FAULT_SEED=0x%llx\n",
+                (unsigned long long)fired, (unsigned long long)seed.load(), (unsigned long long)seed.load());
+      }
+#endif
+    }
+  };
+
+  static RunState& runState() {
+    static RunState state;
+    return state;
+  }
+
+  static std::atomic<uint64_t>& seedSlot() { return runState().seed; }
+
+  static std::atomic<uint64_t>& randomFaults() { return runState().randomFaults; }
+
+  static uint64_t initialSeed() {
+    const char* env = getenv("EMULATION_FAULT_SEED");
+    if (env != nullptr && *env != '\0') {
+      return strtoull(env, nullptr, 0);
+    }
+    std::random_device device;
+    return ((uint64_t)device() << 32) ^ device();
+  }
+
+  static uint64_t hash(const std::string& text) {
+    uint64_t value = 14695981039346656037ULL;
+    for (char c : text) {
+      value = (value ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    return value;
+  }
+
+  std::deque<FaultRule> _rules;                       // Every rule, stable references, the first _count in use.
+  size_t _count = 0;                                  // Rules added since the last clear().
+  std::unordered_map<std::string, Method> _methods;   // Counts and rules per method.
+};
+
+#endif // end of FAULT_INJECTOR_H
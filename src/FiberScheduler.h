@@ -0,0 +1,587 @@
+#if not defined(FIBER_SCHEDULER_H)
+#define FIBER_SCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <ucontext.h>
+#include "Fleet.h"
+#include "LogFunctionEmulators.h"
+#include "SeededRandom.h"
+#include "TimeFunctionEmulators.h"
+#include "VirtualClock.h"
+
+#if not defined(FIBER_STACK_SIZE)
+#define FIBER_STACK_SIZE    (64 * 1024)
+#endif
+
+/**
+ * \file FiberScheduler.h
+ * \brief Multiplexes many emulated firmware loops on one host thread.
+ */
+
+/**
+ * \brief Counters accumulated by a FiberScheduler.
+ *
+ * \param fibers      size_t - Fibers spawned.
+ * \param finished    size_t - Fibers whose body returned.
+ * \param failed      size_t - Fibers whose body threw.
+ * \param switches    uint64_t - Times a fiber was resumed.
+ */
+struct FiberStats {
+  size_t fibers = 0;
+  size_t finished = 0;
+  size_t failed = 0;
+  uint64_t switches = 0;
+};
+
+/**
+ * \class FiberScheduler
+ * \brief A cooperative scheduler running emulated devices as fibers on virtual time.
+ *
+ * Each fiber has its own stack and runs until it waits. Every emulated wait -
+ * `delay()`, mock method delays, `TinyGsm::waitForNetwork()`, AT command
+ * polling, link and route latency, a blocked EmulatedUart write - goes through
+ * `VirtualClock::sleep()` / `VirtualClock::wait()`, which the scheduler hooks
+ * while it runs: the fiber is suspended until the shared clock reaches the end
+ * of its wait. When no fiber is ready the clock jumps to the earliest wake-up,
+ * so thousands of devices share one host thread and one timeline.
+ *
+ * Ready fibers run highest priority first. Among equal priorities they run in
+ * the order they became ready, or in an order drawn from `setSeed()` so that
+ * different interleavings can be explored and any one replayed from its seed.
+ * `park()` / `unpark()` let synchronisation primitives block and wake fibers.
+ *
+ * Fibers switch with ucontext, as the library targets C++17 and so cannot use
+ * C++20 coroutines. Fibers still suspended when the scheduler is destroyed are
+ * discarded without unwinding their stacks.
+ *
+ * Example:
+ * \code{.cpp}
+ * FiberScheduler scheduler;
+ * std::vector<Tracker> devices(2000);
+ * for (auto& device : devices) {
+ *   scheduler.spawn(device);
+ * }
+ * scheduler.run(3600UL * 1000);  // an hour of virtual time
+ * \endcode
+ */
+class FiberScheduler {
+public:
+  /**
+   * \brief Constructs a scheduler.
+   *
+   * \param stackSize   size_t - Stack bytes given to every fiber.
+   */
+  explicit FiberScheduler(size_t stackSize = FIBER_STACK_SIZE) : _stackSize(stackSize) {}
+  FiberScheduler(const FiberScheduler&) = delete;
+  FiberScheduler& operator=(const FiberScheduler&) = delete;
+  ~FiberScheduler() {}
+
+  /**
+   * \brief Adds a fiber running a function.
+   *
+   * \param body        std::function<void()> - What the fiber runs.
+   * \param millis      MillisFunctionEmulator* - Emulator behind `millis()` in this fiber, or nullptr.
+   * \param delay       DelayFunctionEmulator* - Emulator behind `delay()` in this fiber, or nullptr.
+   * \param log         LogFunctionEmulators* - Emulators behind `log_*()` in this fiber, or nullptr.
+   * \return uint32_t   The fiber's id.
+   */
+  uint32_t spawn(std::function<void()> body, MillisFunctionEmulator* millis = nullptr, DelayFunctionEmulator* delay = nullptr,
+                 LogFunctionEmulators* log = nullptr) {
+    std::unique_ptr<Fiber> fiber(new Fiber());
+    fiber->body = std::move(body);
+    fiber->millis = millis;
+    fiber->delay = delay;
+    fiber->log = log;
+    fiber->stack.reset(new char[_stackSize]);
+    getcontext(&fiber->context);
+    fiber->context.uc_stack.ss_sp = fiber->stack.get();
+    fiber->context.uc_stack.ss_size = _stackSize;
+    fiber->context.uc_link = &_main;
+    makecontext(&fiber->context, &FiberScheduler::entry, 0);
+
+    uint32_t id = (uint32_t)_fibers.size();
+    _fibers.push_back(std::move(fiber));
+    makeReady(id);
+    ++_stats.fibers;
+    return id;
+  }
+
+  /**
+   * \brief Adds a fiber running a device's `setup()` once and then `loop()` forever.
+   *
+   * The device's own millis, delay and log emulators are bound while it runs. Its
+   * clock is not used: all fibers share the scheduler's clock. A `loop()` that
+   * does not wait is charged `setLoopTick()` so it cannot starve the others.
+   *
+   * \param device      FleetDevice& - The device, which must outlive the scheduler's use of it.
+   * \return uint32_t   The fiber's id.
+   */
+  uint32_t spawn(FleetDevice& device) {
+    return spawn([this, &device]() {
+      try {
+        device.setup();
+        while (true) {
+          uint64_t before = _clock.nowMicros();
+          device.loop();
+          ++device._loops;
+          if (_clock.nowMicros() == before) {
+            sleepFor(_tickMicros);
+          }
+        }
+      } catch (...) {
+        device._failed = true;
+        throw;
+      }
+    }, &device._millis, &device._delay, &device._log);
+  }
+
+  /**
+   * \brief Runs fibers until all have finished or the clock reaches a point in virtual time.
+   *
+   * May be called repeatedly to continue a run.
+   *
+   * \param untilMillis   uint64_t - Virtual time at which to stop, in milliseconds.
+   * \return bool         true if every fiber has finished.
+   */
+  bool run(uint64_t untilMillis = UINT64_MAX / 1000) {
+    uint64_t until = untilMillis * 1000;
+    FiberScheduler* previousActive = active();
+    active() = this;
+    VirtualClock* previousClock = VirtualClock::bind(&_clock);
+    VirtualClock::SleepHook previousHook = VirtualClock::bindSleep(&FiberScheduler::hook);
+    _outerMillis = MillisFunctionEmulator::bound();
+    _outerDelay = DelayFunctionEmulator::bound();
+    _outerLog = LogFunctionEmulators::bound();
+
+    while (true) {
+      if (_stopping) {
+        break;
+      }
+      if (_readyCount > 0) {
+        resume(takeReady());
+        continue;
+      }
+      if (_timers.empty() || _timers.top().wake > until) {
+        break;
+      }
+      _clock.advanceTo(_timers.top().wake);
+      while (!_timers.empty() && _timers.top().wake <= _clock.nowMicros()) {
+        Timer timer = _timers.top();
+        _timers.pop();
+        Fiber& fiber = *_fibers[timer.fiber];
+        if (!fiber.finished && fiber.generation == timer.generation) {
+          fiber.parked = false;
+          fiber.woken = false;
+          makeReady(timer.fiber);
+        }
+      }
+    }
+    bool done = _stats.finished + _stats.failed == _stats.fibers;
+    if (!done && !_stopping) {
+      _clock.advanceTo(until);
+    }
+
+    _stopping = false;
+    VirtualClock::bindSleep(previousHook);
+    VirtualClock::bind(previousClock);
+    active() = previousActive;
+    return done;
+  }
+
+  /**
+   * \brief Suspends the running fiber until the clock has advanced.
+   *
+   * \param us    uint64_t - Microseconds to wait. 0 yields to other ready fibers.
+   */
+  void sleepFor(uint64_t us) {
+    if (_running == kNone) {
+      _clock.advance(us);
+      return;
+    }
+    if (us == 0) {
+      yield();
+      return;
+    }
+    Fiber& fiber = *_fibers[_running];
+    _timers.push({ _clock.nowMicros() + us, _sequence++, _running, ++fiber.generation });
+    suspend();
+  }
+
+  /**
+   * \brief Lets other ready fibers run before the running fiber continues.
+   */
+  void yield() {
+    if (_running == kNone) {
+      return;
+    }
+    makeReady(_running);
+    suspend();
+  }
+
+  /**
+   * \brief Suspends the running fiber until another fiber unparks it or a timeout expires.
+   *
+   * \param timeoutUs   uint64_t - Longest wait in microseconds, UINT64_MAX to wait forever.
+   * \return bool       true if woken by `unpark()`, false on timeout.
+   */
+  bool park(uint64_t timeoutUs = UINT64_MAX) {
+    if (_running == kNone) {
+      return false;
+    }
+    Fiber& fiber = *_fibers[_running];
+    fiber.parked = true;
+    fiber.woken = false;
+    ++fiber.generation;
+    if (timeoutUs != UINT64_MAX) {
+      _timers.push({ _clock.nowMicros() + timeoutUs, _sequence++, _running, fiber.generation });
+    }
+    suspend();
+    return fiber.woken;
+  }
+
+  /**
+   * \brief Makes a parked fiber ready again. Fibers that are not parked are unaffected.
+   *
+   * \param id    uint32_t - The fiber to wake.
+   */
+  void unpark(uint32_t id) {
+    Fiber& fiber = *_fibers[id];
+    if (!fiber.parked || fiber.finished) {
+      return;
+    }
+    fiber.parked = false;
+    fiber.woken = true;
+    ++fiber.generation;
+    makeReady(id);
+  }
+
+  /**
+   * \brief Stops a fiber that is not running; it is never resumed again.
+   *
+   * \param id    uint32_t - The fiber to stop.
+   */
+  void kill(uint32_t id) {
+    Fiber& fiber = *_fibers[id];
+    if (fiber.finished || id == _running) {
+      return;
+    }
+    fiber.finished = true;
+    fiber.stack.reset();
+    fiber.body = nullptr;
+    ++_stats.finished;
+  }
+
+  /**
+   * \brief Returns the id of the running fiber, or UINT32_MAX outside a fiber.
+   */
+  uint32_t running() const { return _running; }
+
+  /**
+   * \brief Returns true once a fiber has finished or been killed.
+   */
+  bool finished(uint32_t id) const { return _fibers[id]->finished; }
+
+  /**
+   * \brief Sets a fiber's priority. Higher values run first.
+   *
+   * \param id          uint32_t - The fiber.
+   * \param priority    unsigned - The new priority, 0 by default.
+   */
+  void setPriority(uint32_t id, unsigned priority) {
+    Fiber& fiber = *_fibers[id];
+    if (fiber.priority == priority) {
+      return;
+    }
+    // Move a queued fiber to its new level.
+    std::deque<uint32_t>& level = _ready[fiber.priority];
+    for (auto it = level.begin(); it != level.end(); ++it) {
+      if (*it == id) {
+        level.erase(it);
+        --_readyCount;
+        fiber.priority = priority;
+        makeReady(id);
+        return;
+      }
+    }
+    fiber.priority = priority;
+  }
+
+  /**
+   * \brief Returns a fiber's priority.
+   */
+  unsigned priority(uint32_t id) const { return _fibers[id]->priority; }
+
+  /**
+   * \brief Chooses how fibers of equal priority are ordered.
+   *
+   * \param seed    uint64_t - 0 for first-come first-served, otherwise the seed of
+   *                a random but reproducible order.
+   */
+  void setSeed(uint64_t seed) {
+    _seeded = seed != 0;
+    _random.reseed(seed);
+  }
+
+  /**
+   * \brief Decides which of several ready fibers runs next.
+   *
+   * Receives every ready fiber, whatever its priority, in ascending id order
+   * and returns the index of the one to run.
+   */
+  typedef std::function<size_t(const std::vector<uint32_t>& ready)> Chooser;
+
+  /**
+   * \brief Hands every scheduling decision with more than one candidate to a chooser.
+   *
+   * Replaces priority and seed based ordering, letting an explorer drive the
+   * schedule.
+   *
+   * \param chooser   Chooser - The chooser, or nullptr to restore normal scheduling.
+   */
+  void setChooser(Chooser chooser) { _chooser = std::move(chooser); }
+
+  /**
+   * \brief Makes `run()` return once the running fiber next suspends.
+   */
+  void stop() { _stopping = true; }
+
+  /**
+   * \brief Returns how many times a fiber has been resumed.
+   */
+  uint64_t resumes(uint32_t id) const { return _fibers[id]->resumes; }
+
+  /**
+   * \brief Suspends the running fiber until a condition holds or a timeout expires.
+   *
+   * The condition is re-checked every `setPollInterval()` of virtual time.
+   *
+   * \param ready       Pred - Callable returning true once the fiber may continue.
+   * \param timeoutMs   unsigned long - Longest wait in milliseconds.
+   * \return bool       true if the condition held, false on timeout.
+   */
+  template<typename Pred>
+  bool await(Pred ready, unsigned long timeoutMs) {
+    uint64_t deadline = _clock.nowMicros() + (uint64_t)timeoutMs * 1000;
+    while (!ready()) {
+      uint64_t now = _clock.nowMicros();
+      if (now >= deadline) {
+        return false;
+      }
+      sleepFor((deadline - now < _pollMicros) ? deadline - now : _pollMicros);
+    }
+    return true;
+  }
+
+  /**
+   * \brief Sets how often `await()` re-checks its condition.
+   *
+   * \param ms    unsigned long - Poll interval in milliseconds (default 1).
+   */
+  void setPollInterval(unsigned long ms) { _pollMicros = (ms == 0) ? 1 : (uint64_t)ms * 1000; }
+
+  /**
+   * \brief Sets the virtual time charged to a device `loop()` that does not wait.
+   *
+   * \param ms    unsigned long - Milliseconds per idle loop (default 1).
+   */
+  void setLoopTick(unsigned long ms) { _tickMicros = (ms == 0) ? 1 : (uint64_t)ms * 1000; }
+
+  /**
+   * \brief Returns the clock shared by every fiber.
+   */
+  VirtualClock& clock() { return _clock; }
+
+  /**
+   * \brief Returns the accumulated counters.
+   */
+  const FiberStats& stats() const { return _stats; }
+
+  /**
+   * \brief Returns the scheduler running on the calling thread, or nullptr outside `run()`.
+   */
+  static FiberScheduler* current() { return active(); }
+
+  /**
+   * \brief Measures how many fiber switches per second the host sustains.
+   *
+   * \param fibers      size_t - Fibers yielding to each other.
+   * \param switches    uint64_t - Total switches to perform.
+   * \return double     Switches per host second.
+   */
+  static double benchmark(size_t fibers = 1000, uint64_t switches = 1000000) {
+    FiberScheduler scheduler(16 * 1024);
+    uint64_t rounds = switches / ((fibers == 0) ? 1 : fibers);
+    for (size_t i = 0; i < fibers; ++i) {
+      scheduler.spawn([&scheduler, rounds]() {
+        for (uint64_t round = 0; round < rounds; ++round) {
+          scheduler.yield();
+        }
+      });
+    }
+    auto started = std::chrono::steady_clock::now();
+    scheduler.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+    return (elapsed.count() > 0.0) ? (double)scheduler.stats().switches / elapsed.count() : 0.0;
+  }
+
+private:
+  static const uint32_t kNone = UINT32_MAX;
+
+  struct Fiber {
+    ucontext_t context;
+    std::unique_ptr<char[]> stack;
+    std::function<void()> body;
+    MillisFunctionEmulator* millis = nullptr;
+    DelayFunctionEmulator* delay = nullptr;
+    LogFunctionEmulators* log = nullptr;
+    unsigned priority = 0;
+    uint64_t generation = 0;  // Bumped on every wait so stale timers are ignored.
+    bool parked = false;      // Waiting for unpark().
+    bool woken = false;       // The last park() ended by unpark().
+    bool finished = false;
+    uint64_t resumes = 0;
+  };
+
+  struct Timer {
+    uint64_t wake;        // Virtual time the fiber is due.
+    uint64_t sequence;    // Keeps fibers due at the same time in the order they slept.
+    uint32_t fiber;
+    uint64_t generation;  // The wait this timer belongs to.
+
+    bool operator>(const Timer& other) const {
+      return (wake != other.wake) ? wake > other.wake : sequence > other.sequence;
+    }
+  };
+
+  static FiberScheduler*& active() {
+    thread_local FiberScheduler* scheduler = nullptr;
+    return scheduler;
+  }
+
+  static void hook(uint64_t us) { active()->sleepFor(us); }
+
+  static void entry() {
+    FiberScheduler* scheduler = active();
+    Fiber& fiber = *scheduler->_fibers[scheduler->_running];
+    try {
+      fiber.body();
+      ++scheduler->_stats.finished;
+    } catch (...) {
+      ++scheduler->_stats.failed;
+    }
+    fiber.finished = true;
+    // Returning resumes _main through uc_link.
+  }
+
+  void makeReady(uint32_t id) {
+    unsigned priority = _fibers[id]->priority;
+    if (priority >= _ready.size()) {
+      _ready.resize(priority + 1);
+    }
+    _ready[priority].push_back(id);
+    ++_readyCount;
+  }
+
+  uint32_t takeReady() {
+    if (_chooser) {
+      return chooseReady();
+    }
+    size_t priority = _ready.size() - 1;
+    while (_ready[priority].empty()) {
+      --priority;
+    }
+    std::deque<uint32_t>& level = _ready[priority];
+    if (_seeded && level.size() > 1) {
+      std::swap(level.front(), level[_random.below(level.size())]);
+    }
+    uint32_t id = level.front();
+    level.pop_front();
+    --_readyCount;
+    return id;
+  }
+
+  uint32_t chooseReady() {
+    _candidates.clear();
+    for (auto& level : _ready) {
+      for (auto it = level.begin(); it != level.end();) {
+        if (_fibers[*it]->finished) {
+          it = level.erase(it);
+          --_readyCount;
+        } else {
+          _candidates.push_back(*it);
+          ++it;
+        }
+      }
+    }
+    if (_candidates.empty()) {
+      return kNone;
+    }
+    std::sort(_candidates.begin(), _candidates.end());
+    size_t choice = (_candidates.size() > 1) ? _chooser(_candidates) : 0;
+    uint32_t id = _candidates[(choice < _candidates.size()) ? choice : 0];
+    std::deque<uint32_t>& level = _ready[_fibers[id]->priority];
+    level.erase(std::find(level.begin(), level.end(), id));
+    --_readyCount;
+    return id;
+  }
+
+  void resume(uint32_t id) {
+    if (id == kNone) {
+      return;
+    }
+    Fiber& fiber = *_fibers[id];
+    if (fiber.finished) {
+      return;
+    }
+    ++fiber.resumes;
+    _running = id;
+    MillisFunctionEmulator::bind((fiber.millis != nullptr) ? fiber.millis : _outerMillis);
+    DelayFunctionEmulator::bind((fiber.delay != nullptr) ? fiber.delay : _outerDelay);
+    LogFunctionEmulators::bind((fiber.log != nullptr) ? fiber.log : _outerLog);
+    ++_stats.switches;
+    swapcontext(&_main, &fiber.context);
+    _running = kNone;
+    MillisFunctionEmulator::bind(_outerMillis);
+    DelayFunctionEmulator::bind(_outerDelay);
+    LogFunctionEmulators::bind(_outerLog);
+    if (fiber.finished) {
+      fiber.stack.reset();
+      fiber.body = nullptr;
+    }
+  }
+
+  void suspend() {
+    Fiber& fiber = *_fibers[_running];
+    swapcontext(&fiber.context, &_main);
+  }
+
+  size_t _stackSize;
+  VirtualClock _clock;                                // Timeline shared by every fiber.
+  ucontext_t _main;                                   // Context of run(), resumed on every suspend.
+  std::vector<std::unique_ptr<Fiber>> _fibers;
+  std::vector<std::deque<uint32_t>> _ready;           // Fibers waiting for the host thread, by priority.
+  size_t _readyCount = 0;
+  std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> _timers;
+  uint64_t _sequence = 0;
+  uint32_t _running = kNone;                          // Fiber currently executing.
+  uint64_t _pollMicros = 1000;
+  uint64_t _tickMicros = 1000;
+  bool _seeded = false;                               // Order equal priorities from _random.
+  SeededRandom _random;
+  Chooser _chooser;                                   // Takes over scheduling decisions when set.
+  std::vector<uint32_t> _candidates;                  // Scratch list handed to _chooser.
+  bool _stopping = false;                             // stop() was called during run().
+  MillisFunctionEmulator* _outerMillis = nullptr;     // Bindings in effect outside fibers.
+  DelayFunctionEmulator* _outerDelay = nullptr;
+  LogFunctionEmulators* _outerLog = nullptr;
+  FiberStats _stats;
+};
+
+#endif // end of FIBER_SCHEDULER_H
@@ -0,0 +1,348 @@
+#if not defined(FLEET_H)
+#define FLEET_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "EmulatorMemory.h"
+#include "LogFunctionEmulators.h"
+#include "TimeFunctionEmulators.h"
+#include "VirtualClock.h"
+#include "WorkStealingPool.h"
+
+/**
+ * \file Fleet.h
+ * \brief Runs many independent emulated devices in one process.
+ */
+
+/**
+ * \class FleetDevice
+ * \brief One emulated device in a Fleet: its firmware plus its own emulators.
+ *
+ * Firmware is wrapped in a subclass whose members are the mocks it talks to
+ * (HttpClient, TinyGsm, fs::FS...), so every device has an independent set.
+ * While a device runs, its VirtualClock and its millis, delay and log
+ * emulators are bound to the host thread, so `millis()`, `delay()`, `log_*()`,
+ * mock delays and anything charging time to `VirtualClock::current()` act on
+ * that device alone. Its
+ * memory meter is bound too, so the device's emulators allocate through it
+ * and `memory()` tells the device's heap footprint.
+ *
+ * Example:
+ * \code{.cpp}
+ * class Tracker : public FleetDevice {
+ * public:
+ *   Tracker() : http(client, "api.example.com", 80) { http.serve(backend); }
+ *   void loop() override { http.get("/ping"); delay(60000); }
+ * private:
+ *   MockClient client;
+ *   HttpClient http;
+ * };
+ * \endcode
+ */
+class FleetDevice {
+public:
+  FleetDevice() { _millis.setTimeIncrement(0); }
+  virtual ~FleetDevice() {}
+
+  /**
+   * \brief Runs once when the device boots.
+   */
+  virtual void setup() {}
+
+  /**
+   * \brief Runs repeatedly for the rest of the device's life.
+   */
+  virtual void loop() = 0;
+
+  /**
+   * \brief Returns the device's position in its fleet.
+   */
+  uint32_t id() const { return _id; }
+
+  /**
+   * \brief Returns the device's clock.
+   */
+  VirtualClock& clock() { return _clock; }
+
+  /**
+   * \brief Returns the emulator behind `millis()` while this device runs.
+   */
+  MillisFunctionEmulator& millisFunction() { return _millis; }
+
+  /**
+   * \brief Returns the emulator behind `delay()` while this device runs.
+   */
+  DelayFunctionEmulator& delayFunction() { return _delay; }
+
+  /**
+   * \brief Returns the emulators behind the `log_*()` stubs while this device runs.
+   */
+  LogFunctionEmulators& logFunctions() { return _log; }
+
+  /**
+   * \brief Returns the meter the device's emulators allocate through while it runs.
+   */
+  const MemoryMeter& memory() const { return _memory; }
+
+  /**
+   * \brief Returns how many times `loop()` has run.
+   */
+  uint64_t loops() const { return _loops; }
+
+  /**
+   * \brief Returns true if `setup()` or `loop()` threw, which stops the device.
+   */
+  bool failed() const { return _failed; }
+
+private:
+  friend class Fleet;
+  friend class FiberScheduler;
+
+  VirtualClock _clock;
+  MemoryMeter _memory;
+  MillisFunctionEmulator _millis;
+  DelayFunctionEmulator _delay;
+  LogFunctionEmulators _log;
+  uint64_t _loops = 0;
+  uint32_t _id = 0;
+  bool _booted = false;
+  bool _failed = false;
+};
+
+/**
+ * \brief Outcome of a Fleet run.
+ *
+ * \param devices         size_t - Devices in the fleet.
+ * \param workers         unsigned - Host threads the fleet ran on.
+ * \param loops           uint64_t - Calls to `loop()` across every device.
+ * \param failures        size_t - Devices stopped by an exception.
+ * \param steals          uint64_t - Device slices moved between host threads.
+ * \param virtualMillis   uint64_t - Virtual time each device was run for.
+ * \param wallSeconds     double - Host time the run took.
+ * \param deviceBytes     size_t - Size of the largest device object, emulator state included.
+ * \param heapBytes       size_t - Most heap memory any device's emulators held at once.
+ */
+struct FleetReport {
+  size_t devices = 0;
+  unsigned workers = 0;
+  uint64_t loops = 0;
+  size_t failures = 0;
+  uint64_t steals = 0;
+  uint64_t virtualMillis = 0;
+  double wallSeconds = 0.0;
+  size_t deviceBytes = 0;
+  size_t heapBytes = 0;
+
+  /**
+   * \brief Returns `loop()` calls per host second across the fleet.
+   */
+  double loopsPerSecond() const { return (wallSeconds > 0.0) ? (double)loops / wallSeconds : 0.0; }
+
+  /**
+   * \brief Returns emulated device-seconds per host second across the fleet.
+   */
+  double deviceSecondsPerSecond() const {
+    return (wallSeconds > 0.0) ? (double)devices * (double)virtualMillis / 1000.0 / wallSeconds : 0.0;
+  }
+
+  /**
+   * \brief Writes a human readable summary.
+   *
+   * \param out   std::ostream& - The stream to write to.
+   */
+  void report(std::ostream& out) const {
+    out << "Fleet report" << std::endl;
+    out << "  Devices: " << devices << " on " << workers << " threads, " << failures << " failed" << std::endl;
+    out << "  Virtual time per device: " << virtualMillis << " ms, wall time: " << wallSeconds << " s" << std::endl;
+    out << "  Loops: " << loops << " (" << loopsPerSecond() << " /s), steals: " << steals << std::endl;
+    out << "  Device-seconds per second: " << deviceSecondsPerSecond() << std::endl;
+    out << "  Bytes per device: " << deviceBytes << " + " << heapBytes << " heap" << std::endl;
+  }
+};
+
+/**
+ * \class Fleet
+ * \brief Runs many FleetDevice instances concurrently on a work-stealing pool.
+ *
+ * Each device is run in slices: bound to a host thread, it boots or loops
+ * until its clock has advanced by `setSlice()` milliseconds, then yields its
+ * thread to the next device. A `loop()` that does not advance the clock is
+ * charged `setLoopTick()` milliseconds so busy loops still make progress.
+ * Devices share nothing through the emulation layer, so a fleet scales with
+ * host cores. The one process-wide operation is `resetEmulators()`, which
+ * must not be called while `run()` is in progress.
+ *
+ * Example:
+ * \code{.cpp}
+ * Fleet fleet;
+ * fleet.spawn<Tracker>(10000);
+ * FleetReport result = fleet.run(24UL * 3600 * 1000);
+ * result.report(std::cout);
+ * \endcode
+ */
+class Fleet {
+public:
+  /**
+   * \brief Constructs an empty fleet.
+   *
+   * \param workers   unsigned - Host threads to run on, 0 for one per core.
+   */
+  explicit Fleet(unsigned workers = 0) : _pool(workers) {}
+  ~Fleet() {}
+
+  /**
+   * \brief Adds devices constructed with the given arguments.
+   *
+   * \tparam Device   A FleetDevice subclass.
+   * \param count     size_t - The number of devices to add.
+   * \param args      Constructor arguments passed to every device.
+   */
+  template<typename Device, typename... Args>
+  void spawn(size_t count, const Args&... args) {
+    _devices.reserve(_devices.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+      add(std::unique_ptr<FleetDevice>(new Device(args...)));
+    }
+    if (sizeof(Device) > _deviceBytes) {
+      _deviceBytes = sizeof(Device);
+    }
+  }
+
+  /**
+   * \brief Adds one device.
+   *
+   * \param device    std::unique_ptr<FleetDevice> - The device, owned by the fleet from now on.
+   */
+  void add(std::unique_ptr<FleetDevice> device) {
+    device->_id = (uint32_t)_devices.size();
+    _devices.push_back(std::move(device));
+  }
+
+  /**
+   * \brief Returns a device by its id.
+   */
+  FleetDevice& device(size_t id) { return *_devices[id]; }
+
+  /**
+   * \brief Returns the number of devices.
+   */
+  size_t size() const { return _devices.size(); }
+
+  /**
+   * \brief Sets how much virtual time a device runs before yielding its thread.
+   *
+   * \param ms    unsigned long - Slice length in milliseconds (default 1000).
+   */
+  void setSlice(unsigned long ms) { _sliceMicros = (ms == 0) ? 1 : (uint64_t)ms * 1000; }
+
+  /**
+   * \brief Sets the virtual time charged to a `loop()` that does not advance the clock itself.
+   *
+   * \param ms    unsigned long - Milliseconds per idle loop (default 1).
+   */
+  void setLoopTick(unsigned long ms) { _tickMicros = (ms == 0) ? 1 : (uint64_t)ms * 1000; }
+
+  /**
+   * \brief Runs every device until its clock reaches a point in virtual time.
+   *
+   * Devices that have already run continue from where they stopped, so a long
+   * run can be split into several calls.
+   *
+   * \param virtualMillis   uint64_t - Virtual time at which devices stop, in milliseconds.
+   * \return FleetReport    Throughput and footprint figures for this call.
+   */
+  FleetReport run(uint64_t virtualMillis) {
+    uint64_t until = virtualMillis * 1000;
+    std::vector<uint32_t> tasks;
+    tasks.reserve(_devices.size());
+    for (uint32_t i = 0; i < _devices.size(); ++i) {
+      tasks.push_back(i);
+    }
+    uint64_t loopsBefore = totalLoops();
+    uint64_t stealsBefore = _pool.steals();
+
+    auto started = std::chrono::steady_clock::now();
+    _pool.run(tasks, [&](uint32_t id) { return step(*_devices[id], until); });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+    FleetReport result;
+    result.devices = _devices.size();
+    result.workers = _pool.size();
+    result.loops = totalLoops() - loopsBefore;
+    result.steals = _pool.steals() - stealsBefore;
+    result.virtualMillis = virtualMillis;
+    result.wallSeconds = elapsed.count();
+    result.deviceBytes = _deviceBytes;
+    for (const auto& device : _devices) {
+      result.failures += device->_failed ? 1 : 0;
+      result.heapBytes = std::max(result.heapBytes, device->_memory.peak());
+    }
+    return result;
+  }
+
+private:
+  /**
+   * \brief Runs one slice of a device with its clock and emulators bound.
+   *
+   * \return bool   true if the device should be scheduled again.
+   */
+  bool step(FleetDevice& device, uint64_t until) {
+    if (device._failed || device._clock.nowMicros() >= until) {
+      return false;
+    }
+    VirtualClock* previousClock = VirtualClock::bind(&device._clock);
+    MillisFunctionEmulator* previousMillis = MillisFunctionEmulator::bind(&device._millis);
+    DelayFunctionEmulator* previousDelay = DelayFunctionEmulator::bind(&device._delay);
+    LogFunctionEmulators* previousLog = LogFunctionEmulators::bind(&device._log);
+    std::pmr::memory_resource* previousMemory = EmulatorMemory::bind(&device._memory);
+
+    uint64_t sliceEnd = device._clock.nowMicros() + _sliceMicros;
+    if (sliceEnd > until) {
+      sliceEnd = until;
+    }
+    try {
+      if (!device._booted) {
+        device._booted = true;
+        device.setup();
+      }
+      while (device._clock.nowMicros() < sliceEnd) {
+        uint64_t before = device._clock.nowMicros();
+        device.loop();
+        ++device._loops;
+        if (device._clock.nowMicros() == before) {
+          device._clock.advance(_tickMicros);
+        }
+      }
+    } catch (...) {
+      device._failed = true;
+    }
+
+    EmulatorMemory::bind(previousMemory);
+    LogFunctionEmulators::bind(previousLog);
+    DelayFunctionEmulator::bind(previousDelay);
+    MillisFunctionEmulator::bind(previousMillis);
+    VirtualClock::bind(previousClock);
+    return !device._failed && device._clock.nowMicros() < until;
+  }
+
+  uint64_t totalLoops() const {
+    uint64_t loops = 0;
+    for (const auto& device : _devices) {
+      loops += device->_loops;
+    }
+    return loops;
+  }
+
+  WorkStealingPool _pool;
+  std::vector<std::unique_ptr<FleetDevice>> _devices;
+  size_t _deviceBytes = 0;            // sizeof the largest spawned device type.
+  uint64_t _sliceMicros = 1000000;    // Virtual time a device runs per slice.
+  uint64_t _tickMicros = 1000;        // Charged to loops that leave the clock untouched.
+};
+
+#endif // end of FLEET_H
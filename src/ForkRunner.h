@@ -0,0 +1,333 @@
+#if not defined(FORK_RUNNER_H)
+#define FORK_RUNNER_H
+
+#include <unity.h>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * \file ForkRunner.h
+ * \brief Runs Unity tests in forked workers sharing state loaded once, on every core.
+ */
+
+/**
+ * \brief Adds a test to a ForkRunner, as `RUN_TEST()` runs one.
+ */
+#define FORK_TEST(runner, func)    (runner).add(func, #func, __LINE__)
+
+/**
+ * \class ForkRunner
+ * \brief Runs each test, or chunk of tests, in a process forked from a preloaded parent.
+ *
+ * Everything the test program loads before `run()` (scenarios, filesystem
+ * images, cassettes, configured emulators) is inherited copy-on-write by
+ * every worker, so each test starts from that snapshot in the time a fork
+ * takes instead of loading it again, and nothing a test changes leaks into
+ * the next. Up to `workers` processes run at once.
+ *
+ * Worker output is collected through a pipe and printed whole when the worker
+ * ends, so lines of parallel tests never interleave. A test that crashes or
+ * exceeds the timeout fails with a Unity `FAIL` line naming the signal; the
+ * rest of its chunk runs in a new worker. `run()` ends with `UnityEnd()`
+ * totals over all workers, as PlatformIO expects from a test program:
+ *
+ * \code{.cpp}
+ * int main() {
+ *   Scenario::load("test/scenarios/registered.json");   // loaded once, shared by every test
+ *   ForkRunner runner;
+ *   FORK_TEST(runner, test_connects);
+ *   FORK_TEST(runner, test_retries_on_503);
+ *   return runner.run(__FILE__);
+ * }
+ * \endcode
+ *
+ * Workers end with `_exit()`, so reports written from destructors or `atexit()`
+ * in a worker are lost; write them from `onWorkerExit()`. Threads of the
+ * parent are not forked: stop them before `run()`.
+ */
+class ForkRunner {
+public:
+  enum Outcome : uint8_t { Pending, Running, Passed, Failed, Ignored, Crashed, TimedOut };
+
+  /**
+   * \brief Constructs a runner.
+   *
+   * \param workers       unsigned - Processes to run at once, 0 for one per core.
+   * \param testsPerFork  size_t - Tests run one after another by each worker;
+   *                      1 (the default) gives every test a fresh snapshot.
+   */
+  explicit ForkRunner(unsigned workers = 0, size_t testsPerFork = 1) {
+    if (workers == 0) {
+      workers = std::thread::hardware_concurrency();
+    }
+    _workers = (workers == 0) ? 1 : workers;
+    _testsPerFork = (testsPerFork == 0) ? 1 : testsPerFork;
+  }
+  ~ForkRunner() {}
+
+  /**
+   * \brief Adds a test, see `FORK_TEST()`.
+   *
+   * \param func    UnityTestFunction - The test.
+   * \param name    const char* - Its name as reported.
+   * \param line    int - The line it is added on.
+   */
+  void add(UnityTestFunction func, const char* name, int line) { _tests.push_back(Test{ func, name, line }); }
+
+  /**
+   * \brief Kills a worker running longer than this, failing the test it is in (0, the default, never).
+   *
+   * With several tests per fork the limit covers the whole chunk.
+   */
+  void setTimeout(unsigned seconds) { _timeout = seconds; }
+
+  /**
+   * \brief Sets a function each worker runs after its tests, before exiting,
+   * e.g. to save its ScenarioCoverage entries.
+   *
+   * \param hook    std::function<void(size_t)> - Receives the index of the worker's first test.
+   */
+  void onWorkerExit(std::function<void(size_t)> hook) { _exitHook = std::move(hook); }
+
+  /**
+   * \brief Returns the outcome of a test after `run()`.
+   */
+  Outcome outcome(size_t test) const { return _outcomes[test]; }
+
+  /**
+   * \brief Returns the number of workers forked by the last `run()`.
+   */
+  size_t forks() const { return _forks; }
+
+  /**
+   * \brief Runs every test added and writes Unity's summary.
+   *
+   * Totals are added to Unity's counters, so tests run with `RUN_TEST()`
+   * after `UNITY_BEGIN()` and before the runner count too.
+   *
+   * \param file    const char* - The test file, passed to `UnityBegin()` unless
+   *                `UNITY_BEGIN()` was already called.
+   * \return int    The number of failed tests, as returned by `UNITY_END()`.
+   */
+  int run(const char* file) {
+    if (Unity.TestFile == nullptr) {
+      UnityBegin(file);
+    }
+    size_t count = _tests.size();
+    _outcomes.assign(count, Pending);
+    _forks = 0;
+    if (count == 0) {
+      return UnityEnd();
+    }
+    uint8_t* shared = (uint8_t*)mmap(nullptr, count, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+      std::perror("ForkRunner: mmap");
+      return -1;
+    }
+    std::memset(shared, Pending, count);
+
+    std::deque<std::pair<size_t, size_t>> chunks;
+    for (size_t first = 0; first < count; first += _testsPerFork) {
+      chunks.emplace_back(first, std::min(_testsPerFork, count - first));
+    }
+    std::vector<Worker> active;
+    while (!chunks.empty() || !active.empty()) {
+      while (active.size() < _workers && !chunks.empty()) {
+        Worker worker;
+        worker.first = chunks.front().first;
+        worker.count = chunks.front().second;
+        chunks.pop_front();
+        if (!spawn(worker, shared)) {
+          stopAll(active);
+          munmap(shared, count);
+          return -1;
+        }
+        active.push_back(std::move(worker));
+      }
+      collect(active, chunks, shared);
+    }
+
+    size_t failed = 0;
+    size_t ignored = 0;
+    for (size_t i = 0; i < count; ++i) {
+      _outcomes[i] = (Outcome)shared[i];
+      failed += (_outcomes[i] == Failed || _outcomes[i] == Crashed || _outcomes[i] == TimedOut) ? 1 : 0;
+      ignored += (_outcomes[i] == Ignored) ? 1 : 0;
+    }
+    munmap(shared, count);
+    Unity.NumberOfTests += count;
+    Unity.TestFailures += failed;
+    Unity.TestIgnores += ignored;
+    return UnityEnd();
+  }
+
+private:
+  struct Test {
+    UnityTestFunction func;
+    const char* name;
+    int line;
+  };
+
+  struct Worker {
+    pid_t pid = -1;
+    int output = -1;
+    size_t first = 0;
+    size_t count = 0;
+    std::string text;
+    std::chrono::steady_clock::time_point started;
+    bool killed = false;
+  };
+
+  bool spawn(Worker& worker, uint8_t* shared) {
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+      std::perror("ForkRunner: pipe");
+      return false;
+    }
+    std::cout.flush();
+    std::fflush(stdout);
+    std::fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+      std::perror("ForkRunner: fork");
+      close(pipeFds[0]);
+      close(pipeFds[1]);
+      return false;
+    }
+    if (pid == 0) {
+      close(pipeFds[0]);
+      dup2(pipeFds[1], STDOUT_FILENO);
+      dup2(pipeFds[1], STDERR_FILENO);
+      close(pipeFds[1]);
+      runChunk(worker.first, worker.count, shared);
+    }
+    close(pipeFds[1]);
+    ++_forks;
+    worker.pid = pid;
+    worker.output = pipeFds[0];
+    worker.started = std::chrono::steady_clock::now();
+    return true;
+  }
+
+  /**
+   * \brief Kills and reaps every running worker, discarding its output.
+   */
+  static void stopAll(std::vector<Worker>& active) {
+    for (Worker& worker : active) {
+      kill(worker.pid, SIGKILL);
+      close(worker.output);
+      while (waitpid(worker.pid, nullptr, 0) < 0 && errno == EINTR) {}
+    }
+    active.clear();
+  }
+
+  [[noreturn]] void runChunk(size_t first, size_t count, uint8_t* shared) {
+    for (size_t i = first; i < first + count; ++i) {
+      const Test& test = _tests[i];
+      UNITY_COUNTER_TYPE failures = Unity.TestFailures;
+      UNITY_COUNTER_TYPE ignores = Unity.TestIgnores;
+      shared[i] = Running;
+      UnityDefaultTestRun(test.func, test.name, test.line);
+      shared[i] = (Unity.TestFailures > failures) ? Failed : (Unity.TestIgnores > ignores) ? Ignored : Passed;
+    }
+    if (_exitHook) {
+      _exitHook(first);
+    }
+    std::cout.flush();
+    std::fflush(stdout);
+    std::fflush(stderr);
+    _exit(0);
+  }
+
+  /**
+   * \brief Reads worker output until at least one worker ends, killing any past the timeout.
+   */
+  void collect(std::vector<Worker>& active, std::deque<std::pair<size_t, size_t>>& chunks, uint8_t* shared) {
+    std::vector<pollfd> fds(active.size());
+    for (size_t i = 0; i < active.size(); ++i) {
+      fds[i] = pollfd{ active[i].output, POLLIN, 0 };
+    }
+    int wait = (_timeout == 0) ? -1 : 100;
+    if (poll(fds.data(), fds.size(), wait) < 0 && errno != EINTR) {
+      std::perror("ForkRunner: poll");
+    }
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = active.size(); i-- > 0;) {
+      Worker& worker = active[i];
+      if (fds[i].revents != 0) {
+        char buffer[4096];
+        ssize_t got = read(worker.output, buffer, sizeof(buffer));
+        if (got > 0) {
+          worker.text.append(buffer, got);
+          continue;
+        }
+        if (got < 0 && errno == EINTR) {
+          continue;
+        }
+        finish(worker, chunks, shared);
+        active.erase(active.begin() + i);
+        continue;
+      }
+      if (_timeout != 0 && !worker.killed && now - worker.started > std::chrono::seconds(_timeout)) {
+        kill(worker.pid, SIGKILL);
+        worker.killed = true;
+      }
+    }
+  }
+
+  void finish(Worker& worker, std::deque<std::pair<size_t, size_t>>& chunks, uint8_t* shared) {
+    close(worker.output);
+    int status = 0;
+    while (waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {}
+    std::fwrite(worker.text.data(), 1, worker.text.size(), stdout);
+    for (size_t i = worker.first; i < worker.first + worker.count; ++i) {
+      if (shared[i] == Running || (shared[i] == Pending && i == worker.first)) {
+        const Test& test = _tests[i];
+        std::string reason;
+        if (worker.killed) {
+          shared[i] = TimedOut;
+          reason = "Timed out after " + std::to_string(_timeout) + " s";
+        } else {
+          shared[i] = Crashed;
+          reason = WIFSIGNALED(status) ? std::string("Crashed with signal ") + std::to_string(WTERMSIG(status)) + " (" + strsignal(WTERMSIG(status)) + ")"
+                                       : std::string("Exited with status ") + std::to_string(WEXITSTATUS(status));
+        }
+        std::printf("%s:%d:%s:FAIL: %s\n", Unity.TestFile, test.line, test.name, reason.c_str());
+        if (i + 1 < worker.first + worker.count) {
+          chunks.emplace_back(i + 1, worker.first + worker.count - i - 1);
+        }
+        break;
+      }
+      if (shared[i] == Pending) {    // The worker left after finishing a test, run the rest again.
+        chunks.emplace_back(i, worker.first + worker.count - i);
+        break;
+      }
+    }
+    std::fflush(stdout);
+  }
+
+  std::vector<Test> _tests;
+  std::vector<Outcome> _outcomes;
+  std::function<void(size_t)> _exitHook;
+  unsigned _workers;
+  size_t _testsPerFork;
+  unsigned _timeout = 0;
+  size_t _forks = 0;
+};
+
+#endif // end of FORK_RUNNER_H
@@ -17,7 +17,7 @@
 
 class FunctionEmulator : public Emulator {
 public:
-  explicit FunctionEmulator(std::string funcName) : _functionName(funcName), _callCount(0), _capturedArgs() {}
+  explicit FunctionEmulator(std::string funcName) : _functionName(funcName), _callCount(0), _capturedArgs(memory()) {}
   
   virtual ~FunctionEmulator() {}
 
@@ -50,6 +50,7 @@ public:
    * 
    */
   void recordFunctionCall() {
+    refresh();
     _callCount++;
   }
 
@@ -62,21 +63,22 @@ public:
    * \return bool Returns `true` if the function was called at least once, otherwise returns `false`.
    */
   bool wasCalled() {
+    refresh();
     return _callCount > 0;
   }
 
   /**
    * \brief Resets the internal state of the function emulator.
    * 
-   * This method sets the call count `_callCount` back to zero, clears the captured 
-   * arguments from `_capturedArgs`, and then calls the parent class's reset method 
-   * to handle any further reset requirements.
+   * This method sets the call count `_callCount` back to zero, forgets the captured 
+   * arguments while keeping `_capturedArgs` for reuse, and then calls the parent
+   * class's reset method to handle any further reset requirements.
    * 
    * \note This method overrides the `reset` method in the base `Emulator` class.
    */
   void reset() override {
     _callCount = 0;
-    _capturedArgs.clear();
+    _captured = 0;
     Emulator::reset();
     EMULATION_LOG(("FunctionEmulator::reset() - Reset function emulator for " + _functionName).c_str());
   }
@@ -90,7 +92,7 @@ public:
    * \return int The count of how many times the function has been called.
    */
   int timesCalled() const {
-    return _callCount;
+    return stale() ? 0 : _callCount;
   }
 
   /**
@@ -108,7 +110,13 @@ public:
    */
   template<typename... Args>
   void captureArgs(Args... args) {
-    _capturedArgs.emplace_back(std::initializer_list<std::any>{args...});
+    refresh();
+    if (_captured < _capturedArgs.size()) {
+      _capturedArgs[_captured] = std::initializer_list<std::any>{args...};
+    } else {
+      _capturedArgs.emplace_back(std::initializer_list<std::any>{args...});
+    }
+    ++_captured;
   }
 
   /**
@@ -122,11 +130,28 @@ public:
    * the captured arguments of a particular function call, stored as instances of `std::any`.
    */
   ArgContext getArguments() const {
-    ArgContext args(_capturedArgs);
+    size_t captured = stale() ? 0 : _captured;
+    CapturedArgs_t calls;
+    calls.reserve(captured);
+    for (size_t i = 0; i < captured; ++i) {
+      calls.emplace_back(_capturedArgs[i].begin(), _capturedArgs[i].end());
+    }
+    ArgContext args(calls);
     return args;
   }
 
-  
+protected:
+  /**
+   * \brief Moves the captured arguments onto another memory resource with the profiles.
+   *
+   * Entries left from earlier tests are dropped rather than moved.
+   */
+  void adopt(std::pmr::memory_resource* memory) override {
+    _capturedArgs.resize(stale() ? 0 : _captured);
+    rebindContainer(_capturedArgs, memory);
+    Emulator::adopt(memory);
+  }
+
 private:
   /**
    * \brief The name of the function being emulated.
@@ -151,8 +176,16 @@ private:
    * Each time the function is called, its arguments are captured and stored 
    * as a new vector inside this nested vector. This structure enables later 
    * inspection or verification of the arguments passed during testing.
+   * Allocated from the emulator's memory resource.
+   */
+  std::pmr::vector<std::pmr::vector<std::any>> _capturedArgs;
+
+  /**
+   * \brief Number of entries of `_capturedArgs` captured since the last reset.
+   *
+   * Later entries are left from earlier tests and reused, keeping their capacity.
    */
-  CapturedArgs_t _capturedArgs;
+  size_t _captured = 0;
 };
 
 #endif
@@ -0,0 +1,381 @@
+#if not defined(FUZZ_HARNESS_H)
+#define FUZZ_HARNESS_H
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <ostream>
+#include <random>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Emulator.h"
+#include "FuzzInput.h"
+#include "SeededRandom.h"
+#include "VirtualClock.h"
+
+#if not defined(FUZZ_MAX_INPUT)
+#define FUZZ_MAX_INPUT    (4096)
+#endif
+
+#if not defined(FUZZ_MAX_CORPUS)
+#define FUZZ_MAX_CORPUS   (4096)
+#endif
+
+/**
+ * \brief Outcome of a built-in fuzzing run, see `FuzzHarness::fuzz()`.
+ *
+ * \param runs      uint64_t - Inputs run.
+ * \param faulted   uint64_t - Runs ended by an injected exception the code let escape.
+ * \param paths     uint64_t - Distinct paths of mocked calls and responses reached.
+ * \param corpus    uint64_t - Inputs kept for mutation.
+ * \param seconds   double - Wall time taken.
+ * \param seed      uint64_t - The seed the mutations were drawn from, to repeat the run.
+ */
+struct FuzzStats {
+  uint64_t runs = 0;
+  uint64_t faulted = 0;
+  uint64_t paths = 0;
+  uint64_t corpus = 0;
+  double seconds = 0.0;
+  uint64_t seed = 0;
+
+  /**
+   * \brief Writes a one line summary.
+   *
+   * \param out   std::ostream& - The stream to write to.
+   */
+  void report(std::ostream& out) const {
+    out << "Fuzzing: " << runs << " runs in " << seconds << " s ("
+        << (uint64_t)((seconds > 0.0) ? runs / seconds : 0.0) << " exec/s), "
+        << paths << " paths, " << corpus << " corpus inputs, " << faulted << " faulted, seed " << seed << std::endl;
+  }
+};
+
+/**
+ * \class FuzzHarness
+ * \brief Runs firmware code against emulators whose responses are decoded from fuzz input.
+ *
+ * Each run resets every emulator (`Emulator::resetAll()`, constant time),
+ * binds a fresh virtual clock so delays cost nothing, runs the setup, then
+ * runs the target with the input bound: every call the target makes to a
+ * driven emulator, HttpClient, MockClient, TinyGsm (with its TinyGsmClient
+ * sockets), MockFs or any other, takes its return value, read bytes or
+ * exception from the input as
+ * described in FuzzInput. An injected exception escaping the target ends the
+ * run normally; a crash, a failed assertion or any other exception is a
+ * finding.
+ *
+ * The same source runs under libFuzzer, or with the built-in mutation loop
+ * on any Linux host with no extra tooling:
+ * \code{.cpp}
+ * MockClient client;
+ * TinyGsm modem(Serial);
+ *
+ * FuzzHarness& harness() {
+ *   static FuzzHarness fuzz = FuzzHarness()
+ *     .drive(client).drive(modem)
+ *     .setup([]() { client.returns("connect", 1); modem.returns("gprsConnect", true); })
+ *     .target([]() { firmwareUpload(modem, client); });
+ *   return fuzz;
+ * }
+ *
+ * EMULATION_FUZZ_TARGET(harness())
+ * \endcode
+ * Built with `-fsanitize=fuzzer -DEMULATION_LIBFUZZER` this defines
+ * `LLVMFuzzerTestOneInput()`; otherwise it defines `main()`, which runs
+ * `fuzz()`, or replays the input files named on the command line.
+ */
+class FuzzHarness {
+public:
+  FuzzHarness() {}
+  ~FuzzHarness() {}
+
+  /**
+   * \brief Decodes an emulator's calls from the input. With none driven, every emulator's are.
+   */
+  FuzzHarness& drive(Emulator& emulator) { _input.drive(&emulator); return *this; }
+
+  /**
+   * \brief Sets how many of the 256 selector values throw, 0 for no faults (default FUZZ_FAULT_RATE).
+   */
+  FuzzHarness& faults(uint8_t rate) { _input.setFaultRate(rate); return *this; }
+
+  /**
+   * \brief Sets what configures the emulators before each run, after they are reset.
+   *
+   * Calls made here are not decoded from the input.
+   */
+  FuzzHarness& setup(std::function<void()> setup) { _setup = setup; return *this; }
+
+  /**
+   * \brief Sets the firmware code each run exercises.
+   */
+  FuzzHarness& target(std::function<void()> target) { _target = target; return *this; }
+
+  /**
+   * \brief Adds an input the built-in loop starts mutating from.
+   */
+  FuzzHarness& seed(const std::vector<uint8_t>& input) { _seeds.push_back(input); return *this; }
+
+  /**
+   * \brief Runs the target once against an input, the body of `LLVMFuzzerTestOneInput()`.
+   *
+   * \param data    const uint8_t* - The input.
+   * \param size    size_t - Its length in bytes.
+   * \return int    0, as libFuzzer expects.
+   */
+  int run(const uint8_t* data, size_t size) {
+    Emulator::resetAll();
+    _clock.reset();
+    VirtualClock* clock = VirtualClock::bind(&_clock);
+    if (_setup) {
+      _setup();
+    }
+    _input.assign(data, size);
+    FuzzInput* previous = FuzzInput::bind(&_input);
+    try {
+      if (_target) {
+        _target();
+      }
+    } catch (int) {
+      ++_faulted;
+    }
+    FuzzInput::bind(previous);
+    VirtualClock::bind(clock);
+    return 0;
+  }
+
+  /**
+   * \brief Returns the path hash of the last run, see `FuzzInput::path()`.
+   */
+  uint64_t lastPath() const { return _input.path(); }
+
+  /**
+   * \brief Mutates inputs and runs them until `runs` have been made.
+   *
+   * Starts from the inputs added with `seed()`, or an empty one. Each run
+   * takes a kept input, applies a few random mutations (bit flips, byte
+   * changes, inserted and erased ranges, interesting integers, splices with
+   * another kept input) and keeps the result if it reaches a path of mocked
+   * calls and responses no earlier input did. If the target crashes, the
+   * input is written to `crash-<hash>` in the working directory before the
+   * process dies, for `replay()`.
+   *
+   * \param runs    uint64_t - Inputs to run.
+   * \param seed    uint64_t - Seed of the mutations, 0 for a random one.
+   * \return FuzzStats  What the run covered.
+   */
+  FuzzStats fuzz(uint64_t runs, uint64_t seed = 0) {
+    FuzzStats stats;
+    stats.seed = (seed != 0) ? seed : (((uint64_t)std::random_device()() << 32) | std::random_device()());
+    SeededRandom random(stats.seed);
+    std::vector<std::vector<uint8_t>> corpus = _seeds;
+    if (corpus.empty()) {
+      corpus.emplace_back();
+    }
+    std::unordered_set<uint64_t> paths;
+    std::vector<uint8_t> candidate;
+    candidate.reserve(FUZZ_MAX_INPUT);
+    uint64_t faulted = _faulted;
+    CrashGuard guard;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < corpus.size() && stats.runs < runs; ++i, ++stats.runs) {
+      execute(corpus[i]);
+      paths.insert(_input.path());
+    }
+    while (stats.runs < runs) {
+      candidate = corpus[random.below(corpus.size())];
+      mutate(candidate, corpus, random);
+      execute(candidate);
+      ++stats.runs;
+      if (paths.insert(_input.path()).second && corpus.size() < FUZZ_MAX_CORPUS) {
+        corpus.push_back(candidate);
+      }
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.faulted = _faulted - faulted;
+    stats.paths = paths.size();
+    stats.corpus = corpus.size();
+    return stats;
+  }
+
+  /**
+   * \brief Runs the target once against an input read from a file, e.g. a crash.
+   *
+   * \return bool   False if the file could not be read.
+   */
+  bool replay(const char* path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      return false;
+    }
+    std::vector<uint8_t> input((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    run(input.data(), input.size());
+    return true;
+  }
+
+  /**
+   * \brief Command line entry point of a standalone fuzzer.
+   *
+   * `-runs=N` (default 100000) and `-seed=N` configure `fuzz()`; any other
+   * arguments are input files to `replay()` instead.
+   */
+  int main(int argc, char** argv) {
+    uint64_t runs = 100000;
+    uint64_t seed = 0;
+    int replayed = 0;
+    for (int i = 1; i < argc; ++i) {
+      if (strncmp(argv[i], "-runs=", 6) == 0) {
+        runs = strtoull(argv[i] + 6, nullptr, 10);
+      } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+        seed = strtoull(argv[i] + 6, nullptr, 10);
+      } else {
+        if (!replay(argv[i])) {
+          std::cerr << "FuzzHarness: cannot read " << argv[i] << std::endl;
+          return 1;
+        }
+        std::cout << "FuzzHarness: replayed " << argv[i] << std::endl;
+        ++replayed;
+      }
+    }
+    if (replayed == 0) {
+      fuzz(runs, seed).report(std::cout);
+    }
+    return 0;
+  }
+
+private:
+  /**
+   * \brief Writes the running input to `crash-<hash>` if the process takes a fatal signal.
+   */
+  class CrashGuard {
+  public:
+    CrashGuard() {
+      for (size_t i = 0; i < kCount; ++i) {
+        _previous[i] = std::signal(kSignals[i], handle);
+      }
+    }
+    ~CrashGuard() {
+      for (size_t i = 0; i < kCount; ++i) {
+        std::signal(kSignals[i], _previous[i]);
+      }
+    }
+
+    static const uint8_t*& data() { static const uint8_t* data = nullptr; return data; }
+    static size_t& size() { static size_t size = 0; return size; }
+
+  private:
+    static constexpr int kSignals[] = { SIGSEGV, SIGABRT, SIGFPE, SIGILL, SIGBUS };
+    static constexpr size_t kCount = sizeof(kSignals) / sizeof(kSignals[0]);
+
+    static void handle(int sig) {
+      uint64_t hash = 14695981039346656037ULL;
+      for (size_t i = 0; i < size(); ++i) {
+        hash = (hash ^ data()[i]) * 1099511628211ULL;
+      }
+      char path[] = "crash-0000000000000000";
+      for (int i = 0; i < 16; ++i) {
+        path[sizeof(path) - 2 - i] = "0123456789abcdef"[(hash >> (4 * i)) & 0xF];
+      }
+      int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (file >= 0) {
+        ssize_t written = write(file, data(), size());
+        (void)written;
+        close(file);
+      }
+      static const char kMessage[] = "FuzzHarness: crashed, input written to ";
+      ssize_t written = write(STDERR_FILENO, kMessage, sizeof(kMessage) - 1);
+      written = write(STDERR_FILENO, path, sizeof(path) - 1);
+      written = write(STDERR_FILENO, "\n", 1);
+      (void)written;
+      std::signal(sig, SIG_DFL);
+      raise(sig);
+    }
+
+    void (*_previous[kCount])(int);
+  };
+
+  void execute(const std::vector<uint8_t>& input) {
+    CrashGuard::data() = input.data();
+    CrashGuard::size() = input.size();
+    run(input.data(), input.size());
+  }
+
+  /**
+   * \brief Applies one to four random mutations to an input.
+   */
+  static void mutate(std::vector<uint8_t>& input, const std::vector<std::vector<uint8_t>>& corpus, SeededRandom& random) {
+    static const uint16_t kInteresting[] = { 0, 1, 0x7F, 0x80, 0xFF, 0xFFFF, 200, 204, 301, 400, 404, 500, 1024 };
+    size_t mutations = 1 + random.below(4);
+    for (size_t m = 0; m < mutations; ++m) {
+      size_t at = input.empty() ? 0 : random.below(input.size());
+      switch (random.below(input.empty() ? 2 : 7)) {
+        case 0:   // Insert random bytes.
+        case 1: {
+          size_t count = 1 + random.below(8);
+          for (size_t i = 0; i < count && input.size() < FUZZ_MAX_INPUT; ++i) {
+            input.insert(input.begin() + at, (uint8_t)random.next());
+          }
+          break;
+        }
+        case 2:   // Flip a bit.
+          input[at] ^= (uint8_t)(1 << random.below(8));
+          break;
+        case 3:   // Replace a byte.
+          input[at] = (uint8_t)random.next();
+          break;
+        case 4: { // Erase a range.
+          size_t count = 1 + random.below(input.size() - at);
+          input.erase(input.begin() + at, input.begin() + at + ((count < 8) ? count : 8));
+          break;
+        }
+        case 5: { // Write an interesting little endian integer.
+          uint16_t value = kInteresting[random.below(sizeof(kInteresting) / sizeof(kInteresting[0]))];
+          input[at] = (uint8_t)value;
+          if (at + 1 < input.size()) {
+            input[at + 1] = (uint8_t)(value >> 8);
+          }
+          break;
+        }
+        default: { // Splice in part of another kept input.
+          const std::vector<uint8_t>& other = corpus[random.below(corpus.size())];
+          if (!other.empty()) {
+            size_t from = random.below(other.size());
+            size_t count = 1 + random.below(other.size() - from);
+            for (size_t i = 0; i < count && at + i < input.size(); ++i) {
+              input[at + i] = other[from + i];
+            }
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  FuzzInput _input;                           // The input being run, and the driven emulators.
+  VirtualClock _clock;                        // Bound for each run, so delays take no wall time.
+  std::function<void()> _setup;
+  std::function<void()> _target;
+  std::vector<std::vector<uint8_t>> _seeds;   // Inputs the built-in loop starts from.
+  uint64_t _faulted = 0;                      // Runs ended by an escaped injected exception.
+};
+
+#if defined(EMULATION_LIBFUZZER)
+#define EMULATION_FUZZ_TARGET(harness) \
+  extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) { return (harness).run(data, size); }
+#else
+#define EMULATION_FUZZ_TARGET(harness) \
+  int main(int argc, char** argv) { return (harness).main(argc, argv); }
+#endif
+
+#endif // end of FUZZ_HARNESS_H
@@ -0,0 +1,240 @@
+#if not defined(FUZZ_INPUT_H)
+#define FUZZ_INPUT_H
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if not defined(FUZZ_MAX_STRING)
+#define FUZZ_MAX_STRING   (64)
+#endif
+
+#if not defined(FUZZ_FAULT_RATE)
+#define FUZZ_FAULT_RATE   (16)
+#endif
+
+/**
+ * \class FuzzInput
+ * \brief A fuzz input byte stream, decoded into the responses of mocked calls.
+ *
+ * While an input is bound with `bind()`, every mocked call an emulator it
+ * drives makes consumes a selector byte. The selector picks the call's
+ * response:
+ * - even: the value configured with `returns()` / `then()` / `does()`, so the
+ *   paths a test already sets up stay reachable;
+ * - odd: a value decoded from the following bytes: integers and enums from
+ *   their little endian bytes, booleans from one byte, strings (String,
+ *   std::string, const char*) from a length byte then that many bytes;
+ * - one of the top `faultRate()` values: an exception, its code decoded from
+ *   the next two bytes, as `setException()` would throw.
+ *
+ * Mocks that read into a buffer fill it from the input as well, see
+ * `Emulator::fuzzBuffer()`. Once the input is exhausted every byte reads as
+ * 0, so each call gets its configured response: a short input is a prefix of
+ * a longer one, which keeps mutations local. Decoding never allocates after
+ * the first few inputs.
+ */
+class FuzzInput {
+public:
+  /**
+   * \brief What a mocked call's selector chose, see `path()`.
+   */
+  enum Response { Configured = 0, Decoded = 1, Fault = 2 };
+
+  FuzzInput() {}
+  FuzzInput(const uint8_t* data, size_t size) { assign(data, size); }
+  ~FuzzInput() {}
+
+  /**
+   * \brief Starts decoding a new input. The driven emulators and fault rate are kept.
+   *
+   * \param data    const uint8_t* - The input, which must outlive the decoding.
+   * \param size    size_t - Its length in bytes.
+   */
+  void assign(const uint8_t* data, size_t size) {
+    _data = data;
+    _size = size;
+    _offset = 0;
+    _strings = 0;
+    _path = 14695981039346656037ULL;
+    _calls = 0;
+  }
+
+  /**
+   * \brief Returns the number of bytes not yet consumed.
+   */
+  size_t remaining() const { return _size - _offset; }
+
+  /**
+   * \brief Consumes one byte, 0 once the input is exhausted.
+   */
+  uint8_t consumeByte() { return (_offset < _size) ? _data[_offset++] : 0; }
+
+  /**
+   * \brief Consumes up to `size` bytes into a buffer.
+   *
+   * \return size_t The number of bytes copied, fewer than `size` if the input ran out.
+   */
+  size_t consumeBytes(uint8_t* buffer, size_t size) {
+    size_t count = (size < remaining()) ? size : remaining();
+    memcpy(buffer, _data + _offset, count);
+    _offset += count;
+    return count;
+  }
+
+  /**
+   * \brief Consumes an integer from its little endian bytes, missing bytes reading as 0.
+   */
+  template<typename T>
+  T consumeIntegral() {
+    typedef typename std::make_unsigned<T>::type Bits;
+    Bits bits = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+      bits |= (Bits)((Bits)consumeByte() << (8 * i));
+    }
+    return (T)bits;
+  }
+
+  /**
+   * \brief Consumes a length byte and up to that many characters, at most `FUZZ_MAX_STRING`.
+   *
+   * \return const char*  The string, valid until the next `assign()`.
+   */
+  const char* consumeCString() {
+    size_t length = consumeByte() % (FUZZ_MAX_STRING + 1);
+    if (_strings == _storage.size()) {
+      _storage.emplace_back();
+    }
+    std::string& text = _storage[_strings++];
+    length = (length < remaining()) ? length : remaining();
+    text.assign((const char*)_data + _offset, length);
+    _offset += length;
+    return text.c_str();
+  }
+
+  /**
+   * \brief Decodes a value of a mocked call's return type.
+   *
+   * \param value   T& - Receives the value.
+   * \return bool   False if values of T cannot be decoded, e.g. IPAddress or File.
+   */
+  template<typename T>
+  bool decode(T& value) {
+    if constexpr (std::is_same<T, bool>::value) {
+      value = (consumeByte() & 1) != 0;
+    } else if constexpr (std::is_integral<T>::value) {
+      value = consumeIntegral<T>();
+    } else if constexpr (std::is_enum<T>::value) {
+      value = (T)consumeIntegral<typename std::underlying_type<T>::type>();
+    } else if constexpr (std::is_floating_point<T>::value) {
+      uint8_t bytes[sizeof(T)] = {};
+      consumeBytes(bytes, sizeof(T));
+      memcpy(&value, bytes, sizeof(T));
+    } else if constexpr (std::is_same<T, const char*>::value) {
+      value = consumeCString();
+    } else if constexpr (std::is_constructible<T, const char*>::value && std::is_move_assignable<T>::value) {
+      value = T(consumeCString());
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * \brief Consumes a mocked call's selector byte and records it in the path.
+   *
+   * \param func    const std::string& - The mocked method.
+   * \return Response   The response the selector chose.
+   */
+  Response select(const std::string& func) {
+    uint8_t selector = consumeByte();
+    Response response = (selector >= 256 - (int)_faultRate) ? Fault : (Response)(selector & 1);
+    uint64_t step = 14695981039346656037ULL;
+    for (char c : func) {
+      step = (step ^ (uint8_t)c) * 1099511628211ULL;
+    }
+    _path = (_path ^ step ^ (uint64_t)response) * 0x9E3779B97F4A7C15ULL;
+    ++_calls;
+    return response;
+  }
+
+  /**
+   * \brief Returns a hash of the mocked calls made and the responses chosen so far.
+   *
+   * Two inputs with the same path drove the code through the same calls with
+   * the same kinds of response, so a mutation loop keeps only inputs reaching
+   * a new one.
+   */
+  uint64_t path() const { return _path; }
+
+  /**
+   * \brief Returns the number of mocked calls decoded since `assign()`.
+   */
+  size_t calls() const { return _calls; }
+
+  /**
+   * \brief Sets how many of the 256 selector values throw, 0 for no faults (default FUZZ_FAULT_RATE).
+   */
+  void setFaultRate(uint8_t rate) { _faultRate = rate; }
+  uint8_t faultRate() const { return _faultRate; }
+
+  /**
+   * \brief Adds an emulator whose calls are decoded from the input.
+   *
+   * With none added, the calls of every emulator are.
+   */
+  void drive(const void* emulator) { _driven.push_back(emulator); }
+
+  /**
+   * \brief Returns true if an emulator's calls are decoded from the input.
+   */
+  bool drives(const void* emulator) const {
+    if (_driven.empty()) {
+      return true;
+    }
+    for (const void* driven : _driven) {
+      if (driven == emulator) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * \brief Returns the input bound to the calling thread, or nullptr if none is.
+   */
+  static FuzzInput* active() { return slot(); }
+
+  /**
+   * \brief Binds an input to the calling thread, so mocked calls decode it.
+   *
+   * \param input   FuzzInput* - The input, or nullptr to unbind.
+   * \return FuzzInput*  The input bound before.
+   */
+  static FuzzInput* bind(FuzzInput* input) {
+    FuzzInput* previous = slot();
+    slot() = input;
+    return previous;
+  }
+
+private:
+  static FuzzInput*& slot() {
+    thread_local FuzzInput* input = nullptr;
+    return input;
+  }
+
+  const uint8_t* _data = nullptr;
+  size_t _size = 0;
+  size_t _offset = 0;                       // Bytes consumed.
+  std::deque<std::string> _storage;         // Decoded strings, reused across inputs, stable addresses.
+  size_t _strings = 0;                      // Strings of _storage in use.
+  uint64_t _path = 0;                       // Hash of the calls and responses so far.
+  size_t _calls = 0;                        // Mocked calls decoded.
+  uint8_t _faultRate = FUZZ_FAULT_RATE;     // Selector values that throw.
+  std::vector<const void*> _driven;         // Emulators decoded from the input, all if empty.
+};
+
+#endif // end of FUZZ_INPUT_H
@@ -0,0 +1,132 @@
+#if not defined(INPLACE_FUNCTION_H)
+#define INPLACE_FUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if not defined(INPLACE_FUNCTION_CAPACITY)
+#define INPLACE_FUNCTION_CAPACITY   (48)
+#endif
+
+template<typename Signature, size_t Capacity = INPLACE_FUNCTION_CAPACITY>
+class InplaceFunction;
+
+/**
+ * \class InplaceFunction
+ * \brief A copyable callable wrapper that stores its target inside itself and never allocates.
+ *
+ * Works like `std::function`, but the lambda, functor or function pointer is
+ * constructed in a fixed buffer of Capacity bytes rather than on the heap, so
+ * wrapping, copying and calling it cost no allocation. A target larger than
+ * the buffer fails to compile; capture large state by reference or pointer,
+ * or raise INPLACE_FUNCTION_CAPACITY. Targets are expected not to throw when
+ * moved, as lambdas and function pointers do not.
+ *
+ * \code{.cpp}
+ * int count = 0;
+ * InplaceFunction<int(int)> next = [&count](int step) { return count += step; };
+ * next(2);   // 2
+ * \endcode
+ */
+template<typename R, typename... Args, size_t Capacity>
+class InplaceFunction<R(Args...), Capacity> {
+public:
+  InplaceFunction() {}
+  InplaceFunction(std::nullptr_t) {}
+
+  template<typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InplaceFunction>::value>::type>
+  InplaceFunction(F&& target) {
+    typedef typename std::decay<F>::type Target;
+    static_assert(sizeof(Target) <= Capacity, "InplaceFunction: callable is too large, capture by reference or raise INPLACE_FUNCTION_CAPACITY");
+    static_assert(alignof(Target) <= alignof(std::max_align_t), "InplaceFunction: callable is over-aligned");
+    new (_storage) Target(std::forward<F>(target));
+    _ops = opsFor<Target>();
+  }
+
+  InplaceFunction(const InplaceFunction& other) : _ops(other._ops) {
+    if (_ops != nullptr) {
+      _ops->copy(_storage, other._storage);
+    }
+  }
+
+  InplaceFunction(InplaceFunction&& other) noexcept : _ops(other._ops) {
+    if (_ops != nullptr) {
+      _ops->move(_storage, other._storage);
+    }
+  }
+
+  ~InplaceFunction() { clear(); }
+
+  InplaceFunction& operator=(const InplaceFunction& other) {
+    if (this != &other) {
+      clear();
+      if (other._ops != nullptr) {
+        other._ops->copy(_storage, other._storage);
+        _ops = other._ops;
+      }
+    }
+    return *this;
+  }
+
+  InplaceFunction& operator=(InplaceFunction&& other) noexcept {
+    if (this != &other) {
+      clear();
+      if (other._ops != nullptr) {
+        other._ops->move(_storage, other._storage);
+        _ops = other._ops;
+      }
+    }
+    return *this;
+  }
+
+  InplaceFunction& operator=(std::nullptr_t) {
+    clear();
+    return *this;
+  }
+
+  /**
+   * \brief Returns true if a target is stored.
+   */
+  explicit operator bool() const { return _ops != nullptr; }
+
+  /**
+   * \brief Calls the stored target, which must exist.
+   */
+  R operator()(Args... args) const { return _ops->invoke(_storage, std::forward<Args>(args)...); }
+
+private:
+  /**
+   * \brief What a stored target of one type needs done, one static table per type.
+   */
+  struct Ops {
+    R (*invoke)(void* target, Args&&... args);
+    void (*copy)(void* to, const void* from);
+    void (*move)(void* to, void* from);
+    void (*destroy)(void* target);
+  };
+
+  template<typename Target>
+  static const Ops* opsFor() {
+    static const Ops ops = {
+      [](void* target, Args&&... args) -> R { return (*static_cast<Target*>(target))(std::forward<Args>(args)...); },
+      [](void* to, const void* from) { new (to) Target(*static_cast<const Target*>(from)); },
+      [](void* to, void* from) { new (to) Target(std::move(*static_cast<Target*>(from))); },
+      [](void* target) { static_cast<Target*>(target)->~Target(); }
+    };
+    return &ops;
+  }
+
+  void clear() {
+    if (_ops != nullptr) {
+      _ops->destroy(_storage);
+      _ops = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) mutable unsigned char _storage[Capacity];   // The target, constructed in place.
+  const Ops* _ops = nullptr;                                            // Operations on the target, nullptr if empty.
+};
+
+#endif // end of INPLACE_FUNCTION_H
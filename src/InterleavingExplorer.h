@@ -0,0 +1,421 @@
+#if not defined(INTERLEAVING_EXPLORER_H)
+#define INTERLEAVING_EXPLORER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "Emulator.h"
+#include "FiberScheduler.h"
+#include "LogFunctionEmulators.h"
+#include "TimeFunctionEmulators.h"
+#include "Mocks/MockFreeRTOS.h"
+
+/**
+ * \file InterleavingExplorer.h
+ * \brief Systematically explores task interleavings to find races.
+ */
+
+/**
+ * \class ExplorationScenario
+ * \brief One run of the system under test, created afresh for every explored schedule.
+ *
+ * `start()` creates the tasks (with `xTaskCreate()` and friends) on the kernel
+ * the explorer provides. Once every task has finished, or the explored
+ * duration has elapsed, `check()` decides whether the run passed. A task that
+ * throws also fails the run.
+ *
+ * All state the tasks share must live in the scenario object (or be reset by
+ * its constructor), since schedules are explored one after another and, with
+ * more than one worker, in parallel. The same holds for emulators: tasks may
+ * only call mocks the scenario owns. `millis()`, `delay()` and the `log_*()`
+ * stubs are provided fresh for every run by the explorer.
+ */
+class ExplorationScenario {
+public:
+  virtual ~ExplorationScenario() {}
+
+  /**
+   * \brief Creates the tasks of this run.
+   *
+   * \param kernel    RtosKernel& - The kernel tasks are created on. It is also
+   *                  bound as `RtosKernel::current()`.
+   */
+  virtual void start(RtosKernel& kernel) = 0;
+
+  /**
+   * \brief Returns true if the run ended in an acceptable state.
+   */
+  virtual bool check() = 0;
+
+  /**
+   * \brief Returns a hash of the state the tasks share, for pruning.
+   *
+   * Schedules reaching a state seen before (same shared-state hash, same
+   * progress of every task) are not explored further. Returning 0 disables
+   * pruning.
+   */
+  virtual uint64_t stateHash() { return 0; }
+};
+
+/**
+ * \brief Outcome of an exploration.
+ *
+ * \param failed        bool - A schedule failed.
+ * \param schedule      std::vector<uint16_t> - The failing schedule: the index of the
+ *                      fiber chosen at each decision point. Pass it to `replay()`.
+ * \param executions    uint64_t - Schedules run to completion or pruning.
+ * \param pruned        uint64_t - Schedules abandoned at an already explored state.
+ * \param exhausted     bool - Every schedule was explored without reaching the
+ *                      execution or decision limit.
+ */
+struct ExplorationResult {
+  bool failed = false;
+  std::vector<uint16_t> schedule;
+  uint64_t executions = 0;
+  uint64_t pruned = 0;
+  bool exhausted = false;
+
+  /**
+   * \brief Writes a human readable summary, including the failing schedule.
+   *
+   * \param out   std::ostream& - The stream to write to.
+   */
+  void report(std::ostream& out) const {
+    out << "Interleaving exploration: " << executions << " schedules, " << pruned << " pruned, "
+        << (exhausted ? "exhaustive" : "bounded") << std::endl;
+    if (!failed) {
+      out << "  No failing schedule found" << std::endl;
+      return;
+    }
+    out << "  Failing schedule: {";
+    for (size_t i = 0; i < schedule.size(); ++i) {
+      out << ((i == 0) ? "" : ", ") << schedule[i];
+    }
+    out << "}" << std::endl;
+  }
+};
+
+/**
+ * \class InterleavingExplorer
+ * \brief Runs a scenario under every task interleaving, in parallel, to find the one that fails it.
+ *
+ * Tasks run on an RtosKernel whose scheduling decisions are handed to the
+ * explorer. Every `mock()` call a task makes is a scheduling point, as are
+ * FreeRTOS calls and emulated waits, so races between emulated calls are
+ * exposed. At each point any ready task may run next, modelling tasks on two
+ * cores progressing independently; `respectPriorities()` restricts this to the
+ * highest priority ready tasks, as on a single core.
+ *
+ * Schedules are explored depth first. Each run records the alternatives at
+ * its decision points and queues them for the host threads, which share the
+ * work until every schedule within `setMaxDecisions()` has run or one fails.
+ * With `ExplorationScenario::stateHash()` implemented, runs reaching a state
+ * already explored are cut short.
+ *
+ * Every run binds its own millis, delay and log emulators to the host thread,
+ * so runs on different workers never share them. Tasks may only use emulators
+ * owned by the scenario: a global mock would be shared by parallel runs.
+ *
+ * Example:
+ * \code{.cpp}
+ * InterleavingExplorer explorer;
+ * ExplorationResult result = explorer.explore<CounterRace>();
+ * result.report(std::cout);
+ * if (result.failed) {
+ *   explorer.replay<CounterRace>(result.schedule); // deterministic re-run to debug
+ * }
+ * \endcode
+ */
+class InterleavingExplorer {
+public:
+  typedef std::function<std::unique_ptr<ExplorationScenario>()> ScenarioFactory;
+
+  /**
+   * \brief Constructs an explorer.
+   *
+   * \param workers   unsigned - Host threads to explore on, 0 for one per core.
+   */
+  explicit InterleavingExplorer(unsigned workers = 0) {
+    if (workers == 0) {
+      workers = std::thread::hardware_concurrency();
+    }
+    _workers = (workers == 0) ? 1 : workers;
+  }
+  ~InterleavingExplorer() {}
+
+  /**
+   * \brief Limits how many decision points of a run are explored (default 64).
+   *
+   * Later decisions always take the first candidate, and the search is no
+   * longer reported exhaustive.
+   */
+  void setMaxDecisions(size_t decisions) { _maxDecisions = decisions; }
+
+  /**
+   * \brief Limits the number of schedules run (default 1000000).
+   */
+  void setMaxExecutions(uint64_t executions) { _maxExecutions = executions; }
+
+  /**
+   * \brief Sets the virtual time each run lasts at most (default 10000 ms).
+   */
+  void setDuration(uint64_t ms) { _durationMillis = ms; }
+
+  /**
+   * \brief Only lets the highest priority ready tasks be chosen, as on a single core.
+   */
+  void respectPriorities(bool respect = true) { _respectPriorities = respect; }
+
+  /**
+   * \brief Explores schedules of a scenario type until one fails or all have run.
+   *
+   * \tparam Scenario   A default constructible ExplorationScenario.
+   */
+  template<typename Scenario>
+  ExplorationResult explore() {
+    return explore([]() { return std::unique_ptr<ExplorationScenario>(new Scenario()); });
+  }
+
+  /**
+   * \brief Explores schedules of scenarios made by a factory until one fails or all have run.
+   *
+   * \param factory   ScenarioFactory - Makes a fresh scenario for every run.
+   * \return ExplorationResult  The outcome, including any failing schedule.
+   */
+  ExplorationResult explore(ScenarioFactory factory) {
+    Search search;
+    search.pending.push_back({});
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < _workers; ++i) {
+      threads.emplace_back([&]() { work(factory, search); });
+    }
+    work(factory, search);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    ExplorationResult result;
+    result.failed = search.failed;
+    result.schedule = search.failingSchedule;
+    result.executions = search.executions.load();
+    result.pruned = search.pruned.load();
+    result.exhausted = !search.failed && !search.truncated && search.pending.empty();
+    return result;
+  }
+
+  /**
+   * \brief Re-runs one schedule of a scenario type.
+   *
+   * \return bool   true if the scenario passed under that schedule.
+   */
+  template<typename Scenario>
+  bool replay(const std::vector<uint16_t>& schedule) {
+    Scenario scenario;
+    return replay(scenario, schedule);
+  }
+
+  /**
+   * \brief Re-runs one schedule on a given scenario, which can be inspected afterwards.
+   *
+   * \param scenario    ExplorationScenario& - A freshly constructed scenario.
+   * \param schedule    const std::vector<uint16_t>& - The schedule from an ExplorationResult.
+   * \return bool       true if the scenario passed under that schedule.
+   */
+  bool replay(ExplorationScenario& scenario, const std::vector<uint16_t>& schedule) {
+    Run run(schedule);
+    return execute(scenario, run, nullptr);
+  }
+
+private:
+  struct Search {
+    std::mutex mutex;
+    std::vector<std::vector<uint16_t>> pending;   // Schedule prefixes still to run.
+    unsigned busy = 0;                            // Workers running a schedule.
+    bool failed = false;
+    bool truncated = false;                       // Hit the execution or decision limit.
+    std::vector<uint16_t> failingSchedule;
+    std::atomic<uint64_t> executions{0};
+    std::atomic<uint64_t> pruned{0};
+    std::mutex visitedMutex;
+    std::unordered_set<uint64_t> visited;         // Hashes of explored states.
+  };
+
+  struct Run {
+    explicit Run(const std::vector<uint16_t>& prefix) : prefix(prefix) {}
+    const std::vector<uint16_t>& prefix;          // Choices to replay first.
+    std::vector<uint16_t> choices;                // Choices made so far.
+    std::vector<uint16_t> widths;                 // Candidates at each decision.
+    std::vector<size_t> eligible;                 // Scratch list of choosable candidates.
+    bool pruned = false;
+    bool truncated = false;                       // Passed the decision limit with a choice left.
+  };
+
+  void work(ScenarioFactory& factory, Search& search) {
+    while (true) {
+      std::vector<uint16_t> prefix;
+      {
+        std::unique_lock<std::mutex> lock(search.mutex);
+        while (search.pending.empty() && search.busy > 0 && !search.failed) {
+          lock.unlock();
+          std::this_thread::yield();
+          lock.lock();
+        }
+        if (search.pending.empty() || search.failed) {
+          return;
+        }
+        if (search.executions.load() >= _maxExecutions) {
+          search.truncated = true;
+          return;
+        }
+        prefix = std::move(search.pending.back());
+        search.pending.pop_back();
+        ++search.busy;
+      }
+
+      std::unique_ptr<ExplorationScenario> scenario = factory();
+      Run run(prefix);
+      bool passed = execute(*scenario, run, &search);
+      search.executions.fetch_add(1);
+      if (run.pruned) {
+        search.pruned.fetch_add(1);
+      }
+
+      std::lock_guard<std::mutex> lock(search.mutex);
+      --search.busy;
+      if (run.truncated) {
+        search.truncated = true;
+      }
+      if (!passed && !search.failed) {
+        search.failed = true;
+        search.failingSchedule = run.choices;
+      }
+      // Queue the alternatives of every decision this run made beyond its prefix.
+      for (size_t depth = run.choices.size(); depth-- > prefix.size();) {
+        for (uint16_t alternative = run.widths[depth] - 1; alternative > 0; --alternative) {
+          std::vector<uint16_t> next(run.choices.begin(), run.choices.begin() + depth);
+          next.push_back(alternative);
+          search.pending.push_back(std::move(next));
+        }
+      }
+    }
+  }
+
+  /**
+   * \brief Runs a scenario once, following a prefix and then the first candidate.
+   *
+   * \return bool   true if the scenario passed.
+   */
+  bool execute(ExplorationScenario& scenario, Run& run, Search* search) {
+    MillisFunctionEmulator millis;
+    DelayFunctionEmulator delay;
+    LogFunctionEmulators log;
+    millis.setTimeIncrement(0);
+    RtosKernel kernel;
+    FiberScheduler& scheduler = kernel.scheduler();
+    scheduler.setChooser([&](const std::vector<uint32_t>& ready) -> size_t {
+      return choose(scenario, scheduler, ready, run, search);
+    });
+    RtosKernel* previousKernel = RtosKernel::bind(&kernel);
+    MillisFunctionEmulator* previousMillis = MillisFunctionEmulator::bind(&millis);
+    DelayFunctionEmulator* previousDelay = DelayFunctionEmulator::bind(&delay);
+    LogFunctionEmulators* previousLog = LogFunctionEmulators::bind(&log);
+    Emulator::CallHook previousHook = Emulator::bindCallHook(&InterleavingExplorer::schedulingPoint);
+    bool passed = true;
+    try {
+      scenario.start(kernel);
+      kernel.run(_durationMillis);
+      passed = run.pruned || (scheduler.stats().failed == 0 && scenario.check());
+    } catch (...) {
+      passed = false;
+    }
+    Emulator::bindCallHook(previousHook);
+    LogFunctionEmulators::bind(previousLog);
+    DelayFunctionEmulator::bind(previousDelay);
+    MillisFunctionEmulator::bind(previousMillis);
+    RtosKernel::bind(previousKernel);
+    return passed;
+  }
+
+  size_t choose(ExplorationScenario& scenario, FiberScheduler& scheduler, const std::vector<uint32_t>& ready, Run& run, Search* search) {
+    // Candidates the schedule may pick from, in a stable order.
+    run.eligible.clear();
+    unsigned top = 0;
+    for (uint32_t id : ready) {
+      top = (scheduler.priority(id) > top) ? scheduler.priority(id) : top;
+    }
+    for (size_t i = 0; i < ready.size(); ++i) {
+      if (!_respectPriorities || scheduler.priority(ready[i]) == top) {
+        run.eligible.push_back(i);
+      }
+    }
+    size_t depth = run.choices.size();
+    if (run.eligible.size() == 1) {
+      return run.eligible[0];
+    }
+    if (depth >= _maxDecisions) {
+      run.truncated = true;
+      return run.eligible[0];
+    }
+
+    if (search != nullptr && depth >= run.prefix.size()) {
+      uint64_t shared = scenario.stateHash();
+      if (shared != 0 && !firstVisit(*search, stateOf(shared, scheduler))) {
+        run.pruned = true;
+        scheduler.stop();
+        return run.eligible[0];
+      }
+    }
+    uint16_t choice = (depth < run.prefix.size()) ? run.prefix[depth] : 0;
+    if (choice >= run.eligible.size()) {
+      choice = 0;
+    }
+    run.choices.push_back(choice);
+    run.widths.push_back((uint16_t)run.eligible.size());
+    return run.eligible[choice];
+  }
+
+  /**
+   * \brief Hashes the shared state with how far every task has progressed.
+   */
+  static uint64_t stateOf(uint64_t shared, FiberScheduler& scheduler) {
+    uint64_t hash = shared ^ 0x9E3779B97F4A7C15ULL;
+    auto mix = [&hash](uint64_t value) {
+      hash ^= value + 0x9E3779B97F4A7C15ULL + (hash << 6) + (hash >> 2);
+    };
+    for (uint32_t id = 0; id < scheduler.stats().fibers; ++id) {
+      mix(scheduler.resumes(id));
+      mix(scheduler.finished(id) ? 1 : 0);
+    }
+    mix(scheduler.clock().nowMicros());
+    return hash;
+  }
+
+  static bool firstVisit(Search& search, uint64_t state) {
+    std::lock_guard<std::mutex> lock(search.visitedMutex);
+    return search.visited.insert(state).second;
+  }
+
+  /**
+   * \brief Makes every mocked call a task makes a point where another task may run.
+   */
+  static void schedulingPoint(Emulator&, const std::string&) {
+    FiberScheduler* scheduler = FiberScheduler::current();
+    if (scheduler != nullptr) {
+      scheduler->yield();
+    }
+  }
+
+  unsigned _workers = 1;
+  size_t _maxDecisions = 64;
+  uint64_t _maxExecutions = 1000000;
+  uint64_t _durationMillis = 10000;
+  bool _respectPriorities = false;
+};
+
+#endif // end of INTERLEAVING_EXPLORER_H
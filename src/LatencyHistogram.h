@@ -0,0 +1,228 @@
+#if not defined(LATENCY_HISTOGRAM_H)
+#define LATENCY_HISTOGRAM_H
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+#if not defined(LATENCY_HISTOGRAM_SUB_BITS)
+#define LATENCY_HISTOGRAM_SUB_BITS    (4)
+#endif
+
+#if not defined(LATENCY_HISTOGRAM_MAGNITUDES)
+#define LATENCY_HISTOGRAM_MAGNITUDES  (40)
+#endif
+
+/**
+ * \class LatencyHistogram
+ * \brief A fixed size, log-linear histogram of durations in the style of HdrHistogram.
+ *
+ * Values are bucketed by their highest set bit and then linearly by the next
+ * LATENCY_HISTOGRAM_SUB_BITS bits, so every recorded value is kept to within
+ * 1 / 2^LATENCY_HISTOGRAM_SUB_BITS of itself (about 6% by default) across the
+ * whole range. Buckets live inline in the object: recording is a handful of
+ * integer operations and never allocates. Values beyond the last magnitude
+ * (2^43 by default) are counted in the last bucket.
+ *
+ * Example:
+ * \code{.cpp}
+ * LatencyHistogram histogram;
+ * histogram.record(1250);
+ * uint64_t p99 = histogram.percentile(99.0);
+ * \endcode
+ */
+class LatencyHistogram {
+public:
+  static const unsigned kSubBits = LATENCY_HISTOGRAM_SUB_BITS;
+  static const unsigned kSubBuckets = 1u << kSubBits;
+  static const unsigned kBuckets = (LATENCY_HISTOGRAM_MAGNITUDES + 1) * kSubBuckets;
+
+  LatencyHistogram() { reset(); }
+  ~LatencyHistogram() {}
+
+  /**
+   * \brief Counts one value.
+   *
+   * \param value   uint64_t - The value, in whatever unit the histogram holds.
+   */
+  void record(uint64_t value) {
+    ++_counts[bucketOf(value)];
+    ++_count;
+    _sum += value;
+    if (value < _min) {
+      _min = value;
+    }
+    if (value > _max) {
+      _max = value;
+    }
+  }
+
+  /**
+   * \brief Adds every value counted by another histogram.
+   *
+   * \param other   const LatencyHistogram& - The histogram to add.
+   */
+  void merge(const LatencyHistogram& other) {
+    for (unsigned i = 0; i < kBuckets; ++i) {
+      _counts[i] += other._counts[i];
+    }
+    _count += other._count;
+    _sum += other._sum;
+    if (other._min < _min) {
+      _min = other._min;
+    }
+    if (other._max > _max) {
+      _max = other._max;
+    }
+  }
+
+  /**
+   * \brief Forgets every value counted.
+   */
+  void reset() {
+    memset(_counts, 0, sizeof(_counts));
+    _count = 0;
+    _sum = 0;
+    _min = UINT64_MAX;
+    _max = 0;
+  }
+
+  /**
+   * \brief Returns the number of values counted.
+   */
+  uint64_t count() const { return _count; }
+
+  /**
+   * \brief Returns the smallest value counted, or 0 if none were.
+   */
+  uint64_t min() const { return (_count == 0) ? 0 : _min; }
+
+  /**
+   * \brief Returns the largest value counted.
+   */
+  uint64_t max() const { return _max; }
+
+  /**
+   * \brief Returns the sum of the values counted.
+   */
+  uint64_t sum() const { return _sum; }
+
+  /**
+   * \brief Returns how many values fell in a bucket, for exporting histograms losslessly.
+   *
+   * \param index   unsigned - The bucket, below kBuckets.
+   */
+  uint64_t bucket(unsigned index) const { return _counts[index]; }
+
+  /**
+   * \brief Returns the exact mean of the values counted.
+   */
+  double mean() const { return (_count == 0) ? 0.0 : (double)_sum / (double)_count; }
+
+  /**
+   * \brief Returns the value below which a percentage of the counted values fall.
+   *
+   * \param percent   double - The percentile, from 0 to 100.
+   * \return uint64_t  The highest value of the bucket holding that percentile,
+   *                   clamped to the observed minimum and maximum.
+   */
+  uint64_t percentile(double percent) const {
+    if (_count == 0) {
+      return 0;
+    }
+    uint64_t rank = (uint64_t)((percent / 100.0) * (double)_count + 0.5);
+    if (rank < 1) {
+      rank = 1;
+    }
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < kBuckets; ++i) {
+      seen += _counts[i];
+      if (seen >= rank) {
+        uint64_t value = highestOf(i);
+        return (value < _min) ? _min : ((value > _max) ? _max : value);
+      }
+    }
+    return _max;
+  }
+
+  /**
+   * \brief Writes a one line summary: count, mean and percentiles.
+   *
+   * \param out     std::ostream& - The stream to write to.
+   * \param unit    const char* - Unit appended to every value.
+   */
+  void report(std::ostream& out, const char* unit = "ns") const {
+    out << "n=" << _count;
+    if (_count == 0) {
+      return;
+    }
+    out << " min=" << min() << unit << " mean=" << (uint64_t)mean() << unit
+        << " p50=" << percentile(50.0) << unit << " p90=" << percentile(90.0) << unit
+        << " p99=" << percentile(99.0) << unit << " max=" << _max << unit;
+  }
+
+private:
+  /**
+   * \brief Maps a value to its bucket: values below kSubBuckets map to
+   * themselves, larger ones to their magnitude and next kSubBits bits.
+   */
+  static unsigned bucketOf(uint64_t value) {
+    if (value < kSubBuckets) {
+      return (unsigned)value;
+    }
+    unsigned magnitude = 63 - (unsigned)__builtin_clzll(value);
+    unsigned sub = (unsigned)(value >> (magnitude - kSubBits)) - kSubBuckets;
+    unsigned bucket = (magnitude - kSubBits + 1) * kSubBuckets + sub;
+    return (bucket < kBuckets) ? bucket : kBuckets - 1;
+  }
+
+  /**
+   * \brief Returns the largest value that maps to a bucket.
+   */
+  static uint64_t highestOf(unsigned bucket) {
+    if (bucket < kSubBuckets) {
+      return bucket;
+    }
+    unsigned magnitude = bucket / kSubBuckets + kSubBits - 1;
+    uint64_t sub = bucket % kSubBuckets + kSubBuckets;
+    return ((sub + 1) << (magnitude - kSubBits)) - 1;
+  }
+
+  uint64_t _counts[kBuckets];   // Values counted per bucket.
+  uint64_t _count = 0;          // Values counted in total.
+  uint64_t _sum = 0;            // Sum of every value, for an exact mean.
+  uint64_t _min = UINT64_MAX;   // Smallest value counted.
+  uint64_t _max = 0;            // Largest value counted.
+};
+
+/**
+ * \brief Timing histograms kept for a mocked method when EMULATOR_HISTOGRAMS is defined.
+ *
+ * \param wall      LatencyHistogram - Host nanoseconds spent inside each call.
+ * \param emulated  LatencyHistogram - Virtual microseconds each call took on the emulated device.
+ * \param between   LatencyHistogram - Host nanoseconds the firmware ran, on the same
+ *                  thread, between the previous mocked call returning and this one.
+ */
+struct MethodLatency {
+  LatencyHistogram wall;
+  LatencyHistogram emulated;
+  LatencyHistogram between;
+
+  /**
+   * \brief Writes one line per histogram, each prefixed by an indent.
+   *
+   * \param out       std::ostream& - The stream to write to.
+   * \param indent    const char* - Text written before each line.
+   */
+  void report(std::ostream& out, const char* indent = "  ") const {
+    out << indent << "Wall time in call: ";
+    wall.report(out, "ns");
+    out << std::endl << indent << "Emulated time in call: ";
+    emulated.report(out, "us");
+    out << std::endl << indent << "Firmware time before call: ";
+    between.report(out, "ns");
+    out << std::endl;
+  }
+};
+
+#endif // end of LATENCY_HISTOGRAM_H
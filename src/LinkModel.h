@@ -0,0 +1,350 @@
+#if not defined(LINK_MODEL_H)
+#define LINK_MODEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include "SeededRandom.h"
+#include "VirtualClock.h"
+
+/**
+ * \file LinkModel.h
+ * \brief Emulates the throughput and timing of a constrained network link.
+ */
+
+/**
+ * \brief Shape of the latency distribution of a LinkModel.
+ *
+ * - LATENCY_FIXED:   every sample equals the configured latency.
+ * - LATENCY_UNIFORM: latency +/- jitter, uniformly distributed.
+ * - LATENCY_NORMAL:  normally distributed around latency with jitter as standard deviation.
+ * - LATENCY_PARETO:  heavy tailed with latency as the minimum, jitter widens the tail.
+ */
+enum LatencyDistribution {
+  LATENCY_FIXED,
+  LATENCY_UNIFORM,
+  LATENCY_NORMAL,
+  LATENCY_PARETO,
+};
+
+/**
+ * \brief Configuration of an emulated network link.
+ *
+ * \param bandwidth       uint32_t - Throughput in bits per second, 0 for unlimited.
+ * \param latency         unsigned long - One-way latency in milliseconds.
+ * \param jitter          unsigned long - Spread of the latency in milliseconds.
+ * \param distribution    LatencyDistribution - How latency samples are distributed.
+ * \param dropRate        double - Probability a transfer is lost and must be retransmitted.
+ * \param resetRate       double - Probability a transfer resets the connection.
+ * \param retransmit      unsigned long - Milliseconds lost to each retransmission.
+ */
+struct LinkProfile {
+  uint32_t bandwidth = 0;
+  unsigned long latency = 0;
+  unsigned long jitter = 0;
+  LatencyDistribution distribution = LATENCY_NORMAL;
+  double dropRate = 0.0;
+  double resetRate = 0.0;
+  unsigned long retransmit = 1000;
+};
+
+/**
+ * \brief Counters accumulated by a LinkModel.
+ *
+ * \param bytesSent       uint64_t - Bytes delivered by writes.
+ * \param bytesReceived   uint64_t - Bytes delivered by reads.
+ * \param transfers       uint64_t - Number of metered reads and writes.
+ * \param drops           uint64_t - Transfers that had to be retransmitted.
+ * \param resets          uint64_t - Transfers that reset the connection.
+ * \param blockedMicros   uint64_t - Virtual time the caller spent blocked on the link.
+ * \param firstMicros     uint64_t - Virtual time of the first transfer.
+ * \param lastMicros      uint64_t - Virtual time at which the last transfer completed.
+ */
+struct LinkStats {
+  uint64_t bytesSent = 0;
+  uint64_t bytesReceived = 0;
+  uint64_t transfers = 0;
+  uint64_t drops = 0;
+  uint64_t resets = 0;
+  uint64_t blockedMicros = 0;
+  uint64_t firstMicros = 0;
+  uint64_t lastMicros = 0;
+
+  /**
+   * \brief Returns the achieved goodput in bytes per second of virtual time.
+   */
+  double goodput() const {
+    uint64_t span = lastMicros - firstMicros;
+    if (span == 0) {
+      return 0.0;
+    }
+    return (double)(bytesSent + bytesReceived) * 1000000.0 / (double)span;
+  }
+};
+
+/**
+ * \class LinkModel
+ * \brief Meters byte flow through a mocked client according to a LinkProfile.
+ *
+ * Every metered write costs its serialisation time at the configured bandwidth.
+ * The first read after a write additionally waits one latency sample, modelling
+ * the request/response turnaround, and later reads cost serialisation only.
+ * Transfers may be dropped (charged a retransmission) or reset the connection
+ * (delivering nothing) with the configured probabilities. All costs are charged
+ * to the current VirtualClock and drawn from a seeded generator, so a run is
+ * reproducible from its seed.
+ *
+ * Example:
+ * \code{.cpp}
+ * LinkProfile gprs;
+ * gprs.bandwidth = 40000;
+ * gprs.latency = 600;
+ * gprs.jitter = 250;
+ * LinkModel link(gprs, 1234);
+ * mockClient.attachLink(link);
+ * // ... exercise the firmware
+ * link.report(std::cout);
+ * \endcode
+ */
+class LinkModel {
+public:
+  /**
+   * \brief Constructs a link.
+   *
+   * \param profile   LinkProfile - The link characteristics.
+   * \param seed      uint64_t - Seed for latency, drop and reset sampling.
+   */
+  explicit LinkModel(LinkProfile profile = LinkProfile(), uint64_t seed = 1) : _profile(profile), _random(seed) {}
+  ~LinkModel() {}
+
+  /**
+   * \brief Replaces the link characteristics, keeping the accumulated statistics.
+   */
+  void configure(LinkProfile profile) { _profile = profile; }
+
+  /**
+   * \brief Returns the current link characteristics.
+   */
+  const LinkProfile& profile() const { return _profile; }
+
+  /**
+   * \brief Meters a connection handshake, costing one round trip.
+   *
+   * \return bool   false if the handshake reset, true otherwise.
+   */
+  bool open() {
+    _reset = false;
+    _awaitingResponse = false;
+    uint64_t cost = 2 * sampleLatency();
+    if (_random.chance(_profile.resetRate)) {
+      charge(cost);
+      ++_stats.resets;
+      _reset = true;
+      return false;
+    }
+    charge(cost);
+    return true;
+  }
+
+  /**
+   * \brief Meters bytes written to the link.
+   *
+   * \param bytes     size_t - The number of bytes the caller is writing.
+   * \return size_t   The number of bytes delivered, 0 if the connection reset.
+   */
+  size_t send(size_t bytes) {
+    if (!admit(bytes)) {
+      return 0;
+    }
+    _stats.bytesSent += bytes;
+    _awaitingResponse = true;
+    return bytes;
+  }
+
+  /**
+   * \brief Meters bytes read from the link.
+   *
+   * \param bytes     size_t - The number of bytes the caller is reading.
+   * \return size_t   The number of bytes delivered, 0 if the connection reset.
+   */
+  size_t receive(size_t bytes) {
+    if (_awaitingResponse) {
+      _awaitingResponse = false;
+      charge(sampleLatency());
+    }
+    if (!admit(bytes)) {
+      return 0;
+    }
+    _stats.bytesReceived += bytes;
+    return bytes;
+  }
+
+  /**
+   * \brief Returns true once a transfer has reset the connection, until `open()` is called.
+   */
+  bool isReset() const { return _reset; }
+
+  /**
+   * \brief Returns the accumulated statistics.
+   */
+  const LinkStats& stats() const { return _stats; }
+
+  /**
+   * \brief Returns the seed the link was constructed with, for reproducing a run.
+   */
+  uint64_t seed() const { return _random.seed(); }
+
+  /**
+   * \brief Clears statistics and connection state and restarts the random sequence.
+   */
+  void reset() {
+    _stats = LinkStats();
+    _started = false;
+    _reset = false;
+    _awaitingResponse = false;
+    _random.reseed(_random.seed());
+  }
+
+  /**
+   * \brief Writes a human readable summary of the link's statistics.
+   *
+   * \param out   std::ostream& - The stream to write to.
+   */
+  void report(std::ostream& out) const {
+    double span = (double)(_stats.lastMicros - _stats.firstMicros) / 1000.0;
+    out << "Link report (seed " << seed() << ")" << std::endl;
+    out << "  Bytes sent / received: " << _stats.bytesSent << " / " << _stats.bytesReceived << std::endl;
+    out << "  Transfers: " << _stats.transfers << ", drops: " << _stats.drops << ", resets: " << _stats.resets << std::endl;
+    out << "  Active span: " << span << " ms, blocked: " << (double)_stats.blockedMicros / 1000.0 << " ms" << std::endl;
+    out << "  Goodput: " << _stats.goodput() << " B/s" << std::endl;
+  }
+
+private:
+  static const int kMaxRetransmits = 8;
+
+  /**
+   * \brief Charges serialisation, drops and resets for a transfer.
+   */
+  bool admit(size_t bytes) {
+    if (_reset) {
+      return false;
+    }
+    ++_stats.transfers;
+    uint64_t cost = serialise(bytes);
+    if (_random.chance(_profile.resetRate)) {
+      charge(cost / 2);
+      ++_stats.resets;
+      _reset = true;
+      return false;
+    }
+    int attempts = 0;
+    while (_random.chance(_profile.dropRate)) {
+      ++_stats.drops;
+      cost += (uint64_t)_profile.retransmit * 1000;
+      if (++attempts == kMaxRetransmits) {
+        // Give up like a TCP stack would after repeated loss.
+        charge(cost);
+        ++_stats.resets;
+        _reset = true;
+        return false;
+      }
+    }
+    charge(cost);
+    return true;
+  }
+
+  uint64_t serialise(size_t bytes) const {
+    if (_profile.bandwidth == 0) {
+      return 0;
+    }
+    return (uint64_t)bytes * 8 * 1000000 / _profile.bandwidth;
+  }
+
+  uint64_t sampleLatency() {
+    double latency = (double)_profile.latency;
+    double jitter = (double)_profile.jitter;
+    double sample = latency;
+    switch (_profile.distribution) {
+      case LATENCY_FIXED:
+        break;
+      case LATENCY_UNIFORM:
+        sample = latency - jitter + 2.0 * jitter * _random.uniform();
+        break;
+      case LATENCY_NORMAL:
+        sample = _random.normal(latency, jitter);
+        break;
+      case LATENCY_PARETO:
+        sample = (latency > 0.0) ? _random.pareto(latency, 1.0 + latency / (jitter + 1.0)) : 0.0;
+        break;
+    }
+    return (sample > 0.0) ? (uint64_t)(sample * 1000.0) : 0;
+  }
+
+  void charge(uint64_t micros) {
+    if (!_started) {
+      _started = true;
+      _stats.firstMicros = VirtualClock::current().nowMicros();
+    }
+    VirtualClock::wait(micros);
+    _stats.blockedMicros += micros;
+    _stats.lastMicros = VirtualClock::current().nowMicros();
+  }
+
+  LinkProfile _profile;
+  SeededRandom _random;
+  LinkStats _stats;
+  bool _started = false;          // Whether firstMicros has been recorded.
+  bool _reset = false;            // A transfer reset the connection.
+  bool _awaitingResponse = false; // A write has happened since the last read.
+};
+
+/**
+ * \class Linkable
+ * \brief Mixin letting a mocked client route its byte flow through a LinkModel.
+ *
+ * Mocks inherit from Linkable and pass the byte counts of their reads and
+ * writes through `meterWrite()` / `meterRead()`. With no link attached the
+ * counts pass through unchanged.
+ */
+class Linkable {
+public:
+  /**
+   * \brief Meters this client's traffic through a link.
+   *
+   * \param link    LinkModel& - The link, which must outlive the attachment.
+   */
+  void attachLink(LinkModel& link) { _link = &link; }
+
+  /**
+   * \brief Stops metering this client's traffic.
+   */
+  void detachLink() { _link = nullptr; }
+
+  /**
+   * \brief Returns the attached link, or nullptr.
+   */
+  LinkModel* link() const { return _link; }
+
+protected:
+  size_t meterWrite(size_t bytes) { return (_link == nullptr) ? bytes : _link->send(bytes); }
+
+  int meterRead(int bytes) {
+    if (_link == nullptr || bytes <= 0) {
+      return bytes;
+    }
+    return (_link->receive((size_t)bytes) == 0) ? -1 : bytes;
+  }
+
+  bool meterConnect(bool connected) {
+    if (_link == nullptr || !connected) {
+      return connected;
+    }
+    return _link->open();
+  }
+
+  bool linkIsReset() const { return _link != nullptr && _link->isReset(); }
+
+  LinkModel* _link = nullptr; // The link traffic is metered through, if any.
+};
+
+#endif // end of LINK_MODEL_H
@@ -0,0 +1,47 @@
+#if not defined(__LOG_FUNCTION_EMULATORS_H__)
+#define __LOG_FUNCTION_EMULATORS_H__
+
+#include "FunctionEmulator.h"
+
+/**
+ * \class LogFunctionEmulators
+ * \brief The emulators behind the `log_d()`, `log_i()`, `log_w()`, `log_e()` and `log_v()` stubs.
+ *
+ * The stubs record into the global `log_*_stub` emulators unless a set of
+ * these is bound to the calling thread, the way Fleet binds each device's
+ * millis and delay emulators, so devices running on parallel host threads
+ * log into emulators of their own.
+ */
+class LogFunctionEmulators {
+public:
+	LogFunctionEmulators() : debug("log_d"), info("log_i"), warning("log_w"), error("log_e"), verbose("log_v") {}
+	~LogFunctionEmulators() {}
+
+	FunctionEmulator debug;   // Behind log_d().
+	FunctionEmulator info;    // Behind log_i().
+	FunctionEmulator warning; // Behind log_w().
+	FunctionEmulator error;   // Behind log_e().
+	FunctionEmulator verbose; // Behind log_v().
+
+    /**
+     * \brief Binds a set of log emulators to the calling thread.
+     *
+     * \param emulators The emulators the log stubs should use, or nullptr for the global ones.
+     * \return The previously bound set, so callers can restore it.
+     */
+	static LogFunctionEmulators* bind(LogFunctionEmulators* emulators) {
+		LogFunctionEmulators* previous = bound();
+		bound() = emulators;
+		return previous;
+	}
+
+    /**
+     * \brief Returns the set bound to the calling thread, or nullptr if none is.
+     */
+	static LogFunctionEmulators*& bound() {
+		thread_local LogFunctionEmulators* emulators = nullptr;
+		return emulators;
+	}
+};
+
+#endif // end of __LOG_FUNCTION_EMULATORS_H__
@@ -1,66 +1,334 @@
 #ifndef METHOD_LOG_H
 #define METHOD_LOG_H
 
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
 #include <vector>
 #include "MethodProfile.h"
 
 using namespace std;
 
+#if not defined(METHOD_LOG_BUFFER)
+#define METHOD_LOG_BUFFER   (64 * 1024)
+#endif
+
+#define METHOD_LOG_MAGIC    "EMLG"
+#define METHOD_LOG_VERSION  (1)
+
 /**
  * \brief Provides logging functionality for method invocation profiles.
  *
- * The `MethodLog` class is utilized to log information about how mocked 
- * methods have been called during tests. It captures details such as 
- * the number of times a method has been invoked and the set of return 
- * values associated with each method.
- * 
- * Usage:
- * 1. Create an instance of `MethodLog`.
- * 2. After the test run, call `dumpMethodProfiles` to generate a log 
- *    detailing the invocation profile of each mocked method.
- * 
+ * The `MethodLog` class is utilized to log information about how mocked
+ * methods have been called during tests. It captures details such as
+ * the number of times a method has been invoked, how many of its configured
+ * return values were consumed, how many calls threw and, when built with
+ * EMULATOR_HISTOGRAMS, how long the calls took.
+ *
+ * A log is opened once and streamed to: every `write()` appends the profiles
+ * of one test through a METHOD_LOG_BUFFER byte buffer, so exporting thousands
+ * of tests costs one file open and a few large writes. Four formats are
+ * supported:
+ * - Text: one human readable line per method, as `dumpMethodProfiles` has always written.
+ * - Json: a single array of objects, one per method per test.
+ * - Csv: a header row followed by one row per method per test.
+ * - Binary: a compact little-endian record stream, with histograms stored
+ *   bucket by bucket so `scripts/logmerge.py` can aggregate many files exactly.
+ *
  * Example:
  * \code{.cpp}
- * MethodLog logger;
+ * MethodLog log("profiles.json", MethodLog::Json);
  * // ... [Tests and mocks run here]
- * logger.dumpMethodProfiles(myMethodList, "myTestMethodProfile");
+ * log.write(client.methods(), "test_upload");
+ * log.close();
  * \endcode
- * 
- * This will produce a file named `myTestMethodProfile.log` that contains 
- * information on how each method in `myMethodList` was invoked.
- * 
- * \note Ensure that the log file is closed appropriately or data may 
- * not be written as expected.
+ *
+ * \note The log is completed when it is closed or destroyed. A Json log that
+ * is never closed lacks its closing bracket.
  */
 class MethodLog {
 public:
+  /**
+   * \brief Output formats, see the class description.
+   */
+  enum Format { Text, Json, Csv, Binary };
+
   ofstream _file;
 
   MethodLog() {}
-  ~MethodLog() {}
+
+  /**
+   * \brief Constructs a log and opens it, see `open()`.
+   */
+  MethodLog(const char * path, Format format) { open(path, format); }
+
+  ~MethodLog() { close(); }
+
+  /**
+   * \brief Opens a log for writing, replacing any existing file.
+   *
+   * \param path      const char* - The file to write.
+   * \param format    Format - The format to write in.
+   * \return bool     true if the file could be opened.
+   */
+  bool open(const char * path, Format format) {
+    close();
+    _buffer.resize(METHOD_LOG_BUFFER);
+    _file.rdbuf()->pubsetbuf(_buffer.data(), _buffer.size());
+    _file.open(path, (format == Binary) ? ios::out | ios::trunc | ios::binary : ios::out | ios::trunc);
+    if (!_file.is_open()) {
+      return false;
+    }
+    _format = format;
+    _records = 0;
+    writeHeader();
+    return true;
+  }
+
+  /**
+   * \brief Appends the profiles of every method of one test.
+   *
+   * \param _methods   const MethodProfiles& - The methods, typically an emulator's `methods()`.
+   * \param test       const char* - The test the profiles belong to, may be empty.
+   */
+  void write(const MethodProfiles& _methods, const char * test = "") {
+    if (!_file.is_open()) {
+      return;
+    }
+    for (const auto& method : _methods) {
+      _record.clear();
+      switch (_format) {
+        case Text:   formatText(method); break;
+        case Json:   formatJson(method, test); break;
+        case Csv:    formatCsv(method, test); break;
+        case Binary: formatBinary(method, test); break;
+      }
+      _file.write(_record.data(), _record.size());
+      ++_records;
+    }
+  }
+
+  /**
+   * \brief Completes the log and closes it. Called by the destructor.
+   */
+  void close() {
+    if (!_file.is_open()) {
+      return;
+    }
+    if (_format == Json) {
+      _file << ((_records == 0) ? "]" : "\n]") << '\n';
+    }
+    _file.close();
+  }
+
+  /**
+   * \brief Returns the number of method records written since the log was opened.
+   */
+  uint64_t records() const { return _records; }
 
   /**
    * \brief Dumps the method invocation profiles to a log file.
    *
    * Generates a detailed log file with information on method invocations,
    * such as the number of times they were invoked and their associated return values.
-   * 
-   * \param _methods   vector<MethodProfile> - List of methods with their associated invocation profiles.
+   * The file is opened as a Text log by the first call; later calls append to it.
+   *
+   * \param _methods   const MethodProfiles& - List of methods with their associated invocation profiles.
    * \param filename   const char* - Name of the log file to be generated (without the .log extension).
    */
-  void dumpMethodProfiles(vector<MethodProfile> _methods, const char * filename="method") {
-    std::string fileName = std::string(filename) + ".log";
-    _file.open(fileName.c_str());
-    for (auto method_It = _methods.begin(); method_It != _methods.end(); ++method_It) {
-      std::string time = (method_It->invoked == 1) ? "time" : "times"; 
-      _file << "Method: " << method_It->methodName << "() [invoked " << method_It->invoked << " " << time << "] ";
-      size_t nRetVals = method_It->then.size() + 1;
-      std::string value = (nRetVals == 1) ? "value" : "values"; 
-      _file << "with " << nRetVals << " return " << value << endl;
+  void dumpMethodProfiles(const MethodProfiles& _methods, const char * filename="method") {
+    if (!_file.is_open()) {
+      std::string fileName = std::string(filename) + ".log";
+      open(fileName.c_str(), Text);
+    }
+    write(_methods);
+  }
+
+private:
+  /**
+   * \brief Returns how many configured return values the method never returned.
+   */
+  static uint64_t unconsumed(const MethodProfile& method) {
+    uint64_t remaining = 0;
+    for (size_t i = 0; i < retValCount(method); ++i) {
+      remaining += retValReturned(method, i) ? 0 : 1;
+    }
+    return remaining;
+  }
+
+  void writeHeader() {
+    switch (_format) {
+      case Json:
+        _file << "[";
+        break;
+      case Csv:
+        _file << "test,method,invoked,consumed,unconsumed,thrown,delay_ms";
+#ifdef EMULATOR_HISTOGRAMS
+        _file << ",wall_mean_ns,wall_p50_ns,wall_p99_ns,wall_max_ns"
+              << ",emulated_mean_us,emulated_p99_us,between_mean_ns,between_p99_ns";
+#endif
+        _file << '\n';
+        break;
+      case Binary: {
+        _record.assign(METHOD_LOG_MAGIC, 4);
+        appendInt(METHOD_LOG_VERSION, 2);
+#ifdef EMULATOR_HISTOGRAMS
+        appendInt(LatencyHistogram::kSubBits, 2);
+        appendInt(LatencyHistogram::kBuckets, 4);
+#else
+        appendInt(0, 2);
+        appendInt(0, 4);
+#endif
+        _file.write(_record.data(), _record.size());
+        break;
+      }
+      case Text:
+        break;
+    }
+  }
+
+  void formatText(const MethodProfile& method) {
+    std::string time = (method.invoked == 1) ? "time" : "times";
+    _record += "Method: " + std::string(method.methodName) + "(" + std::string(method.args) + ") [invoked " + std::to_string(method.invoked) + " " + time + "] ";
+    size_t nRetVals = retValCount(method);
+    std::string value = (nRetVals == 1) ? "value" : "values";
+    _record += "with " + std::to_string(nRetVals) + " return " + value;
+    if (method.thrown > 0) {
+      _record += ", threw " + std::to_string(method.thrown);
     }
+    _record += '\n';
+#ifdef EMULATOR_HISTOGRAMS
+    std::ostringstream latency;
+    method.latency.report(latency);
+    _record += latency.str();
+#endif
+  }
+
+  void formatJson(const MethodProfile& method, const char * test) {
+    _record += (_records == 0) ? "\n  {" : ",\n  {";
+    _record += "\"test\": ";
+    appendQuoted(test, '"');
+    _record += ", \"method\": ";
+    appendQuoted(method.methodName, '"');
+    _record += ", \"invoked\": " + std::to_string(method.invoked);
+    _record += ", \"consumed\": " + std::to_string(method.consumed);
+    _record += ", \"unconsumed\": " + std::to_string(unconsumed(method));
+    _record += ", \"thrown\": " + std::to_string(method.thrown);
+    _record += ", \"delay_ms\": " + std::to_string(method.delay);
+#ifdef EMULATOR_HISTOGRAMS
+    appendJsonHistogram("wall_ns", method.latency.wall);
+    appendJsonHistogram("emulated_us", method.latency.emulated);
+    appendJsonHistogram("between_ns", method.latency.between);
+#endif
+    _record += "}";
+  }
+
+  void formatCsv(const MethodProfile& method, const char * test) {
+    appendQuoted(test, '"');
+    _record += ',';
+    appendQuoted(method.methodName, '"');
+    _record += ',' + std::to_string(method.invoked) + ',' + std::to_string(method.consumed)
+             + ',' + std::to_string(unconsumed(method)) + ',' + std::to_string(method.thrown)
+             + ',' + std::to_string(method.delay);
+#ifdef EMULATOR_HISTOGRAMS
+    const MethodLatency& latency = method.latency;
+    _record += ',' + std::to_string((uint64_t)latency.wall.mean()) + ',' + std::to_string(latency.wall.percentile(50.0))
+             + ',' + std::to_string(latency.wall.percentile(99.0)) + ',' + std::to_string(latency.wall.max())
+             + ',' + std::to_string((uint64_t)latency.emulated.mean()) + ',' + std::to_string(latency.emulated.percentile(99.0))
+             + ',' + std::to_string((uint64_t)latency.between.mean()) + ',' + std::to_string(latency.between.percentile(99.0));
+#endif
+    _record += '\n';
   }
+
+  /**
+   * \brief Appends one binary record.
+   *
+   * Layout: u16 test length, test, u16 method length, method, u64 invoked,
+   * consumed, unconsumed, thrown and delay_ms, u8 histogram count, then per
+   * histogram u64 count, sum, min and max, u32 non-empty buckets and that
+   * many (u32 bucket, u64 count) pairs.
+   */
+  void formatBinary(const MethodProfile& method, const char * test) {
+    std::string testName(test);
+    appendInt(testName.size(), 2);
+    _record += testName;
+    appendInt(method.methodName.size(), 2);
+    _record += method.methodName;
+    appendInt((uint64_t)method.invoked, 8);
+    appendInt((uint64_t)method.consumed, 8);
+    appendInt(unconsumed(method), 8);
+    appendInt((uint64_t)method.thrown, 8);
+    appendInt((uint64_t)method.delay, 8);
+#ifdef EMULATOR_HISTOGRAMS
+    appendInt(3, 1);
+    appendBinaryHistogram(method.latency.wall);
+    appendBinaryHistogram(method.latency.emulated);
+    appendBinaryHistogram(method.latency.between);
+#else
+    appendInt(0, 1);
+#endif
+  }
+
+#ifdef EMULATOR_HISTOGRAMS
+  void appendJsonHistogram(const char * name, const LatencyHistogram& histogram) {
+    _record += std::string(", \"") + name + "\": {\"count\": " + std::to_string(histogram.count())
+             + ", \"min\": " + std::to_string(histogram.min()) + ", \"mean\": " + std::to_string((uint64_t)histogram.mean())
+             + ", \"p50\": " + std::to_string(histogram.percentile(50.0)) + ", \"p90\": " + std::to_string(histogram.percentile(90.0))
+             + ", \"p99\": " + std::to_string(histogram.percentile(99.0)) + ", \"max\": " + std::to_string(histogram.max()) + "}";
+  }
+
+  void appendBinaryHistogram(const LatencyHistogram& histogram) {
+    appendInt(histogram.count(), 8);
+    appendInt(histogram.sum(), 8);
+    appendInt(histogram.min(), 8);
+    appendInt(histogram.max(), 8);
+    uint32_t used = 0;
+    for (unsigned i = 0; i < LatencyHistogram::kBuckets; ++i) {
+      used += (histogram.bucket(i) > 0) ? 1 : 0;
+    }
+    appendInt(used, 4);
+    for (unsigned i = 0; i < LatencyHistogram::kBuckets; ++i) {
+      if (histogram.bucket(i) > 0) {
+        appendInt(i, 4);
+        appendInt(histogram.bucket(i), 8);
+      }
+    }
+  }
+#endif
+
+  void appendInt(uint64_t value, unsigned bytes) {
+    for (unsigned i = 0; i < bytes; ++i) {
+      _record += (char)((value >> (8 * i)) & 0xFF);
+    }
+  }
+
+  /**
+   * \brief Appends text in quotes, escaping quotes and control characters for JSON and CSV.
+   */
+  void appendQuoted(std::string_view text, char quote) {
+    _record += quote;
+    for (char c : text) {
+      if (c == quote) {
+        _record += (_format == Csv) ? "\"\"" : "\\\"";
+      } else if (_format == Json && (c == '\\' || (unsigned char)c < 0x20)) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), (c == '\\') ? "\\\\" : "\\u%04x", (unsigned char)c);
+        _record += escaped;
+      } else {
+        _record += c;
+      }
+    }
+    _record += quote;
+  }
+
+  Format _format = Text;
+  uint64_t _records = 0;          // Method records written since opening.
+  std::string _record;            // Reused to format each record before one write.
+  std::vector<char> _buffer;      // Stream buffer, METHOD_LOG_BUFFER bytes.
 };
 
 #endif
@@ -2,8 +2,16 @@
 #define INVOKABLE_H
 
 #include <any>
+#include <cstdint>
+#include <memory_resource>
 #include <vector>
 #include <string>
+#include "ArgMatcher.h"
+#include "InplaceFunction.h"
+
+#ifdef EMULATOR_HISTOGRAMS
+#include "LatencyHistogram.h"
+#endif
 
 /**
  * \brief Represents a return value configuration for a mocked method.
@@ -19,6 +27,15 @@
  */
 typedef std::pair<int, std::any> RetVal;
 
+/**
+ * \brief An action run on each call to a mocked method, see `Emulator::does()`.
+ *
+ * It receives the call's arguments and returns the value the call should
+ * return, or an empty std::any to return the next configured value instead.
+ * Stored in place, so actions never allocate.
+ */
+typedef InplaceFunction<std::any(const MockArgs&)> MockAction;
+
 /**
  * \brief Represents the profile of a mocked method for emulation purposes.
  *
@@ -27,20 +44,150 @@ typedef std::pair<int, std::any> RetVal;
  * potential subsequent return values in a 'then' sequence), the number of times it
  * has been invoked, and an optional delay before returning the value.
  *
- * \param methodName  std::string - The name of the method/function being mocked.
+ * \param methodName  std::pmr::string - The name of the method/function being mocked.
  * \param retVal      RetVal - The primary return value configuration for the method.
- * \param then        std::vector<RetVal> - A list of subsequent return values 
+ * \param then        std::pmr::vector<RetVal> - A list of subsequent return values 
  *                     the method should return after the primary value has been used.
  * \param invoked     int - A counter for the number of times the method has been invoked.
  * \param delay       int - An optional delay in milliseconds to be applied before 
  *                     returning the value. Default is 0, meaning no delay.
+ * \param consumed    int - Return values taken from the configured sequence so far.
+ * \param thrown      int - Calls that threw a configured exception instead of returning.
+ * \param cursor      size_t - Position in the return sequence: 0 for `retVal`, i for `then[i - 1]`.
+ * \param repeats     int - Times the value at `cursor` has been returned so far.
+ * \param returned    std::pmr::vector<uint64_t> - One bit per sequence position, set once
+ *                     that value has been returned. Unset bits are dead configuration.
+ * \param args        std::pmr::string - The arguments the profile is conditional on, as
+ *                     text for reports, e.g. `"/config", 80`. Empty for the profile
+ *                     returned when no argument rule matches.
+ * \param action      MockAction - Run on every call to compute the return value
+ *                     or perform a side effect, if set.
+ * \param shared      const RetVal* - A return sequence owned elsewhere, e.g. by a
+ *                     compiled Scenario, used in place of `retVal` and `then` when set.
+ * \param sharedCount size_t - The number of values at `shared`.
+ * \param latency     MethodLatency - Wall and emulated time histograms for calls
+ *                     to the method, present only when EMULATOR_HISTOGRAMS is defined.
+ *
+ * Profiles are allocator aware: in a `std::pmr` container their strings and
+ * vectors allocate from the container's resource, see EmulatorMemory.
  */
-typedef struct {
-    std::string methodName;
+struct MethodProfile {
+    typedef std::pmr::polymorphic_allocator<char> allocator_type;
+
+    MethodProfile() {}
+    explicit MethodProfile(const allocator_type& allocator) : methodName(allocator), then(allocator), returned(allocator), args(allocator) {}
+    MethodProfile(const MethodProfile& other, const allocator_type& allocator) : MethodProfile(allocator) { *this = other; }
+    MethodProfile(MethodProfile&& other, const allocator_type& allocator) : MethodProfile(allocator) { *this = std::move(other); }
+    MethodProfile(const MethodProfile&) = default;
+    MethodProfile(MethodProfile&&) = default;
+    MethodProfile& operator=(const MethodProfile&) = default;
+    MethodProfile& operator=(MethodProfile&&) = default;
+
+    std::pmr::string methodName;
     RetVal retVal;
-    std::vector<RetVal> then = {};
+    std::pmr::vector<RetVal> then = {};
     int invoked = 0;
     int delay = 0;
-} MethodProfile;
+    int consumed = 0;
+    int thrown = 0;
+    size_t cursor = 0;
+    int repeats = 0;
+    std::pmr::vector<uint64_t> returned = {};
+    std::pmr::string args = "";
+    MockAction action;
+    const RetVal* shared = nullptr;
+    size_t sharedCount = 0;
+#ifdef EMULATOR_HISTOGRAMS
+    MethodLatency latency;
+#endif
+};
+
+/**
+ * \brief The profiles of an emulator, allocated from its memory resource.
+ */
+typedef std::pmr::vector<MethodProfile> MethodProfiles;
+
+/**
+ * \brief Returns the number of values in a method's return sequence, `retVal` included.
+ */
+inline size_t retValCount(const MethodProfile& method) { return (method.shared != nullptr) ? method.sharedCount : method.then.size() + 1; }
+
+/**
+ * \brief Returns the value at a position of a method's return sequence, 0 for `retVal`.
+ */
+inline const RetVal& retValAt(const MethodProfile& method, size_t index) {
+  if (method.shared != nullptr) {
+    return method.shared[index];
+  }
+  return (index == 0) ? method.retVal : method.then[index - 1];
+}
+
+/**
+ * \brief Copies a shared return sequence into the profile's own `retVal` and `then`,
+ * so it can be extended without touching the sequence other emulators share.
+ */
+inline void unshareMethodProfile(MethodProfile& method) {
+  if (method.shared == nullptr) {
+    return;
+  }
+  method.retVal = method.shared[0];
+  method.then.assign(method.shared + 1, method.shared + method.sharedCount);
+  method.shared = nullptr;
+  method.sharedCount = 0;
+}
+
+/**
+ * \brief Returns true if the value at a position of the return sequence has been returned.
+ *
+ * \param method    const MethodProfile& - The method.
+ * \param index     size_t - Position in the sequence, 0 for `retVal`.
+ */
+inline bool retValReturned(const MethodProfile& method, size_t index) {
+  size_t word = index >> 6;
+  return word < method.returned.size() && ((method.returned[word] >> (index & 63)) & 1) != 0;
+}
+
+/**
+ * \brief Marks the value at a position of the return sequence as returned.
+ *
+ * \param method    MethodProfile& - The method.
+ * \param index     size_t - Position in the sequence, 0 for `retVal`.
+ */
+inline void markRetValReturned(MethodProfile& method, size_t index) {
+  size_t word = index >> 6;
+  if (word >= method.returned.size()) {
+    method.returned.resize(word + 1, 0);
+  }
+  method.returned[word] |= (uint64_t)1 << (index & 63);
+}
+
+/**
+ * \brief Returns a profile to the state `Emulator::returns()` starts from, keeping
+ * the capacity of its strings and vectors so reconfiguring it does not allocate.
+ *
+ * \param method    MethodProfile& - The profile to recycle.
+ * \param name      const std::string& - The method it will describe.
+ */
+inline void recycleMethodProfile(MethodProfile& method, const std::string& name) {
+  method.methodName = name;
+  method.retVal = RetVal();
+  method.then.clear();
+  method.invoked = 0;
+  method.delay = 0;
+  method.consumed = 0;
+  method.thrown = 0;
+  method.cursor = 0;
+  method.repeats = 0;
+  method.returned.assign(1, 0);
+  method.args.clear();
+  method.action = nullptr;
+  method.shared = nullptr;
+  method.sharedCount = 0;
+#ifdef EMULATOR_HISTOGRAMS
+  method.latency.wall.reset();
+  method.latency.emulated.reset();
+  method.latency.between.reset();
+#endif
+}
 
 #endif
@@ -0,0 +1,996 @@
+#if not defined(MOCK_AT_MODEM_H)
+#define MOCK_AT_MODEM_H
+
+#include <Arduino.h>
+#include <EmulatedUart.h>
+#include <TraceRecorder.h>
+#include <VirtualClock.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+/**
+ * \brief FNV-1a hash used to precompile the AT command table.
+ *
+ * Evaluated at compile time for the `case` labels of the dispatcher and at
+ * run time for the command name of each received line.
+ */
+constexpr uint32_t atCommandHash(const char* text, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; ++i) {
+    hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+  }
+  return hash;
+}
+
+constexpr uint32_t atCommandHash(const char* text) {
+  size_t length = 0;
+  while (text[length] != '\0') {
+    ++length;
+  }
+  return atCommandHash(text, length);
+}
+
+/**
+ * \class AtModem
+ * \brief An emulated cellular modem that speaks AT commands over a Stream.
+ *
+ * The host writes command lines to the modem and reads back responses exactly
+ * as it would over a UART, so AT parsing code (including the real TinyGSM
+ * library) can run against it. Behind the command interface sits a small
+ * network model:
+ *
+ * - `AT+CFUN=1` starts a network search, which completes after the
+ *   registration delay (in virtual time) with the configured outcome.
+ * - `AT+CGATT=1` attaches to packet data once registered, and `AT+CGACT=1,1`
+ *   or `AT+CIICR` activates the data context and assigns an IP address.
+ * - `AT+SAPBR=1,1` opens the bearer, attaching to packet data once registered.
+ * - Losing registration detaches packet data and closes every socket.
+ * - `AT+CSQ` reports the configured signal quality.
+ *
+ * With a context active, the SIM800 socket commands (`+CIPMUX`, `+CIPSTART`,
+ * `+CIPSEND`, `+CIPQSEND`, `+CIPRXGET`, `+CIPSTATUS`, `+CIPCLOSE`) open up to
+ * six TCP connections. `serve()` delivers bytes from the far end and
+ * `socketSent()` returns what the host sent. `+CIPSEND` needs an explicit
+ * length, and `+CIPRXGET=3` (hex) is not supported.
+ *
+ * Commands chained with `;` on one line run in order and report one final
+ * result, stopping at the first error.
+ *
+ * The modem can also sit on the far end of an EmulatedUart with `attach()`,
+ * so commands and responses are paced at the link's baud rate.
+ *
+ * Each command charges its response latency to the current VirtualClock.
+ * Command names are hashed once per line and dispatched through a table
+ * resolved at compile time, so soak tests can push tens of thousands of
+ * commands per second through the emulator.
+ *
+ * Example:
+ * \code{.cpp}
+ * AtModem modem;
+ * modem.setSignalQuality(17);
+ * modem.setRegistrationDelay(4000);
+ * TinyGsm driver(modem);
+ * driver.useAtCommands();
+ * \endcode
+ */
+class AtModem : public Stream, public UartDevice {
+public:
+  /**
+   * \brief Identifiers of the commands the modem understands.
+   */
+  enum Command {
+    AT_NONE, AT_ECHO, AT_INFO, AT_RESET, AT_CFUN, AT_CPIN, AT_CSQ, AT_CREG, AT_CGREG,
+    AT_CEREG, AT_COPS, AT_CGATT, AT_CGDCONT, AT_CGACT, AT_CSTT, AT_CIICR, AT_CIFSR,
+    AT_CIPSHUT, AT_CGPADDR, AT_GSN, AT_CCID, AT_CGMI, AT_CGMM, AT_CGMR, AT_SAPBR,
+    AT_CIPMUX, AT_CIPQSEND, AT_CIPRXGET, AT_CDNSCFG, AT_CIPSTATUS, AT_CIPSTART,
+    AT_CIPSEND, AT_CIPCLOSE, AT_SETTING, AT_UNKNOWN, AT_COMMAND_COUNT
+  };
+
+  static constexpr int kSockets = 6;      // Connections available with +CIPMUX=1.
+
+  AtModem() {
+    for (int i = 0; i < AT_COMMAND_COUNT; ++i) {
+      _latency[i] = 0;
+    }
+    startSearch();
+  }
+  ~AtModem() {}
+
+  // Stream, as seen from the host
+  size_t write(uint8_t byte) override {
+    if (_sendRemaining > 0) {
+      if (_skipLineFeed) {
+        _skipLineFeed = false;
+        if (byte == '\n') {
+          return 1;
+        }
+      }
+      _sockets[_sending].sent.push_back((char)byte);
+      if (--_sendRemaining == 0) {
+        finishSend();
+      }
+      return 1;
+    }
+    if (_echo) {
+      _out.push_back((char)byte);
+    }
+    if (byte == '\r' || byte == '\n') {
+      if (!_line.empty()) {
+        _terminator = (char)byte;
+        execute(_line);
+        _line.clear();
+      }
+    } else {
+      _line.push_back((char)byte);
+    }
+    return 1;
+  }
+
+  size_t write(const uint8_t *buf, size_t size) override {
+    for (size_t i = 0; i < size; ++i) {
+      write(buf[i]);
+    }
+    return size;
+  }
+
+  int available() override { return (int)(_out.size() - _outPos); }
+
+  int read() override {
+    if (_outPos >= _out.size()) {
+      return -1;
+    }
+    int byte = (uint8_t)_out[_outPos++];
+    if (_outPos == _out.size()) {
+      _out.clear();
+      _outPos = 0;
+    }
+    return byte;
+  }
+
+  int peek() override { return (_outPos < _out.size()) ? (uint8_t)_out[_outPos] : -1; }
+
+  void flush() override {}
+
+  /**
+   * \brief Places the modem on the far end of an emulated serial link.
+   *
+   * \param port    EmulatedUart& - The modem's endpoint, connected to the host's.
+   */
+  void attach(EmulatedUart& port) { port.attachDevice(this); }
+
+  /**
+   * \brief Executes commands that have arrived on the port and transmits the responses.
+   */
+  void service(EmulatedUart& port) override {
+    int byte;
+    while ((byte = port.read()) >= 0) {
+      write((uint8_t)byte);
+    }
+    while ((byte = read()) >= 0) {
+      port.write((uint8_t)byte);
+    }
+  }
+
+  /**
+   * \brief Sets the signal quality reported by `AT+CSQ`.
+   *
+   * \param csq   int16_t - RSSI in 27.007 units, 0-31 or 99 for unknown.
+   */
+  void setSignalQuality(int16_t csq) { _csq = csq; }
+
+  /**
+   * \brief Sets how long a network search takes before registration completes.
+   *
+   * \param ms    unsigned long - The delay in milliseconds of virtual time.
+   */
+  void setRegistrationDelay(unsigned long ms) { _registrationDelay = ms; }
+
+  /**
+   * \brief Sets the registration status a network search ends in.
+   *
+   * \param status  int - A `+CREG` status code, e.g. 1 (home), 5 (roaming) or 3 (denied).
+   */
+  void setRegistrationOutcome(int status) { _registrationOutcome = status; }
+
+  /**
+   * \brief Drops registration, detaching packet data and restarting the network search.
+   */
+  void dropRegistration() {
+    detach();
+    if (_functionality == 1) {
+      startSearch();
+    } else {
+      setRegistration(0);
+    }
+  }
+
+  /**
+   * \brief Sets the latency charged to every command without its own latency.
+   *
+   * \param ms    unsigned long - Milliseconds of virtual time per response.
+   */
+  void setResponseLatency(unsigned long ms) { _defaultLatency = ms; }
+
+  /**
+   * \brief Sets the latency charged to one command.
+   *
+   * \param command   const char* - The command name as sent, e.g. "+CGATT" or "I".
+   * \param ms        unsigned long - Milliseconds of virtual time per response.
+   */
+  void setCommandLatency(const char* command, unsigned long ms) {
+    _latency[lookup(command)] = ms + 1;
+  }
+
+  /**
+   * \brief Sets the identity strings the modem reports.
+   */
+  void setIdentity(const char* imei, const char* ccid, const char* operatorName, const char* model) {
+    _imei = imei;
+    _ccid = ccid;
+    _operator = operatorName;
+    _model = model;
+  }
+
+  /**
+   * \brief Current `+CREG` status code after applying any elapsed search time.
+   */
+  int registrationStatus() {
+    update();
+    return _registration;
+  }
+
+  /**
+   * \brief Whether packet data is attached.
+   */
+  bool gprsAttached() {
+    update();
+    return _attached;
+  }
+
+  /**
+   * \brief Whether a data context is active.
+   */
+  bool contextActive() {
+    update();
+    return _contextActive;
+  }
+
+  /**
+   * \brief Whether a socket is connected.
+   *
+   * \param mux   int - The connection number, 0 in single connection mode.
+   */
+  bool socketConnected(int mux) const { return validSocket(mux) && _sockets[mux].open; }
+
+  /**
+   * \brief Bytes the host has sent on a socket since it was opened.
+   *
+   * \param mux   int - The connection number, 0 in single connection mode.
+   */
+  const std::string& socketSent(int mux) const {
+    static const std::string none;
+    return validSocket(mux) ? _sockets[mux].sent : none;
+  }
+
+  /**
+   * \brief Delivers bytes from the far end of a connected socket.
+   *
+   * With `+CIPRXGET=1` the bytes are buffered and announced with a
+   * `+CIPRXGET: 1` notification, otherwise they are pushed to the host
+   * straight away.
+   *
+   * \param mux   int - The connection number, 0 in single connection mode.
+   * \param data  const std::string& - The bytes the server sends.
+   */
+  void serve(int mux, const std::string& data) {
+    if (!socketConnected(mux) || data.empty()) {
+      return;
+    }
+    char buffer[48];
+    if (_manualReceive) {
+      bool announce = _sockets[mux].received.empty();
+      _sockets[mux].received.append(data);
+      if (announce) {
+        if (_multiplexed) {
+          snprintf(buffer, sizeof(buffer), "+CIPRXGET: 1,%d", mux);
+        } else {
+          snprintf(buffer, sizeof(buffer), "+CIPRXGET: 1");
+        }
+        respond(buffer);
+      }
+    } else {
+      if (_multiplexed) {
+        snprintf(buffer, sizeof(buffer), "+RECEIVE,%d,%u:", mux, (unsigned)data.size());
+        respond(buffer);
+      }
+      _out.append(data);
+    }
+  }
+
+  /**
+   * \brief Closes a socket from the far end, notifying the host.
+   *
+   * \param mux   int - The connection number, 0 in single connection mode.
+   */
+  void remoteClose(int mux) {
+    if (socketConnected(mux)) {
+      closeSocket(mux);
+      respond(socketPrefix(mux) + "CLOSED");
+    }
+  }
+
+  /**
+   * \brief Number of command lines the modem has executed.
+   */
+  uint64_t commandsHandled() const { return _commands; }
+
+private:
+  /**
+   * \brief A TCP connection opened with +CIPSTART.
+   */
+  struct Socket {
+    bool open = false;
+    std::string host;
+    int port = 0;
+    std::string received;                 // Bytes waiting for +CIPRXGET=2.
+    std::string sent;                     // Bytes the host sent with +CIPSEND.
+  };
+
+  /**
+   * \brief Maps a command name onto its identifier.
+   *
+   * The name is hashed once and dispatched through a table resolved at compile
+   * time, then compared with the table entry so a colliding hash is unknown.
+   */
+  static Command lookup(std::string_view name) {
+#define AT_COMMAND_ENTRY(text, command) \
+      case atCommandHash(text): return (name == text) ? command : AT_UNKNOWN;
+    switch (atCommandHash(name.data(), name.size())) {
+      AT_COMMAND_ENTRY("", AT_NONE)
+      AT_COMMAND_ENTRY("E", AT_ECHO)
+      AT_COMMAND_ENTRY("I", AT_INFO)
+      AT_COMMAND_ENTRY("Z", AT_RESET)
+      AT_COMMAND_ENTRY("+CFUN", AT_CFUN)
+      AT_COMMAND_ENTRY("+CPIN", AT_CPIN)
+      AT_COMMAND_ENTRY("+CSQ", AT_CSQ)
+      AT_COMMAND_ENTRY("+CREG", AT_CREG)
+      AT_COMMAND_ENTRY("+CGREG", AT_CGREG)
+      AT_COMMAND_ENTRY("+CEREG", AT_CEREG)
+      AT_COMMAND_ENTRY("+COPS", AT_COPS)
+      AT_COMMAND_ENTRY("+CGATT", AT_CGATT)
+      AT_COMMAND_ENTRY("+CGDCONT", AT_CGDCONT)
+      AT_COMMAND_ENTRY("+CGACT", AT_CGACT)
+      AT_COMMAND_ENTRY("+CSTT", AT_CSTT)
+      AT_COMMAND_ENTRY("+CIICR", AT_CIICR)
+      AT_COMMAND_ENTRY("+CIFSR", AT_CIFSR)
+      AT_COMMAND_ENTRY("+CIPSHUT", AT_CIPSHUT)
+      AT_COMMAND_ENTRY("+CGPADDR", AT_CGPADDR)
+      AT_COMMAND_ENTRY("+GSN", AT_GSN)
+      AT_COMMAND_ENTRY("+CGSN", AT_GSN)
+      AT_COMMAND_ENTRY("+CCID", AT_CCID)
+      AT_COMMAND_ENTRY("+ICCID", AT_CCID)
+      AT_COMMAND_ENTRY("+CGMI", AT_CGMI)
+      AT_COMMAND_ENTRY("+CGMM", AT_CGMM)
+      AT_COMMAND_ENTRY("+GMM", AT_CGMM)
+      AT_COMMAND_ENTRY("+CGMR", AT_CGMR)
+      AT_COMMAND_ENTRY("+GMR", AT_CGMR)
+      AT_COMMAND_ENTRY("+SAPBR", AT_SAPBR)
+      AT_COMMAND_ENTRY("+CIPMUX", AT_CIPMUX)
+      AT_COMMAND_ENTRY("+CIPQSEND", AT_CIPQSEND)
+      AT_COMMAND_ENTRY("+CIPRXGET", AT_CIPRXGET)
+      AT_COMMAND_ENTRY("+CDNSCFG", AT_CDNSCFG)
+      AT_COMMAND_ENTRY("+CIPSTATUS", AT_CIPSTATUS)
+      AT_COMMAND_ENTRY("+CIPSTART", AT_CIPSTART)
+      AT_COMMAND_ENTRY("+CIPSEND", AT_CIPSEND)
+      AT_COMMAND_ENTRY("+CIPCLOSE", AT_CIPCLOSE)
+      AT_COMMAND_ENTRY("+CMEE", AT_SETTING)
+      AT_COMMAND_ENTRY("+CLTS", AT_SETTING)
+      AT_COMMAND_ENTRY("+CBATCHK", AT_SETTING)
+      AT_COMMAND_ENTRY("+CNMI", AT_SETTING)
+      AT_COMMAND_ENTRY("+CMGF", AT_SETTING)
+      AT_COMMAND_ENTRY("+IPR", AT_SETTING)
+      AT_COMMAND_ENTRY("&W", AT_SETTING)
+      AT_COMMAND_ENTRY("&F", AT_SETTING)
+      AT_COMMAND_ENTRY("V", AT_SETTING)
+      AT_COMMAND_ENTRY("Q", AT_SETTING)
+      default:                        return AT_UNKNOWN;
+    }
+#undef AT_COMMAND_ENTRY
+  }
+
+  /**
+   * \brief Parses one command line and executes each `;` separated command on it.
+   */
+  void execute(const std::string& line) {
+    ++_commands;
+    _failed = false;
+    std::string_view text(line);
+    if (text.size() < 2 || (text[0] != 'A' && text[0] != 'a') || (text[1] != 'T' && text[1] != 't')) {
+      result("ERROR");
+      return;
+    }
+    text.remove_prefix(2);
+
+    size_t start = 0;
+    bool quoted = false;
+    for (size_t i = 0; i <= text.size(); ++i) {
+      if (i == text.size() || (text[i] == ';' && !quoted)) {
+        _moreCommands = i < text.size();
+        run(text.substr(start, i - start));
+        if (_failed || _sendRemaining > 0) {
+          break;
+        }
+        start = i + 1;
+      } else if (text[i] == '"') {
+        quoted = !quoted;
+      }
+    }
+    _moreCommands = false;
+  }
+
+  /**
+   * \brief Parses and executes one command of a line, without its "AT" prefix.
+   */
+  void run(std::string_view text) {
+    // Extended commands run up to '=', '?' or the end, basic commands are one letter.
+    size_t nameLength = 0;
+    if (!text.empty() && (text[0] == '+' || text[0] == '&')) {
+      nameLength = 1;
+      while (nameLength < text.size() && text[nameLength] != '=' && text[nameLength] != '?') {
+        ++nameLength;
+      }
+      if (text[0] == '&' && nameLength > 2) {
+        nameLength = 2;
+      }
+    } else if (!text.empty()) {
+      nameLength = 1;
+    }
+    std::string_view name = text.substr(0, nameLength);
+    std::string_view rest = text.substr(nameLength);
+    bool query = !rest.empty() && rest[0] == '?';
+    bool set = !rest.empty() && rest[0] == '=';
+    std::string_view args = set ? rest.substr(1) : rest;
+    if (set && args == "?") {
+      result("OK");
+      return;
+    }
+
+    Command command = lookup(name);
+    charge(command);
+    update();
+    dispatch(command, query, set, args);
+  }
+
+  void dispatch(Command command, bool query, bool set, std::string_view args) {
+    char buffer[96];
+    switch (command) {
+      case AT_NONE:
+      case AT_SETTING:
+      case AT_CGDCONT:
+      case AT_CSTT:
+      case AT_CDNSCFG:
+        result("OK");
+        break;
+      case AT_ECHO:
+        _echo = (args != "0");
+        result("OK");
+        break;
+      case AT_INFO:
+        respond(_model);
+        result("OK");
+        break;
+      case AT_RESET:
+        detach();
+        _echo = true;
+        result("OK");
+        break;
+      case AT_CFUN:
+        if (query) {
+          snprintf(buffer, sizeof(buffer), "+CFUN: %d", _functionality);
+          respond(buffer);
+        } else if (set) {
+          setFunctionality(argument(args, 0));
+        }
+        result("OK");
+        break;
+      case AT_CPIN:
+        if (query) {
+          respond("+CPIN: READY");
+        }
+        result("OK");
+        break;
+      case AT_CSQ:
+        snprintf(buffer, sizeof(buffer), "+CSQ: %d,99", _csq);
+        respond(buffer);
+        result("OK");
+        break;
+      case AT_CREG:
+      case AT_CGREG:
+      case AT_CEREG:
+        if (query) {
+          const char* prefix = (command == AT_CREG) ? "+CREG" : ((command == AT_CGREG) ? "+CGREG" : "+CEREG");
+          snprintf(buffer, sizeof(buffer), "%s: 0,%d", prefix, _registration);
+          respond(buffer);
+        }
+        result("OK");
+        break;
+      case AT_COPS:
+        if (query) {
+          if (registered()) {
+            snprintf(buffer, sizeof(buffer), "+COPS: 0,0,\"%s\"", _operator.c_str());
+            respond(buffer);
+          } else {
+            respond("+COPS: 0");
+          }
+        }
+        result("OK");
+        break;
+      case AT_CGATT:
+        if (query) {
+          snprintf(buffer, sizeof(buffer), "+CGATT: %d", _attached ? 1 : 0);
+          respond(buffer);
+          result("OK");
+        } else if (argument(args, 0) == 1) {
+          if (!registered()) {
+            result("ERROR");
+            break;
+          }
+          setAttached(true);
+          result("OK");
+        } else {
+          detach();
+          result("OK");
+        }
+        break;
+      case AT_CGACT:
+        if (query) {
+          snprintf(buffer, sizeof(buffer), "+CGACT: 1,%d", _contextActive ? 1 : 0);
+          respond(buffer);
+          result("OK");
+        } else if (argument(args, 0) == 1) {
+          result(activate() ? "OK" : "ERROR");
+        } else {
+          deactivate();
+          result("OK");
+        }
+        break;
+      case AT_CIICR:
+        result(activate() ? "OK" : "ERROR");
+        break;
+      case AT_CIFSR:
+        if (_contextActive) {
+          respond(_ip);
+        } else {
+          result("ERROR");
+        }
+        break;
+      case AT_CGPADDR:
+        if (_contextActive) {
+          snprintf(buffer, sizeof(buffer), "+CGPADDR: 1,\"%s\"", _ip.c_str());
+          respond(buffer);
+        }
+        result("OK");
+        break;
+      case AT_CIPSHUT:
+        deactivate();
+        result("SHUT OK");
+        break;
+      case AT_GSN:
+        respond(_imei);
+        result("OK");
+        break;
+      case AT_CCID:
+        respond(_ccid);
+        result("OK");
+        break;
+      case AT_CGMI:
+        respond("Emulation");
+        result("OK");
+        break;
+      case AT_CGMM:
+        respond(_model);
+        result("OK");
+        break;
+      case AT_CGMR:
+        respond("Revision:EMULATED");
+        result("OK");
+        break;
+      case AT_SAPBR:
+        bearer(argument(args, 0));
+        break;
+      case AT_CIPMUX:
+      case AT_CIPQSEND:
+        if (query) {
+          snprintf(buffer, sizeof(buffer), "%s: %d", (command == AT_CIPMUX) ? "+CIPMUX" : "+CIPQSEND",
+                   (command == AT_CIPMUX) ? (int)_multiplexed : (int)_quickSend);
+          respond(buffer);
+        } else if (command == AT_CIPMUX) {
+          _multiplexed = argument(args, 0) == 1;
+        } else {
+          _quickSend = argument(args, 0) == 1;
+        }
+        result("OK");
+        break;
+      case AT_CIPRXGET:
+        if (query) {
+          snprintf(buffer, sizeof(buffer), "+CIPRXGET: %d", _manualReceive ? 1 : 0);
+          respond(buffer);
+          result("OK");
+        } else {
+          receive(args);
+        }
+        break;
+      case AT_CIPSTATUS:
+        status(set, args);
+        break;
+      case AT_CIPSTART:
+        connect(args);
+        break;
+      case AT_CIPSEND:
+        startSend(args);
+        break;
+      case AT_CIPCLOSE: {
+        int mux = _multiplexed ? argument(args, 0) : 0;
+        if (!socketConnected(mux)) {
+          result("ERROR");
+          break;
+        }
+        closeSocket(mux);
+        result((socketPrefix(mux) + "CLOSE OK").c_str());
+        break;
+      }
+      default:
+        result("ERROR");
+        break;
+    }
+  }
+
+  /**
+   * \brief Handles +SAPBR: 0 closes the bearer, 1 opens it, 2 queries it and 3/4 set/read parameters.
+   */
+  void bearer(int operation) {
+    char buffer[64];
+    switch (operation) {
+      case 0:
+        _bearerOpen = false;
+        result("OK");
+        break;
+      case 1:
+        if (!registered()) {
+          result("ERROR");
+          break;
+        }
+        setAttached(true);
+        _bearerOpen = true;
+        result("OK");
+        break;
+      case 2:
+        snprintf(buffer, sizeof(buffer), "+SAPBR: 1,%d,\"%s\"", _bearerOpen ? 1 : 3, _bearerOpen ? _ip.c_str() : "0.0.0.0");
+        respond(buffer);
+        result("OK");
+        break;
+      case 3:
+      case 4:
+        result("OK");
+        break;
+      default:
+        result("ERROR");
+        break;
+    }
+  }
+
+  /**
+   * \brief Handles +CIPRXGET: 0/1 select the receive mode, 2 reads buffered bytes and 4 reports their count.
+   */
+  void receive(std::string_view args) {
+    char buffer[64];
+    int mode = argument(args, 0);
+    int mux = _multiplexed ? argument(args, 1) : 0;
+    if (mode == 0 || mode == 1) {
+      _manualReceive = mode == 1;
+      result("OK");
+      return;
+    }
+    if ((mode != 2 && mode != 4) || !socketConnected(mux)) {
+      result("ERROR");
+      return;
+    }
+    std::string& received = _sockets[mux].received;
+    if (mode == 4) {
+      if (_multiplexed) {
+        snprintf(buffer, sizeof(buffer), "+CIPRXGET: 4,%d,%u", mux, (unsigned)received.size());
+      } else {
+        snprintf(buffer, sizeof(buffer), "+CIPRXGET: 4,%u", (unsigned)received.size());
+      }
+      respond(buffer);
+      result("OK");
+      return;
+    }
+    int requested = argument(args, _multiplexed ? 2 : 1);
+    size_t length = (requested > 0) ? std::min(received.size(), (size_t)requested) : 0;
+    if (_multiplexed) {
+      snprintf(buffer, sizeof(buffer), "+CIPRXGET: 2,%d,%u,%u", mux, (unsigned)length, (unsigned)(received.size() - length));
+    } else {
+      snprintf(buffer, sizeof(buffer), "+CIPRXGET: 2,%u,%u", (unsigned)length, (unsigned)(received.size() - length));
+    }
+    respond(buffer);
+    _out.append(received, 0, length);
+    received.erase(0, length);
+    result("OK");
+  }
+
+  /**
+   * \brief Handles +CIPSTATUS, for one connection or for the whole IP stack.
+   */
+  void status(bool set, std::string_view args) {
+    char buffer[96];
+    if (set) {
+      int mux = argument(args, 0);
+      if (!validSocket(mux)) {
+        result("ERROR");
+        return;
+      }
+      const Socket& socket = _sockets[mux];
+      if (socket.open) {
+        snprintf(buffer, sizeof(buffer), "+CIPSTATUS: %d,0,\"TCP\",\"%s\",\"%d\",\"CONNECTED\"", mux, socket.host.c_str(), socket.port);
+      } else {
+        snprintf(buffer, sizeof(buffer), "+CIPSTATUS: %d,,\"\",\"\",\"\",\"INITIAL\"", mux);
+      }
+      respond(buffer);
+      result("OK");
+      return;
+    }
+    bool connected = false;
+    for (const Socket& socket : _sockets) {
+      connected = connected || socket.open;
+    }
+    result("OK");
+    respond(!_contextActive ? "STATE: IP INITIAL" : (connected ? "STATE: CONNECT OK" : "STATE: IP STATUS"));
+  }
+
+  /**
+   * \brief Handles +CIPSTART, opening a TCP connection once a context is active.
+   */
+  void connect(std::string_view args) {
+    int base = _multiplexed ? 1 : 0;
+    int mux = _multiplexed ? argument(args, 0) : 0;
+    std::string_view type = field(args, base);
+    int port = argument(args, base + 2);
+    if (!validSocket(mux) || !_contextActive || type != "TCP" || port < 0) {
+      result("ERROR");
+      return;
+    }
+    Socket& socket = _sockets[mux];
+    result("OK");
+    if (socket.open) {
+      respond(socketPrefix(mux) + "ALREADY CONNECT");
+      return;
+    }
+    socket = Socket();
+    socket.open = true;
+    socket.host = std::string(field(args, base + 1));
+    socket.port = port;
+    respond(socketPrefix(mux) + "CONNECT OK");
+  }
+
+  /**
+   * \brief Handles +CIPSEND, prompting for the given number of data bytes.
+   */
+  void startSend(std::string_view args) {
+    int mux = _multiplexed ? argument(args, 0) : 0;
+    int length = argument(args, _multiplexed ? 1 : 0);
+    if (!socketConnected(mux) || length <= 0) {
+      result("ERROR");
+      return;
+    }
+    _sending = mux;
+    _sendLength = length;
+    _sendRemaining = length;
+    _skipLineFeed = _terminator == '\r';  // The LF of a CR LF terminated command line is not data.
+    _out.append("\r\n> ");
+  }
+
+  /**
+   * \brief Acknowledges a +CIPSEND once all of its data bytes have arrived.
+   */
+  void finishSend() {
+    char buffer[48];
+    if (_quickSend) {
+      if (_multiplexed) {
+        snprintf(buffer, sizeof(buffer), "DATA ACCEPT:%d,%d", _sending, _sendLength);
+      } else {
+        snprintf(buffer, sizeof(buffer), "DATA ACCEPT:%d", _sendLength);
+      }
+      respond(buffer);
+    } else {
+      respond(socketPrefix(_sending) + "SEND OK");
+    }
+  }
+
+  void respond(const std::string& text) {
+    _out.append("\r\n");
+    _out.append(text);
+    _out.append("\r\n");
+  }
+
+  /**
+   * \brief Reports a command's final result code.
+   *
+   * An OK from a command with more commands chained after it on the same line
+   * is held back, and an ERROR stops the rest of the line.
+   */
+  void result(const char* code) {
+    if (std::strcmp(code, "ERROR") == 0) {
+      _failed = true;
+    } else if (_moreCommands && std::strcmp(code, "OK") == 0) {
+      return;
+    }
+    respond(code);
+  }
+
+  void charge(Command command) {
+    unsigned long latency = (_latency[command] != 0) ? _latency[command] - 1 : _defaultLatency;
+    VirtualClock::wait((uint64_t)latency * 1000);
+  }
+
+  /**
+   * \brief Returns one comma separated argument, without its quotes.
+   */
+  static std::string_view field(std::string_view args, int index) {
+    int current = 0;
+    size_t start = 0;
+    bool quoted = false;
+    for (size_t i = 0; i <= args.size(); ++i) {
+      if (i == args.size() || (args[i] == ',' && !quoted)) {
+        if (current == index) {
+          std::string_view value = args.substr(start, i - start);
+          if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+            value = value.substr(1, value.size() - 2);
+          }
+          return value;
+        }
+        ++current;
+        start = i + 1;
+      } else if (args[i] == '"') {
+        quoted = !quoted;
+      }
+    }
+    return std::string_view();
+  }
+
+  static int argument(std::string_view args, int index) {
+    int value = 0;
+    bool found = false;
+    for (char c : field(args, index)) {
+      if (c >= '0' && c <= '9') {
+        value = value * 10 + (c - '0');
+        found = true;
+      }
+    }
+    return found ? value : -1;
+  }
+
+  static bool validSocket(int mux) { return mux >= 0 && mux < kSockets; }
+
+  std::string socketPrefix(int mux) const { return _multiplexed ? std::to_string(mux) + ", " : std::string(); }
+
+  void closeSocket(int mux) {
+    _sockets[mux] = Socket();
+    if (_sendRemaining > 0 && _sending == mux) {
+      _sendRemaining = 0;
+    }
+  }
+
+  void setFunctionality(int functionality) {
+    _functionality = (functionality == 1) ? 1 : 0;
+    if (_functionality == 1) {
+      startSearch();
+    } else {
+      detach();
+      setRegistration(0);
+    }
+  }
+
+  void startSearch() {
+    setRegistration(2);
+    _searchStartedAt = VirtualClock::current().nowMicros();
+  }
+
+  /**
+   * \brief Completes a pending network search once its delay has elapsed.
+   */
+  void update() {
+    if (_registration == 2 && VirtualClock::current().nowMicros() >= _searchStartedAt + (uint64_t)_registrationDelay * 1000) {
+      setRegistration(_registrationOutcome);
+    }
+  }
+
+  bool registered() const { return _registration == 1 || _registration == 5; }
+
+  bool activate() {
+    if (!_attached) {
+      return false;
+    }
+    _contextActive = true;
+    return true;
+  }
+
+  void detach() {
+    setAttached(false);
+    _bearerOpen = false;
+    deactivate();
+  }
+
+  /**
+   * \brief Deactivates the data context, closing every socket with a notification.
+   */
+  void deactivate() {
+    _contextActive = false;
+    for (int mux = 0; mux < kSockets; ++mux) {
+      remoteClose(mux);
+    }
+  }
+
+  /**
+   * \brief Changes the +CREG status, recording the change on any installed trace.
+   */
+  void setRegistration(int status) {
+    if (status != _registration) {
+      _registration = status;
+      if (TraceRecorder* trace = TraceRecorder::active()) {
+        trace->counter(this, "AtModem", "registration", status);
+      }
+    }
+  }
+
+  /**
+   * \brief Changes the packet data attachment, recording the change on any installed trace.
+   */
+  void setAttached(bool attached) {
+    if (attached != _attached) {
+      _attached = attached;
+      if (TraceRecorder* trace = TraceRecorder::active()) {
+        trace->counter(this, "AtModem", "attached", attached ? 1 : 0);
+      }
+    }
+  }
+
+  std::string _line;                      // Command line being received.
+  std::string _out;                       // Responses waiting to be read by the host.
+  size_t _outPos = 0;                     // Read position in _out.
+  bool _echo = true;                      // Echo received characters (ATE).
+  int _functionality = 1;                 // +CFUN level.
+  int _registration = 2;                  // +CREG status code, searching at power on.
+  int _registrationOutcome = 1;           // Status a search completes with.
+  unsigned long _registrationDelay = 3000;// Duration of a network search in ms.
+  uint64_t _searchStartedAt = 0;          // Virtual time the pending search started.
+  bool _attached = false;                 // Packet data attached (+CGATT).
+  bool _contextActive = false;            // Data context active (+CGACT / +CIICR).
+  bool _bearerOpen = false;               // Bearer profile 1 open (+SAPBR).
+  bool _multiplexed = false;              // Multiple connections (+CIPMUX).
+  bool _quickSend = false;                // Acknowledge sends with DATA ACCEPT (+CIPQSEND).
+  bool _manualReceive = false;            // Hold received data for +CIPRXGET=2.
+  Socket _sockets[kSockets];              // Connections by number.
+  int _sending = 0;                       // Connection the pending +CIPSEND writes to.
+  int _sendLength = 0;                    // Length of the pending +CIPSEND.
+  int _sendRemaining = 0;                 // Data bytes still expected by +CIPSEND.
+  bool _skipLineFeed = false;             // Drop a LF ending the +CIPSEND command line.
+  char _terminator = '\r';                // Character that ended the last command line.
+  bool _moreCommands = false;             // More commands follow on the current line.
+  bool _failed = false;                   // A command on the current line failed.
+  int16_t _csq = 20;                      // Signal quality reported by +CSQ.
+  unsigned long _defaultLatency = 10;     // Response latency in ms.
+  unsigned long _latency[AT_COMMAND_COUNT]; // Per command latency + 1, 0 when unset.
+  uint64_t _commands = 0;                 // Command lines executed.
+  std::string _imei = "490154203237518";
+  std::string _ccid = "8944500102198304826";
+  std::string _operator = "Emulated";
+  std::string _model = "SIM800 R14.18";
+  std::string _ip = "10.0.0.2";
+};
+
+#endif // end of MOCK_AT_MODEM_H
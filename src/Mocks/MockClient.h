@@ -3,23 +3,26 @@
 
 #include "Client.h"
 #include "Emulator.h"
+#include "LinkModel.h"
 
-class MockClient : public Client, public Emulator {
+class MockClient : public Client, public Emulator, public Linkable {
 public:
   int connect(IPAddress ip, uint16_t port) override {
-    return this->mock<int>("connect");
+    int result = this->mock<int>("connect");
+    return meterConnect(result > 0) ? result : 0;
   }
 
   int connect(const char *host, uint16_t port) override {
-    return this->mock<int>("connect");
+    int result = this->mock<int>("connect", host, port);
+    return meterConnect(result > 0) ? result : 0;
   }
 
   size_t write(uint8_t byte) override {
-    return this->mock<size_t>("write");
+    return meterWrite(countBytes("write", this->mock<size_t>("write")));
   }
 
   size_t write(const uint8_t *buf, size_t size) override {
-    return this->mock<size_t>("write");
+    return meterWrite(countBytes("write", this->mock<size_t>("write")));
   }
 
   int available() override {
@@ -27,11 +30,12 @@ public:
   }
 
   int read() override {
-    return this->mock<int>("read");
+    int byte = this->mock<int>("read");
+    return (byte < 0 || meterRead(1) > 0) ? byte : -1;
   }
 
   int read(uint8_t *buf, size_t size) override {
-    return this->mock<int>("read");
+    return meterRead(fuzzBuffer(this->mock<int>("read"), buf, size));
   }
 
   int peek() override {
@@ -43,7 +47,8 @@ public:
   void stop() override {}
 
   uint8_t connected() override {
-    return this->mock<uint8_t>("connected");
+    uint8_t state = this->mock<uint8_t>("connected");
+    return linkIsReset() ? 0 : state;
   }
 
   operator bool() override {
@@ -0,0 +1,806 @@
+#if not defined(MOCK_FREERTOS_H)
+#define MOCK_FREERTOS_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <FiberScheduler.h>
+#include <VirtualClock.h>
+
+/**
+ * \file MockFreeRTOS.h
+ * \brief Emulates the FreeRTOS task, queue, semaphore and event group API.
+ *
+ * Tasks run as fibers of an RtosKernel on one host thread, so multi-task
+ * firmware executes deterministically against the virtual clock. The highest
+ * priority ready task runs, and a task switch can happen at any FreeRTOS call,
+ * `delay()` or other emulated wait. Tasks of equal priority run round-robin,
+ * or in an order drawn from the kernel's seed so interleavings can be varied
+ * and replayed.
+ *
+ * Ticks are milliseconds (configTICK_RATE_HZ 1000, as on the ESP32). Stack
+ * depths and core affinities are recorded but not enforced. Critical sections
+ * are no-ops because only one task executes at a time.
+ */
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t EventBits_t;
+typedef uint32_t StackType_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE                     ((BaseType_t)0)
+#define pdTRUE                      ((BaseType_t)1)
+#define pdPASS                      (pdTRUE)
+#define pdFAIL                      (pdFALSE)
+#define errQUEUE_EMPTY              ((BaseType_t)0)
+#define errQUEUE_FULL               ((BaseType_t)0)
+#define portMAX_DELAY               ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS          ((TickType_t)1)
+#define portTICK_RATE_MS            portTICK_PERIOD_MS
+#define configTICK_RATE_HZ          1000
+#define configMAX_PRIORITIES        25
+#define tskIDLE_PRIORITY            ((UBaseType_t)0)
+#define tskNO_AFFINITY              ((BaseType_t)0x7FFFFFFF)
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks)        ((uint32_t)(ticks))
+
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    0
+#define portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL(mux)
+#define portENTER_CRITICAL_ISR(mux)
+#define portEXIT_CRITICAL_ISR(mux)
+#define taskENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(...)
+
+enum eNotifyAction {
+  eNoAction = 0,
+  eSetBits,
+  eIncrement,
+  eSetValueWithOverwrite,
+  eSetValueWithoutOverwrite,
+};
+
+enum eRtosQueueKind {
+  RTOS_QUEUE,
+  RTOS_BINARY_SEMAPHORE,
+  RTOS_COUNTING_SEMAPHORE,
+  RTOS_MUTEX,
+  RTOS_RECURSIVE_MUTEX,
+};
+
+struct RtosTask;
+
+/**
+ * \brief A FreeRTOS queue. Semaphores and mutexes are queues of zero sized items.
+ *
+ * Items are copied into a ring allocated once at creation, so sending and
+ * receiving never allocate.
+ */
+struct RtosQueue {
+  eRtosQueueKind kind = RTOS_QUEUE;
+  std::vector<uint8_t> storage;       // length * itemSize bytes.
+  UBaseType_t length = 0;             // Capacity in items (or maximum semaphore count).
+  UBaseType_t itemSize = 0;
+  UBaseType_t head = 0;               // Slot of the oldest item.
+  UBaseType_t count = 0;              // Items (or semaphore count) held.
+  RtosTask* holder = nullptr;         // Task holding a mutex.
+  UBaseType_t recursion = 0;          // Nested takes of a recursive mutex.
+  std::vector<RtosTask*> senders;     // Tasks blocked waiting for space.
+  std::vector<RtosTask*> receivers;   // Tasks blocked waiting for an item.
+};
+
+/**
+ * \brief A FreeRTOS event group.
+ */
+struct RtosEventGroup {
+  EventBits_t bits = 0;
+  std::vector<RtosTask*> waiters;     // Tasks blocked in xEventGroupWaitBits().
+};
+
+/**
+ * \brief A FreeRTOS task.
+ */
+struct RtosTask {
+  uint32_t fiber = 0;                 // Fiber the task runs on.
+  std::string name;
+  TaskFunction_t function = nullptr;
+  void* parameter = nullptr;
+  UBaseType_t priority = 0;
+  uint32_t stackDepth = 0;
+  BaseType_t core = tskNO_AFFINITY;
+  uint32_t notifyValue = 0;
+  bool notifyPending = false;
+  bool suspended = false;             // vTaskSuspend() takes effect at the task's next kernel call.
+  std::vector<RtosTask*> notifyWait;  // Holds the task itself while it waits for a notification.
+  std::vector<RtosTask*> resumeWait;  // Holds the task itself while it is suspended.
+};
+
+typedef RtosTask* TaskHandle_t;
+typedef RtosQueue* QueueHandle_t;
+typedef RtosQueue* SemaphoreHandle_t;
+typedef RtosEventGroup* EventGroupHandle_t;
+
+/**
+ * \class RtosKernel
+ * \brief The emulated FreeRTOS kernel behind the API functions.
+ *
+ * The API functions act on `RtosKernel::current()`, a process-wide kernel
+ * unless another has been bound to the thread with `bind()`. Tasks created
+ * before `run()` start when it is called; `run()` may be called repeatedly to
+ * advance the system further.
+ *
+ * Example:
+ * \code{.cpp}
+ * RtosKernel& kernel = RtosKernel::current();
+ * kernel.setSeed(42);                 // vary equal-priority interleavings
+ * QueueHandle_t samples = xQueueCreate(16, sizeof(int));
+ * xTaskCreate(producer, "producer", 4096, samples, 2, nullptr);
+ * xTaskCreate(consumer, "consumer", 4096, samples, 1, nullptr);
+ * kernel.run(5000);                   // five seconds of virtual time
+ * \endcode
+ */
+class RtosKernel {
+public:
+  /**
+   * \brief Constructs a kernel.
+   *
+   * \param seed    uint64_t - 0 to run equal-priority tasks round-robin,
+   *                otherwise the seed of a reproducible random order.
+   */
+  explicit RtosKernel(uint64_t seed = 0) { reset(seed); }
+  RtosKernel(const RtosKernel&) = delete;
+  RtosKernel& operator=(const RtosKernel&) = delete;
+  ~RtosKernel() {}
+
+  /**
+   * \brief Discards every task, queue and event group and restarts the kernel.
+   *
+   * \param seed    uint64_t - The seed for the new run, see the constructor.
+   */
+  void reset(uint64_t seed = 0) {
+    _scheduler.reset(new FiberScheduler());
+    _scheduler->setSeed(seed);
+    _tasks.clear();
+    _byFiber.clear();
+    _queues.clear();
+    _groups.clear();
+    _queueOperations = 0;
+    _yieldPending = false;
+  }
+
+  /**
+   * \brief Reorders equal-priority tasks from a seed, see the constructor.
+   */
+  void setSeed(uint64_t seed) { _scheduler->setSeed(seed); }
+
+  /**
+   * \brief Runs tasks until the clock reaches a point in virtual time or nothing is left to run.
+   *
+   * \param untilMillis   uint64_t - Virtual time at which to stop, in milliseconds.
+   * \return bool         true if every task has returned or been deleted.
+   */
+  bool run(uint64_t untilMillis) {
+    RtosKernel* previous = bind(this);
+    bool done = _scheduler->run(untilMillis);
+    bind(previous);
+    return done;
+  }
+
+  /**
+   * \brief Returns the scheduler the tasks run on.
+   */
+  FiberScheduler& scheduler() { return *_scheduler; }
+
+  /**
+   * \brief Returns the number of successful queue, semaphore and mutex operations.
+   */
+  uint64_t queueOperations() const { return _queueOperations; }
+
+  /**
+   * \brief Returns the task that is running, or nullptr outside a task.
+   */
+  RtosTask* currentTask() {
+    uint32_t fiber = _scheduler->running();
+    return (fiber < _byFiber.size()) ? _byFiber[fiber] : nullptr;
+  }
+
+  /**
+   * \brief Returns the kernel the API functions act on in the calling thread.
+   */
+  static RtosKernel& current() {
+    RtosKernel* bound = slot();
+    if (bound == nullptr) {
+      static RtosKernel process;
+      return process;
+    }
+    return *bound;
+  }
+
+  /**
+   * \brief Binds a kernel to the calling thread.
+   *
+   * \param kernel    RtosKernel* - The kernel, or nullptr for the process-wide one.
+   * \return RtosKernel*  The previously bound kernel, so callers can restore it.
+   */
+  static RtosKernel* bind(RtosKernel* kernel) {
+    RtosKernel* previous = slot();
+    slot() = kernel;
+    return previous;
+  }
+
+  // Tasks
+
+  BaseType_t createTask(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    std::unique_ptr<RtosTask> task(new RtosTask());
+    RtosTask* created = task.get();
+    created->name = (name != nullptr) ? name : "";
+    created->function = function;
+    created->parameter = parameter;
+    created->priority = (priority < configMAX_PRIORITIES) ? priority : configMAX_PRIORITIES - 1;
+    created->stackDepth = stackDepth;
+    created->core = core;
+    created->fiber = _scheduler->spawn([created]() {
+      try {
+        created->function(created->parameter);
+      } catch (const TaskDeleted&) {
+      }
+    });
+    _scheduler->setPriority(created->fiber, created->priority);
+    if (created->fiber >= _byFiber.size()) {
+      _byFiber.resize(created->fiber + 1, nullptr);
+    }
+    _byFiber[created->fiber] = created;
+    _tasks.push_back(std::move(task));
+    if (handle != nullptr) {
+      *handle = created;
+    }
+    wokeHigherPriority(created);
+    preempt();
+    return pdPASS;
+  }
+
+  void deleteTask(TaskHandle_t task) {
+    RtosTask* self = currentTask();
+    if (task == nullptr || task == self) {
+      if (self != nullptr) {
+        throw TaskDeleted();
+      }
+      return;
+    }
+    _scheduler->kill(task->fiber);
+  }
+
+  void delayTask(TickType_t ticks) {
+    checkSuspended();
+    _scheduler->sleepFor((uint64_t)ticks * 1000);
+  }
+
+  BaseType_t delayTaskUntil(TickType_t* previousWake, TickType_t increment) {
+    checkSuspended();
+    TickType_t wake = *previousWake + increment;
+    TickType_t now = tickCount();
+    *previousWake = wake;
+    if ((int32_t)(wake - now) <= 0) {
+      return pdFALSE;
+    }
+    _scheduler->sleepFor((uint64_t)(wake - now) * 1000);
+    return pdTRUE;
+  }
+
+  TickType_t tickCount() const { return (TickType_t)VirtualClock::current().nowMillis(); }
+
+  void yield() { _scheduler->yield(); }
+
+  void setPriority(TaskHandle_t task, UBaseType_t priority) {
+    RtosTask* target = (task != nullptr) ? task : currentTask();
+    if (target == nullptr) {
+      return;
+    }
+    target->priority = (priority < configMAX_PRIORITIES) ? priority : configMAX_PRIORITIES - 1;
+    _scheduler->setPriority(target->fiber, target->priority);
+    _scheduler->yield();
+  }
+
+  void suspend(TaskHandle_t task) {
+    RtosTask* target = (task != nullptr) ? task : currentTask();
+    if (target != nullptr) {
+      target->suspended = true;
+      checkSuspended();
+    }
+  }
+
+  void resume(TaskHandle_t task) {
+    if (task == nullptr || !task->suspended) {
+      return;
+    }
+    task->suspended = false;
+    wakeAll(task->resumeWait);
+    preempt();
+  }
+
+  // Notifications
+
+  BaseType_t notify(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* woken = nullptr) {
+    bool delivered = true;
+    switch (action) {
+      case eNoAction:
+        break;
+      case eSetBits:
+        task->notifyValue |= value;
+        break;
+      case eIncrement:
+        ++task->notifyValue;
+        break;
+      case eSetValueWithOverwrite:
+        task->notifyValue = value;
+        break;
+      case eSetValueWithoutOverwrite:
+        if (task->notifyPending) {
+          delivered = false;
+        } else {
+          task->notifyValue = value;
+        }
+        break;
+    }
+    if (delivered) {
+      task->notifyPending = true;
+      wake(task->notifyWait, false, woken);
+      if (woken == nullptr) {
+        preempt();
+      }
+    }
+    return delivered ? pdPASS : pdFAIL;
+  }
+
+  uint32_t notifyTake(bool clearOnExit, TickType_t ticks) {
+    RtosTask* self = currentTask();
+    if (self == nullptr) {
+      return 0;
+    }
+    uint64_t deadline = deadlineFor(ticks);
+    while (self->notifyValue == 0) {
+      if (!block(self->notifyWait, deadline)) {
+        return 0;
+      }
+    }
+    uint32_t value = self->notifyValue;
+    self->notifyValue = clearOnExit ? 0 : value - 1;
+    self->notifyPending = false;
+    return value;
+  }
+
+  BaseType_t notifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t* value, TickType_t ticks) {
+    RtosTask* self = currentTask();
+    if (self == nullptr) {
+      return pdFALSE;
+    }
+    if (!self->notifyPending) {
+      self->notifyValue &= ~clearOnEntry;
+    }
+    uint64_t deadline = deadlineFor(ticks);
+    while (!self->notifyPending) {
+      if (!block(self->notifyWait, deadline)) {
+        if (value != nullptr) {
+          *value = self->notifyValue;
+        }
+        return pdFALSE;
+      }
+    }
+    if (value != nullptr) {
+      *value = self->notifyValue;
+    }
+    self->notifyValue &= ~clearOnExit;
+    self->notifyPending = false;
+    return pdTRUE;
+  }
+
+  // Queues, semaphores and mutexes
+
+  QueueHandle_t createQueue(UBaseType_t length, UBaseType_t itemSize, eRtosQueueKind kind = RTOS_QUEUE, UBaseType_t initial = 0) {
+    std::unique_ptr<RtosQueue> queue(new RtosQueue());
+    queue->kind = kind;
+    queue->length = length;
+    queue->itemSize = itemSize;
+    queue->count = initial;
+    queue->storage.resize((size_t)length * itemSize);
+    _queues.push_back(std::move(queue));
+    return _queues.back().get();
+  }
+
+  /**
+   * \brief Sends an item, or gives a semaphore when the queue holds no items.
+   */
+  BaseType_t send(QueueHandle_t queue, const void* item, TickType_t ticks, bool toFront, BaseType_t* woken = nullptr) {
+    checkSuspended();
+    uint64_t deadline = deadlineFor(ticks);
+    while (queue->count == queue->length) {
+      if (woken != nullptr || !block(queue->senders, deadline)) {
+        return errQUEUE_FULL;
+      }
+    }
+    if (queue->itemSize > 0) {
+      UBaseType_t slot;
+      if (toFront) {
+        queue->head = (queue->head + queue->length - 1) % queue->length;
+        slot = queue->head;
+      } else {
+        slot = (queue->head + queue->count) % queue->length;
+      }
+      memcpy(&queue->storage[(size_t)slot * queue->itemSize], item, queue->itemSize);
+    }
+    ++queue->count;
+    ++_queueOperations;
+    wake(queue->receivers, true, woken);
+    if (woken == nullptr) {
+      preempt();
+    }
+    return pdPASS;
+  }
+
+  /**
+   * \brief Replaces the item of a one item queue, whether or not it is full.
+   */
+  BaseType_t overwrite(QueueHandle_t queue, const void* item, BaseType_t* woken = nullptr) {
+    if (queue->count == queue->length && queue->length > 0) {
+      queue->count = 0;
+    }
+    return send(queue, item, 0, false, woken);
+  }
+
+  /**
+   * \brief Receives or peeks an item, or takes a semaphore when the queue holds no items.
+   */
+  BaseType_t receive(QueueHandle_t queue, void* item, TickType_t ticks, bool peek, BaseType_t* woken = nullptr) {
+    checkSuspended();
+    uint64_t deadline = deadlineFor(ticks);
+    while (queue->count == 0) {
+      if (woken != nullptr || !block(queue->receivers, deadline)) {
+        return errQUEUE_EMPTY;
+      }
+    }
+    if (queue->itemSize > 0 && item != nullptr) {
+      memcpy(item, &queue->storage[(size_t)queue->head * queue->itemSize], queue->itemSize);
+    }
+    if (peek) {
+      // Another waiting receiver may take the item that is still there.
+      wake(queue->receivers, true, woken);
+      return pdPASS;
+    }
+    if (queue->itemSize > 0) {
+      queue->head = (queue->head + 1) % queue->length;
+    }
+    --queue->count;
+    ++_queueOperations;
+    wake(queue->senders, true, woken);
+    if (woken == nullptr) {
+      preempt();
+    }
+    return pdPASS;
+  }
+
+  BaseType_t take(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    RtosTask* self = currentTask();
+    if (semaphore->kind == RTOS_RECURSIVE_MUTEX && semaphore->holder != nullptr && semaphore->holder == self) {
+      ++semaphore->recursion;
+      return pdTRUE;
+    }
+    if (receive(semaphore, nullptr, ticks, false) != pdPASS) {
+      return pdFALSE;
+    }
+    if (semaphore->kind == RTOS_MUTEX || semaphore->kind == RTOS_RECURSIVE_MUTEX) {
+      semaphore->holder = self;
+      semaphore->recursion = 1;
+    }
+    return pdTRUE;
+  }
+
+  BaseType_t give(SemaphoreHandle_t semaphore, BaseType_t* woken = nullptr) {
+    if (semaphore->kind == RTOS_MUTEX || semaphore->kind == RTOS_RECURSIVE_MUTEX) {
+      if (semaphore->holder != currentTask()) {
+        return pdFALSE;
+      }
+      if (--semaphore->recursion > 0) {
+        return pdTRUE;
+      }
+      semaphore->holder = nullptr;
+    }
+    return (send(semaphore, nullptr, 0, false, woken) == pdPASS) ? pdTRUE : pdFALSE;
+  }
+
+  /**
+   * \brief Frees a queue, semaphore or mutex. As in FreeRTOS, no task may be blocked on it.
+   */
+  void deleteQueue(QueueHandle_t queue) { release(_queues, queue); }
+
+  void resetQueue(QueueHandle_t queue) {
+    queue->head = 0;
+    queue->count = 0;
+    wakeAll(queue->senders);
+  }
+
+  // Event groups
+
+  EventGroupHandle_t createEventGroup() {
+    _groups.emplace_back(new RtosEventGroup());
+    return _groups.back().get();
+  }
+
+  /**
+   * \brief Frees an event group. As in FreeRTOS, no task may be blocked on it.
+   */
+  void deleteEventGroup(EventGroupHandle_t group) { release(_groups, group); }
+
+  EventBits_t setBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t* woken = nullptr) {
+    group->bits |= bits;
+    EventBits_t result = group->bits;
+    wake(group->waiters, false, woken);
+    if (woken == nullptr) {
+      preempt();
+    }
+    return result;
+  }
+
+  EventBits_t clearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+  }
+
+  EventBits_t waitBits(EventGroupHandle_t group, EventBits_t bits, bool clearOnExit, bool waitForAll, TickType_t ticks) {
+    checkSuspended();
+    uint64_t deadline = deadlineFor(ticks);
+    while (true) {
+      EventBits_t set = group->bits & bits;
+      if (waitForAll ? (set == bits) : (set != 0)) {
+        EventBits_t result = group->bits;
+        if (clearOnExit) {
+          group->bits &= ~bits;
+        }
+        return result;
+      }
+      if (!block(group->waiters, deadline)) {
+        return group->bits;
+      }
+    }
+  }
+
+private:
+  struct TaskDeleted {};
+
+  static RtosKernel*& slot() {
+    thread_local RtosKernel* kernel = nullptr;
+    return kernel;
+  }
+
+  template<typename T>
+  static void release(std::vector<std::unique_ptr<T>>& owned, T* object) {
+    for (size_t i = 0; i < owned.size(); ++i) {
+      if (owned[i].get() == object) {
+        owned[i] = std::move(owned.back());
+        owned.pop_back();
+        return;
+      }
+    }
+  }
+
+  uint64_t deadlineFor(TickType_t ticks) const {
+    if (ticks == portMAX_DELAY) {
+      return UINT64_MAX;
+    }
+    return VirtualClock::current().nowMicros() + (uint64_t)ticks * 1000;
+  }
+
+  /**
+   * \brief Blocks the running task on a wait list until woken or the deadline passes.
+   *
+   * \return bool   false on timeout, or when not called from a task.
+   */
+  bool block(std::vector<RtosTask*>& waiters, uint64_t deadline) {
+    RtosTask* self = currentTask();
+    if (self == nullptr) {
+      return false;
+    }
+    uint64_t now = VirtualClock::current().nowMicros();
+    if (deadline <= now) {
+      return false;
+    }
+    waiters.push_back(self);
+    bool woken = _scheduler->park((deadline == UINT64_MAX) ? UINT64_MAX : deadline - now);
+    if (!woken) {
+      for (auto it = waiters.begin(); it != waiters.end(); ++it) {
+        if (*it == self) {
+          waiters.erase(it);
+          break;
+        }
+      }
+    }
+    return woken;
+  }
+
+  /**
+   * \brief Wakes the highest priority (then longest waiting) task of a wait list.
+   */
+  void wake(std::vector<RtosTask*>& waiters, bool one, BaseType_t* woken) {
+    while (!waiters.empty()) {
+      size_t best = 0;
+      for (size_t i = 1; i < waiters.size(); ++i) {
+        if (waiters[i]->priority > waiters[best]->priority) {
+          best = i;
+        }
+      }
+      RtosTask* task = waiters[best];
+      waiters.erase(waiters.begin() + best);
+      if (_scheduler->finished(task->fiber)) {
+        continue;
+      }
+      _scheduler->unpark(task->fiber);
+      if (wokeHigherPriority(task) && woken != nullptr) {
+        *woken = pdTRUE;
+      }
+      if (one) {
+        return;
+      }
+    }
+  }
+
+  void wakeAll(std::vector<RtosTask*>& waiters) { wake(waiters, false, nullptr); }
+
+  bool wokeHigherPriority(RtosTask* task) {
+    RtosTask* self = currentTask();
+    if (self == nullptr || task->priority > self->priority) {
+      _yieldPending = self != nullptr;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * \brief Lets a task that was just woken run if it outranks the running one.
+   */
+  void preempt() {
+    if (_yieldPending) {
+      _yieldPending = false;
+      _scheduler->yield();
+    }
+  }
+
+  void checkSuspended() {
+    RtosTask* self = currentTask();
+    while (self != nullptr && self->suspended) {
+      self->resumeWait.push_back(self);
+      _scheduler->park();
+    }
+  }
+
+  std::unique_ptr<FiberScheduler> _scheduler;
+  std::vector<std::unique_ptr<RtosTask>> _tasks;
+  std::vector<RtosTask*> _byFiber;    // Task running on each fiber, by fiber id.
+  std::vector<std::unique_ptr<RtosQueue>> _queues;
+  std::vector<std::unique_ptr<RtosEventGroup>> _groups;
+  uint64_t _queueOperations = 0;
+  bool _yieldPending = false;         // A woken task outranks the running one.
+};
+
+// Tasks
+
+inline BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter, UBaseType_t priority, TaskHandle_t* handle) {
+  return RtosKernel::current().createTask(function, name, stackDepth, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  return RtosKernel::current().createTask(function, name, stackDepth, parameter, priority, handle, core);
+}
+
+inline void vTaskDelete(TaskHandle_t task) { RtosKernel::current().deleteTask(task); }
+inline void vTaskDelay(TickType_t ticks) { RtosKernel::current().delayTask(ticks); }
+inline BaseType_t xTaskDelayUntil(TickType_t* previousWake, TickType_t increment) { return RtosKernel::current().delayTaskUntil(previousWake, increment); }
+inline void vTaskDelayUntil(TickType_t* previousWake, TickType_t increment) { RtosKernel::current().delayTaskUntil(previousWake, increment); }
+inline TickType_t xTaskGetTickCount() { return RtosKernel::current().tickCount(); }
+inline TickType_t xTaskGetTickCountFromISR() { return RtosKernel::current().tickCount(); }
+inline TaskHandle_t xTaskGetCurrentTaskHandle() { return RtosKernel::current().currentTask(); }
+inline UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+  RtosTask* target = (task != nullptr) ? task : RtosKernel::current().currentTask();
+  return (target != nullptr) ? target->priority : 0;
+}
+inline void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) { RtosKernel::current().setPriority(task, priority); }
+inline const char* pcTaskGetName(TaskHandle_t task) {
+  RtosTask* target = (task != nullptr) ? task : RtosKernel::current().currentTask();
+  return (target != nullptr) ? target->name.c_str() : "";
+}
+inline void vTaskSuspend(TaskHandle_t task) { RtosKernel::current().suspend(task); }
+inline void vTaskResume(TaskHandle_t task) { RtosKernel::current().resume(task); }
+inline BaseType_t xTaskResumeFromISR(TaskHandle_t task) { RtosKernel::current().resume(task); return pdFALSE; }
+#define taskYIELD()   RtosKernel::current().yield()
+
+// Notifications
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t task) { return RtosKernel::current().notify(task, 0, eIncrement); }
+inline void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* woken) {
+  BaseType_t ignored = pdFALSE;
+  RtosKernel::current().notify(task, 0, eIncrement, (woken != nullptr) ? woken : &ignored);
+}
+inline BaseType_t xTaskNotify(TaskHandle_t task, uint32_t value, eNotifyAction action) { return RtosKernel::current().notify(task, value, action); }
+inline BaseType_t xTaskNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action, BaseType_t* woken) {
+  BaseType_t ignored = pdFALSE;
+  return RtosKernel::current().notify(task, value, action, (woken != nullptr) ? woken : &ignored);
+}
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) { return RtosKernel::current().notifyTake(clearOnExit != pdFALSE, ticks); }
+inline BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t* value, TickType_t ticks) {
+  return RtosKernel::current().notifyWait(clearOnEntry, clearOnExit, value, ticks);
+}
+
+// Queues
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) { return RtosKernel::current().createQueue(length, itemSize); }
+inline void vQueueDelete(QueueHandle_t queue) { RtosKernel::current().deleteQueue(queue); }
+inline BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) { return RtosKernel::current().send(queue, item, ticks, false); }
+inline BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks) { return RtosKernel::current().send(queue, item, ticks, false); }
+inline BaseType_t xQueueSendToFront(QueueHandle_t queue, const void* item, TickType_t ticks) { return RtosKernel::current().send(queue, item, ticks, true); }
+inline BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item) { return RtosKernel::current().overwrite(queue, item); }
+inline BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) { return RtosKernel::current().receive(queue, item, ticks, false); }
+inline BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t ticks) { return RtosKernel::current().receive(queue, item, ticks, true); }
+inline BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+  BaseType_t ignored = pdFALSE;
+  return RtosKernel::current().send(queue, item, 0, false, (woken != nullptr) ? woken : &ignored);
+}
+inline BaseType_t xQueueSendToBackFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) { return xQueueSendFromISR(queue, item, woken); }
+inline BaseType_t xQueueOverwriteFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+  BaseType_t ignored = pdFALSE;
+  return RtosKernel::current().overwrite(queue, item, (woken != nullptr) ? woken : &ignored);
+}
+inline BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void* item, BaseType_t* woken) {
+  BaseType_t ignored = pdFALSE;
+  return RtosKernel::current().receive(queue, item, 0, false, (woken != nullptr) ? woken : &ignored);
+}
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) { return queue->count; }
+inline UBaseType_t uxQueueMessagesWaitingFromISR(QueueHandle_t queue) { return queue->count; }
+inline UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) { return queue->length - queue->count; }
+inline BaseType_t xQueueReset(QueueHandle_t queue) { RtosKernel::current().resetQueue(queue); return pdPASS; }
+
+// Semaphores and mutexes
+
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return RtosKernel::current().createQueue(1, 0, RTOS_BINARY_SEMAPHORE, 0); }
+inline SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  return RtosKernel::current().createQueue(maxCount, 0, RTOS_COUNTING_SEMAPHORE, initialCount);
+}
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return RtosKernel::current().createQueue(1, 0, RTOS_MUTEX, 1); }
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return RtosKernel::current().createQueue(1, 0, RTOS_RECURSIVE_MUTEX, 1); }
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) { RtosKernel::current().deleteQueue(semaphore); }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) { return RtosKernel::current().take(semaphore, ticks); }
+inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks) { return RtosKernel::current().take(semaphore, ticks); }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) { return RtosKernel::current().give(semaphore); }
+inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore) { return RtosKernel::current().give(semaphore); }
+inline BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t* woken) {
+  BaseType_t ignored = pdFALSE;
+  return RtosKernel::current().give(semaphore, (woken != nullptr) ? woken : &ignored);
+}
+inline BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t semaphore, BaseType_t* woken) {
+  BaseType_t ignored = pdFALSE;
+  return RtosKernel::current().receive(semaphore, nullptr, 0, false, (woken != nullptr) ? woken : &ignored);
+}
+inline UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore) { return semaphore->count; }
+inline TaskHandle_t xSemaphoreGetMutexHolder(SemaphoreHandle_t semaphore) { return semaphore->holder; }
+
+// Event groups
+
+inline EventGroupHandle_t xEventGroupCreate() { return RtosKernel::current().createEventGroup(); }
+inline void vEventGroupDelete(EventGroupHandle_t group) { RtosKernel::current().deleteEventGroup(group); }
+inline EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) { return RtosKernel::current().setBits(group, bits); }
+inline BaseType_t xEventGroupSetBitsFromISR(EventGroupHandle_t group, EventBits_t bits, BaseType_t* woken) {
+  BaseType_t ignored = pdFALSE;
+  RtosKernel::current().setBits(group, bits, (woken != nullptr) ? woken : &ignored);
+  return pdPASS;
+}
+inline EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) { return RtosKernel::current().clearBits(group, bits); }
+inline EventBits_t xEventGroupGetBits(EventGroupHandle_t group) { return group->bits; }
+inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit, BaseType_t waitForAll, TickType_t ticks) {
+  return RtosKernel::current().waitBits(group, bits, clearOnExit != pdFALSE, waitForAll != pdFALSE, ticks);
+}
+
+#endif // end of MOCK_FREERTOS_H
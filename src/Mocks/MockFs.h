@@ -31,13 +31,13 @@ public:
         _timeout = 0;
     }
 
-    size_t write(uint8_t) override { return this->mock<size_t>("write"); }
-    size_t write(const uint8_t *buf, size_t size) override { return this->mock<size_t>("write"); }
+    size_t write(uint8_t) override { return countBytes("write", this->mock<size_t>("write")); }
+    size_t write(const uint8_t *buf, size_t size) override { return countBytes("write", this->mock<size_t>("write")); }
     int available() override { return this->mock<int>("available"); }
     int read() override { return this->mock<int>("read"); }
     int peek() override { return this->mock<int>("peek"); }
     void flush() override {}
-    size_t read(uint8_t* buf, size_t size) { return this->mock<size_t>("read"); }
+    size_t read(uint8_t* buf, size_t size) { return fuzzBuffer(this->mock<size_t>("read"), buf, size); }
     size_t readBytes(char *buffer, size_t length)
     {
         return read((uint8_t*)buffer, length);
@@ -77,20 +77,20 @@ public:
     File open(const char* path, const char* mode = FILE_READ, const bool create = false) { return ifile; }
     File open(const String& path, const char* mode = FILE_READ, const bool create = false) { return ifile; }
 
-    bool exists(const char* path) { return this->mock<bool>("exists"); }
-    bool exists(const String& path) { return this->mock<bool>("exists"); }
+    bool exists(const char* path) { return this->mock<bool>("exists", path); }
+    bool exists(const String& path) { return this->mock<bool>("exists", path); }
 
-    bool remove(const char* path) { return this->mock<bool>("remove"); }
-    bool remove(const String& path) { return this->mock<bool>("remove"); }
+    bool remove(const char* path) { return this->mock<bool>("remove", path); }
+    bool remove(const String& path) { return this->mock<bool>("remove", path); }
 
-    bool rename(const char* pathFrom, const char* pathTo) { return this->mock<bool>("rename"); }
-    bool rename(const String& pathFrom, const String& pathTo) { return this->mock<bool>("rename"); }
+    bool rename(const char* pathFrom, const char* pathTo) { return this->mock<bool>("rename", pathFrom, pathTo); }
+    bool rename(const String& pathFrom, const String& pathTo) { return this->mock<bool>("rename", pathFrom, pathTo); }
 
-    bool mkdir(const char *path) { return this->mock<bool>("mkdir"); }
-    bool mkdir(const String &path) { return this->mock<bool>("mkdir"); }
+    bool mkdir(const char *path) { return this->mock<bool>("mkdir", path); }
+    bool mkdir(const String &path) { return this->mock<bool>("mkdir", path); }
 
-    bool rmdir(const char *path) { return this->mock<bool>("rmdir"); }
-    bool rmdir(const String &path) { return this->mock<bool>("rmdir"); }
+    bool rmdir(const char *path) { return this->mock<bool>("rmdir", path); }
+    bool rmdir(const String &path) { return this->mock<bool>("rmdir", path); }
 
 
 protected:
@@ -3,6 +3,9 @@
 
 #include <Arduino.h>
 #include <Emulator.h>
+#include <LinkModel.h>
+#include <RouteTable.h>
+#include <VirtualClock.h>
 
 #define HTTP_METHOD_GET    "GET"
 #define HTTP_METHOD_POST   "POST"
@@ -22,7 +25,7 @@ static const int MOCK_HTTP_ERROR_API = -2;
 static const int MOCK_HTTP_ERROR_TIMED_OUT = -3; 
 static const int MOCK_HTTP_ERROR_INVALID_RESPONSE = -4;
 
-class HttpClient : public Emulator, public Client {
+class HttpClient : public Emulator, public Client, public Linkable {
     public:
     HttpClient(Client& aClient, const char* aServerName, uint16_t aServerPort = 443) {}
     HttpClient(Client& aClient, const String& aServerName, uint16_t aServerPort = 443) {}
@@ -55,15 +58,15 @@ class HttpClient : public Emulator, public Client {
       @param aURLPath     Url to request
       @return 0 if successful, else error
     */
-    int get(const char* aURLPath) { return this->mock<int>("get"); }
-    int get(const String& aURLPath) { return this->mock<int>("get"); }
+    int get(const char* aURLPath) { return request(HTTP_METHOD_GET, aURLPath, "get"); }
+    int get(const String& aURLPath) { return request(HTTP_METHOD_GET, aURLPath.c_str(), "get"); }
 
     /** Connect to the server and start to send a POST request.
       @param aURLPath     Url to request
       @return 0 if successful, else error
     */
-    int post(const char* aURLPath) { return this->mock<int>("post"); }
-    int post(const String& aURLPath) { return this->mock<int>("post"); }
+    int post(const char* aURLPath) { return request(HTTP_METHOD_POST, aURLPath, "post"); }
+    int post(const String& aURLPath) { return request(HTTP_METHOD_POST, aURLPath.c_str(), "post"); }
 
     /** Connect to the server and send a POST request
         with body and content type
@@ -72,16 +75,16 @@ class HttpClient : public Emulator, public Client {
       @param aBody        Body of the request
       @return 0 if successful, else error
     */
-    int post(const char* aURLPath, const char* aContentType, const char* aBody) { return this->mock<int>("post"); }
-    int post(const String& aURLPath, const String& aContentType, const String& aBody) { return this->mock<int>("post"); }
-    int post(const char* aURLPath, const char* aContentType, int aContentLength, const uint8_t aBody[]) { return this->mock<int>("post"); }
+    int post(const char* aURLPath, const char* aContentType, const char* aBody) { return request(HTTP_METHOD_POST, aURLPath, "post"); }
+    int post(const String& aURLPath, const String& aContentType, const String& aBody) { return request(HTTP_METHOD_POST, aURLPath.c_str(), "post"); }
+    int post(const char* aURLPath, const char* aContentType, int aContentLength, const uint8_t aBody[]) { return request(HTTP_METHOD_POST, aURLPath, "post"); }
 
     /** Connect to the server and start to send a PUT request.
       @param aURLPath     Url to request
       @return 0 if successful, else error
     */
-    int put(const char* aURLPath) { return this->mock<int>("put"); }
-    int put(const String& aURLPath) { return this->mock<int>("put"); }
+    int put(const char* aURLPath) { return request(HTTP_METHOD_PUT, aURLPath, "put"); }
+    int put(const String& aURLPath) { return request(HTTP_METHOD_PUT, aURLPath.c_str(), "put"); }
 
     /** Connect to the server and send a PUT request
         with body and content type
@@ -90,16 +93,16 @@ class HttpClient : public Emulator, public Client {
       @param aBody        Body of the request
       @return 0 if successful, else error
     */
-    int put(const char* aURLPath, const char* aContentType, const char* aBody) { return this->mock<int>("put"); }
-    int put(const String& aURLPath, const String& aContentType, const String& aBody) { return this->mock<int>("put"); }
-    int put(const char* aURLPath, const char* aContentType, int aContentLength, const uint8_t aBody[]) { return this->mock<int>("put"); }
+    int put(const char* aURLPath, const char* aContentType, const char* aBody) { return request(HTTP_METHOD_PUT, aURLPath, "put"); }
+    int put(const String& aURLPath, const String& aContentType, const String& aBody) { return request(HTTP_METHOD_PUT, aURLPath.c_str(), "put"); }
+    int put(const char* aURLPath, const char* aContentType, int aContentLength, const uint8_t aBody[]) { return request(HTTP_METHOD_PUT, aURLPath, "put"); }
 
     /** Connect to the server and start to send a PATCH request.
       @param aURLPath     Url to request
       @return 0 if successful, else error
     */
-    int patch(const char* aURLPath) { return this->mock<int>("patch"); }
-    int patch(const String& aURLPath) { return this->mock<int>("patch"); }
+    int patch(const char* aURLPath) { return request(HTTP_METHOD_PATCH, aURLPath, "patch"); }
+    int patch(const String& aURLPath) { return request(HTTP_METHOD_PATCH, aURLPath.c_str(), "patch"); }
 
     /** Connect to the server and send a PATCH request
         with body and content type
@@ -108,16 +111,16 @@ class HttpClient : public Emulator, public Client {
       @param aBody        Body of the request
       @return 0 if successful, else error
     */
-    int patch(const char* aURLPath, const char* aContentType, const char* aBody) { return this->mock<int>("patch"); }
-    int patch(const String& aURLPath, const String& aContentType, const String& aBody) { return this->mock<int>("patch"); }
-    int patch(const char* aURLPath, const char* aContentType, int aContentLength, const uint8_t aBody[]) { return this->mock<int>("patch"); }
+    int patch(const char* aURLPath, const char* aContentType, const char* aBody) { return request(HTTP_METHOD_PATCH, aURLPath, "patch"); }
+    int patch(const String& aURLPath, const String& aContentType, const String& aBody) { return request(HTTP_METHOD_PATCH, aURLPath.c_str(), "patch"); }
+    int patch(const char* aURLPath, const char* aContentType, int aContentLength, const uint8_t aBody[]) { return request(HTTP_METHOD_PATCH, aURLPath, "patch"); }
 
     /** Connect to the server and start to send a DELETE request.
       @param aURLPath     Url to request
       @return 0 if successful, else error
     */
-    int del(const char* aURLPath) { return this->mock<int>("del"); }
-    int del(const String& aURLPath) { return this->mock<int>("del"); }
+    int del(const char* aURLPath) { return request(HTTP_METHOD_DELETE, aURLPath, "del"); }
+    int del(const String& aURLPath) { return request(HTTP_METHOD_DELETE, aURLPath.c_str(), "del"); }
 
     /** Connect to the server and send a DELETE request
         with body and content type
@@ -126,9 +129,9 @@ class HttpClient : public Emulator, public Client {
       @param aBody        Body of the request
       @return 0 if successful, else error
     */
-    int del(const char* aURLPath, const char* aContentType, const char* aBody) { return this->mock<int>("del"); }
-    int del(const String& aURLPath, const String& aContentType, const String& aBody) { return this->mock<int>("del"); }
-    int del(const char* aURLPath, const char* aContentType, int aContentLength, const uint8_t aBody[]) { return this->mock<int>("del"); }
+    int del(const char* aURLPath, const char* aContentType, const char* aBody) { return request(HTTP_METHOD_DELETE, aURLPath, "del"); }
+    int del(const String& aURLPath, const String& aContentType, const String& aBody) { return request(HTTP_METHOD_DELETE, aURLPath.c_str(), "del"); }
+    int del(const char* aURLPath, const char* aContentType, int aContentLength, const uint8_t aBody[]) { return request(HTTP_METHOD_DELETE, aURLPath, "del"); }
 
     /** Connect to the server and start to send the request.
         If a body is provided, the entire request (including headers and body) will be sent
@@ -143,7 +146,7 @@ class HttpClient : public Emulator, public Client {
                      const char* aHttpMethod,
                      const char* aContentType = NULL,
                      int aContentLength = -1,
-                     const uint8_t aBody[] = NULL) { return this->mock<int>("del"); }
+                     const uint8_t aBody[] = NULL) { return request(aHttpMethod, aURLPath, "del"); }
 
     /** Send an additional header line.  This can only be called in between the
       calls to beginRequest and endRequest.
@@ -194,24 +197,48 @@ class HttpClient : public Emulator, public Client {
     /** Get the HTTP status code contained in the response.
       For example, 200 for successful request, 404 for file not found, etc.
     */
-    int responseStatusCode() { return this->mock<int>("responseStatusCode"); }
+    int responseStatusCode() {
+      if (_response != nullptr) {
+        return _response->status;
+      }
+      return this->mock<int>("responseStatusCode");
+    }
 
     /** Check if a header is available to be read.
       Use readHeaderName() to read header name, and readHeaderValue() to
       read the header value
       MUST be called after responseStatusCode() and before contentLength()
     */
-    bool headerAvailable() { return this->mock<bool>("headerAvailable"); }
+    bool headerAvailable() {
+      if (_response != nullptr) {
+        if (_nextHeader >= _response->headers.size()) {
+          return false;
+        }
+        _currentHeader = _nextHeader++;
+        return true;
+      }
+      return this->mock<bool>("headerAvailable");
+    }
 
     /** Read the name of the current response header.
       Returns empty string if a header is not available.
     */
-    String readHeaderName() { return this->mock<String>("readHeaderName"); }
+    String readHeaderName() {
+      if (_response != nullptr) {
+        return (_currentHeader < _response->headers.size()) ? String(_response->headers[_currentHeader].first.c_str()) : String("");
+      }
+      return this->mock<String>("readHeaderName");
+    }
 
     /** Read the vallue of the current response header.
       Returns empty string if a header is not available.
     */
-    String readHeaderValue() { return this->mock<String>("readHeaderValue"); }
+    String readHeaderValue() {
+      if (_response != nullptr) {
+        return (_currentHeader < _response->headers.size()) ? String(_response->headers[_currentHeader].second.c_str()) : String("");
+      }
+      return this->mock<String>("readHeaderValue");
+    }
 
     /** Read the next character of the response headers.
       This functions in the same way as read() but to be used when reading
@@ -231,18 +258,34 @@ class HttpClient : public Emulator, public Client {
       MUST be called after responseStatusCode()
       @return HTTP_SUCCESS if successful, else an error code
     */
-    int skipResponseHeaders() { return this->mock<int>("skipResponseHeaders"); }
+    int skipResponseHeaders() {
+      if (_response != nullptr) {
+        _nextHeader = _response->headers.size();
+        return MOCK_HTTP_SUCCESS;
+      }
+      return this->mock<int>("skipResponseHeaders");
+    }
 
     /** Test whether all of the response headers have been consumed.
       @return true if we are now processing the response body, else false
     */
-    bool endOfHeadersReached() { return this->mock<bool>("endOfHeadersReached"); }
+    bool endOfHeadersReached() {
+      if (_response != nullptr) {
+        return _nextHeader >= _response->headers.size();
+      }
+      return this->mock<bool>("endOfHeadersReached");
+    }
 
     /** Test whether the end of the body has been reached.
       Only works if the Content-Length header was returned by the server
       @return true if we are now at the end of the body, else false
     */
-    bool endOfBodyReached() { return this->mock<bool>("endOfBodyReached"); }
+    bool endOfBodyReached() {
+      if (_response != nullptr) {
+        return _bodyRead >= _response->body.size();
+      }
+      return this->mock<bool>("endOfBodyReached");
+    }
     bool endOfStream() { return endOfBodyReached(); };
     bool completed() { return endOfBodyReached(); };
 
@@ -252,7 +295,12 @@ class HttpClient : public Emulator, public Client {
       @return Length of the body, in bytes, or kNoContentLengthHeader if no
       Content-Length header was returned by the server
     */
-    int contentLength() { return this->mock<int>("contentLength"); }
+    int contentLength() {
+      if (_response != nullptr) {
+        return (int)_response->body.size();
+      }
+      return this->mock<int>("contentLength");
+    }
 
     /** Returns if the response body is chunked
       @return true if response body is chunked, false otherwise
@@ -264,7 +312,14 @@ class HttpClient : public Emulator, public Client {
       MUST be called after responseStatusCode()
       @return response body of request as a String
     */
-    String responseBody() { return this->mock<String>("responseBody"); }
+    String responseBody() {
+      if (_response != nullptr) {
+        String body(_response->body.substr(_bodyRead).c_str());
+        _bodyRead = _response->body.size();
+        return body;
+      }
+      return this->mock<String>("responseBody");
+    }
 
     /** Enables connection keep-alive mode
     */
@@ -281,22 +336,40 @@ class HttpClient : public Emulator, public Client {
       if (iState < eRequestSent) {
         finishHeaders(); 
       }
-      return this->mock<size_t>("write");
+      return meterWrite(countBytes("write", this->mock<size_t>("write")));
     }
     size_t write(const uint8_t *aBuffer, size_t aSize) {
       if (iState < eRequestSent) {
         finishHeaders();
       } 
-      return this->mock<size_t>("write");
+      return meterWrite(countBytes("write", this->mock<size_t>("write")));
     }
     // Inherited from Stream
-    int available() { return this->mock<int>("available"); }
+    int available() {
+      if (_response != nullptr) {
+        return (int)(_response->body.size() - _bodyRead);
+      }
+      return this->mock<int>("available");
+    }
     /** Read the next byte from the server.
       @return Byte read or -1 if there are no bytes available.
     */
-    int read() { return this->mock<int>("read"); }
-    int read(uint8_t *buf, size_t size) { return this->mock<int>("read"); }
-    int readBytes(uint8_t *buf, size_t size) { return this->mock<int>("read"); }
+    int read() {
+      int byte = -1;
+      if (_response != nullptr) {
+        byte = (_bodyRead < _response->body.size()) ? (uint8_t)_response->body[_bodyRead++] : -1;
+      } else {
+        byte = this->mock<int>("read");
+      }
+      return (byte < 0 || meterRead(1) > 0) ? byte : -1;
+    }
+    int read(uint8_t *buf, size_t size) {
+      if (_response != nullptr) {
+        return meterRead(readBody(buf, size));
+      }
+      return meterRead(fuzzBuffer(this->mock<int>("read"), buf, size));
+    }
+    int readBytes(uint8_t *buf, size_t size) { return read(buf, size); }
     int peek() { return iClient->peek(); }
     void flush() { iClient->flush(); }
 
@@ -304,15 +377,65 @@ class HttpClient : public Emulator, public Client {
     int connect(IPAddress ip, uint16_t port) { return iClient->connect(ip, port); }
     int connect(const char *host, uint16_t port) { return iClient->connect(host, port); }
     void stop() {}
-    uint8_t connected() { return this->mock<uint8_t>("connected"); };
+    uint8_t connected() { uint8_t state = this->mock<uint8_t>("connected"); return linkIsReset() ? 0 : state; };
     operator bool() { return bool(iClient); };
     uint32_t httpResponseTimeout() { return iHttpResponseTimeout; };
     void setHttpResponseTimeout(uint32_t timeout) { iHttpResponseTimeout = timeout; };
+
+    /** Answer requests from an emulated server instead of scripted values.
+      Each request is matched against the route table, the route's latency is
+      charged to the virtual clock, and the response accessors (status code,
+      headers, body, read) then serve that route until the next request.
+      @param routes  The route table to consult, which must outlive this client
+    */
+    void serve(const RouteTable& routes) { _routes = &routes; _response = nullptr; }
+
+    /** Stop consulting a route table and return to scripted values.
+    */
+    void stopServing() { _routes = nullptr; _response = nullptr; }
 protected:
     /** Reset internal state data back to the "just initialised" state
     */
     void resetState() {}
 
+    /** Issue a request against the route table if one is being served,
+        otherwise return the scripted value for the calling method.
+      @param aHttpMethod  Type of HTTP request to make, e.g. "GET", "POST", etc.
+      @param aURLPath     Url to request
+      @param aMockName    Name of the scripted method to fall back to
+      @return 0 if successful, else error
+    */
+    int request(const char* aHttpMethod, const char* aURLPath, const char* aMockName) {
+      if (_routes == nullptr) {
+        return this->mock<int>(aMockName, aURLPath);
+      }
+      _response = &_routes->resolve(aHttpMethod, aURLPath);
+      _nextHeader = 0;
+      _currentHeader = SIZE_MAX;
+      _bodyRead = 0;
+      TraceRecorder* trace = TraceRecorder::active();
+      uint64_t started = (trace != nullptr) ? trace->now() : 0;
+      VirtualClock::wait((uint64_t)_response->latency * 1000);
+      if (trace != nullptr) {
+        trace->complete(this, "HttpClient", "http", std::string(aHttpMethod) + " " + aURLPath + " " + std::to_string(_response->status), started, trace->now() - started);
+      }
+      return MOCK_HTTP_SUCCESS;
+    }
+
+    /** Copy up to size bytes of the served response body into buf.
+      @return Number of bytes copied, or -1 once the body is exhausted
+    */
+    int readBody(uint8_t *buf, size_t size) {
+      size_t remaining = _response->body.size() - _bodyRead;
+      if (remaining == 0) {
+        return -1;
+      }
+      size_t n = (size < remaining) ? size : remaining;
+      memcpy(buf, _response->body.data() + _bodyRead, n);
+      _bodyRead += n;
+      return (int)n;
+    }
+
     /** Send the first part of the request and the initial headers.
       @param aURLPath	Url to request
       @param aHttpMethod  Type of HTTP request to make, e.g. "GET", "POST", etc.
@@ -377,6 +500,16 @@ protected:
     bool iConnectionClose;
     bool iSendDefaultRequestHeaders;
     String iHeaderLine;
+    // Emulated server consulted for requests, if any
+    const RouteTable* _routes = nullptr;
+    // Route serving the current response, if any
+    const HttpRoute* _response = nullptr;
+    // Index of the next response header to make available
+    size_t _nextHeader = 0;
+    // Index of the response header returned by readHeaderName/Value
+    size_t _currentHeader = SIZE_MAX;
+    // How many bytes of the served body have been read
+    size_t _bodyRead = 0;
 };
 
 #endif
@@ -3,24 +3,25 @@
 
 #include <Arduino.h>
 #include <Emulator.h>
+#include <LinkModel.h>
 
 template<class T>
-class SSLClient : public Emulator, public Client  {
+class SSLClient : public Emulator, public Client, public Linkable  {
 public:
     SSLClient() {}
     SSLClient(T* client) {}
     ~SSLClient() {}
-    int connect(IPAddress ip, uint16_t port) { return this->mock<int>("connect"); };
-    int connect(const char *host, uint16_t port) { return this->mock<int>("connect"); };
-    size_t write(uint8_t) { return this->mock<size_t>("write"); };
-    size_t write(const uint8_t *buf, size_t size) { return this->mock<size_t>("write"); };
+    int connect(IPAddress ip, uint16_t port) { int result = this->mock<int>("connect"); return meterConnect(result > 0) ? result : 0; };
+    int connect(const char *host, uint16_t port) { int result = this->mock<int>("connect"); return meterConnect(result > 0) ? result : 0; };
+    size_t write(uint8_t) { return meterWrite(countBytes("write", this->mock<size_t>("write"))); };
+    size_t write(const uint8_t *buf, size_t size) { return meterWrite(countBytes("write", this->mock<size_t>("write"))); };
     int available() { return this->mock<int>("available"); };
-    int read() { return this->mock<int>("read"); };
-    int read(uint8_t *buf, size_t size) { return this->mock<int>("read"); };
+    int read() { int byte = this->mock<int>("read"); return (byte < 0 || meterRead(1) > 0) ? byte : -1; };
+    int read(uint8_t *buf, size_t size) { return meterRead(fuzzBuffer(this->mock<int>("read"), buf, size)); };
     int peek() { return this->mock<int>("peek"); };
     void flush() {};
     void stop() {};
-    uint8_t connected() { return this->mock<uint8_t>("connected"); };
+    uint8_t connected() { uint8_t state = this->mock<uint8_t>("connected"); return linkIsReset() ? 0 : state; };
     operator bool() { return bool(true); };
 };
 
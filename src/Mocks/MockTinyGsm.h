@@ -2,7 +2,15 @@
 #define MOCK_TINY_GSM_H
 
 #include <Arduino.h>
+#include <Client.h>
 #include <Emulator.h>
+#include <LinkModel.h>
+#include <SignalTrace.h>
+#include <VirtualClock.h>
+#include "MockAtModem.h"
+#include <cstdio>
+#include <deque>
+#include <string>
 
 enum RegStatus {
   MOCK_REG_NO_RESULT    = -1,
@@ -14,29 +22,515 @@ enum RegStatus {
   MOCK_REG_UNKNOWN      = 4,
 };
 
+enum RadioTechnology {
+  MOCK_RAT_GSM,
+  MOCK_RAT_GPRS,
+  MOCK_RAT_EDGE,
+  MOCK_RAT_UMTS,
+  MOCK_RAT_LTE_M,
+  MOCK_RAT_NB_IOT,
+};
+
+/**
+ * \brief What an emulated modem last reported about its network, as its
+ * TinyGsmClient sockets see it.
+ *
+ * \param registered  bool - Registered on the home or a roaming network.
+ * \param gprs        bool - A data context is attached.
+ * \param csq         int16_t - Signal quality as reported by AT+CSQ, 0-31 or 99 for unknown.
+ */
+struct ModemState {
+  bool registered = true;
+  bool gprs = true;
+  int16_t csq = 20;
+};
+
 class TinyGsm : public Emulator {
 public:
-    explicit TinyGsm(Stream& stream) {}
+    explicit TinyGsm(Stream& stream) : _stream(&stream) {}
     ~TinyGsm() {}
-    inline bool init() { return this->mock<bool>("init"); }
-    inline RegStatus getRegistrationStatus() { return this->mock<RegStatus>("getRegistrationStatus"); }
-    inline bool waitForNetwork(uint32_t timeout_ms, bool check_signal=false) { return this->mock<bool>("waitForNetwork"); }
-    bool gprsConnect(const char* apn, const char* user, const char* pwd) { return this->mock<bool>("gprsConnect"); }
-    bool isGprsConnected() { return this->mock<bool>("isGprsConnected"); }
-    String getSimCCID() { return this->mock<String>("getSimCCID"); }
-    String getIMEI() { return this->mock<String>("getIMEI"); }
-    String getOperator() { return this->mock<String>("getOperator"); }
-    inline IPAddress localIP() { return this->mock<IPAddress>("localIP"); }
-    inline int16_t getSignalQuality() { return this->mock<int16_t>("getSignalQuality"); }
-    inline String getModemName() { return this->mock<String>("getModemName"); }
-    inline String getModemInfo() { return this->mock<String>("getModemInfo"); }
-    inline bool isNetworkConnected() { return this->mock<bool>("isNetworkConnected"); }
+    inline bool init() {
+      if (_atMode) {
+        return sendAT("") == 1 && sendAT("E0") == 1;
+      }
+      return this->mock<bool>("init");
+    }
+    inline RegStatus getRegistrationStatus() {
+      if (_trace != nullptr) {
+        return (RegStatus)traceSample().registration;
+      }
+      RegStatus status;
+      if (_atMode) {
+        String reply;
+        if (sendAT("+CREG?", &reply) != 1) {
+          return MOCK_REG_NO_RESULT;
+        }
+        int comma = reply.indexOf(',');
+        status = (RegStatus)((comma < 0) ? -1 : reply.substring(comma + 1).toInt());
+      } else {
+        status = this->mock<RegStatus>("getRegistrationStatus");
+      }
+      if (status != MOCK_REG_NO_RESULT) {
+        observe(status == MOCK_REG_OK_HOME || status == MOCK_REG_OK_ROAMING, _state.gprs, _state.csq);
+      }
+      return status;
+    }
+    inline bool waitForNetwork(uint32_t timeout_ms, bool check_signal=false) {
+      if (_atMode) {
+        uint64_t deadline = VirtualClock::current().nowMicros() + (uint64_t)timeout_ms * 1000;
+        do {
+          if (isNetworkConnected()) {
+            return true;
+          }
+          VirtualClock::wait((uint64_t)kNetworkPollInterval * 1000);
+        } while (VirtualClock::current().nowMicros() < deadline);
+        return false;
+      }
+      return this->mock<bool>("waitForNetwork");
+    }
+    bool gprsConnect(const char* apn, const char* user, const char* pwd) {
+      if (_atMode) {
+        String context = String("+CGDCONT=1,\"IP\",\"") + apn + "\"";
+        bool attached = sendAT(context.c_str()) == 1 && sendAT("+CGATT=1", nullptr, 10000) == 1 && sendAT("+CGACT=1,1", nullptr, 10000) == 1;
+        observe(_state.registered, attached, _state.csq);
+        return attached;
+      }
+      bool attached = this->mock<bool>("gprsConnect");
+      observe(_state.registered, attached, _state.csq);
+      return attached;
+    }
+    bool isGprsConnected() {
+      if (_trace != nullptr) {
+        return traceSample().gprs != 0;
+      }
+      bool attached;
+      if (_atMode) {
+        String reply;
+        attached = sendAT("+CGATT?", &reply) == 1 && reply.endsWith("1");
+      } else {
+        attached = this->mock<bool>("isGprsConnected");
+      }
+      observe(_state.registered, attached, _state.csq);
+      return attached;
+    }
+    String getSimCCID() {
+      if (_atMode) {
+        return queryLine("+CCID");
+      }
+      return this->mock<String>("getSimCCID");
+    }
+    String getIMEI() {
+      if (_atMode) {
+        return queryLine("+GSN");
+      }
+      return this->mock<String>("getIMEI");
+    }
+    String getOperator() {
+      if (_atMode) {
+        String reply = queryLine("+COPS?");
+        int open = reply.indexOf('"');
+        int close = reply.lastIndexOf('"');
+        return (open < 0 || close <= open) ? String("") : reply.substring(open + 1, close);
+      }
+      return this->mock<String>("getOperator");
+    }
+    inline IPAddress localIP() {
+      if (_atMode) {
+        String reply;
+        int a = 0, b = 0, c = 0, d = 0;
+        if (sendAT("+CIFSR", &reply) != 3 || sscanf(reply.c_str(), "%d.%d.%d.%d", &a, &b, &c, &d) != 4) {
+          return IPAddress(0, 0, 0, 0);
+        }
+        return IPAddress(a, b, c, d);
+      }
+      return this->mock<IPAddress>("localIP");
+    }
+    inline int16_t getSignalQuality() {
+      if (_trace != nullptr) {
+        return traceSample().csq;
+      }
+      int16_t csq;
+      if (_atMode) {
+        String reply = queryLine("+CSQ");
+        int colon = reply.indexOf(':');
+        csq = (colon < 0) ? 99 : (int16_t)reply.substring(colon + 1).toInt();
+      } else {
+        csq = this->mock<int16_t>("getSignalQuality");
+      }
+      observe(_state.registered, _state.gprs, csq);
+      return csq;
+    }
+    inline String getModemName() {
+      if (_atMode) {
+        return queryLine("I");
+      }
+      return this->mock<String>("getModemName");
+    }
+    inline String getModemInfo() {
+      if (_atMode) {
+        return queryLine("I");
+      }
+      return this->mock<String>("getModemInfo");
+    }
+    inline bool isNetworkConnected() {
+      if (_trace != nullptr) {
+        int8_t status = traceSample().registration;
+        return status == MOCK_REG_OK_HOME || status == MOCK_REG_OK_ROAMING;
+      }
+      if (_atMode) {
+        RegStatus status = getRegistrationStatus();
+        return status == MOCK_REG_OK_HOME || status == MOCK_REG_OK_ROAMING;
+      }
+      bool connected = this->mock<bool>("isNetworkConnected");
+      observe(connected, _state.gprs, _state.csq);
+      return connected;
+    }
+
+    /** Set the radio access technology the emulated modem is camped on.
+      Determines the throughput and round trip time of TinyGsmClient sockets.
+    */
+    void setRadioTechnology(RadioTechnology rat) {
+      if (rat != _rat) {
+        _rat = rat;
+        ++_stateVersion;
+      }
+    }
+    RadioTechnology radioTechnology() const { return _rat; }
+
+    /** Talk AT commands over the stream given to the constructor instead of
+      returning scripted values, e.g. to an AtModem or an emulated UART wired
+      to one. Waiting for responses is charged to the virtual clock.
+    */
+    void useAtCommands(bool enable = true) { _atMode = enable; }
+
+    /** Replay a recorded trace: getSignalQuality(), getRegistrationStatus(),
+      isNetworkConnected() and isGprsConnected() return what the device saw at
+      the current virtual time. The trace starts at the moment replay() is called.
+      @param trace   The trace, which must outlive the replay
+      @param offset  Milliseconds into the trace to start from
+    */
+    void replay(SignalTrace& trace, uint64_t offset = 0) {
+      _trace = &trace;
+      _traceOrigin = VirtualClock::current().nowMicros() / 1000 - offset;
+    }
+
+    /** Stop replaying and return to AT commands or scripted values.
+    */
+    void stopReplay() {
+      _trace = nullptr;
+      ++_stateVersion;
+    }
+
+    /** The network state sockets run on: what the firmware last read through
+      isNetworkConnected(), getRegistrationStatus(), isGprsConnected(),
+      gprsConnect() and getSignalQuality(), or the replayed trace at the current
+      virtual time. Reading it consumes no scripted values and sends no AT
+      commands. A modem starts registered and attached at CSQ 20, and returns
+      to that when reset.
+    */
+    const ModemState& networkState() {
+      refresh();
+      if (_trace != nullptr) {
+        const SignalSample& sample = traceSample();
+        observe(sample.registration == MOCK_REG_OK_HOME || sample.registration == MOCK_REG_OK_ROAMING, sample.gprs != 0, sample.csq);
+      }
+      return _state;
+    }
+
+    /** Change the network state sockets see without a call from the firmware,
+      e.g. to drop the network in the middle of a transfer.
+    */
+    void setNetworkState(const ModemState& state) {
+      refresh();
+      observe(state.registered, state.gprs, state.csq);
+    }
+
+    /** Counts changes of networkState() and the radio technology, so sockets
+      only rebuild their link when either changed.
+    */
+    uint32_t stateVersion() const { return _stateVersion; }
+
+    void reset() override {
+      Emulator::reset();
+      observe(true, true, 20);
+    }
+
+private:
+    void observe(bool registered, bool gprs, int16_t csq) {
+      if (registered != _state.registered || gprs != _state.gprs || csq != _state.csq) {
+        _state.registered = registered;
+        _state.gprs = gprs;
+        _state.csq = csq;
+        ++_stateVersion;
+      }
+    }
+
+    const SignalSample& traceSample() {
+      return _trace->at(VirtualClock::current().nowMicros() / 1000 - _traceOrigin);
+    }
+
+    /** Send "AT<command>" and collect the response.
+      @param command   The command without the "AT" prefix
+      @param payload   Receives the first information line of the response, if any
+      @param timeout   Milliseconds of virtual time to wait for a final result
+      @return 1 for OK, 2 for ERROR, 3 if the only response was an information line, 0 on timeout
+    */
+    int8_t sendAT(const char* command, String* payload = nullptr, unsigned long timeout = kResponseTimeout) {
+      while (_stream->available() > 0) {
+        _stream->read();
+      }
+      _stream->print("AT");
+      _stream->print(command);
+      _stream->print("\r\n");
+
+      String line;
+      bool informed = false;
+      uint64_t deadline = VirtualClock::current().nowMicros() + (uint64_t)timeout * 1000;
+      while (true) {
+        int c = _stream->read();
+        if (c < 0) {
+          if (VirtualClock::current().nowMicros() >= deadline) {
+            return informed ? 3 : 0;
+          }
+          VirtualClock::wait(1000);
+          continue;
+        }
+        if (c != '\r' && c != '\n') {
+          line += (char)c;
+          continue;
+        }
+        if (line.length() == 0 || line.startsWith("AT")) {
+          line = "";
+          continue;
+        }
+        if (line == "OK" || line == "SHUT OK") {
+          return 1;
+        }
+        if (line == "ERROR" || line.startsWith("+CME ERROR")) {
+          return 2;
+        }
+        if (!informed && payload != nullptr) {
+          *payload = line;
+        }
+        informed = true;
+        if (strcmp(command, "+CIFSR") == 0) {
+          return 3;
+        }
+        line = "";
+      }
+    }
+
+    String queryLine(const char* command) {
+      String reply;
+      sendAT(command, &reply);
+      return reply;
+    }
+
+    static const unsigned long kResponseTimeout = 1000;
+    static const unsigned long kNetworkPollInterval = 250;
+
+    Stream* _stream;
+    bool _atMode = false;
+    SignalTrace* _trace = nullptr;
+    uint64_t _traceOrigin = 0;
+    RadioTechnology _rat = MOCK_RAT_GPRS;
+    ModemState _state;
+    uint32_t _stateVersion = 0;
 };
 
-class TinyGsmClient {
+/**
+ * \class TinyGsmClient
+ * \brief A Client whose data path runs through an emulated TinyGsm modem.
+ *
+ * Connecting succeeds only while the modem's `networkState()` has a data
+ * context. Every transfer checks that state, which follows what the firmware
+ * last read from the modem (scripted values or AT responses) or a replayed
+ * trace, without consuming scripted values or sending AT commands of its own:
+ * losing registration or the data context drops the connection, and
+ * throughput and round trip time follow the modem's radio technology and
+ * signal quality through an internal LinkModel, rebuilt only when they change.
+ *
+ * Bytes written are kept for inspection with `sent()`, and the emulated server
+ * side queues response bytes with `feed()`. While a FuzzInput driving the
+ * modem is bound, `available()` and `read()` take their counts and bytes from
+ * it the way MockClient does: the configured response is the fed data.
+ */
+class TinyGsmClient : public Client {
 public:
-  TinyGsmClient(TinyGsm& mockModemDriver) {}
+  TinyGsmClient(TinyGsm& mockModemDriver, uint8_t mux = 0) : _modem(&mockModemDriver), _mux(mux) {}
   ~TinyGsmClient() {}
+
+  int connect(IPAddress, uint16_t) override { return open(); }
+  int connect(const char*, uint16_t) override { return open(); }
+
+  size_t write(uint8_t byte) override { return write(&byte, 1); }
+
+  size_t write(const uint8_t *buf, size_t size) override {
+    if (!alive()) {
+      return 0;
+    }
+    size_t n = _link.send(size);
+    if (_link.isReset()) {
+      _connected = false;
+      return 0;
+    }
+    _sent.append((const char*)buf, n);
+    return n;
+  }
+
+  int available() override {
+    if (!alive()) {
+      return 0;
+    }
+    int count;
+    return fuzzed("available", count) ? count : (int)_rx.size();
+  }
+
+  int read() override {
+    uint8_t byte;
+    return (read(&byte, 1) == 1) ? byte : -1;
+  }
+
+  int read(uint8_t *buf, size_t size) override {
+    if (!alive()) {
+      return -1;
+    }
+    int count;
+    if (fuzzed("read", count)) {
+      count = _modem->fuzzBuffer(count, buf, size);
+      return (count <= 0 || meter(count)) ? count : -1;
+    }
+    if (_rx.empty()) {
+      return -1;
+    }
+    size_t n = (size < _rx.size()) ? size : _rx.size();
+    if (!meter(n)) {
+      return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      buf[i] = _rx.front();
+      _rx.pop_front();
+    }
+    return _modem->fuzzBuffer((int)n, buf, size);
+  }
+
+  int peek() override { return _rx.empty() ? -1 : _rx.front(); }
+  void flush() override {}
+  void stop() override { _connected = false; }
+  uint8_t connected() override { return alive() ? 1 : 0; }
+  operator bool() override { return _connected; }
+
+  /** Queue bytes the emulated server sends to the device.
+  */
+  void feed(const uint8_t *buf, size_t size) { _rx.insert(_rx.end(), buf, buf + size); }
+  void feed(const char *text) { feed((const uint8_t*)text, strlen(text)); }
+
+  /** Bytes the device has written to the socket so far.
+  */
+  const std::string& sent() const { return _sent; }
+  void clearSent() { _sent.clear(); }
+
+  /** The link the socket's traffic is metered through, for its report.
+  */
+  LinkModel& link() { return _link; }
+
+  /** The multiplexed socket number this client was created with.
+  */
+  uint8_t mux() const { return _mux; }
+
+  /** Link characteristics for a radio technology at a signal quality.
+      Weak signal (low CSQ) reduces bandwidth and raises latency and loss.
+    @param rat  The radio access technology
+    @param csq  Signal quality as reported by AT+CSQ, 0-31 or 99 for unknown
+  */
+  static LinkProfile profileFor(RadioTechnology rat, int16_t csq) {
+    LinkProfile profile;
+    switch (rat) {
+      case MOCK_RAT_GSM:    profile.bandwidth = 9600;   profile.latency = 800; break;
+      case MOCK_RAT_GPRS:   profile.bandwidth = 40000;  profile.latency = 600; break;
+      case MOCK_RAT_EDGE:   profile.bandwidth = 150000; profile.latency = 300; break;
+      case MOCK_RAT_UMTS:   profile.bandwidth = 384000; profile.latency = 150; break;
+      case MOCK_RAT_LTE_M:  profile.bandwidth = 375000; profile.latency = 100; break;
+      case MOCK_RAT_NB_IOT: profile.bandwidth = 30000;  profile.latency = 1500; break;
+    }
+    double quality = (csq < 0 || csq > 31) ? 0.05 : (double)(csq - 2) / 28.0;
+    quality = (quality < 0.05) ? 0.05 : ((quality > 1.0) ? 1.0 : quality);
+    profile.bandwidth = (uint32_t)(profile.bandwidth * quality);
+    profile.latency = (unsigned long)(profile.latency / quality);
+    profile.jitter = profile.latency / 3;
+    profile.dropRate = 0.2 * (1.0 - quality) * (1.0 - quality);
+    return profile;
+  }
+
+private:
+  int open() {
+    _connected = false;
+    const ModemState& state = _modem->networkState();
+    if (!state.gprs) {
+      return 0;
+    }
+    _link.configure(profileFor(_modem->radioTechnology(), state.csq));
+    _stateVersion = _modem->stateVersion();
+    if (!_link.open()) {
+      return 0;
+    }
+    _connected = true;
+    return 1;
+  }
+
+  /** Checks the modem state, dropping the socket if the network went away
+    and rebuilding the link if the signal or radio technology changed.
+  */
+  bool alive() {
+    if (!_connected) {
+      return false;
+    }
+    const ModemState& state = _modem->networkState();
+    if (!state.registered || !state.gprs) {
+      _connected = false;
+      return false;
+    }
+    if (_stateVersion != _modem->stateVersion()) {
+      _link.configure(profileFor(_modem->radioTechnology(), state.csq));
+      _stateVersion = _modem->stateVersion();
+    }
+    return true;
+  }
+
+  /** Meters received bytes through the link, dropping the socket if it resets.
+  */
+  bool meter(size_t n) {
+    if (_link.receive(n) == 0) {
+      _connected = false;
+      return false;
+    }
+    return true;
+  }
+
+  /** While a FuzzInput driving the modem is bound, consumes a transfer's
+    selector: throws a decoded exception, or decodes the result into `value`.
+    @return   True if `value` was decoded, false to take the configured path
+  */
+  template<typename T>
+  bool fuzzed(const char* func, T& value) {
+    FuzzInput* fuzz = FuzzInput::active();
+    if (fuzz == nullptr || !fuzz->drives(static_cast<Emulator*>(_modem))) {
+      return false;
+    }
+    FuzzInput::Response response = fuzz->select(func);
+    if (response == FuzzInput::Fault) {
+      throw (int)fuzz->consumeIntegral<uint16_t>();
+    }
+    return response == FuzzInput::Decoded && fuzz->decode<T>(value);
+  }
+
+  TinyGsm* _modem;              // The modem carrying this socket.
+  uint8_t _mux;                 // Socket number on the modem.
+  bool _connected = false;      // Whether the socket is open.
+  uint32_t _stateVersion = 0;   // Modem state version the link was configured for.
+  LinkModel _link;              // Meters throughput and latency.
+  std::deque<uint8_t> _rx;      // Bytes queued by the emulated server.
+  std::string _sent;            // Bytes written by the device.
 };
 
 #endif
@@ -0,0 +1 @@
+#include "../MockFreeRTOS.h"
\ No newline at end of file
@@ -0,0 +1,601 @@
+#if not defined(PROPERTY_TEST_H)
+#define PROPERTY_TEST_H
+
+#include <algorithm>
+#include <any>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <typeinfo>
+#include <vector>
+#include "Emulator.h"
+#include "EmulatorMemory.h"
+#include "LogFunctionEmulators.h"
+#include "SeededRandom.h"
+#include "TimeFunctionEmulators.h"
+#include "TypeName.h"
+#include "VirtualClock.h"
+
+#if not defined(PROPERTY_CASES)
+#define PROPERTY_CASES          (200)
+#endif
+
+#if not defined(PROPERTY_MAX_SHRINKS)
+#define PROPERTY_MAX_SHRINKS    (2000)
+#endif
+
+/**
+ * \class Gen
+ * \brief Generates the values of a mocked method's return sequence, and shrinks them.
+ *
+ * A generator draws each value from a SeededRandom, seeing the value before
+ * it in the sequence, so curves such as a drifting signal quality can be
+ * described as well as independent values. Its shrinker lists simpler
+ * values to try in place of one from a failing case, simplest first.
+ *
+ * \code{.cpp}
+ * Gen<int>::oneOf({ 200, 301, 404, 500, -1 });   // shrinks towards 200
+ * Gen<int16_t>::walk(0, 31, 4);                  // signal quality drifting by up to 4
+ * Gen<int>::range(-1, 64);                       // partial read() sizes, shrinks towards 0
+ * \endcode
+ */
+template<typename T>
+class Gen {
+public:
+  typedef std::function<T(SeededRandom& random, const T* previous)> Generate;
+  typedef std::function<std::vector<T>(const T& value)> Shrink;
+
+  /**
+   * \brief Constructs a generator from its functions.
+   *
+   * \param generate    Generate - Draws a value; `previous` is nullptr for the first of a sequence.
+   * \param shrink      Shrink - Lists simpler values, or nullptr if values do not shrink.
+   */
+  Gen(Generate generate, Shrink shrink = nullptr) : _generate(generate), _shrink(shrink) {}
+
+  /**
+   * \brief Integers in [lo, hi], shrinking towards the one nearest 0.
+   */
+  static Gen range(T lo, T hi) {
+    return Gen([lo, hi](SeededRandom& random, const T*) { return uniform(random, lo, hi); },
+               [lo, hi](const T& value) { return towards(value, nearestZero(lo, hi)); });
+  }
+
+  /**
+   * \brief One of a list of values, shrinking towards the first.
+   */
+  static Gen oneOf(std::vector<T> values) {
+    std::shared_ptr<const std::vector<T>> list = std::make_shared<const std::vector<T>>(std::move(values));
+    return Gen([list](SeededRandom& random, const T*) { return (*list)[random.below(list->size())]; },
+               [list](const T& value) {
+                 std::vector<T> simpler;
+                 for (const T& candidate : *list) {
+                   if (candidate == value) {
+                     break;
+                   }
+                   simpler.push_back(candidate);
+                 }
+                 return simpler;
+               });
+  }
+
+  /**
+   * \brief A random walk in [lo, hi], each value within `step` of the one before.
+   *
+   * Shrinking moves single values towards the one nearest 0, so a shrunk
+   * curve may take larger steps than the walk does.
+   */
+  static Gen walk(T lo, T hi, T step) {
+    return Gen([lo, hi, step](SeededRandom& random, const T* previous) {
+                 if (previous == nullptr) {
+                   return uniform(random, lo, hi);
+                 }
+                 long long from = std::max<long long>((long long)*previous - (long long)step, (long long)lo);
+                 long long to = std::min<long long>((long long)*previous + (long long)step, (long long)hi);
+                 return (T)uniform<long long>(random, from, to);
+               },
+               [lo, hi](const T& value) { return towards(value, nearestZero(lo, hi)); });
+  }
+
+  /**
+   * \brief Always the same value.
+   */
+  static Gen constant(T value) { return Gen([value](SeededRandom&, const T*) { return value; }); }
+
+  T generate(SeededRandom& random, const T* previous) const { return _generate(random, previous); }
+  std::vector<T> shrink(const T& value) const { return _shrink ? _shrink(value) : std::vector<T>(); }
+
+private:
+  template<typename V>
+  static V uniform(SeededRandom& random, V lo, V hi) {
+    if constexpr (std::is_floating_point<V>::value) {
+      return lo + (V)(random.uniform() * (hi - lo));
+    } else {
+      uint64_t span = (uint64_t)((long long)hi - (long long)lo);
+      return (V)((long long)lo + (long long)((span == UINT64_MAX) ? random.next() : random.below(span + 1)));
+    }
+  }
+
+  static T nearestZero(T lo, T hi) { return (lo > 0) ? lo : ((hi < 0) ? hi : (T)0); }
+
+  /**
+   * \brief Lists the target, the value halfway there and the next value towards it.
+   */
+  static std::vector<T> towards(T value, T target) {
+    std::vector<T> simpler;
+    if (value == target) {
+      return simpler;
+    }
+    simpler.push_back(target);
+    T half = (T)(target + (value - target) / 2);
+    if (half != target && half != value) {
+      simpler.push_back(half);
+    }
+    if constexpr (!std::is_floating_point<T>::value) {
+      T next = (T)((value > target) ? value - 1 : value + 1);
+      if (next != target && next != half) {
+        simpler.push_back(next);
+      }
+    }
+    return simpler;
+  }
+
+  Generate _generate;
+  Shrink _shrink;
+};
+
+/**
+ * \brief Outcome of a property check, see `PropertyTest::check()`.
+ *
+ * \param failed          bool - A case broke the property.
+ * \param cases           uint64_t - Cases run before the first failure, or in total.
+ * \param seed            uint64_t - The seed cases were generated from, to repeat the check.
+ * \param shrinks         uint64_t - Simpler cases tried while shrinking.
+ * \param counterexample  std::string - The shrunk failing case, as `returns().then()` code.
+ * \param error           std::string - What the property threw in the shrunk case, if anything.
+ */
+struct PropertyResult {
+  bool failed = false;
+  uint64_t cases = 0;
+  uint64_t seed = 0;
+  uint64_t shrinks = 0;
+  std::string counterexample;
+  std::string error;
+
+  /**
+   * \brief Writes a human readable summary, including the counterexample.
+   *
+   * \param out   std::ostream& - The stream to write to.
+   */
+  void report(std::ostream& out) const {
+    char hex[19];
+    snprintf(hex, sizeof(hex), "0x%016llx", (unsigned long long)seed);
+    if (!failed) {
+      out << "Property held for " << cases << " cases, seed " << hex << std::endl;
+      return;
+    }
+    out << "Property failed after " << cases << " cases, seed " << hex << ", shrunk in " << shrinks << " tries"
+        << (error.empty() ? "" : ": " + error) << std::endl
+        << counterexample;
+  }
+};
+
+/**
+ * \class PropertyTest
+ * \brief Checks a property of firmware code against generated mock return sequences,
+ * shrinking any failing case to a minimal one.
+ *
+ * Each `forAll()` declares a shape: the return sequence of one method of one
+ * emulator of the Fixture, with a generator for its values and bounds on its
+ * length. Every case draws a sequence for each shape, resets the emulators,
+ * configures them with `returns()`, `times()` and `then()`, and runs the
+ * property on them. Cases run in parallel on several host threads. Every case
+ * gets a new Fixture, virtual clock and `millis()`, `delay()` and `log_*()`
+ * emulators, bound like a Fleet device's, and allocates from its thread's
+ * EmulatorArena, released after the case. The property must only use the
+ * emulators of the Fixture it is given. The first failing case, in case order so a seed always finds
+ * the same one, is shrunk by dropping runs of values and simplifying single
+ * values while it still fails, then reported as code to paste into a test:
+ *
+ * \code{.cpp}
+ * struct Uplink {
+ *   MockClient client;
+ *   HttpClient http{client, "api.example.com", 443};
+ *   TinyGsm modem{Serial};
+ * };
+ *
+ * PropertyTest<Uplink> property;
+ * property.forAll("http", &Uplink::http, "responseStatusCode", Gen<int>::oneOf({ 200, 404, 500, -1 }), 1, 6)
+ *         .forAll("modem", &Uplink::modem, "getSignalQuality", Gen<int16_t>::walk(0, 31, 4), 1, 10);
+ * PropertyResult result = property.check([](Uplink& u) { return uploadWithRetry(u.modem, u.http) != CORRUPT; });
+ * result.report(std::cout);
+ * // Property failed after 37 cases, seed 0x..., shrunk in 52 tries
+ * //   http.returns("responseStatusCode", 500).times(2).then(200);
+ * //   modem.returns("getSignalQuality", (short)0);
+ * \endcode
+ *
+ * The seed is read from `EMULATION_PROPERTY_SEED` unless set with `setSeed()`,
+ * otherwise chosen at random; it is reported with the result.
+ *
+ * \tparam Fixture   A default constructible type holding the emulators.
+ */
+template<typename Fixture>
+class PropertyTest {
+public:
+  typedef std::function<bool(Fixture&)> Property;
+
+  /**
+   * \brief Constructs a property test.
+   *
+   * \param workers   unsigned - Host threads to run cases on, 0 for one per core.
+   */
+  explicit PropertyTest(unsigned workers = 0) {
+    if (workers == 0) {
+      workers = std::thread::hardware_concurrency();
+    }
+    _workers = (workers == 0) ? 1 : workers;
+    const char* seed = getenv("EMULATION_PROPERTY_SEED");
+    _seed = (seed != nullptr) ? strtoull(seed, nullptr, 0) : 0;
+  }
+  ~PropertyTest() {}
+
+  /**
+   * \brief Declares a generated return sequence for a method of one of the Fixture's emulators.
+   *
+   * \param name        const std::string& - The emulator's name in the reported code.
+   * \param emulator    E Fixture::* - The emulator.
+   * \param func        const std::string& - The mocked method.
+   * \param values      Gen<T> - Generates its values; T must be the type the mock returns.
+   * \param minLength   size_t - Fewest values in a sequence (default 1).
+   * \param maxLength   size_t - Most values in a sequence (default 8).
+   */
+  template<typename E, typename T>
+  PropertyTest& forAll(const std::string& name, E Fixture::* emulator, const std::string& func, Gen<T> values,
+                       size_t minLength = 1, size_t maxLength = 8) {
+    static_assert(std::is_base_of<Emulator, E>::value, "PropertyTest: forAll() needs an Emulator member");
+    _shapes.push_back(std::make_shared<TypedShape<E, T>>(name, emulator, func, values, minLength, std::max(minLength, maxLength)));
+    return *this;
+  }
+
+  /**
+   * \brief Sets the number of cases to run (default PROPERTY_CASES).
+   */
+  void setCases(uint64_t cases) { _cases = cases; }
+
+  /**
+   * \brief Sets the seed cases are generated from, 0 for a random one.
+   */
+  void setSeed(uint64_t seed) { _seed = seed; }
+
+  /**
+   * \brief Limits the simpler cases tried while shrinking (default PROPERTY_MAX_SHRINKS).
+   */
+  void setMaxShrinks(uint64_t shrinks) { _maxShrinks = shrinks; }
+
+  /**
+   * \brief Runs the cases, then shrinks the first failing one.
+   *
+   * A property fails by returning false or by throwing.
+   *
+   * \param property    Property - The condition on the firmware's behaviour.
+   * \return PropertyResult  The outcome, with the shrunk counterexample if one failed.
+   */
+  PropertyResult check(Property property) {
+    PropertyResult result;
+    result.seed = (_seed != 0) ? _seed : (((uint64_t)std::random_device()() << 32) | std::random_device()());
+
+    std::atomic<uint64_t> next{0};
+    std::atomic<uint64_t> failing{UINT64_MAX};
+    auto work = [&]() {
+      EmulatorArena arena;
+      std::string error;
+      for (uint64_t i = next++; i < _cases && i < failing.load(); i = next++) {
+        bool held = run(generate(result.seed, i), property, error);
+        arena.release();
+        if (!held) {
+          uint64_t current = failing.load();
+          while (i < current && !failing.compare_exchange_weak(current, i)) {}
+        }
+      }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < _workers; ++i) {
+      threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    if (failing.load() == UINT64_MAX) {
+      result.cases = _cases;
+      return result;
+    }
+    result.failed = true;
+    result.cases = failing.load() + 1;
+    Case shrunk = shrink(generate(result.seed, failing.load()), property, result);
+    result.counterexample = code(shrunk);
+    return result;
+  }
+
+private:
+  typedef std::vector<std::any> Sequence;
+  typedef std::vector<Sequence> Case;       // One sequence per shape.
+
+  /**
+   * \brief A declared return sequence, its value type erased.
+   */
+  struct Shape {
+    Shape(const std::string& name, const std::string& func, size_t minLength, size_t maxLength)
+      : name(name), func(func), minLength(minLength), maxLength(maxLength) {}
+    virtual ~Shape() {}
+
+    virtual Emulator& emulator(Fixture& fixture) const = 0;
+    virtual void generate(SeededRandom& random, Sequence& values) const = 0;
+    virtual std::vector<std::any> shrink(const std::any& value) const = 0;
+    virtual std::string literal(const std::any& value) const = 0;
+
+    /**
+     * \brief Configures the sequence on the emulator of a new fixture.
+     */
+    void apply(Fixture& fixture, const Sequence& values) const {
+      Emulator& target = emulator(fixture);
+      for (size_t i = 0; i < values.size(); ++i) {
+        if (i == 0) {
+          target.returns(func, values[i]);
+        } else {
+          target.then(values[i]);
+        }
+      }
+    }
+
+    std::string name;
+    std::string func;
+    size_t minLength;
+    size_t maxLength;
+  };
+
+  template<typename E, typename T>
+  struct TypedShape : public Shape {
+    TypedShape(const std::string& name, E Fixture::* member, const std::string& func, Gen<T> values, size_t minLength, size_t maxLength)
+      : Shape(name, func, minLength, maxLength), member(member), values(values) {}
+
+    Emulator& emulator(Fixture& fixture) const override { return fixture.*member; }
+
+    void generate(SeededRandom& random, Sequence& sequence) const override {
+      size_t length = this->minLength + random.below(this->maxLength - this->minLength + 1);
+      T previous = T();
+      for (size_t i = 0; i < length; ++i) {
+        previous = values.generate(random, (i == 0) ? nullptr : &previous);
+        sequence.push_back(previous);
+      }
+    }
+
+    std::vector<std::any> shrink(const std::any& value) const override {
+      std::vector<std::any> simpler;
+      for (const T& candidate : values.shrink(std::any_cast<const T&>(value))) {
+        simpler.push_back(candidate);
+      }
+      return simpler;
+    }
+
+    std::string literal(const std::any& value) const override { return PropertyTest::literal(std::any_cast<const T&>(value)); }
+
+    E Fixture::* member;
+    Gen<T> values;
+  };
+
+  template<typename V, typename = void>
+  struct HasCStr : std::false_type {};
+
+  template<typename V>
+  struct HasCStr<V, std::void_t<decltype(std::declval<const V&>().c_str())>> : std::true_type {};
+
+  /**
+   * \brief Renders a value as a C++ expression of exactly its type, as `returns()` must be given.
+   */
+  template<typename V>
+  static std::string literal(const V& value) {
+    if constexpr (std::is_same<V, bool>::value) {
+      return value ? "true" : "false";
+    } else if constexpr (std::is_same<V, int>::value) {
+      return std::to_string(value);
+    } else if constexpr (std::is_integral<V>::value || std::is_enum<V>::value) {
+      std::string digits = std::is_signed<V>::value ? std::to_string((long long)value) : std::to_string((unsigned long long)value);
+      return "(" + demangledTypeName(typeid(V).name()) + ")" + digits;
+    } else if constexpr (std::is_floating_point<V>::value) {
+      char digits[40];
+      snprintf(digits, sizeof(digits), "%.17g", (double)value);
+      std::string text = digits;
+      if (text.find_first_of(".en") == std::string::npos) {
+        text += ".0";
+      }
+      return std::is_same<V, float>::value ? text + "f" : text;
+    } else if constexpr (std::is_same<V, const char*>::value) {
+      return quoted(value);
+    } else if constexpr (HasCStr<V>::value) {
+      return demangledTypeName(typeid(V).name()) + "(" + quoted(value.c_str()) + ")";
+    } else {
+      return demangledTypeName(typeid(V).name()) + "()";
+    }
+  }
+
+  static std::string quoted(const char* text) {
+    std::string out = "\"";
+    for (const char* c = (text != nullptr) ? text : ""; *c != '\0'; ++c) {
+      switch (*c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+          if ((uint8_t)*c < 0x20 || (uint8_t)*c >= 0x7F) {
+            char escaped[5];
+            snprintf(escaped, sizeof(escaped), "\\%03o", (uint8_t)*c);
+            out += escaped;
+          } else {
+            out += *c;
+          }
+      }
+    }
+    return out + "\"";
+  }
+
+  /**
+   * \brief Generates case `index` of a seed, the same on every thread and run.
+   */
+  Case generate(uint64_t seed, uint64_t index) const {
+    SeededRandom random(seed ^ ((index + 1) * 0x9E3779B97F4A7C15ULL));
+    Case sequences(_shapes.size());
+    for (size_t i = 0; i < _shapes.size(); ++i) {
+      _shapes[i]->generate(random, sequences[i]);
+    }
+    return sequences;
+  }
+
+  /**
+   * \brief Runs the property against one case, on a new Fixture with its own
+   * clock and millis, delay and log emulators bound.
+   *
+   * \return bool   True if the property held.
+   */
+  bool run(const Case& sequences, const Property& property, std::string& error) const {
+    VirtualClock clock;
+    MillisFunctionEmulator millis;
+    DelayFunctionEmulator delay;
+    LogFunctionEmulators log;
+    millis.setTimeIncrement(0);
+    VirtualClock* previousClock = VirtualClock::bind(&clock);
+    MillisFunctionEmulator* previousMillis = MillisFunctionEmulator::bind(&millis);
+    DelayFunctionEmulator* previousDelay = DelayFunctionEmulator::bind(&delay);
+    LogFunctionEmulators* previousLog = LogFunctionEmulators::bind(&log);
+
+    bool held = false;
+    error.clear();
+    try {
+      std::unique_ptr<Fixture> fixture(new Fixture());
+      for (size_t i = 0; i < _shapes.size(); ++i) {
+        _shapes[i]->apply(*fixture, sequences[i]);
+      }
+      held = property(*fixture);
+    } catch (const std::exception& e) {
+      error = e.what();
+    } catch (int code) {
+      error = "exception code " + std::to_string(code);
+    } catch (...) {
+      error = "unknown exception";
+    }
+
+    LogFunctionEmulators::bind(previousLog);
+    DelayFunctionEmulator::bind(previousDelay);
+    MillisFunctionEmulator::bind(previousMillis);
+    VirtualClock::bind(previousClock);
+    return held;
+  }
+
+  /**
+   * \brief Shrinks a failing case until no simpler one fails: first dropping runs of
+   * values, longest first, then replacing single values with simpler ones.
+   */
+  Case shrink(Case failing, const Property& property, PropertyResult& result) const {
+    EmulatorArena arena;
+    run(failing, property, result.error);
+    arena.release();
+    auto fails = [&](const Case& candidate) {
+      if (result.shrinks >= _maxShrinks) {
+        return false;
+      }
+      ++result.shrinks;
+      std::string error;
+      bool held = run(candidate, property, error);
+      arena.release();
+      if (held) {
+        return false;
+      }
+      result.error = error;
+      return true;
+    };
+
+    bool simpler = true;
+    while (simpler && result.shrinks < _maxShrinks) {
+      simpler = false;
+      for (size_t s = 0; s < _shapes.size() && !simpler; ++s) {
+        size_t length = failing[s].size();
+        for (size_t count = length / 2; count > 0 && !simpler; count /= 2) {
+          if (length - count < _shapes[s]->minLength) {
+            continue;
+          }
+          for (size_t from = 0; from + count <= length && !simpler; from += count) {
+            Case candidate = failing;
+            candidate[s].erase(candidate[s].begin() + from, candidate[s].begin() + from + count);
+            if (fails(candidate)) {
+              failing = candidate;
+              simpler = true;
+            }
+          }
+        }
+      }
+      for (size_t s = 0; s < _shapes.size() && !simpler; ++s) {
+        for (size_t v = 0; v < failing[s].size() && !simpler; ++v) {
+          for (const std::any& value : _shapes[s]->shrink(failing[s][v])) {
+            Case candidate = failing;
+            candidate[s][v] = value;
+            if (fails(candidate)) {
+              failing = candidate;
+              simpler = true;
+              break;
+            }
+          }
+        }
+      }
+    }
+    return failing;
+  }
+
+  /**
+   * \brief Renders a case as `returns().times().then()` statements, one per shape.
+   */
+  std::string code(const Case& sequences) const {
+    std::string text;
+    for (size_t s = 0; s < _shapes.size(); ++s) {
+      const Shape& shape = *_shapes[s];
+      if (sequences[s].empty()) {
+        continue;
+      }
+      text += "  " + shape.name + ".returns(" + quoted(shape.func.c_str()) + ", ";
+      for (size_t v = 0; v < sequences[s].size();) {
+        std::string value = shape.literal(sequences[s][v]);
+        size_t repeats = 1;
+        while (v + repeats < sequences[s].size() && shape.literal(sequences[s][v + repeats]) == value) {
+          ++repeats;
+        }
+        text += (v == 0) ? value + ")" : ".then(" + value + ")";
+        if (repeats > 1) {
+          text += ".times(" + std::to_string(repeats) + ")";
+        }
+        v += repeats;
+      }
+      text += ";\n";
+    }
+    return text;
+  }
+
+  std::vector<std::shared_ptr<Shape>> _shapes;    // Declared return sequences, in forAll() order.
+  unsigned _workers = 1;
+  uint64_t _cases = PROPERTY_CASES;
+  uint64_t _seed = 0;
+  uint64_t _maxShrinks = PROPERTY_MAX_SHRINKS;
+};
+
+#endif // end of PROPERTY_TEST_H
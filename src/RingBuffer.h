@@ -0,0 +1,95 @@
+#if not defined(RING_BUFFER_H)
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * \class RingBuffer
+ * \brief A fixed-capacity, lock-free, single-producer single-consumer ring buffer.
+ *
+ * One thread may push while another pops without locking. Storage is a fixed
+ * array sized at compile time, so the buffer never allocates.
+ *
+ * \tparam T          The element type.
+ * \tparam Capacity   The number of elements, which must be a power of two.
+ */
+template<typename T, size_t Capacity>
+class RingBuffer {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "RingBuffer capacity must be a power of two");
+
+public:
+  RingBuffer() {}
+  ~RingBuffer() {}
+
+  /**
+   * \brief Appends an element. Producer side only.
+   *
+   * \param value   const T& - The element to append.
+   * \return bool   false if the buffer is full.
+   */
+  bool push(const T& value) {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    _slots[tail & (Capacity - 1)] = value;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * \brief Removes the oldest element. Consumer side only.
+   *
+   * \param value   T& - Receives the element.
+   * \return bool   false if the buffer is empty.
+   */
+  bool pop(T& value) {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    value = _slots[head & (Capacity - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * \brief Returns the oldest element without removing it. Consumer side only.
+   *
+   * \return const T*   The element, or nullptr if the buffer is empty.
+   */
+  const T* front() const {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &_slots[head & (Capacity - 1)];
+  }
+
+  /**
+   * \brief Returns the number of elements currently held.
+   */
+  size_t size() const { return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire); }
+
+  bool empty() const { return size() == 0; }
+
+  bool full() const { return size() == Capacity; }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+  /**
+   * \brief Discards every element. Only safe while neither side is in use.
+   */
+  void clear() {
+    _head.store(0, std::memory_order_relaxed);
+    _tail.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  alignas(64) std::atomic<size_t> _head{0}; // Next slot to pop, written by the consumer.
+  alignas(64) std::atomic<size_t> _tail{0}; // Next slot to push, written by the producer.
+  T _slots[Capacity];
+};
+
+#endif // end of RING_BUFFER_H
@@ -0,0 +1,267 @@
+#if not defined(ROUTE_TABLE_H)
+#define ROUTE_TABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * \file RouteTable.h
+ * \brief Declarative description of an emulated HTTP server.
+ */
+
+/**
+ * \brief The canned response an emulated server gives for a route.
+ *
+ * \param status    int - The HTTP status code, e.g. 200.
+ * \param headers   std::vector<std::pair<std::string, std::string>> - Response headers in order.
+ * \param body      std::string - The response body.
+ * \param latency   unsigned long - Milliseconds of virtual time the request takes.
+ */
+struct HttpRoute {
+  int status = 200;
+  std::vector<std::pair<std::string, std::string>> headers = {};
+  std::string body = "";
+  unsigned long latency = 0;
+};
+
+/**
+ * \class RouteTable
+ * \brief Maps (method, path pattern) pairs to canned responses.
+ *
+ * Patterns are split into '/' separated segments and compiled into a trie.
+ * A segment may be a literal (`devices`), a parameter that matches any single
+ * segment (`:id`), or a wildcard that matches the rest of the path (`*`), which
+ * must be the last segment.
+ * Literal children are looked up by hash, so matching costs O(path length)
+ * however many routes are registered. When a literal and a parameter both
+ * match a segment the literal is preferred, falling back to the parameter only
+ * if the literal branch has no route for the remainder of the path.
+ *
+ * Query strings (`?a=b`) are ignored when matching.
+ *
+ * Example:
+ * \code{.cpp}
+ * RouteTable backend;
+ * backend.on(HTTP_METHOD_GET, "/config", { 200, {{ "Content-Type", "application/json" }}, "{}", 120 });
+ * backend.on(HTTP_METHOD_POST, "/devices/:id/readings", { 201, {}, "", 350 });
+ * httpClientMock.serve(backend);
+ * \endcode
+ */
+class RouteTable {
+public:
+  RouteTable() { _nodes.emplace_back(); }
+  RouteTable(const RouteTable&) = delete;
+  RouteTable& operator=(const RouteTable&) = delete;
+  RouteTable(RouteTable&&) = default;
+  RouteTable& operator=(RouteTable&&) = default;
+  ~RouteTable() {}
+
+  /**
+   * \brief Registers a response for a method and path pattern.
+   *
+   * Registering the same method and pattern twice replaces the earlier response.
+   *
+   * \param method    const char* - The HTTP method, e.g. "GET".
+   * \param pattern   const char* - The path pattern, e.g. "/devices/:id".
+   * \param route     HttpRoute - The response to serve.
+   *
+   * \return RouteTable&  A reference to this table, allowing for method chaining.
+   * \throw std::invalid_argument if a `*` segment is not the last one.
+   */
+  RouteTable& on(const char* method, const char* pattern, HttpRoute route) {
+    uint32_t node = 0;
+    std::string_view rest(pattern);
+    std::string_view segment;
+    while (nextSegment(rest, segment)) {
+      if (segment == "*") {
+        std::string_view after = rest;
+        std::string_view trailing;
+        if (nextSegment(after, trailing)) {
+          throw std::invalid_argument(std::string("RouteTable: '*' must be the last segment of ") + pattern);
+        }
+        if (_nodes[node].wildcard == kNone) {
+          uint32_t child = newNode();
+          _nodes[node].wildcard = child;
+        }
+        node = _nodes[node].wildcard;
+        break;
+      }
+      if (segment[0] == ':') {
+        if (_nodes[node].param == kNone) {
+          uint32_t child = newNode();
+          _nodes[node].param = child;
+        }
+        node = _nodes[node].param;
+        continue;
+      }
+      auto found = _nodes[node].children.find(segment);
+      if (found == _nodes[node].children.end()) {
+        uint32_t child = newNode();
+        _keys.emplace_back(segment);
+        _nodes[node].children.emplace(std::string_view(_keys.back()), child);
+        node = child;
+      } else {
+        node = found->second;
+      }
+    }
+
+    int32_t& slot = _nodes[node].routes[methodIndex(method)];
+    if (slot == -1) {
+      slot = (int32_t)_routes.size();
+      _routes.push_back(std::move(route));
+    } else {
+      _routes[slot] = std::move(route);
+    }
+    return *this;
+  }
+
+  /**
+   * \brief Sets the response used when no route matches.
+   *
+   * Defaults to an empty 404 with no latency.
+   *
+   * \param route   HttpRoute - The response to serve for unmatched requests.
+   */
+  void otherwise(HttpRoute route) { _fallback = std::move(route); }
+
+  /**
+   * \brief Finds the response for a request.
+   *
+   * \param method    const char* - The HTTP method of the request.
+   * \param path      const char* - The request path, optionally with a query string.
+   *
+   * \return const HttpRoute*  The matching route, or nullptr if none matches.
+   */
+  const HttpRoute* match(const char* method, const char* path) const {
+    std::string_view target(path);
+    size_t query = target.find('?');
+    if (query != std::string_view::npos) {
+      target = target.substr(0, query);
+    }
+    int32_t index = find(0, target, methodIndex(method));
+    return (index < 0) ? nullptr : &_routes[index];
+  }
+
+  /**
+   * \brief Finds the response for a request, falling back to `otherwise()`.
+   *
+   * \param method    const char* - The HTTP method of the request.
+   * \param path      const char* - The request path.
+   *
+   * \return const HttpRoute&  The matching route or the fallback response.
+   */
+  const HttpRoute& resolve(const char* method, const char* path) const {
+    const HttpRoute* route = match(method, path);
+    return (route != nullptr) ? *route : _fallback;
+  }
+
+  /**
+   * \brief Returns the number of registered routes.
+   */
+  size_t size() const { return _routes.size(); }
+
+  /**
+   * \brief Removes every route and restores the default fallback.
+   */
+  void clear() {
+    _nodes.clear();
+    _nodes.emplace_back();
+    _keys.clear();
+    _routes.clear();
+    _fallback = HttpRoute{ 404 };
+  }
+
+private:
+  static const uint32_t kNone = UINT32_MAX;
+  static const int kMethods = 7;
+
+  struct Node {
+    std::unordered_map<std::string_view, uint32_t> children = {};
+    uint32_t param = kNone;
+    uint32_t wildcard = kNone;
+    int32_t routes[kMethods] = { -1, -1, -1, -1, -1, -1, -1 };
+  };
+
+  /**
+   * \brief Maps an HTTP method name onto a slot in Node::routes.
+   */
+  static int methodIndex(const char* method) {
+    static const char* names[kMethods - 1] = { "GET", "POST", "PUT", "PATCH", "DELETE", "HEAD" };
+    for (int i = 0; i < kMethods - 1; ++i) {
+      if (strcmp(method, names[i]) == 0) {
+        return i;
+      }
+    }
+    return kMethods - 1;
+  }
+
+  /**
+   * \brief Pops the next non-empty '/' separated segment from a path.
+   */
+  static bool nextSegment(std::string_view& rest, std::string_view& segment) {
+    while (!rest.empty() && rest.front() == '/') {
+      rest.remove_prefix(1);
+    }
+    if (rest.empty()) {
+      return false;
+    }
+    size_t end = rest.find('/');
+    segment = rest.substr(0, end);
+    rest.remove_prefix((end == std::string_view::npos) ? rest.size() : end);
+    return true;
+  }
+
+  uint32_t newNode() {
+    _nodes.emplace_back();
+    return (uint32_t)(_nodes.size() - 1);
+  }
+
+  /**
+   * \brief Walks the trie from a node, remembering the deepest wildcard as a fallback.
+   */
+  int32_t find(uint32_t node, std::string_view rest, int method, int32_t fallback = -1) const {
+    std::string_view segment;
+    while (true) {
+      const Node& current = _nodes[node];
+      if (current.wildcard != kNone && _nodes[current.wildcard].routes[method] != -1) {
+        fallback = _nodes[current.wildcard].routes[method];
+      }
+
+      std::string_view remaining = rest;
+      if (!nextSegment(remaining, segment)) {
+        return (current.routes[method] != -1) ? current.routes[method] : fallback;
+      }
+
+      auto literal = current.children.find(segment);
+      if (literal != current.children.end() && current.param != kNone) {
+        // Both a literal and a parameter match; only this case backtracks.
+        int32_t found = find(literal->second, remaining, method, -1);
+        if (found != -1) {
+          return found;
+        }
+        node = current.param;
+      } else if (literal != current.children.end()) {
+        node = literal->second;
+      } else if (current.param != kNone) {
+        node = current.param;
+      } else {
+        return fallback;
+      }
+      rest = remaining;
+    }
+  }
+
+  std::vector<Node> _nodes;           // Trie nodes, the root is index 0.
+  std::deque<std::string> _keys;      // Owns literal segment text viewed by Node::children.
+  std::vector<HttpRoute> _routes;     // Registered responses.
+  HttpRoute _fallback = HttpRoute{ 404 };
+};
+
+#endif // end of ROUTE_TABLE_H
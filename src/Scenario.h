@@ -0,0 +1,689 @@
+#if not defined(SCENARIO_H)
+#define SCENARIO_H
+
+#include <Arduino.h>
+#include <any>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Emulator.h"
+#include "Exceptions/ScenarioException.h"
+
+/**
+ * \file Scenario.h
+ * \brief Declarative mock configuration compiled once per process and shared by every test.
+ */
+
+/**
+ * \brief A parsed JSON value with the position it was read from.
+ *
+ * Numbers keep their source text so each is converted to the type its method
+ * returns without losing range, and object members keep their order.
+ */
+struct ScenarioJson {
+  enum Kind { Null, Bool, Number, Text, Array, Object };
+
+  Kind kind = Null;
+  bool boolean = false;
+  std::string text;                                          // Number or string.
+  std::vector<ScenarioJson> items;                           // Array elements.
+  std::vector<std::pair<std::string, ScenarioJson>> members; // Object members, in order.
+  size_t line = 1;
+  size_t column = 1;
+
+  /**
+   * \brief Returns the member named `key`, or nullptr.
+   */
+  const ScenarioJson* find(const char* key) const {
+    for (const auto& member : members) {
+      if (member.first == key) {
+        return &member.second;
+      }
+    }
+    return nullptr;
+  }
+
+  bool integral() const { return kind == Number && text.find_first_of(".eE") == std::string::npos; }
+};
+
+/**
+ * \class Scenario
+ * \brief Mock return values read from a JSON file, compiled once and attached to emulators.
+ *
+ * A scenario file describes what each mock returns. Top level keys name roles,
+ * each an object of methods:
+ *
+ * \code{.json}
+ * {
+ *   "modem": {
+ *     "getSignalQuality": { "returns": 21, "type": "int16_t" },
+ *     "isNetworkConnected": [false, { "value": true, "times": 3 }],
+ *     "init": { "throws": 7 }
+ *   },
+ *   "http": {
+ *     "responseStatusCode": [{ "value": 503, "times": 2 }, 200],
+ *     "responseBody": { "returns": "OK", "delay": 40 }
+ *   }
+ * }
+ * \endcode
+ *
+ * A method is a single value, an array of values returned in turn, or an
+ * object with `returns` (a value or array), `then` (an array appended to it),
+ * `times` (repeats of a single `returns` value), `delay` in milliseconds,
+ * `type` and `throws` (an exception code, see `Emulator::setException()`).
+ * A value may be `{ "value": v, "times": n, "type": "..." }`.
+ *
+ * Values are converted to the C++ type named by `type`, or else booleans to
+ * bool, integers to int, fractions to double and strings to String. The
+ * fixed width integers, long, size_t, time_t, float, double, `const char*`,
+ * std::string and String are built in; `defineType()` adds others such as
+ * enums.
+ *
+ * `load()` parses and compiles each file once per process; later calls
+ * return the same immutable Scenario, which any thread may attach. `attach()`
+ * points the emulator's recycled profiles at the compiled values (see
+ * `Emulator::returnsShared()`), so a test pays only for its cursors:
+ *
+ * \code{.cpp}
+ * void setUp() {
+ *   Scenario::load("test/scenarios/registered.json").attach("modem", modemDriverMock);
+ * }
+ * \endcode
+ */
+class Scenario {
+public:
+  typedef std::function<std::any(const ScenarioJson&, Scenario&)> Converter;
+
+  Scenario() {}
+  Scenario(Scenario&&) = default;
+  Scenario& operator=(Scenario&&) = default;
+  Scenario(const Scenario&) = delete;
+  Scenario& operator=(const Scenario&) = delete;
+
+  /**
+   * \brief Returns the compiled scenario of a file, parsing it on first use.
+   *
+   * \param path    const std::string& - Path of the JSON file.
+   * \return const Scenario&  Valid for the life of the process.
+   * \throws ScenarioException if the file cannot be read or is not a valid scenario.
+   */
+  static const Scenario& load(const std::string& path) {
+    std::lock_guard<std::mutex> lock(cacheMutex());
+    std::unique_ptr<Scenario>& cached = cache()[path];
+    if (!cached) {
+      std::ifstream in(path, std::ios::binary);
+      if (!in) {
+        cache().erase(path);
+        ScenarioException(("Cannot read scenario " + path).c_str());
+      }
+      std::stringstream json;
+      json << in.rdbuf();
+      try {
+        cached.reset(new Scenario(parse(json.str(), path)));
+      } catch (...) {
+        cache().erase(path);
+        throw;
+      }
+    }
+    return *cached;
+  }
+
+  /**
+   * \brief Parses and compiles a scenario held in memory, without caching it.
+   *
+   * \param json    const std::string& - The scenario.
+   * \param source  const std::string& - Name used in error messages.
+   * \throws ScenarioException on a syntax error, unknown type or value out of range.
+   */
+  static Scenario parse(const std::string& json, const std::string& source = "scenario") {
+    Scenario scenario;
+    scenario._source = source;
+    Parser parser{ json, source };
+    ScenarioJson root = parser.document();
+    if (root.kind != ScenarioJson::Object) {
+      scenario.fail(root, "expected an object of roles");
+    }
+    for (const auto& role : root.members) {
+      scenario.compileRole(role.first, role.second);
+    }
+    return scenario;
+  }
+
+  /**
+   * \brief Registers a type that `type` may name, converting integers or, for
+   * enums, the names given.
+   *
+   * \code{.cpp}
+   * Scenario::defineType<RegStatus>("RegStatus", {{ "MOCK_REG_OK_HOME", MOCK_REG_OK_HOME }, { "MOCK_REG_SEARCHING", MOCK_REG_SEARCHING }});
+   * \endcode
+   *
+   * \param name    const std::string& - The name used in scenario files.
+   * \param names   std::initializer_list - Symbolic values accepted as strings.
+   */
+  template<typename T>
+  static void defineType(const std::string& name, std::initializer_list<std::pair<const char*, T>> names = {}) {
+    std::vector<std::pair<std::string, T>> symbols;
+    for (const auto& symbol : names) {
+      symbols.emplace_back(symbol.first, symbol.second);
+    }
+    defineType(name, Converter([symbols](const ScenarioJson& value, Scenario& scenario) -> std::any {
+      if (value.kind == ScenarioJson::Text) {
+        for (const auto& symbol : symbols) {
+          if (symbol.first == value.text) {
+            return symbol.second;
+          }
+        }
+        scenario.fail(value, "unknown name " + value.text);
+      }
+      if constexpr (std::is_enum<T>::value) {
+        return static_cast<T>(scenario.integer<typename std::underlying_type<T>::type>(value));
+      } else if constexpr (std::is_integral<T>::value) {
+        return scenario.integer<T>(value);
+      } else {
+        scenario.fail(value, "expected a name");
+        return std::any();
+      }
+    }));
+  }
+
+  /**
+   * \brief Registers a type with a converter of its own.
+   */
+  static void defineType(const std::string& name, Converter converter) {
+    std::lock_guard<std::mutex> lock(typeMutex());
+    types()[name] = std::move(converter);
+  }
+
+  /**
+   * \brief Configures an emulator with the methods of a role.
+   *
+   * Profiles are added as `returns()` would, so they follow any configured
+   * earlier and may be extended afterwards; extending one copies its values.
+   *
+   * \param role        const std::string& - The role's key in the file.
+   * \param emulator    Emulator& - The mock to configure.
+   * \throws ScenarioException if the scenario has no such role.
+   */
+  void attach(const std::string& role, Emulator& emulator) const {
+    for (const Role& candidate : _roles) {
+      if (candidate.name == role) {
+        for (const Method& method : candidate.methods) {
+          if (method.throws) {
+            emulator.setException(method.name, method.exception);
+          }
+          if (!method.values.empty()) {
+            emulator.returnsShared(method.name, method.values.data(), method.values.size(), method.delay);
+          }
+        }
+        return;
+      }
+    }
+    ScenarioException((_source + ": no role " + role).c_str());
+  }
+
+  /**
+   * \brief Returns true if the scenario describes a role.
+   */
+  bool has(const std::string& role) const {
+    for (const Role& candidate : _roles) {
+      if (candidate.name == role) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * \brief Returns the number of methods a role configures, 0 if there is no such role.
+   */
+  size_t methods(const std::string& role) const {
+    for (const Role& candidate : _roles) {
+      if (candidate.name == role) {
+        return candidate.methods.size();
+      }
+    }
+    return 0;
+  }
+
+  /**
+   * \brief Throws a ScenarioException naming the position of `value`.
+   */
+  [[noreturn]] void fail(const ScenarioJson& value, const std::string& message) const {
+    std::string where = _source + ":" + std::to_string(value.line) + ":" + std::to_string(value.column) + ": " + message;
+    ScenarioException(where.c_str());
+  }
+
+  /**
+   * \brief Converts a JSON integer to T, failing if it is not one or is out of range.
+   */
+  template<typename T>
+  T integer(const ScenarioJson& value) {
+    if (std::is_same<T, bool>::value || !value.integral()) {
+      fail(value, "expected an integer");
+    }
+    errno = 0;
+    char* end = nullptr;
+    bool inRange;
+    T converted;
+    if (std::is_signed<T>::value) {
+      long long parsed = std::strtoll(value.text.c_str(), &end, 10);
+      inRange = parsed >= (long long)std::numeric_limits<T>::min() && parsed <= (long long)std::numeric_limits<T>::max();
+      converted = (T)parsed;
+    } else {
+      unsigned long long parsed = std::strtoull(value.text.c_str(), &end, 10);
+      inRange = value.text[0] != '-' && parsed <= (unsigned long long)std::numeric_limits<T>::max();
+      converted = (T)parsed;
+    }
+    if (errno == ERANGE || !inRange) {
+      fail(value, value.text + " is out of range");
+    }
+    return converted;
+  }
+
+  /**
+   * \brief Keeps a copy of a string for the life of the scenario and returns it.
+   */
+  const char* intern(const std::string& text) {
+    _strings.push_back(text);
+    return _strings.back().c_str();
+  }
+
+private:
+  struct Method {
+    std::string name;
+    std::vector<RetVal> values;
+    int delay = 0;
+    bool throws = false;
+    uint16_t exception = 0;
+  };
+
+  struct Role {
+    std::string name;
+    std::vector<Method> methods;
+  };
+
+  /**
+   * \brief A recursive descent JSON parser tracking line and column.
+   */
+  struct Parser {
+    const std::string& json;
+    const std::string& source;
+    size_t offset = 0;
+    size_t line = 1;
+    size_t column = 1;
+
+    ScenarioJson document() {
+      ScenarioJson root = value();
+      skipSpace();
+      if (offset < json.size()) {
+        fail("unexpected text after the scenario");
+      }
+      return root;
+    }
+
+    [[noreturn]] void fail(const std::string& message) {
+      std::string where = source + ":" + std::to_string(line) + ":" + std::to_string(column) + ": " + message;
+      ScenarioException(where.c_str());
+    }
+
+    int peek() const { return (offset < json.size()) ? (unsigned char)json[offset] : -1; }
+
+    char next() {
+      if (offset >= json.size()) {
+        fail("unexpected end of scenario");
+      }
+      char c = json[offset++];
+      if (c == '\n') {
+        ++line;
+        column = 1;
+      } else {
+        ++column;
+      }
+      return c;
+    }
+
+    void skipSpace() {
+      while (peek() == ' ' || peek() == '\t' || peek() == '\n' || peek() == '\r') {
+        next();
+      }
+    }
+
+    void expect(char c) {
+      skipSpace();
+      if (peek() != c) {
+        fail(std::string("expected '") + c + "'");
+      }
+      next();
+    }
+
+    void keyword(const char* word) {
+      for (const char* c = word; *c != '\0'; ++c) {
+        if (peek() != *c) {
+          fail(std::string("expected ") + word);
+        }
+        next();
+      }
+    }
+
+    ScenarioJson value() {
+      skipSpace();
+      ScenarioJson result;
+      result.line = line;
+      result.column = column;
+      int c = peek();
+      if (c == '{') {
+        result.kind = ScenarioJson::Object;
+        next();
+        skipSpace();
+        if (peek() == '}') {
+          next();
+          return result;
+        }
+        do {
+          skipSpace();
+          if (peek() != '"') {
+            fail("expected a member name");
+          }
+          std::string key = string();
+          expect(':');
+          result.members.emplace_back(std::move(key), value());
+          skipSpace();
+        } while (peek() == ',' && next());
+        expect('}');
+      } else if (c == '[') {
+        result.kind = ScenarioJson::Array;
+        next();
+        skipSpace();
+        if (peek() == ']') {
+          next();
+          return result;
+        }
+        do {
+          result.items.push_back(value());
+          skipSpace();
+        } while (peek() == ',' && next());
+        expect(']');
+      } else if (c == '"') {
+        result.kind = ScenarioJson::Text;
+        result.text = string();
+      } else if (c == 't' || c == 'f') {
+        result.kind = ScenarioJson::Bool;
+        result.boolean = (c == 't');
+        keyword(result.boolean ? "true" : "false");
+      } else if (c == 'n') {
+        keyword("null");
+      } else if (c == '-' || (c >= '0' && c <= '9')) {
+        result.kind = ScenarioJson::Number;
+        while (peek() == '-' || peek() == '+' || peek() == '.' || peek() == 'e' || peek() == 'E' || (peek() >= '0' && peek() <= '9')) {
+          result.text += next();
+        }
+        char* end = nullptr;
+        std::strtod(result.text.c_str(), &end);
+        if (end != result.text.c_str() + result.text.size()) {
+          fail("malformed number " + result.text);
+        }
+      } else {
+        fail("expected a value");
+      }
+      return result;
+    }
+
+    std::string string() {
+      next();
+      std::string text;
+      while (peek() != '"') {
+        char c = next();
+        if (c != '\\') {
+          text += c;
+          continue;
+        }
+        c = next();
+        switch (c) {
+          case 'n': text += '\n'; break;
+          case 't': text += '\t'; break;
+          case 'r': text += '\r'; break;
+          case 'b': text += '\b'; break;
+          case 'f': text += '\f'; break;
+          case 'u': appendUtf8(text, codePoint()); break;
+          case '"': case '\\': case '/': text += c; break;
+          default: fail(std::string("unknown escape \\") + c);
+        }
+      }
+      next();
+      return text;
+    }
+
+    uint32_t hex4() {
+      uint32_t value = 0;
+      for (int i = 0; i < 4; ++i) {
+        char c = next();
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else fail("malformed \\u escape");
+      }
+      return value;
+    }
+
+    uint32_t codePoint() {
+      uint32_t point = hex4();
+      if (point >= 0xD800 && point < 0xDC00 && peek() == '\\') {
+        next();
+        keyword("u");
+        uint32_t low = hex4();
+        point = 0x10000 + ((point - 0xD800) << 10) + (low - 0xDC00);
+      }
+      return point;
+    }
+
+    static void appendUtf8(std::string& text, uint32_t point) {
+      if (point < 0x80) {
+        text += (char)point;
+      } else if (point < 0x800) {
+        text += (char)(0xC0 | (point >> 6));
+        text += (char)(0x80 | (point & 0x3F));
+      } else if (point < 0x10000) {
+        text += (char)(0xE0 | (point >> 12));
+        text += (char)(0x80 | ((point >> 6) & 0x3F));
+        text += (char)(0x80 | (point & 0x3F));
+      } else {
+        text += (char)(0xF0 | (point >> 18));
+        text += (char)(0x80 | ((point >> 12) & 0x3F));
+        text += (char)(0x80 | ((point >> 6) & 0x3F));
+        text += (char)(0x80 | (point & 0x3F));
+      }
+    }
+  };
+
+  void compileRole(const std::string& name, const ScenarioJson& methods) {
+    if (methods.kind != ScenarioJson::Object) {
+      fail(methods, "role " + name + " must be an object of methods");
+    }
+    Role role;
+    role.name = name;
+    for (const auto& entry : methods.members) {
+      role.methods.push_back(compileMethod(entry.first, entry.second));
+    }
+    _roles.push_back(std::move(role));
+  }
+
+  Method compileMethod(const std::string& name, const ScenarioJson& entry) {
+    Method method;
+    method.name = name;
+    if (entry.kind != ScenarioJson::Object || entry.find("value") != nullptr) {
+      appendValues(method, entry, nullptr);
+      return method;
+    }
+    const ScenarioJson* type = entry.find("type");
+    if (type != nullptr && type->kind != ScenarioJson::Text) {
+      fail(*type, "type must be a string");
+    }
+    for (const auto& member : entry.members) {
+      const std::string& key = member.first;
+      if (key != "returns" && key != "then" && key != "times" && key != "delay" && key != "type" && key != "throws") {
+        fail(member.second, "unknown key " + key + " for " + name);
+      }
+    }
+    if (const ScenarioJson* returns = entry.find("returns")) {
+      appendValues(method, *returns, type);
+    }
+    if (const ScenarioJson* times = entry.find("times")) {
+      if (method.values.size() != 1) {
+        fail(*times, "times needs a single returns value; use { \"value\": v, \"times\": n } in sequences");
+      }
+      method.values[0].first = integer<int>(*times);
+    }
+    if (const ScenarioJson* then = entry.find("then")) {
+      if (method.values.empty()) {
+        fail(*then, "then needs a returns value");
+      }
+      appendValues(method, *then, type);
+    }
+    if (const ScenarioJson* delay = entry.find("delay")) {
+      method.delay = integer<int>(*delay);
+    }
+    if (const ScenarioJson* throws = entry.find("throws")) {
+      method.throws = true;
+      method.exception = integer<uint16_t>(*throws);
+    }
+    if (method.values.empty() && !method.throws) {
+      fail(entry, name + " has no returns or throws");
+    }
+    return method;
+  }
+
+  void appendValues(Method& method, const ScenarioJson& values, const ScenarioJson* type) {
+    if (values.kind != ScenarioJson::Array) {
+      method.values.push_back(compileValue(values, type));
+      return;
+    }
+    if (values.items.empty()) {
+      fail(values, "empty sequence for " + method.name);
+    }
+    for (const ScenarioJson& item : values.items) {
+      method.values.push_back(compileValue(item, type));
+    }
+  }
+
+  RetVal compileValue(const ScenarioJson& item, const ScenarioJson* type) {
+    if (item.kind != ScenarioJson::Object) {
+      return RetVal{ 1, convert(item, type) };
+    }
+    const ScenarioJson* value = item.find("value");
+    if (value == nullptr) {
+      fail(item, "expected a value or { \"value\": ... }");
+    }
+    const ScenarioJson* times = item.find("times");
+    const ScenarioJson* own = item.find("type");
+    return RetVal{ (times != nullptr) ? integer<int>(*times) : 1, convert(*value, (own != nullptr) ? own : type) };
+  }
+
+  std::any convert(const ScenarioJson& value, const ScenarioJson* type) {
+    std::string name;
+    if (type != nullptr) {
+      name = type->text;
+    } else if (value.kind == ScenarioJson::Bool) {
+      name = "bool";
+    } else if (value.kind == ScenarioJson::Number) {
+      name = value.integral() ? "int" : "double";
+    } else if (value.kind == ScenarioJson::Text) {
+      name = "String";
+    } else {
+      fail(value, "expected a number, boolean or string");
+    }
+    Converter converter;
+    {
+      std::lock_guard<std::mutex> lock(typeMutex());
+      auto found = types().find(name);
+      if (found == types().end()) {
+        fail((type != nullptr) ? *type : value, "unknown type " + name + ", see Scenario::defineType()");
+      }
+      converter = found->second;
+    }
+    return converter(value, *this);
+  }
+
+  template<typename T>
+  static std::any integral(const ScenarioJson& value, Scenario& scenario) { return scenario.integer<T>(value); }
+
+  template<typename T>
+  static std::any floating(const ScenarioJson& value, Scenario& scenario) {
+    if (value.kind != ScenarioJson::Number) {
+      scenario.fail(value, "expected a number");
+    }
+    return (T)std::strtod(value.text.c_str(), nullptr);
+  }
+
+  static const std::string& text(const ScenarioJson& value, Scenario& scenario) {
+    if (value.kind != ScenarioJson::Text) {
+      scenario.fail(value, "expected a string");
+    }
+    return value.text;
+  }
+
+  static std::map<std::string, Converter>& types() {
+    static std::map<std::string, Converter> registry = {
+      { "bool", [](const ScenarioJson& value, Scenario& scenario) -> std::any {
+          if (value.kind != ScenarioJson::Bool) {
+            scenario.fail(value, "expected true or false");
+          }
+          return value.boolean;
+        } },
+      { "int", integral<int> },
+      { "int8_t", integral<int8_t> },
+      { "uint8_t", integral<uint8_t> },
+      { "int16_t", integral<int16_t> },
+      { "uint16_t", integral<uint16_t> },
+      { "int32_t", integral<int32_t> },
+      { "uint32_t", integral<uint32_t> },
+      { "int64_t", integral<int64_t> },
+      { "uint64_t", integral<uint64_t> },
+      { "long", integral<long> },
+      { "unsigned long", integral<unsigned long> },
+      { "size_t", integral<size_t> },
+      { "time_t", integral<time_t> },
+      { "float", floating<float> },
+      { "double", floating<double> },
+      { "const char*", [](const ScenarioJson& value, Scenario& scenario) -> std::any { return scenario.intern(text(value, scenario)); } },
+      { "std::string", [](const ScenarioJson& value, Scenario& scenario) -> std::any { return text(value, scenario); } },
+      { "String", [](const ScenarioJson& value, Scenario& scenario) -> std::any { return String(text(value, scenario).c_str()); } },
+    };
+    return registry;
+  }
+
+  static std::mutex& typeMutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static std::map<std::string, std::unique_ptr<Scenario>>& cache() {
+    static std::map<std::string, std::unique_ptr<Scenario>> scenarios;
+    return scenarios;
+  }
+
+  static std::mutex& cacheMutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  std::string _source;              // File name for error messages.
+  std::vector<Role> _roles;         // Compiled tables, immutable once parsed.
+  std::deque<std::string> _strings; // Storage of `const char*` values, never moved.
+};
+
+#endif // end of SCENARIO_H
@@ -0,0 +1,301 @@
+#if not defined(SCENARIO_COVERAGE_H)
+#define SCENARIO_COVERAGE_H
+
+#include <any>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "Emulator.h"
+#include "TypeName.h"
+
+/**
+ * \class ScenarioCoverage
+ * \brief Reports configured return values and exceptions that tests never consumed.
+ *
+ * A value set with `returns()` / `then()` that the firmware never asks for, or
+ * an exception or fault rule that never fires, means a test does not exercise
+ * the scenario it describes. Each MethodProfile keeps one bit per value of its
+ * return sequence, set as the value is returned, so tracking costs a single OR
+ * on the dispatch path. Recording an emulator at the end of
+ * each test snapshots those bits; the report lists dead configuration per test
+ * and, aggregated over the suite, values no test consumed.
+ *
+ * Coverage from parallel shards is merged by saving each shard's entries with
+ * `save()` and loading every file into one ScenarioCoverage with `load()`.
+ *
+ * Example:
+ * \code{.cpp}
+ * ScenarioCoverage coverage;
+ * void tearDown() {
+ *   coverage.record(Unity.CurrentTestName, http);
+ *   coverage.record(Unity.CurrentTestName, modem);
+ * }
+ * // after UNITY_END():
+ * coverage.report(std::cout);
+ * coverage.save("coverage.shard0.tsv");
+ * \endcode
+ */
+class ScenarioCoverage {
+public:
+  /**
+   * \brief One configured value or exception of one test.
+   *
+   * \param test        std::string - The test that configured it.
+   * \param emulator    std::string - The emulator's name or type.
+   * \param method      std::string - The mocked method.
+   * \param position    std::string - "returns", "then[i]", "action", "exception" or "fault".
+   * \param value       std::string - The value or exception code, as text.
+   * \param consumed    bool - true if the test returned the value or threw the exception.
+   */
+  struct Entry {
+    std::string test;
+    std::string emulator;
+    std::string method;
+    std::string position;
+    std::string value;
+    bool consumed = false;
+  };
+
+  ScenarioCoverage() {}
+  ~ScenarioCoverage() {}
+
+  /**
+   * \brief Records which of an emulator's configured values a test consumed.
+   *
+   * Call once per emulator at the end of each test, before it is reset.
+   * Emulators left stale by `Emulator::resetAll()` have nothing to record.
+   *
+   * \param test        const char* - The test, typically `Unity.CurrentTestName`.
+   * \param emulator    const Emulator& - The emulator.
+   * \param name        const char* - A name for the emulator, or nullptr to use its type.
+   */
+  void record(const char* test, const Emulator& emulator, const char* name = nullptr) {
+    if (emulator.stale()) {
+      return;
+    }
+    std::string emulatorName = (name != nullptr) ? name : demangledTypeName(typeid(emulator).name());
+    std::string testName = (test != nullptr) ? test : "";
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& method : emulator.methods()) {
+      std::string methodName(method.methodName);
+      if (!method.args.empty()) {
+        methodName += "(" + std::string(method.args) + ")";
+      }
+      if (method.action) {
+        Entry entry;
+        entry.test = testName;
+        entry.emulator = emulatorName;
+        entry.method = methodName;
+        entry.position = "action";
+        entry.value = "<action>";
+        entry.consumed = method.invoked > 0;
+        _entries.push_back(entry);
+      }
+      for (size_t i = 0; i < retValCount(method); ++i) {
+        const RetVal& retVal = retValAt(method, i);
+        if (i == 0 && method.action && !retVal.second.has_value()) {
+          continue;   // does() has no returns() value of its own.
+        }
+        Entry entry;
+        entry.test = testName;
+        entry.emulator = emulatorName;
+        entry.method = methodName;
+        entry.position = (i == 0) ? "returns" : "then[" + std::to_string(i) + "]";
+        entry.value = describe(retVal.second);
+        entry.consumed = retValReturned(method, i);
+        _entries.push_back(entry);
+      }
+    }
+    for (size_t i = 0; i < emulator.faults().size(); ++i) {
+      const FaultRule& rule = emulator.faults().rule(i);
+      Entry entry;
+      entry.test = testName;
+      entry.emulator = emulatorName;
+      entry.method = rule.method();
+      entry.position = (rule.unconditional() && rule.throwing()) ? "exception" : "fault";
+      entry.value = rule.describe();
+      entry.consumed = rule.fired() > 0;
+      _entries.push_back(entry);
+    }
+  }
+
+  /**
+   * \brief Returns every entry recorded or loaded.
+   */
+  const std::vector<Entry>& entries() const { return _entries; }
+
+  /**
+   * \brief Returns the number of entries consumed.
+   */
+  size_t consumed() const {
+    size_t count = 0;
+    for (const auto& entry : _entries) {
+      count += entry.consumed ? 1 : 0;
+    }
+    return count;
+  }
+
+  /**
+   * \brief Returns the entries their test never consumed.
+   */
+  std::vector<Entry> dead() const {
+    std::vector<Entry> unused;
+    for (const auto& entry : _entries) {
+      if (!entry.consumed) {
+        unused.push_back(entry);
+      }
+    }
+    return unused;
+  }
+
+  /**
+   * \brief Forgets every entry.
+   */
+  void clear() { _entries.clear(); }
+
+  /**
+   * \brief Writes every entry as tab separated text, one per line, for merging shards.
+   *
+   * \param path    const char* - The file to write.
+   * \return bool   true if the file was written.
+   */
+  bool save(const char* path) const {
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out.is_open()) {
+      return false;
+    }
+    for (const auto& entry : _entries) {
+      out << field(entry.test) << '\t' << field(entry.emulator) << '\t' << field(entry.method) << '\t'
+          << field(entry.position) << '\t' << field(entry.value) << '\t' << (entry.consumed ? 1 : 0) << '\n';
+    }
+    return out.good();
+  }
+
+  /**
+   * \brief Adds the entries of a file written by `save()`.
+   *
+   * \param path    const char* - The file to read.
+   * \return bool   true if the file could be read.
+   */
+  bool load(const char* path) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+      return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+      std::vector<std::string> fields;
+      std::stringstream stream(line);
+      std::string value;
+      while (std::getline(stream, value, '\t')) {
+        fields.push_back(value);
+      }
+      if (fields.size() != 6) {
+        continue;
+      }
+      Entry entry;
+      entry.test = fields[0];
+      entry.emulator = fields[1];
+      entry.method = fields[2];
+      entry.position = fields[3];
+      entry.value = fields[4];
+      entry.consumed = fields[5] == "1";
+      _entries.push_back(entry);
+    }
+    return true;
+  }
+
+  /**
+   * \brief Writes the coverage summary, dead configuration per test, and
+   * configuration no test consumed.
+   *
+   * \param out       std::ostream& - The stream to write to.
+   * \param perTest   bool - List dead configuration test by test as well as aggregated.
+   */
+  void report(std::ostream& out, bool perTest = true) const {
+    std::map<std::string, bool> tests;
+    typedef std::tuple<std::string, std::string, std::string, std::string> Site;
+    std::map<Site, std::pair<size_t, size_t>> sites;    // Tests configuring and consuming each site.
+    for (const auto& entry : _entries) {
+      tests[entry.test] = true;
+      auto& site = sites[std::make_tuple(entry.emulator, entry.method, entry.position, entry.value)];
+      site.first += 1;
+      site.second += entry.consumed ? 1 : 0;
+    }
+    size_t used = consumed();
+    out << "Scenario coverage: " << used << " of " << _entries.size() << " configured values consumed";
+    if (!_entries.empty()) {
+      out << " (" << (used * 100 / _entries.size()) << "%)";
+    }
+    out << " over " << tests.size() << " tests" << std::endl;
+
+    if (perTest && used < _entries.size()) {
+      out << "Dead configuration by test:" << std::endl;
+      for (const auto& entry : _entries) {
+        if (!entry.consumed) {
+          out << "  " << (entry.test.empty() ? "(outside a test)" : entry.test) << "  " << entry.emulator << "::"
+              << entry.method << "  " << entry.position << " = " << entry.value << std::endl;
+        }
+      }
+    }
+    bool header = false;
+    for (const auto& site : sites) {
+      if (site.second.second > 0) {
+        continue;
+      }
+      if (!header) {
+        out << "Never consumed in any test:" << std::endl;
+        header = true;
+      }
+      out << "  " << std::get<0>(site.first) << "::" << std::get<1>(site.first) << "  " << std::get<2>(site.first)
+          << " = " << std::get<3>(site.first) << "  (configured in " << site.second.first << " tests)" << std::endl;
+    }
+  }
+
+private:
+  /**
+   * \brief Returns a configured value as text, for the common return types of mocks.
+   */
+  static std::string describe(const std::any& value) {
+    if (!value.has_value()) {
+      return "(empty)";
+    }
+    if (const int* v = std::any_cast<int>(&value)) return std::to_string(*v);
+    if (const unsigned* v = std::any_cast<unsigned>(&value)) return std::to_string(*v);
+    if (const long* v = std::any_cast<long>(&value)) return std::to_string(*v);
+    if (const unsigned long* v = std::any_cast<unsigned long>(&value)) return std::to_string(*v);
+    if (const int16_t* v = std::any_cast<int16_t>(&value)) return std::to_string(*v);
+    if (const uint16_t* v = std::any_cast<uint16_t>(&value)) return std::to_string(*v);
+    if (const int8_t* v = std::any_cast<int8_t>(&value)) return std::to_string(*v);
+    if (const uint8_t* v = std::any_cast<uint8_t>(&value)) return std::to_string(*v);
+    if (const bool* v = std::any_cast<bool>(&value)) return *v ? "true" : "false";
+    if (const double* v = std::any_cast<double>(&value)) return std::to_string(*v);
+    if (const float* v = std::any_cast<float>(&value)) return std::to_string(*v);
+    if (const std::string* v = std::any_cast<std::string>(&value)) return "\"" + *v + "\"";
+    if (const char* const* v = std::any_cast<const char*>(&value)) return "\"" + std::string(*v) + "\"";
+    return "<" + demangledTypeName(value.type().name()) + ">";
+  }
+
+  /**
+   * \brief Returns text with tabs and line breaks replaced, to fit one field of a line.
+   */
+  static std::string field(std::string text) {
+    for (char& c : text) {
+      if (c == '\t' || c == '\n' || c == '\r') {
+        c = ' ';
+      }
+    }
+    return text;
+  }
+
+  std::mutex _mutex;
+  std::vector<Entry> _entries;    // Every configured value recorded, in order.
+};
+
+#endif // end of SCENARIO_COVERAGE_H
@@ -0,0 +1,126 @@
+#if not defined(SEEDED_RANDOM_H)
+#define SEEDED_RANDOM_H
+
+#include <cmath>
+#include <cstdint>
+
+/**
+ * \class SeededRandom
+ * \brief A small, fast and reproducible pseudo random number generator.
+ *
+ * Implements xoshiro256** seeded through splitmix64. Emulated components
+ * that behave randomly (link jitter, packet loss) draw from a SeededRandom
+ * so that any run can be replayed exactly by reusing its seed.
+ *
+ * Example:
+ * \code{.cpp}
+ * SeededRandom rng(42);
+ * if (rng.chance(0.05)) {
+ *   // 5% of the time
+ * }
+ * \endcode
+ */
+class SeededRandom {
+public:
+  /**
+   * \brief Constructs a generator from a seed.
+   *
+   * \param seed    uint64_t - The seed. The same seed always yields the same sequence.
+   */
+  explicit SeededRandom(uint64_t seed = 0x9E3779B97F4A7C15ULL) { reseed(seed); }
+
+  /**
+   * \brief Restarts the sequence from a new seed.
+   *
+   * \param seed    uint64_t - The seed to restart from.
+   */
+  void reseed(uint64_t seed) {
+    _seed = seed;
+    uint64_t x = seed;
+    for (int i = 0; i < 4; ++i) {
+      x += 0x9E3779B97F4A7C15ULL;
+      uint64_t z = x;
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      _state[i] = z ^ (z >> 31);
+    }
+  }
+
+  /**
+   * \brief Returns the seed the current sequence was started from.
+   */
+  uint64_t seed() const { return _seed; }
+
+  /**
+   * \brief Returns the next 64 random bits.
+   */
+  uint64_t next() {
+    uint64_t result = rotl(_state[1] * 5, 7) * 9;
+    uint64_t t = _state[1] << 17;
+    _state[2] ^= _state[0];
+    _state[3] ^= _state[1];
+    _state[1] ^= _state[2];
+    _state[0] ^= _state[3];
+    _state[2] ^= t;
+    _state[3] = rotl(_state[3], 45);
+    return result;
+  }
+
+  /**
+   * \brief Returns a uniformly distributed double in [0, 1).
+   */
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  /**
+   * \brief Returns a uniformly distributed integer in [0, bound).
+   *
+   * \param bound   uint64_t - The exclusive upper bound, must be non-zero.
+   */
+  uint64_t below(uint64_t bound) { return (uint64_t)(((__uint128_t)next() * bound) >> 64); }
+
+  /**
+   * \brief Returns true with the given probability.
+   *
+   * \param probability   double - Probability in [0, 1].
+   */
+  bool chance(double probability) {
+    if (probability <= 0.0) {
+      return false;
+    }
+    return uniform() < probability;
+  }
+
+  /**
+   * \brief Returns a normally distributed value (Box-Muller).
+   *
+   * \param mean      double - The mean of the distribution.
+   * \param stddev    double - The standard deviation of the distribution.
+   */
+  double normal(double mean, double stddev) {
+    double u1 = uniform();
+    double u2 = uniform();
+    if (u1 < 1e-300) {
+      u1 = 1e-300;
+    }
+    return mean + stddev * std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+  }
+
+  /**
+   * \brief Returns a Pareto distributed value, useful for heavy-tailed latency spikes.
+   *
+   * \param scale     double - The minimum value of the distribution.
+   * \param shape     double - The tail index, smaller values give heavier tails.
+   */
+  double pareto(double scale, double shape) {
+    double u = 1.0 - uniform();
+    return scale / std::pow(u, 1.0 / shape);
+  }
+
+private:
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  uint64_t _state[4];
+  uint64_t _seed;
+};
+
+#endif // end of SEEDED_RANDOM_H
@@ -0,0 +1,344 @@
+#if not defined(SIGNAL_TRACE_H)
+#define SIGNAL_TRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * \file SignalTrace.h
+ * \brief Replays recorded modem signal quality and registration against virtual time.
+ */
+
+/**
+ * \brief One recorded observation of the modem's radio state.
+ *
+ * \param time          uint64_t - Milliseconds since the start of the trace.
+ * \param csq           int16_t - Signal quality in 27.007 units (0-31, 99 unknown).
+ * \param registration  int8_t - `+CREG` status code at that moment.
+ * \param gprs          uint8_t - Non-zero if packet data was attached.
+ */
+struct SignalSample {
+  uint64_t time;
+  int16_t csq;
+  int8_t registration;
+  uint8_t gprs;
+  uint8_t reserved[4];
+};
+
+static_assert(sizeof(SignalSample) == 16, "SignalSample is stored verbatim in binary traces");
+
+/**
+ * \class SignalTrace
+ * \brief A recorded signal-quality and registration trace, streamed rather than loaded.
+ *
+ * Two formats are accepted and detected automatically:
+ *
+ * - CSV, one line per sample: `seconds,csq,registration[,gprs]`. Lines that do
+ *   not start with a digit (headers, comments) are skipped. Timestamps may be
+ *   absolute (e.g. epoch seconds) and are rebased so the first sample is at 0.
+ *   When the gprs column is missing it follows registration.
+ * - Binary, produced by `compile()`: a 16 byte header followed by packed
+ *   SignalSample records. Binary traces are memory mapped and searched in
+ *   place, so traces spanning weeks cost no load time.
+ *
+ * CSV traces are scanned once on open to build a sparse index of file offsets
+ * (one entry per kIndexStride samples). Lookups seek to the nearest indexed
+ * sample and parse forward, and the current position is cached so the usual
+ * monotonically advancing queries cost O(1).
+ *
+ * Example:
+ * \code{.cpp}
+ * SignalTrace field;
+ * field.open("device-42-week.csv");
+ * modemDriverMock.replay(field);
+ * \endcode
+ */
+class SignalTrace {
+public:
+  SignalTrace() {}
+  SignalTrace(const SignalTrace&) = delete;
+  SignalTrace& operator=(const SignalTrace&) = delete;
+  ~SignalTrace() { close(); }
+
+  /**
+   * \brief Opens a CSV or binary trace.
+   *
+   * \param path    const char* - Path of the trace file.
+   * \return bool   true if the trace was opened and holds at least one sample.
+   */
+  bool open(const char* path) {
+    close();
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    char magic[4] = { 0, 0, 0, 0 };
+    ssize_t got = ::read(fd, magic, sizeof(magic));
+    if (got == 4 && memcmp(magic, kMagic, 4) == 0) {
+      return openBinary(fd);
+    }
+    ::close(fd);
+    return openCsv(path);
+  }
+
+  /**
+   * \brief Releases the file and any mapping.
+   */
+  void close() {
+    if (_map != nullptr) {
+      munmap(_map, _mapLength);
+      _map = nullptr;
+      _records = nullptr;
+    }
+    if (_csv != nullptr) {
+      fclose(_csv);
+      _csv = nullptr;
+    }
+    _index.clear();
+    _count = 0;
+  }
+
+  /**
+   * \brief Returns the sample in effect at a point in the trace.
+   *
+   * Before the first sample the first sample is returned, after the last the
+   * last sample stays in effect.
+   *
+   * \param ms      uint64_t - Milliseconds since the start of the trace.
+   * \return const SignalSample&  The sample in effect at that time.
+   */
+  const SignalSample& at(uint64_t ms) {
+    if (_records != nullptr) {
+      return atBinary(ms);
+    }
+    return atCsv(ms);
+  }
+
+  /**
+   * \brief Returns the number of samples in the trace.
+   */
+  size_t size() const { return _count; }
+
+  /**
+   * \brief Returns the time of the last sample in milliseconds.
+   */
+  uint64_t duration() const { return _duration; }
+
+  /**
+   * \brief Converts a CSV trace into the binary format.
+   *
+   * \param csvPath   const char* - The CSV trace to read.
+   * \param binPath   const char* - The binary trace to write.
+   * \return bool     true on success.
+   */
+  static bool compile(const char* csvPath, const char* binPath) {
+    FILE* in = fopen(csvPath, "r");
+    if (in == nullptr) {
+      return false;
+    }
+    FILE* out = fopen(binPath, "wb");
+    if (out == nullptr) {
+      fclose(in);
+      return false;
+    }
+    char header[16] = { 0 };
+    memcpy(header, kMagic, 4);
+    fwrite(header, 1, sizeof(header), out);
+
+    char line[256];
+    double origin = -1.0;
+    uint64_t count = 0;
+    SignalSample sample;
+    while (fgets(line, sizeof(line), in) != nullptr) {
+      if (parse(line, origin, sample)) {
+        fwrite(&sample, sizeof(sample), 1, out);
+        ++count;
+      }
+    }
+    fseek(out, 8, SEEK_SET);
+    fwrite(&count, sizeof(count), 1, out);
+    fclose(in);
+    return fclose(out) == 0;
+  }
+
+private:
+  static constexpr const char* kMagic = "EMTR";
+  static const size_t kIndexStride = 1024;
+
+  struct IndexEntry {
+    uint64_t time;
+    long offset;
+  };
+
+  /**
+   * \brief Parses one CSV line, rebasing its time against the first sample's.
+   */
+  static bool parse(const char* line, double& origin, SignalSample& sample) {
+    if (line[0] < '0' || line[0] > '9') {
+      return false;
+    }
+    char* cursor = nullptr;
+    double seconds = strtod(line, &cursor);
+    if (*cursor != ',') {
+      return false;
+    }
+    long csq = strtol(cursor + 1, &cursor, 10);
+    if (*cursor != ',') {
+      return false;
+    }
+    long registration = strtol(cursor + 1, &cursor, 10);
+    long gprs = (registration == 1 || registration == 5) ? 1 : 0;
+    if (*cursor == ',') {
+      gprs = strtol(cursor + 1, &cursor, 10);
+    }
+    if (origin < 0.0) {
+      origin = seconds;
+    }
+    memset(&sample, 0, sizeof(sample));
+    sample.time = (uint64_t)((seconds - origin) * 1000.0 + 0.5);
+    sample.csq = (int16_t)csq;
+    sample.registration = (int8_t)registration;
+    sample.gprs = (gprs != 0) ? 1 : 0;
+    return true;
+  }
+
+  bool openBinary(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < 16) {
+      ::close(fd);
+      return false;
+    }
+    _mapLength = (size_t)info.st_size;
+    void* map = mmap(nullptr, _mapLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+      return false;
+    }
+    _map = map;
+    uint64_t count;
+    memcpy(&count, (const char*)_map + 8, sizeof(count));
+    size_t capacity = (_mapLength - 16) / sizeof(SignalSample);
+    _count = (count < capacity) ? (size_t)count : capacity;
+    _records = (const SignalSample*)((const char*)_map + 16);
+    _cursor = 0;
+    _duration = (_count > 0) ? _records[_count - 1].time : 0;
+    return _count > 0;
+  }
+
+  bool openCsv(const char* path) {
+    _csv = fopen(path, "r");
+    if (_csv == nullptr) {
+      return false;
+    }
+    setvbuf(_csv, nullptr, _IOFBF, 1 << 16);
+    char line[256];
+    long offset = 0;
+    SignalSample sample;
+    _origin = -1.0;
+    while (fgets(line, sizeof(line), _csv) != nullptr) {
+      long next = offset + (long)strlen(line);
+      if (parse(line, _origin, sample)) {
+        if (_count % kIndexStride == 0) {
+          _index.push_back({ sample.time, offset });
+        }
+        _duration = sample.time;
+        ++_count;
+      }
+      offset = next;
+    }
+    if (_count == 0) {
+      return false;
+    }
+    seekCsv(0);
+    return true;
+  }
+
+  const SignalSample& atBinary(uint64_t ms) {
+    // Sequential queries usually land on the cached or the following record.
+    if (_records[_cursor].time <= ms && (_cursor + 1 == _count || _records[_cursor + 1].time > ms)) {
+      return _records[_cursor];
+    }
+    if (_cursor + 2 < _count && _records[_cursor + 1].time <= ms && _records[_cursor + 2].time > ms) {
+      return _records[++_cursor];
+    }
+    size_t low = 0;
+    size_t high = _count;
+    while (high - low > 1) {
+      size_t mid = low + (high - low) / 2;
+      if (_records[mid].time <= ms) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+    _cursor = low;
+    return _records[_cursor];
+  }
+
+  const SignalSample& atCsv(uint64_t ms) {
+    size_t block = _ordinal / kIndexStride;
+    if (ms < _current.time || (block + 1 < _index.size() && ms >= _index[block + 1].time)) {
+      size_t low = 0;
+      size_t high = _index.size();
+      while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+        if (_index[mid].time <= ms) {
+          low = mid;
+        } else {
+          high = mid;
+        }
+      }
+      seekCsv(low);
+    }
+    while (_hasNext && _next.time <= ms) {
+      _current = _next;
+      _hasNext = readCsv(_next);
+      ++_ordinal;
+    }
+    return _current;
+  }
+
+  void seekCsv(size_t indexEntry) {
+    fseek(_csv, _index[indexEntry].offset, SEEK_SET);
+    readCsv(_current);
+    _hasNext = readCsv(_next);
+    _ordinal = indexEntry * kIndexStride;
+  }
+
+  bool readCsv(SignalSample& sample) {
+    char line[256];
+    while (fgets(line, sizeof(line), _csv) != nullptr) {
+      if (parse(line, _origin, sample)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Binary traces
+  void* _map = nullptr;                   // Mapping of the whole file.
+  size_t _mapLength = 0;                  // Length of the mapping in bytes.
+  const SignalSample* _records = nullptr; // Records within the mapping.
+  size_t _cursor = 0;                     // Record returned by the last lookup.
+
+  // CSV traces
+  FILE* _csv = nullptr;                   // The open CSV file.
+  double _origin = -1.0;                  // Timestamp of the first sample in seconds.
+  std::vector<IndexEntry> _index;         // Offset of every kIndexStride-th sample.
+  SignalSample _current = {};             // Sample in effect at the last lookup.
+  SignalSample _next = {};                // The sample after _current.
+  bool _hasNext = false;                  // Whether _next holds a sample.
+  size_t _ordinal = 0;                    // Position of _current within the trace.
+
+  size_t _count = 0;                      // Number of samples.
+  uint64_t _duration = 0;                 // Time of the last sample in ms.
+};
+
+#endif // end of SIGNAL_TRACE_H
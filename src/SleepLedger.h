@@ -0,0 +1,198 @@
+#if not defined(SLEEP_LEDGER_H)
+#define SLEEP_LEDGER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "TypeName.h"
+#include "VirtualClock.h"
+
+#if __has_include(<unity.h>)
+#include <unity.h>
+// Weak, so programs that include Unity's header without linking it still build.
+extern struct UNITY_STORAGE_T Unity __attribute__((weak));
+#endif
+
+#if not defined(SLEEP_LEDGER_REPORT_ROWS)
+#define SLEEP_LEDGER_REPORT_ROWS    (20)
+#endif
+
+/**
+ * \class SleepLedger
+ * \brief Accounts for every host sleep the library makes, by test, emulator and method.
+ *
+ * Emulated waits only block the host when no device clock is bound and no
+ * scheduler has hooked sleeps (see `VirtualClock::sleep()`). Every such sleep
+ * in the library, mocked method delays, `Emulator::await()` and emulated
+ * `delay()`, goes through `SleepLedger::sleep()`, which times it and charges
+ * it to the running Unity test (`Unity.CurrentTestName`), the emulator's type
+ * and the method. Waits absorbed by a clock or scheduler cost no host time and
+ * are not charged, and zero-length host sleeps are skipped rather than
+ * costing a system call.
+ *
+ * When the process exits, a ranked report of the tests, and of the emulator
+ * methods within them, that slept longest is written to stderr, so the tests
+ * most worth moving onto a virtual clock are listed first. Defining
+ * SLEEP_LEDGER_QUIET suppresses the report; `report()` can still be called.
+ *
+ * Example output:
+ * \code
+ * Host sleep by test (4.20 s total)
+ *   3.10 s   test_modem_reconnect
+ *   1.10 s   test_http_retry
+ * Host sleep by test, emulator and method
+ *   3.00 s   test_modem_reconnect  HttpClient::connect  x3
+ * \endcode
+ */
+class SleepLedger {
+public:
+  /**
+   * \brief Waits on behalf of an emulator, charging any host sleep to the ledger.
+   *
+   * \param us          uint64_t - The number of microseconds to wait.
+   * \param emulator    const char* - The emulator's type, as from `typeid().name()`.
+   * \param method      const std::string& - The method that waits.
+   */
+  static void sleep(uint64_t us, const char* emulator, const std::string& method) {
+    if (!VirtualClock::sleepsHost()) {
+      VirtualClock::sleep(us);
+      return;
+    }
+    if (us == 0) {
+      return;
+    }
+    auto started = std::chrono::steady_clock::now();
+    VirtualClock::sleep(us);
+    uint64_t slept = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+    instance().charge(currentTest(), emulator, method, slept);
+  }
+
+  /**
+   * \brief Returns the ledger of the process.
+   */
+  static SleepLedger& instance() {
+    static SleepLedger ledger;
+    return ledger;
+  }
+
+  /**
+   * \brief Adds host time slept to an entry.
+   *
+   * \param test        const std::string& - The test that slept.
+   * \param emulator    const char* - The emulator's type.
+   * \param method      const std::string& - The method that slept.
+   * \param us          uint64_t - Host microseconds slept.
+   */
+  void charge(const std::string& test, const char* emulator, const std::string& method, uint64_t us) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Entry& entry = _entries[std::make_tuple(test, std::string(emulator), method)];
+    entry.micros += us;
+    entry.sleeps += 1;
+    _total += us;
+  }
+
+  /**
+   * \brief Returns the host microseconds slept by a test, or by every test.
+   *
+   * \param test    const char* - The test, or nullptr for all of them.
+   */
+  uint64_t slept(const char* test = nullptr) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (test == nullptr) {
+      return _total;
+    }
+    uint64_t micros = 0;
+    for (const auto& entry : _entries) {
+      micros += (std::get<0>(entry.first) == test) ? entry.second.micros : 0;
+    }
+    return micros;
+  }
+
+  /**
+   * \brief Writes the ranked report, see the class description.
+   *
+   * \param out     FILE* - Where to write.
+   * \param rows    size_t - The most rows to list in each ranking.
+   */
+  void report(FILE* out = stderr, size_t rows = SLEEP_LEDGER_REPORT_ROWS) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_entries.empty()) {
+      return;
+    }
+    std::map<std::string, uint64_t> byTest;
+    std::vector<std::pair<uint64_t, const Key*>> bySite;
+    for (const auto& entry : _entries) {
+      byTest[std::get<0>(entry.first)] += entry.second.micros;
+      bySite.push_back(std::make_pair(entry.second.micros, &entry.first));
+    }
+    std::vector<std::pair<uint64_t, std::string>> tests;
+    for (const auto& test : byTest) {
+      tests.push_back(std::make_pair(test.second, test.first));
+    }
+    std::sort(tests.rbegin(), tests.rend());
+    std::sort(bySite.begin(), bySite.end(), [](const std::pair<uint64_t, const Key*>& a, const std::pair<uint64_t, const Key*>& b) {
+      return a.first > b.first;
+    });
+
+    fprintf(out, "Host sleep by test (%.2f s total)\n", _total / 1e6);
+    for (size_t i = 0; i < tests.size() && i < rows; ++i) {
+      fprintf(out, "  %8.2f s   %s\n", tests[i].first / 1e6, nameOf(tests[i].second));
+    }
+    fprintf(out, "Host sleep by test, emulator and method\n");
+    for (size_t i = 0; i < bySite.size() && i < rows; ++i) {
+      const Key& key = *bySite[i].second;
+      fprintf(out, "  %8.2f s   %s  %s::%s  x%lu\n", bySite[i].first / 1e6, nameOf(std::get<0>(key)),
+              demangledTypeName(std::get<1>(key).c_str()).c_str(), std::get<2>(key).c_str(), (unsigned long)_entries[key].sleeps);
+    }
+  }
+
+  /**
+   * \brief Forgets everything charged so far.
+   */
+  void reset() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.clear();
+    _total = 0;
+  }
+
+private:
+  typedef std::tuple<std::string, std::string, std::string> Key;   // Test, emulator type, method.
+
+  struct Entry {
+    uint64_t micros = 0;    // Host time slept.
+    uint64_t sleeps = 0;    // Number of sleeps.
+  };
+
+  SleepLedger() {}
+
+  ~SleepLedger() {
+#if not defined(SLEEP_LEDGER_QUIET)
+    report();
+#endif
+  }
+
+  static std::string currentTest() {
+#if __has_include(<unity.h>)
+    // Read through a volatile pointer: the compiler may assume `&Unity` is never null and fold the check.
+    static struct UNITY_STORAGE_T* volatile unity = &Unity;
+    struct UNITY_STORAGE_T* storage = unity;
+    return (storage != nullptr && storage->CurrentTestName != nullptr) ? storage->CurrentTestName : "";
+#else
+    return "";
+#endif
+  }
+
+  static const char* nameOf(const std::string& test) { return test.empty() ? "(outside a test)" : test.c_str(); }
+
+  std::mutex _mutex;
+  std::map<Key, Entry> _entries;    // Host sleep per test, emulator and method.
+  uint64_t _total = 0;              // Host microseconds slept in total.
+};
+
+#endif // end of SLEEP_LEDGER_H
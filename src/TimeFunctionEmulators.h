@@ -2,6 +2,10 @@
 #define __TIME_FUNCTION_EMULATORS_H__
 
 #include "FunctionEmulator.h"
+#include <typeinfo>
+#include "VirtualClock.h"
+#include "TraceRecorder.h"
+#include "SleepLedger.h"
 
 /**
  * \class DelayFunctionEmulator
@@ -36,13 +40,36 @@ public:
      * \brief Emulates the delay function.
      * 
      * Records the function call for testing verification and then emulates 
-     * the delay by sleeping the thread for the specified duration.
+     * the delay by sleeping the thread for the specified duration, or by
+     * advancing the device clock when one is bound (see VirtualClock::sleep()).
      * 
      * \param ms The number of milliseconds to delay.
      */
 	void mockDelay(unsigned long ms) {
 		recordFunctionCall();
-		usleep(ms * 1000);
+		static const std::string name = "delay";
+		TraceSpan span(this, "delay", "delay", name);
+		SleepLedger::sleep((uint64_t)ms * 1000, typeid(*this).name(), name);
+	}
+
+    /**
+     * \brief Binds a per-device delay emulator to the calling thread.
+     * 
+     * \param emulator The emulator `delay()` should use, or nullptr for the global one.
+     * \return The previously bound emulator, so callers can restore it.
+     */
+	static DelayFunctionEmulator* bind(DelayFunctionEmulator* emulator) {
+		DelayFunctionEmulator* previous = bound();
+		bound() = emulator;
+		return previous;
+	}
+
+    /**
+     * \brief Returns the emulator bound to the calling thread, or nullptr if none is.
+     */
+	static DelayFunctionEmulator*& bound() {
+		thread_local DelayFunctionEmulator* emulator = nullptr;
+		return emulator;
 	}
 };
 
@@ -84,17 +111,28 @@ public:
 		_lastMillisValue = 0;
 	}
 
+    /**
+     * \brief Resets the emulated millis value along with the emulator's state.
+     */
+	void reset() override {
+		resetMillis();
+		FunctionEmulator::reset();
+	}
+
     /**
      * \brief Emulates the millis function.
      * 
      * Records the function call for testing verification and returns 
-     * an incremented value based on the previously set time increment.
+     * an incremented value based on the previously set time increment,
+     * plus any time emulated components have charged to the current
+     * VirtualClock.
      * 
      * \return The emulated time in milliseconds.
      */
 	unsigned long mockMillis() {
 		recordFunctionCall();
-		return _lastMillisValue += _timeIncrement;
+		_lastMillisValue += _timeIncrement;
+		return _lastMillisValue + VirtualClock::current().nowMillis();
 	}
 
     /**
@@ -109,6 +147,26 @@ public:
 		_timeIncrement = increment;
 	}
 
+    /**
+     * \brief Binds a per-device millis emulator to the calling thread.
+     * 
+     * \param emulator The emulator `millis()` should use, or nullptr for the global one.
+     * \return The previously bound emulator, so callers can restore it.
+     */
+	static MillisFunctionEmulator* bind(MillisFunctionEmulator* emulator) {
+		MillisFunctionEmulator* previous = bound();
+		bound() = emulator;
+		return previous;
+	}
+
+    /**
+     * \brief Returns the emulator bound to the calling thread, or nullptr if none is.
+     */
+	static MillisFunctionEmulator*& bound() {
+		thread_local MillisFunctionEmulator* emulator = nullptr;
+		return emulator;
+	}
+
 private:
 	unsigned long _lastMillisValue = 0; // The last returned value of the emulated millis.
 	unsigned long _timeIncrement = 100; // The time increment for each call to the emulated millis.
@@ -0,0 +1,357 @@
+#if not defined(TRACE_RECORDER_H)
+#define TRACE_RECORDER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "TypeName.h"
+#include "VirtualClock.h"
+
+#if not defined(TRACE_CHUNK_SIZE)
+#define TRACE_CHUNK_SIZE    (1024 * 1024)
+#endif
+
+/**
+ * \class TraceRecorder
+ * \brief Streams an emulated timeline to disk in the Chrome Trace Event JSON format.
+ *
+ * While a recorder is installed with `bind()`, every `mock()` call, emulated
+ * `delay()`, served HTTP request and modem state change is written as a trace
+ * event. Timestamps are read from the calling thread's VirtualClock, so a
+ * simulated hour appears as an hour on the timeline whatever it took to run.
+ * Each clock (one per FleetDevice, or the process-wide one) is a process in the
+ * trace and each emulator instance a thread within it, giving one track per
+ * instance per device.
+ *
+ * Events are formatted into a chunk of TRACE_CHUNK_SIZE bytes which is
+ * written out whenever it fills, so traces of long soak runs never have to
+ * fit in memory. The file is a JSON array that `chrome://tracing` and
+ * ui.perfetto.dev open directly, and which stays loadable if a run crashes
+ * before `close()`.
+ *
+ * Recording is safe from several host threads at once; each event takes a
+ * short lock.
+ *
+ * Example:
+ * \code{.cpp}
+ * TraceRecorder trace("soak.json");
+ * TraceRecorder::bind(&trace);
+ * // ... [Run firmware for an hour of virtual time]
+ * TraceRecorder::bind(nullptr);
+ * trace.close();
+ * \endcode
+ */
+class TraceRecorder {
+public:
+  /**
+   * \brief Where event timestamps come from.
+   *
+   * Virtual reads the calling thread's VirtualClock. Host reads a steady host
+   * clock from when the recorder was opened, for tests whose delays sleep the
+   * host rather than advancing a clock.
+   */
+  enum TimeBase { Virtual, Host };
+
+  TraceRecorder() {}
+
+  /**
+   * \brief Constructs a recorder and opens its file, see `open()`.
+   */
+  explicit TraceRecorder(const char* path, TimeBase timeBase = Virtual) { open(path, timeBase); }
+
+  ~TraceRecorder() {
+    if (active() == this) {
+      bind(nullptr);
+    }
+    close();
+  }
+
+  /**
+   * \brief Opens a trace file, replacing any existing one.
+   *
+   * \param path        const char* - The file to write.
+   * \param timeBase    TimeBase - Where timestamps come from.
+   * \return bool       true if the file could be opened.
+   */
+  bool open(const char* path, TimeBase timeBase = Virtual) {
+    close();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _file = fopen(path, "wb");
+    if (_file == nullptr) {
+      return false;
+    }
+    _timeBase = timeBase;
+    _opened = std::chrono::steady_clock::now();
+    _chunk.reserve(TRACE_CHUNK_SIZE + 4096);
+    _chunk = "[";
+    _events = 0;
+    _bytes = 0;
+    _processes.clear();
+    _tracks.clear();
+    _trackNames.assign(1, "");
+    return true;
+  }
+
+  /**
+   * \brief Writes out buffered events and completes the file.
+   */
+  void close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_file == nullptr) {
+      return;
+    }
+    _chunk += "\n]\n";
+    flushChunk();
+    fclose(_file);
+    _file = nullptr;
+  }
+
+  /**
+   * \brief Installs a recorder for every thread of the process.
+   *
+   * \param recorder    TraceRecorder* - The recorder, or nullptr to stop recording.
+   * \return TraceRecorder*  The previously installed recorder.
+   */
+  static TraceRecorder* bind(TraceRecorder* recorder) {
+    return slot().exchange(recorder, std::memory_order_acq_rel);
+  }
+
+  /**
+   * \brief Returns the installed recorder, or nullptr if nothing is being recorded.
+   */
+  static TraceRecorder* active() { return slot().load(std::memory_order_acquire); }
+
+  /**
+   * \brief Returns the current timestamp in microseconds.
+   */
+  uint64_t now() const {
+    if (_timeBase == Host) {
+      return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _opened).count();
+    }
+    return VirtualClock::current().nowMicros();
+  }
+
+  /**
+   * \brief Records something that took time, such as a call or a delay.
+   *
+   * \param instance    const void* - The emulator or component, one track per instance.
+   * \param type        const char* - Its type, naming the track; mangled names are demangled.
+   * \param category    const char* - Event category, e.g. "mock" or "http".
+   * \param name        const std::string& - Event name.
+   * \param start       uint64_t - Start timestamp from `now()`.
+   * \param duration    uint64_t - Duration in microseconds.
+   */
+  void complete(const void* instance, const char* type, const char* category, const std::string& name, uint64_t start, uint64_t duration) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_file == nullptr) {
+      return;
+    }
+    std::pair<uint32_t, uint32_t> track = trackOf(instance, type);
+    beginEvent(category, name, "X", start, track);
+    _chunk += ",\"dur\":";
+    _chunk += std::to_string(duration);
+    endEvent();
+  }
+
+  /**
+   * \brief Records a moment, such as a state change, with an optional integer argument.
+   *
+   * \param instance    const void* - The emulator or component, one track per instance.
+   * \param type        const char* - Its type, naming the track.
+   * \param category    const char* - Event category.
+   * \param name        const std::string& - Event name.
+   * \param key         const char* - Name of the argument, or nullptr for none.
+   * \param value       int64_t - Value of the argument.
+   */
+  void instant(const void* instance, const char* type, const char* category, const std::string& name, const char* key = nullptr, int64_t value = 0) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_file == nullptr) {
+      return;
+    }
+    std::pair<uint32_t, uint32_t> track = trackOf(instance, type);
+    beginEvent(category, name, "i", now(), track);
+    _chunk += ",\"s\":\"t\"";
+    if (key != nullptr) {
+      _chunk += ",\"args\":{";
+      appendString(key);
+      _chunk += ":";
+      _chunk += std::to_string(value);
+      _chunk += "}";
+    }
+    endEvent();
+  }
+
+  /**
+   * \brief Records the new value of a quantity, drawn as a counter track.
+   *
+   * \param instance    const void* - The emulator or component the value belongs to.
+   * \param type        const char* - Its type.
+   * \param name        const std::string& - Name of the quantity, e.g. "registration".
+   * \param value       int64_t - Its new value.
+   */
+  void counter(const void* instance, const char* type, const std::string& name, int64_t value) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_file == nullptr) {
+      return;
+    }
+    std::pair<uint32_t, uint32_t> track = trackOf(instance, type);
+    beginEvent("state", _trackNames[track.second] + " " + name, "C", now(), track);
+    _chunk += ",\"args\":{\"value\":";
+    _chunk += std::to_string(value);
+    _chunk += "}";
+    endEvent();
+  }
+
+  /**
+   * \brief Returns the number of events recorded since opening.
+   */
+  uint64_t events() const { return _events; }
+
+  /**
+   * \brief Returns the number of bytes written to the file so far.
+   */
+  uint64_t bytesWritten() const { return _bytes; }
+
+private:
+  static std::atomic<TraceRecorder*>& slot() {
+    static std::atomic<TraceRecorder*> recorder(nullptr);
+    return recorder;
+  }
+
+  /**
+   * \brief Returns the (process, thread) ids of an instance on the calling
+   * thread's clock, naming new ones with metadata events.
+   */
+  std::pair<uint32_t, uint32_t> trackOf(const void* instance, const char* type) {
+    const VirtualClock* clock = &VirtualClock::current();
+    auto process = _processes.find(clock);
+    if (process == _processes.end()) {
+      uint32_t pid = (uint32_t)_processes.size() + 1;
+      process = _processes.emplace(clock, pid).first;
+      std::string name = VirtualClock::isBound() ? "device " + std::to_string(pid) : "emulation";
+      appendMetadata("process_name", pid, 0, name);
+    }
+    uint32_t pid = process->second;
+    auto track = _tracks.find(std::make_pair(pid, instance));
+    if (track == _tracks.end()) {
+      uint32_t tid = (uint32_t)_trackNames.size();
+      track = _tracks.emplace(std::make_pair(pid, instance), tid).first;
+      std::string name = demangledTypeName(type);
+      size_t colon = name.rfind("::");
+      if (colon != std::string::npos) {
+        name = name.substr(colon + 2);
+      }
+      _trackNames.push_back(name + " #" + std::to_string(tid));
+      appendMetadata("thread_name", pid, tid, _trackNames.back());
+    }
+    return std::make_pair(pid, track->second);
+  }
+
+  void appendMetadata(const char* kind, uint32_t pid, uint32_t tid, const std::string& name) {
+    _chunk += (_events == 0) ? "\n" : ",\n";
+    _chunk += "{\"name\":\"";
+    _chunk += kind;
+    _chunk += "\",\"ph\":\"M\",\"pid\":" + std::to_string(pid) + ",\"tid\":" + std::to_string(tid) + ",\"args\":{\"name\":";
+    appendString(name);
+    _chunk += "}}";
+    ++_events;
+  }
+
+  void beginEvent(const char* category, const std::string& name, const char* phase, uint64_t ts, std::pair<uint32_t, uint32_t> track) {
+    _chunk += (_events == 0) ? "\n" : ",\n";
+    _chunk += "{\"name\":";
+    appendString(name);
+    _chunk += ",\"cat\":\"";
+    _chunk += category;
+    _chunk += "\",\"ph\":\"";
+    _chunk += phase;
+    _chunk += "\",\"ts\":" + std::to_string(ts) + ",\"pid\":" + std::to_string(track.first) + ",\"tid\":" + std::to_string(track.second);
+  }
+
+  void endEvent() {
+    _chunk += "}";
+    ++_events;
+    if (_chunk.size() >= TRACE_CHUNK_SIZE) {
+      flushChunk();
+    }
+  }
+
+  void appendString(const std::string& text) {
+    _chunk += '"';
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        _chunk += '\\';
+        _chunk += c;
+      } else if ((unsigned char)c < 0x20) {
+        char escaped[8];
+        snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+        _chunk += escaped;
+      } else {
+        _chunk += c;
+      }
+    }
+    _chunk += '"';
+  }
+
+  void flushChunk() {
+    _bytes += fwrite(_chunk.data(), 1, _chunk.size(), _file);
+    fflush(_file);    // Reach the file now, not at fclose(), so a crashed run still leaves its events.
+    _chunk.clear();
+  }
+
+  std::mutex _mutex;
+  FILE* _file = nullptr;
+  TimeBase _timeBase = Virtual;
+  std::chrono::steady_clock::time_point _opened;
+  std::string _chunk;                                                 // Events not yet written.
+  uint64_t _events = 0;                                               // Events recorded, metadata included.
+  uint64_t _bytes = 0;                                                // Bytes written to the file.
+  std::map<const VirtualClock*, uint32_t> _processes;                 // Trace pid of each clock.
+  std::map<std::pair<uint32_t, const void*>, uint32_t> _tracks;       // Trace tid of each instance per clock.
+  std::vector<std::string> _trackNames = { "" };                      // Track names by tid, tid 0 unused.
+};
+
+/**
+ * \class TraceSpan
+ * \brief Records the time until it goes out of scope as a complete event, if a recorder is installed.
+ *
+ * Costs one atomic load when nothing is being recorded.
+ */
+class TraceSpan {
+public:
+  /**
+   * \param instance    const void* - The emulator or component doing the work.
+   * \param type        const char* - Its type.
+   * \param category    const char* - Event category.
+   * \param name        const std::string& - Event name, which must outlive the span.
+   */
+  TraceSpan(const void* instance, const char* type, const char* category, const std::string& name)
+    : _recorder(TraceRecorder::active()), _instance(instance), _type(type), _category(category), _name(name) {
+    if (_recorder != nullptr) {
+      _start = _recorder->now();
+    }
+  }
+
+  ~TraceSpan() {
+    if (_recorder != nullptr) {
+      uint64_t end = _recorder->now();
+      _recorder->complete(_instance, _type, _category, _name, _start, (end > _start) ? end - _start : 0);
+    }
+  }
+
+private:
+  TraceRecorder* _recorder;
+  const void* _instance;
+  const char* _type;
+  const char* _category;
+  const std::string& _name;
+  uint64_t _start = 0;
+};
+
+#endif // end of TRACE_RECORDER_H
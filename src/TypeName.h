@@ -0,0 +1,22 @@
+#if not defined(TYPE_NAME_H)
+#define TYPE_NAME_H
+
+#include <cstdlib>
+#include <cxxabi.h>
+#include <string>
+
+/**
+ * \brief Returns a readable C++ type name, as used to label emulators in reports.
+ *
+ * \param mangled   const char* - A name from `typeid().name()`.
+ * \return std::string  The demangled name, or `mangled` itself if it cannot be demangled.
+ */
+inline std::string demangledTypeName(const char* mangled) {
+  int status = 0;
+  char* readable = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+  std::string name = (status == 0 && readable != nullptr) ? readable : mangled;
+  free(readable);
+  return name;
+}
+
+#endif // end of TYPE_NAME_H
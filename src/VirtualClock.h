@@ -0,0 +1,183 @@
+#if not defined(VIRTUAL_CLOCK_H)
+#define VIRTUAL_CLOCK_H
+
+#include <cstdint>
+#include <unistd.h>
+
+/**
+ * \class VirtualClock
+ * \brief A monotonic, manually advanced clock used as the time axis for emulation.
+ *
+ * Emulated components (routes, links, modems) charge the time their operations
+ * would take on a real device to a VirtualClock instead of sleeping the host.
+ * Tests therefore run at host speed while firmware reading `millis()` still
+ * observes realistic elapsed time.
+ *
+ * Each thread has a current clock, which defaults to a single process-wide
+ * instance. Runners that multiplex several emulated devices bind a per-device
+ * clock with `bind()` while that device is executing. While a device clock is
+ * bound, emulated delays go through `sleep()` and advance it instead of
+ * blocking the host thread.
+ *
+ * Example:
+ * \code{.cpp}
+ * VirtualClock::current().advanceMillis(250);
+ * unsigned long now = VirtualClock::current().nowMillis(); // 250
+ * \endcode
+ */
+class VirtualClock {
+public:
+  VirtualClock() {}
+  ~VirtualClock() {}
+
+  /**
+   * \brief Returns the elapsed virtual time in microseconds.
+   */
+  uint64_t nowMicros() const { return _now; }
+
+  /**
+   * \brief Returns the elapsed virtual time in milliseconds.
+   */
+  unsigned long nowMillis() const { return (unsigned long)(_now / 1000); }
+
+  /**
+   * \brief Moves the clock forward.
+   *
+   * \param us    uint64_t - The number of microseconds to advance by.
+   */
+  void advance(uint64_t us) { _now += us; }
+
+  /**
+   * \brief Moves the clock forward by a number of milliseconds.
+   *
+   * \param ms    unsigned long - The number of milliseconds to advance by.
+   */
+  void advanceMillis(unsigned long ms) { _now += (uint64_t)ms * 1000; }
+
+  /**
+   * \brief Moves the clock forward to an absolute point in time.
+   *
+   * The clock never runs backwards, so a target in the past is ignored.
+   *
+   * \param us    uint64_t - The absolute time in microseconds.
+   */
+  void advanceTo(uint64_t us) {
+    if (us > _now) {
+      _now = us;
+    }
+  }
+
+  /**
+   * \brief Rewinds the clock to zero.
+   */
+  void reset() { _now = 0; }
+
+  /**
+   * \brief Returns the clock bound to the calling thread.
+   *
+   * \return VirtualClock&  The per-device clock bound with `bind()`, or the
+   *                        process-wide clock if none is bound.
+   */
+  static VirtualClock& current() { return *slot(); }
+
+  /**
+   * \brief Binds a clock to the calling thread.
+   *
+   * \param clock   VirtualClock* - The clock to bind, or nullptr to restore
+   *                the process-wide clock.
+   * \return VirtualClock*  The previously bound clock, so callers can restore it.
+   */
+  static VirtualClock* bind(VirtualClock* clock) {
+    VirtualClock* previous = slot();
+    slot() = (clock != nullptr) ? clock : &processClock();
+    return previous;
+  }
+
+  /**
+   * \brief Returns true if the calling thread has a per-device clock bound.
+   */
+  static bool isBound() { return slot() != &processClock(); }
+
+  /**
+   * \brief Signature of a hook taking over waits, see `bindSleep()`.
+   */
+  typedef void (*SleepHook)(uint64_t us);
+
+  /**
+   * \brief Routes the calling thread's waits through a hook.
+   *
+   * A cooperative scheduler installs a hook that suspends the running device
+   * until the clock reaches the end of the wait, letting others run meanwhile.
+   *
+   * \param hook    SleepHook - The hook, or nullptr to remove it.
+   * \return SleepHook  The previously installed hook, so callers can restore it.
+   */
+  static SleepHook bindSleep(SleepHook hook) {
+    SleepHook previous = sleepSlot();
+    sleepSlot() = hook;
+    return previous;
+  }
+
+  /**
+   * \brief Returns true if `sleep()` on the calling thread would block the host.
+   */
+  static bool sleepsHost() { return sleepSlot() == nullptr && !isBound(); }
+
+  /**
+   * \brief Waits on behalf of an emulated device.
+   *
+   * With a sleep hook installed the hook performs the wait. With a per-device
+   * clock bound the wait is charged to that clock and returns immediately, so
+   * runners multiplexing many devices never block a host thread. Otherwise the
+   * host thread sleeps, as emulated delays always have.
+   *
+   * \param us    uint64_t - The number of microseconds to wait.
+   */
+  static void sleep(uint64_t us) {
+    if (sleepSlot() != nullptr) {
+      sleepSlot()(us);
+    } else if (isBound()) {
+      current().advance(us);
+    } else {
+      usleep(us);
+    }
+  }
+
+  /**
+   * \brief Charges time an emulated operation takes to the current clock.
+   *
+   * Unlike `sleep()` this never blocks the host: without a sleep hook the
+   * current clock is simply advanced. Emulated components use it for latency,
+   * serialisation and polling so a cooperative scheduler can run other devices
+   * while one waits.
+   *
+   * \param us    uint64_t - The number of microseconds the operation takes.
+   */
+  static void wait(uint64_t us) {
+    if (sleepSlot() != nullptr) {
+      sleepSlot()(us);
+    } else {
+      current().advance(us);
+    }
+  }
+
+private:
+  static VirtualClock& processClock() {
+    static VirtualClock clock;
+    return clock;
+  }
+
+  static VirtualClock*& slot() {
+    thread_local VirtualClock* bound = &processClock();
+    return bound;
+  }
+
+  static SleepHook& sleepSlot() {
+    thread_local SleepHook hook = nullptr;
+    return hook;
+  }
+
+  uint64_t _now = 0; // Elapsed virtual time in microseconds.
+};
+
+#endif // end of VIRTUAL_CLOCK_H
@@ -0,0 +1,152 @@
+#if not defined(WORK_STEALING_POOL_H)
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * \class WorkStealingPool
+ * \brief Runs a set of resumable tasks across host threads, balancing load by stealing.
+ *
+ * Tasks are plain 32 bit identifiers (for example an index into a table of
+ * emulated devices), so queuing one never allocates. Each worker owns a deque:
+ * it takes work from the front and puts resumed tasks back at the end, so the
+ * tasks it holds advance round-robin. A worker that runs dry steals half of the
+ * tasks queued at the back of another worker's deque.
+ *
+ * Example:
+ * \code{.cpp}
+ * WorkStealingPool pool;
+ * pool.run(taskIds, [&](uint32_t id) {
+ *   return step(id);  // true to run the task again later
+ * });
+ * \endcode
+ */
+class WorkStealingPool {
+public:
+  /**
+   * \brief Constructs a pool.
+   *
+   * \param workers   unsigned - Number of host threads, 0 for one per core.
+   */
+  explicit WorkStealingPool(unsigned workers = 0) {
+    if (workers == 0) {
+      workers = std::thread::hardware_concurrency();
+    }
+    _workers = (workers == 0) ? 1 : workers;
+  }
+  ~WorkStealingPool() {}
+
+  /**
+   * \brief Returns the number of host threads tasks are run on.
+   */
+  unsigned size() const { return _workers; }
+
+  /**
+   * \brief Runs every task to completion, returning once all have finished.
+   *
+   * \tparam Fn     Callable as `bool fn(uint32_t task)`, returning true if the
+   *                task should be queued again and false once it is finished.
+   * \param tasks   const std::vector<uint32_t>& - The tasks, dealt out to workers in turn.
+   * \param fn      Fn - Runs one step of a task. Called concurrently from every worker.
+   */
+  template<typename Fn>
+  void run(const std::vector<uint32_t>& tasks, Fn fn) {
+    std::vector<std::unique_ptr<Queue>> queues;
+    for (unsigned i = 0; i < _workers; ++i) {
+      queues.emplace_back(new Queue());
+    }
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      queues[i % _workers]->tasks.push_back(tasks[i]);
+    }
+    std::atomic<size_t> outstanding(tasks.size());
+
+    auto work = [&](unsigned self) {
+      Queue& own = *queues[self];
+      uint32_t task;
+      while (outstanding.load(std::memory_order_acquire) > 0) {
+        if (!take(own, task) && !steal(queues, self, task)) {
+          std::this_thread::yield();
+          continue;
+        }
+        if (fn(task)) {
+          std::lock_guard<std::mutex> lock(own.mutex);
+          own.tasks.push_back(task);
+        } else {
+          outstanding.fetch_sub(1, std::memory_order_acq_rel);
+        }
+      }
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < _workers; ++i) {
+      threads.emplace_back(work, i);
+    }
+    work(0);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  /**
+   * \brief Returns the number of tasks moved between workers by stealing, over all runs.
+   */
+  uint64_t steals() const { return _steals.load(std::memory_order_relaxed); }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<uint32_t> tasks;
+  };
+
+  static bool take(Queue& queue, uint32_t& task) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      return false;
+    }
+    task = queue.tasks.front();
+    queue.tasks.pop_front();
+    return true;
+  }
+
+  /**
+   * \brief Moves half of the first non-empty victim's tasks to the thief and takes one.
+   */
+  bool steal(std::vector<std::unique_ptr<Queue>>& queues, unsigned self, uint32_t& task) {
+    for (unsigned offset = 1; offset < queues.size(); ++offset) {
+      Queue& victim = *queues[(self + offset) % queues.size()];
+      std::vector<uint32_t> loot;
+      {
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        size_t count = (victim.tasks.size() + 1) / 2;
+        for (size_t i = 0; i < count; ++i) {
+          loot.push_back(victim.tasks.back());
+          victim.tasks.pop_back();
+        }
+      }
+      if (loot.empty()) {
+        continue;
+      }
+      _steals.fetch_add(loot.size(), std::memory_order_relaxed);
+      task = loot.back();
+      loot.pop_back();
+      if (!loot.empty()) {
+        Queue& own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.tasks.insert(own.tasks.end(), loot.rbegin(), loot.rend());
+      }
+      return true;
+    }
+    return false;
+  }
+
+  unsigned _workers = 1;                // Number of host threads.
+  std::atomic<uint64_t> _steals{0};     // Tasks moved between workers.
+};
+
+#endif // end of WORK_STEALING_POOL_H
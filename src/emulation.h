@@ -7,6 +7,7 @@
 #include <cstdarg>
 #include "FunctionEmulator.h"
 #include "TimeFunctionEmulators.h"
+#include "LogFunctionEmulators.h"
 
 /**
  * \var MillisFunctionEmulator millisEmulator
@@ -72,6 +73,21 @@ FunctionEmulator log_e_stub("log_e");
  */
 FunctionEmulator log_v_stub("log_v");
 
+/**
+ * \fn FunctionEmulator& currentLogStub(FunctionEmulator& global, FunctionEmulator LogFunctionEmulators::*level)
+ * \brief Returns the emulator a log stub records into on the calling thread.
+ * 
+ * This is the global stub unless a runner such as Fleet has bound a
+ * per-device set with `LogFunctionEmulators::bind()`.
+ * 
+ * \param global The global stub, e.g. `log_d_stub`.
+ * \param level The matching member of a bound set, e.g. `&LogFunctionEmulators::debug`.
+ */
+FunctionEmulator& currentLogStub(FunctionEmulator& global, FunctionEmulator LogFunctionEmulators::*level) {
+  LogFunctionEmulators* bound = LogFunctionEmulators::bound();
+  return (bound != nullptr) ? bound->*level : global;
+}
+
 /**
  * \fn void log_d(const char* format, ...)
  * \brief Mocked debug log function.
@@ -83,11 +99,12 @@ FunctionEmulator log_v_stub("log_v");
  * \param ... Variable arguments for the format string.
  */
 void log_d(const char* format, ...) { 
+  FunctionEmulator& stub = currentLogStub(log_d_stub, &LogFunctionEmulators::debug);
   va_list args;
   va_start(args, format);
-  log_d_stub.captureArgs(format, args);
+  stub.captureArgs(format, args);
   va_end(args);
-  log_d_stub.recordFunctionCall();
+  stub.recordFunctionCall();
 }
 
 /**
@@ -101,11 +118,12 @@ void log_d(const char* format, ...) {
  * \param ... Variable arguments for the format string.
  */
 void log_i(const char* format, ...) { 
+  FunctionEmulator& stub = currentLogStub(log_i_stub, &LogFunctionEmulators::info);
   va_list args;
   va_start(args, format);
-  log_i_stub.captureArgs(format, args);
+  stub.captureArgs(format, args);
   va_end(args);
-  log_i_stub.recordFunctionCall();
+  stub.recordFunctionCall();
 }
 
 /**
@@ -119,11 +137,12 @@ void log_i(const char* format, ...) {
  * \param ... Variable arguments for the format string.
  */
 void log_v(const char* format, ...) { 
+  FunctionEmulator& stub = currentLogStub(log_v_stub, &LogFunctionEmulators::verbose);
   va_list args;
   va_start(args, format);
-  log_v_stub.captureArgs(format, args);
+  stub.captureArgs(format, args);
   va_end(args);
-  log_v_stub.recordFunctionCall();
+  stub.recordFunctionCall();
 }
 
 /**
@@ -137,11 +156,12 @@ void log_v(const char* format, ...) {
  * \param ... Variable arguments for the format string.
  */
 void log_w(const char* format, ...) { 
+  FunctionEmulator& stub = currentLogStub(log_w_stub, &LogFunctionEmulators::warning);
   va_list args;
   va_start(args, format);
-  log_w_stub.captureArgs(format, args);
+  stub.captureArgs(format, args);
   va_end(args);
-  log_w_stub.recordFunctionCall();
+  stub.recordFunctionCall();
 }
 
 /**
@@ -155,30 +175,58 @@ void log_w(const char* format, ...) {
  * \param ... Variable arguments for the format string.
  */
 void log_e(const char* format, ...) { 
+  FunctionEmulator& stub = currentLogStub(log_e_stub, &LogFunctionEmulators::error);
   va_list args;
   va_start(args, format);
-  log_e_stub.captureArgs(format, args);
+  stub.captureArgs(format, args);
   va_end(args);
-  log_e_stub.recordFunctionCall();
+  stub.recordFunctionCall();
+}
+
+/**
+ * \fn MillisFunctionEmulator& currentMillisEmulator()
+ * \brief Returns the millis emulator in effect on the calling thread.
+ * 
+ * This is `millisEmulator` unless a runner such as Fleet has bound a
+ * per-device emulator with `MillisFunctionEmulator::bind()`.
+ */
+MillisFunctionEmulator& currentMillisEmulator() {
+  MillisFunctionEmulator* bound = MillisFunctionEmulator::bound();
+  return (bound != nullptr) ? *bound : millisEmulator;
+}
+
+/**
+ * \fn DelayFunctionEmulator& currentDelayEmulator()
+ * \brief Returns the delay emulator in effect on the calling thread.
+ * 
+ * This is `delayEmulator` unless a runner such as Fleet has bound a
+ * per-device emulator with `DelayFunctionEmulator::bind()`.
+ */
+DelayFunctionEmulator& currentDelayEmulator() {
+  DelayFunctionEmulator* bound = DelayFunctionEmulator::bound();
+  return (bound != nullptr) ? *bound : delayEmulator;
 }
 
 /**
  * \fn void resetEmulators()
  * \brief Resets all emulators to their default state.
  * 
+ * Every Emulator, the millis, delay and log stubs as well as the mocks a test
+ * declares, is reset on its next use (see `Emulator::resetAll()`), so the cost
+ * does not grow with the number of emulators.
+ * 
+ * The reset is process wide: it also reaches the emulators of devices running
+ * on other threads, so it must not be called while a Fleet, PropertyTest or
+ * other multi-threaded run is in progress.
  */
 void resetEmulators() {
-  millisEmulator.resetMillis();
-  log_d_stub.reset();
-  log_i_stub.reset();
-  log_v_stub.reset();
-  log_w_stub.reset();
-  log_e_stub.reset();
+  VirtualClock::current().reset();
+  Emulator::resetAll();
 }
 
 #if not defined(ARDUINO)
-  #define delay(x) delayEmulator.mockDelay(x)
-  #define millis() millisEmulator.mockMillis()
+  #define delay(x) currentDelayEmulator().mockDelay(x)
+  #define millis() currentMillisEmulator().mockMillis()
   #define ResetEmulators() resetEmulators()
 #endif
 
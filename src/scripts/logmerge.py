@@ -0,0 +1,209 @@
+#!/usr/bin/python3
+import os, struct, sys, getopt
+
+MAGIC = b'EMLG'
+HEADER = struct.Struct('<4sHHI')
+COUNTERS = struct.Struct('<QQQQQB')
+HISTOGRAM = struct.Struct('<QQQQI')
+NAMES = ('invoked', 'consumed', 'unconsumed', 'thrown', 'delay_ms')
+HISTOGRAMS = ('wall_ns', 'emulated_us', 'between_ns')
+
+def main(argv):
+    """Runtime
+
+    Args:
+        argv (list): command line arguments
+    """
+    output = ''
+    byTest = False
+    opts, args = getopt.getopt(argv,"ho:t",["output=","byTest"])
+    for opt, arg in opts:
+        if opt == '-h':
+            printHelp()
+            sys.exit()
+        elif opt in ("-o", "--output"):
+            output = arg
+        elif opt in ("-t", "--byTest"):
+            byTest = True
+
+    if len(args) == 0:
+        printHelp()
+        sys.exit(2)
+
+    header, merged = mergeLogs(args, byTest)
+    if output == '':
+        writeCsv(sys.stdout, header, merged)
+    elif output.endswith('.csv'):
+        with open(output, 'w') as out:
+            writeCsv(out, header, merged)
+    else:
+        writeBinary(output, header, merged)
+
+
+def printHelp():
+    """Prints help message
+    """
+    print("*** Merges binary MethodLog files, summing methods of the same name ***\n")
+    print("logmerge.py <log.bin> [<log.bin> ...]                 CSV summary to stdout\n")
+    print("logmerge.py -o <merged.csv> <log.bin> [<log.bin> ...] CSV summary to a file\n")
+    print("logmerge.py -o <merged.bin> <log.bin> [<log.bin> ...] merged binary log\n")
+    print("logmerge.py -t ...                                    keep tests apart, merging by test and method\n")
+
+
+def mergeLogs(paths, byTest):
+    """Reads every log and aggregates its records
+
+    Args:
+        paths (list): binary MethodLog files to read
+        byTest (bool): merge by test and method rather than by method alone
+
+    Returns:
+        tuple: the shared file header and a dict of merged records by key
+    """
+    header = None
+    merged = {}
+    for path in paths:
+        with open(path, 'rb') as log:
+            data = log.read()
+        magic, version, subBits, buckets = HEADER.unpack_from(data, 0)
+        if magic != MAGIC or version != 1:
+            raise ValueError(path + ' is not a binary MethodLog')
+        if header is None:
+            header = (subBits, buckets)
+        elif header != (subBits, buckets):
+            raise ValueError(path + ' was written with a different histogram layout')
+        offset = HEADER.size
+        while offset < len(data):
+            record, offset = readRecord(data, offset)
+            key = (record['test'] if byTest else '', record['method'])
+            if key not in merged:
+                merged[key] = record
+            else:
+                mergeRecord(merged[key], record)
+    return header, merged
+
+
+def readRecord(data, offset):
+    """Decodes one record
+
+    Args:
+        data (bytes): the file contents
+        offset (int): where the record starts
+
+    Returns:
+        tuple: the record as a dict and the offset of the next one
+    """
+    record = {}
+    for name in ('test', 'method'):
+        length, = struct.unpack_from('<H', data, offset)
+        record[name] = data[offset + 2:offset + 2 + length].decode('utf-8', 'replace')
+        offset += 2 + length
+    values = COUNTERS.unpack_from(data, offset)
+    offset += COUNTERS.size
+    for name, value in zip(NAMES, values):
+        record[name] = value
+    record['histograms'] = []
+    for _ in range(values[-1]):
+        count, total, low, high, used = HISTOGRAM.unpack_from(data, offset)
+        offset += HISTOGRAM.size
+        buckets = {}
+        for index, hits in struct.iter_unpack('<IQ', data[offset:offset + used * 12]):
+            buckets[index] = hits
+        offset += used * 12
+        record['histograms'].append({ 'count': count, 'sum': total, 'min': low, 'max': high, 'buckets': buckets })
+    return record, offset
+
+
+def mergeRecord(into, record):
+    """Adds one record to another of the same key
+
+    Args:
+        into (dict): the aggregate
+        record (dict): the record to add
+    """
+    for name in ('invoked', 'consumed', 'unconsumed', 'thrown'):
+        into[name] += record[name]
+    into['delay_ms'] = max(into['delay_ms'], record['delay_ms'])
+    for mine, theirs in zip(into['histograms'], record['histograms']):
+        if theirs['count'] == 0:
+            continue
+        mine['min'] = theirs['min'] if mine['count'] == 0 else min(mine['min'], theirs['min'])
+        mine['max'] = max(mine['max'], theirs['max'])
+        mine['count'] += theirs['count']
+        mine['sum'] += theirs['sum']
+        for index, hits in theirs['buckets'].items():
+            mine['buckets'][index] = mine['buckets'].get(index, 0) + hits
+
+
+def percentile(histogram, subBits, percent):
+    """Returns a percentile the way LatencyHistogram::percentile() does
+
+    Args:
+        histogram (dict): a decoded histogram
+        subBits (int): LatencyHistogram::kSubBits of the writer
+        percent (float): the percentile, from 0 to 100
+
+    Returns:
+        int: the highest value of the bucket holding the percentile
+    """
+    if histogram['count'] == 0:
+        return 0
+    subBuckets = 1 << subBits
+    rank = max(1, int(percent / 100.0 * histogram['count'] + 0.5))
+    seen = 0
+    for index in sorted(histogram['buckets']):
+        seen += histogram['buckets'][index]
+        if seen >= rank:
+            if index < subBuckets:
+                value = index
+            else:
+                magnitude = index // subBuckets + subBits - 1
+                value = ((index % subBuckets + subBuckets + 1) << (magnitude - subBits)) - 1
+            return min(max(value, histogram['min']), histogram['max'])
+    return histogram['max']
+
+
+def writeCsv(out, header, merged):
+    """Writes one row per merged record
+
+    Args:
+        out (file): where to write
+        header (tuple): histogram layout of the inputs
+        merged (dict): merged records by key
+    """
+    columns = ['test', 'method'] + list(NAMES)
+    for name in HISTOGRAMS if header[1] > 0 else ():
+        columns += [name + '_count', name + '_mean', name + '_p50', name + '_p99', name + '_max']
+    out.write(','.join(columns) + '\n')
+    for (test, method), record in sorted(merged.items()):
+        row = ['"' + test.replace('"', '""') + '"', '"' + method.replace('"', '""') + '"']
+        row += [str(record[name]) for name in NAMES]
+        for histogram in record['histograms']:
+            mean = histogram['sum'] // histogram['count'] if histogram['count'] else 0
+            row += [str(histogram['count']), str(mean), str(percentile(histogram, header[0], 50.0)),
+                    str(percentile(histogram, header[0], 99.0)), str(histogram['max'])]
+        out.write(','.join(row) + '\n')
+
+
+def writeBinary(path, header, merged):
+    """Writes the merged records as a binary MethodLog, itself mergeable
+
+    Args:
+        path (string): the file to write
+        header (tuple): histogram layout of the inputs
+        merged (dict): merged records by key
+    """
+    with open(path, 'wb') as out:
+        out.write(HEADER.pack(MAGIC, 1, header[0], header[1]))
+        for (test, method), record in sorted(merged.items()):
+            for name in (test, method):
+                encoded = name.encode('utf-8')
+                out.write(struct.pack('<H', len(encoded)) + encoded)
+            out.write(COUNTERS.pack(*[record[name] for name in NAMES], len(record['histograms'])))
+            for histogram in record['histograms']:
+                out.write(HISTOGRAM.pack(histogram['count'], histogram['sum'], histogram['min'], histogram['max'], len(histogram['buckets'])))
+                out.write(b''.join(struct.pack('<IQ', index, hits) for index, hits in sorted(histogram['buckets'].items())))
+
+
+if __name__ == "__main__":
+    main(sys.argv[1:])
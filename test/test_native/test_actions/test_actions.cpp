@@ -0,0 +1,162 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <cstdlib>
+#include <new>
+
+size_t allocations = 0;
+
+void* operator new(size_t size) {
+	++allocations;
+	void* block = malloc(size);
+	if (block == nullptr) {
+		throw std::bad_alloc();
+	}
+	return block;
+}
+
+void operator delete(void* block) noexcept {
+	free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+	free(block);
+}
+
+class Sensor : public Emulator {
+public:
+	uint32_t readRegister() { return this->mock<uint32_t>("readRegister"); }
+	int readAt(int address) { return this->mock<int>("readAt", address); }
+	std::string name() { return this->mock<std::string>("name"); }
+	int poke() { return this->mock<int>("poke"); }
+};
+
+Sensor sensor;
+uint32_t counter = 0;
+int sideEffects = 0;
+
+void bump() {
+	++sideEffects;
+}
+
+void setUp(void) {
+	counter = 0;
+	sideEffects = 0;
+}
+
+void tearDown(void) {
+	sensor.reset();
+	resetEmulators();
+}
+
+void test_action_computes_every_value() {
+	sensor.does("readRegister", [](const MockArgs&) -> std::any { return counter++; });
+	TEST_ASSERT_EQUAL_UINT32(0, sensor.readRegister());
+	TEST_ASSERT_EQUAL_UINT32(1, sensor.readRegister());
+	TEST_ASSERT_EQUAL_UINT32(2, sensor.readRegister());
+	TEST_ASSERT_EQUAL(3, sensor.methods()[0].invoked);
+}
+
+void test_action_receives_the_arguments() {
+	sensor.does("readAt", [](const MockArgs& args) -> std::any { return (int)args.integer(0) * 2; });
+	TEST_ASSERT_EQUAL(42, sensor.readAt(21));
+	TEST_ASSERT_EQUAL(-8, sensor.readAt(-4));
+}
+
+void test_empty_result_falls_back_to_then() {
+	sensor.does("readAt", [](const MockArgs& args) -> std::any {
+		if (args.integer(0) > 0) {
+			return 99;
+		}
+		return std::any();
+	}).then(5).then(6);
+	TEST_ASSERT_EQUAL(5, sensor.readAt(0));
+	TEST_ASSERT_EQUAL(99, sensor.readAt(1));
+	TEST_ASSERT_EQUAL(6, sensor.readAt(0));
+	TEST_ASSERT_EQUAL(6, sensor.readAt(0));
+}
+
+void test_action_of_the_wrong_type_throws() {
+	sensor.does("name", [](const MockArgs&) -> std::any { return 7; });
+	bool threw = false;
+	try {
+		sensor.name();
+	} catch (const NoReturnValueException&) {
+		threw = true;
+	}
+	TEST_ASSERT_TRUE(threw);
+}
+
+void test_action_applies_to_its_argument_rule() {
+	sensor.returns("readAt", 0);
+	sensor.does("readAt", [](const MockArgs&) -> std::any { return (int)++counter; }).withArgs(7);
+	TEST_ASSERT_EQUAL(1, sensor.readAt(7));
+	TEST_ASSERT_EQUAL(0, sensor.readAt(8));
+	TEST_ASSERT_EQUAL(2, sensor.readAt(7));
+}
+
+void test_set_method_runs_a_side_effect() {
+	sensor.setMethod("poke", bump, 7);
+	TEST_ASSERT_EQUAL(7, sensor.poke());
+	TEST_ASSERT_EQUAL(1, sideEffects);
+	sensor.invokeMethod("poke");
+	TEST_ASSERT_EQUAL(2, sideEffects);
+	TEST_ASSERT_EQUAL(2, sensor.methods()[0].invoked);
+}
+
+void test_copies_share_captures_but_not_counts() {
+	sensor.does("readRegister", [](const MockArgs&) -> std::any { return counter++; });
+	sensor.readRegister();
+	Sensor copy = sensor;
+	TEST_ASSERT_EQUAL_UINT32(1, copy.readRegister());
+	TEST_ASSERT_EQUAL_UINT32(2, sensor.readRegister());
+	TEST_ASSERT_EQUAL(2, copy.methods()[0].invoked);
+	TEST_ASSERT_EQUAL(2, sensor.methods()[0].invoked);
+}
+
+void test_calling_an_action_never_allocates() {
+	uint32_t local = 0;
+	sensor.does("readRegister", [&local](const MockArgs&) -> std::any { return ++local; });
+	sensor.readRegister();
+	size_t before = allocations;
+	for (int i = 0; i < 100; ++i) {
+		sensor.readRegister();
+	}
+	TEST_ASSERT_EQUAL_UINT32(101, local);
+	TEST_ASSERT_EQUAL(0, (int)(allocations - before));
+	InplaceFunction<int(int)> add = [&local](int step) { return (int)(local += step); };
+	before = allocations;
+	InplaceFunction<int(int)> copy = add;
+	TEST_ASSERT_EQUAL(103, copy(2));
+	TEST_ASSERT_EQUAL(0, (int)(allocations - before));
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_action_computes_every_value);
+	RUN_TEST(test_action_receives_the_arguments);
+	RUN_TEST(test_empty_result_falls_back_to_then);
+	RUN_TEST(test_action_of_the_wrong_type_throws);
+	RUN_TEST(test_action_applies_to_its_argument_rule);
+	RUN_TEST(test_set_method_runs_a_side_effect);
+	RUN_TEST(test_copies_share_captures_but_not_counts);
+	RUN_TEST(test_calling_an_action_never_allocates);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,135 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include "MockClient.h"
+
+class Http : public Emulator {
+public:
+	template<typename... Args>
+	int get(const Args&... args) { return this->mock<int>("get", args...); }
+};
+
+Http http;
+MockClient client;
+
+void setUp(void) {
+	http.returns("get", 200);
+}
+
+void tearDown(void) {
+	http.reset();
+	client.reset();
+	resetEmulators();
+}
+
+void test_args_render_to_text() {
+	MockArgs args;
+	args.assign("/config", 80, true, 'x', -2.5, std::string("s"));
+	TEST_ASSERT_EQUAL(6, (int)args.size());
+	TEST_ASSERT_EQUAL_STRING("/config, 80, true, x, -2.5, s", args.describe().c_str());
+	TEST_ASSERT_TRUE(args.integer(1) == 80);
+	TEST_ASSERT_TRUE(args.integer(0) == 0);
+	TEST_ASSERT_TRUE(args.str(6).empty());
+	args.assign();
+	TEST_ASSERT_EQUAL(0, (int)args.size());
+}
+
+void test_unmatched_calls_get_the_unconditional_value() {
+	http.returns("get", 404).withArgs("/missing");
+	TEST_ASSERT_EQUAL(200, http.get("/present"));
+	TEST_ASSERT_EQUAL(200, http.get());
+	TEST_ASSERT_EQUAL(2, http.methods()[0].invoked);
+}
+
+void test_exact_args_match_any_string_and_integer_type() {
+	http.returns("get", 404).withArgs("/missing", 80);
+	TEST_ASSERT_EQUAL(404, http.get("/missing", 80));
+	TEST_ASSERT_EQUAL(404, http.get(std::string("/missing"), (uint16_t)80));
+	TEST_ASSERT_EQUAL(404, http.get(String("/missing"), 80L));
+	TEST_ASSERT_EQUAL(200, http.get("/missing"));
+	TEST_ASSERT_EQUAL(200, http.get("/missing", 8080));
+}
+
+void test_longest_prefix_wins() {
+	http.returns("get", 301).withArgPrefix("/old/");
+	http.returns("get", 302).withArgPrefix("/old/very/");
+	TEST_ASSERT_EQUAL(301, http.get("/old/page"));
+	TEST_ASSERT_EQUAL(302, http.get("/old/very/page", 80));
+	TEST_ASSERT_EQUAL(200, http.get("/ol"));
+}
+
+void test_exact_beats_prefix_beats_predicate() {
+	http.returns("get", 500).withArgsMatching([](const MockArgs& args) { return args.integer(1) > 100; }, "port > 100");
+	http.returns("get", 301).withArgPrefix("/old/");
+	http.returns("get", 404).withArgs("/old/gone", 443);
+	TEST_ASSERT_EQUAL(404, http.get("/old/gone", 443));
+	TEST_ASSERT_EQUAL(301, http.get("/old/moved", 443));
+	TEST_ASSERT_EQUAL(500, http.get("/new", 443));
+	TEST_ASSERT_EQUAL(200, http.get("/new", 80));
+}
+
+void test_first_accepting_predicate_wins() {
+	http.returns("get", 1).withArgsMatching([](const MockArgs& args) { return args.integer(0) > 10; });
+	http.returns("get", 2).withArgsMatching([](const MockArgs& args) { return args.integer(0) > 5; });
+	TEST_ASSERT_EQUAL(1, http.get(20));
+	TEST_ASSERT_EQUAL(2, http.get(7));
+	TEST_ASSERT_EQUAL(200, http.get(3));
+}
+
+void test_each_rule_keeps_its_own_sequence() {
+	http.returns("get", 1).withArgs("/seq").then(2).times(2).then(3);
+	TEST_ASSERT_EQUAL(1, http.get("/seq"));
+	TEST_ASSERT_EQUAL(200, http.get("/other"));
+	TEST_ASSERT_EQUAL(2, http.get("/seq"));
+	TEST_ASSERT_EQUAL(2, http.get("/seq"));
+	TEST_ASSERT_EQUAL(3, http.get("/seq"));
+	TEST_ASSERT_EQUAL(1, http.methods()[0].invoked);
+	TEST_ASSERT_EQUAL(4, http.methods()[1].invoked);
+	TEST_ASSERT_EQUAL_STRING("/seq", std::string(http.methods()[1].args).c_str());
+}
+
+void test_mocks_pass_their_arguments() {
+	client.returns("connect", 1);
+	client.returns("connect", 0).withArgs("bad.host", 443);
+	TEST_ASSERT_EQUAL(0, client.connect("bad.host", 443));
+	TEST_ASSERT_EQUAL(1, client.connect("good.host", 443));
+	TEST_ASSERT_EQUAL(1, client.connect("bad.host", 80));
+}
+
+void test_reset_forgets_rules() {
+	http.returns("get", 404).withArgs("/missing");
+	http.reset();
+	http.returns("get", 200);
+	TEST_ASSERT_EQUAL(200, http.get("/missing"));
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_args_render_to_text);
+	RUN_TEST(test_unmatched_calls_get_the_unconditional_value);
+	RUN_TEST(test_exact_args_match_any_string_and_integer_type);
+	RUN_TEST(test_longest_prefix_wins);
+	RUN_TEST(test_exact_beats_prefix_beats_predicate);
+	RUN_TEST(test_first_accepting_predicate_wins);
+	RUN_TEST(test_each_rule_keeps_its_own_sequence);
+	RUN_TEST(test_mocks_pass_their_arguments);
+	RUN_TEST(test_reset_forgets_rules);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,230 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <string>
+#include "MockTinyGsm.h"
+
+std::string drain(AtModem& modem) {
+	std::string response;
+	int byte;
+	while ((byte = modem.read()) >= 0) {
+		response += (char)byte;
+	}
+	return response;
+}
+
+std::string exchange(AtModem& modem, const char* command) {
+	modem.print(command);
+	modem.print("\r\n");
+	return drain(modem);
+}
+
+bool contains(const std::string& response, const char* text) {
+	return response.find(text) != std::string::npos;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_answers_basic_commands() {
+	AtModem modem;
+	modem.setSignalQuality(17);
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT"), "OK"));
+	exchange(modem, "ATE0");
+	std::string response = exchange(modem, "AT+CSQ");
+	TEST_ASSERT_TRUE(contains(response, "+CSQ: 17,99"));
+	TEST_ASSERT_FALSE(contains(response, "AT+CSQ"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+NOPE"), "ERROR"));
+	TEST_ASSERT_EQUAL_UINT32(4, (uint32_t)modem.commandsHandled());
+}
+
+void test_reports_identity() {
+	AtModem modem;
+	modem.setIdentity("111", "222", "Operator", "Model X");
+	exchange(modem, "ATE0");
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+GSN"), "111"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CGMM"), "Model X"));
+}
+
+void test_registers_after_the_search_delay() {
+	AtModem modem;
+	modem.setRegistrationDelay(4000);
+	exchange(modem, "ATE0");
+	exchange(modem, "AT+CFUN=1");
+	TEST_ASSERT_EQUAL(2, modem.registrationStatus());
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CGATT=1"), "ERROR"));
+	VirtualClock::current().advance(4000000ULL);
+	TEST_ASSERT_EQUAL(1, modem.registrationStatus());
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CREG?"), "+CREG: 0,1"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CGATT=1"), "OK"));
+	TEST_ASSERT_TRUE(modem.gprsAttached());
+}
+
+void test_registration_outcome_can_be_denied() {
+	AtModem modem;
+	modem.setRegistrationDelay(0);
+	modem.setRegistrationOutcome(3);
+	exchange(modem, "AT+CFUN=1");
+	VirtualClock::current().advance(1000);
+	TEST_ASSERT_EQUAL(3, modem.registrationStatus());
+}
+
+void test_commands_charge_their_latency() {
+	AtModem modem;
+	modem.setResponseLatency(10);
+	modem.setCommandLatency("+CSQ", 300);
+	exchange(modem, "AT");
+	TEST_ASSERT_EQUAL_UINT32(10, (uint32_t)VirtualClock::current().nowMillis());
+	exchange(modem, "AT+CSQ");
+	TEST_ASSERT_EQUAL_UINT32(310, (uint32_t)VirtualClock::current().nowMillis());
+}
+
+void test_drives_tiny_gsm_over_at_commands() {
+	AtModem modem;
+	modem.setSignalQuality(17);
+	modem.setRegistrationDelay(4000);
+	TinyGsm driver(modem);
+	driver.useAtCommands();
+
+	TEST_ASSERT_TRUE(driver.init());
+	TEST_ASSERT_EQUAL(17, driver.getSignalQuality());
+	TEST_ASSERT_FALSE(driver.gprsConnect("apn", "", ""));
+	TEST_ASSERT_TRUE(driver.waitForNetwork(60000));
+	TEST_ASSERT_TRUE(VirtualClock::current().nowMillis() >= 4000);
+	TEST_ASSERT_TRUE(driver.gprsConnect("apn", "", ""));
+	TEST_ASSERT_TRUE(driver.isGprsConnected());
+	TEST_ASSERT_TRUE(modem.contextActive());
+
+	modem.dropRegistration();
+	TEST_ASSERT_FALSE(driver.isNetworkConnected());
+	TEST_ASSERT_FALSE(driver.isGprsConnected());
+}
+
+void test_hash_collisions_are_unknown_commands() {
+	AtModem modem;
+	exchange(modem, "ATE0");
+	TEST_ASSERT_EQUAL_UINT32(atCommandHash("+CGDCONT"), atCommandHash("+NTLFPAA"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+NTLFPAA"), "ERROR"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CGDCONT=1,\"IP\",\"apn\""), "OK"));
+}
+
+void test_chained_commands_report_one_result() {
+	AtModem modem;
+	modem.setSignalQuality(9);
+	TEST_ASSERT_TRUE(contains(exchange(modem, "ATE0;+CSQ;+CPIN?"), "\r\n+CSQ: 9,99\r\n\r\n+CPIN: READY\r\n\r\nOK\r\n"));
+	TEST_ASSERT_EQUAL_STRING("\r\nERROR\r\n", exchange(modem, "AT+CIFSR;E1").c_str());
+	TEST_ASSERT_EQUAL_STRING("\r\nOK\r\n", exchange(modem, "AT+CMEE=2;+CDNSCFG=\"8.8.8.8;\",\"8.8.4.4\"").c_str());
+	TEST_ASSERT_EQUAL_UINT32(3, (uint32_t)modem.commandsHandled());
+}
+
+void test_runs_the_tiny_gsm_sim800_connect_sequence() {
+	AtModem modem;
+	modem.setRegistrationDelay(0);
+
+	// TinyGsmSim800::initImpl()
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "ATE0"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CMEE=2"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CGMI"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+GMM"), "SIM800"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CLTS=1"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CBATCHK=1"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CPIN?"), "+CPIN: READY"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CREG?"), "+CREG: 0,1"));
+
+	// TinyGsmSim800::gprsConnectImpl()
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPSHUT"), "SHUT OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CGATT=0"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+SAPBR=3,1,\"Contype\",\"GPRS\""), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+SAPBR=3,1,\"APN\",\"apn\""), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CGDCONT=1,\"IP\",\"apn\""), "OK"));
+	exchange(modem, "AT+CGACT=1,1");
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+SAPBR=1,1"), "OK"));
+	std::string bearer = exchange(modem, "AT+SAPBR=2,1");
+	TEST_ASSERT_TRUE(contains(bearer, "+SAPBR: 1,1,\"10.0.0.2\""));
+	TEST_ASSERT_TRUE(contains(bearer, "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CGATT=1"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPMUX=1"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPQSEND=1"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPRXGET=1"), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CSTT=\"apn\",\"\",\"\""), "OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIICR"), "OK"));
+	TEST_ASSERT_EQUAL_STRING("\r\n10.0.0.2\r\n\r\nOK\r\n", exchange(modem, "AT+CIFSR;E0").c_str());
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CDNSCFG=\"8.8.8.8\",\"8.8.4.4\""), "OK"));
+	TEST_ASSERT_TRUE(modem.contextActive());
+
+	// TinyGsmSim800::modemConnect(), modemSend(), modemRead() and stop()
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPSTART=1,\"TCP\",\"example.com\",80"), "1, CONNECT OK"));
+	TEST_ASSERT_TRUE(modem.socketConnected(1));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPSTATUS=1"), ",\"CONNECTED\""));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPSTATUS=2"), ",\"INITIAL\""));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPSEND=1,5"), ">"));
+	modem.print("hello");
+	TEST_ASSERT_TRUE(contains(drain(modem), "DATA ACCEPT:1,5"));
+	TEST_ASSERT_EQUAL_STRING("hello", modem.socketSent(1).c_str());
+
+	modem.serve(1, "welcome");
+	TEST_ASSERT_EQUAL_STRING("\r\n+CIPRXGET: 1,1\r\n", drain(modem).c_str());
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPRXGET=4,1"), "+CIPRXGET: 4,1,7"));
+	TEST_ASSERT_EQUAL_STRING("\r\n+CIPRXGET: 2,1,4,3\r\nwelc\r\nOK\r\n", exchange(modem, "AT+CIPRXGET=2,1,4").c_str());
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPRXGET=2,1,64"), "+CIPRXGET: 2,1,3,0\r\nome"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPCLOSE=1,1"), "1, CLOSE OK"));
+	TEST_ASSERT_FALSE(modem.socketConnected(1));
+}
+
+void test_losing_the_network_closes_sockets() {
+	AtModem modem;
+	modem.setRegistrationDelay(0);
+	exchange(modem, "ATE0");
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPSTART=\"TCP\",\"example.com\",80"), "ERROR"));
+	exchange(modem, "AT+CGATT=1");
+	exchange(modem, "AT+CIICR");
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPSTART=\"TCP\",\"example.com\",80"), "\r\nCONNECT OK"));
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPSTATUS"), "STATE: CONNECT OK"));
+	exchange(modem, "AT+CIPSEND=2");
+	modem.print("hi");
+	modem.serve(0, "pong");
+	std::string pushed = drain(modem);
+	TEST_ASSERT_TRUE(contains(pushed, "SEND OK"));
+	TEST_ASSERT_TRUE(contains(pushed, "pong"));
+
+	modem.dropRegistration();
+	TEST_ASSERT_FALSE(modem.socketConnected(0));
+	TEST_ASSERT_EQUAL_STRING("\r\nCLOSED\r\n", drain(modem).c_str());
+	TEST_ASSERT_TRUE(contains(exchange(modem, "AT+CIPSTATUS"), "STATE: IP INITIAL"));
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_answers_basic_commands);
+	RUN_TEST(test_reports_identity);
+	RUN_TEST(test_registers_after_the_search_delay);
+	RUN_TEST(test_registration_outcome_can_be_denied);
+	RUN_TEST(test_commands_charge_their_latency);
+	RUN_TEST(test_drives_tiny_gsm_over_at_commands);
+	RUN_TEST(test_hash_collisions_are_unknown_commands);
+	RUN_TEST(test_chained_commands_report_one_result);
+	RUN_TEST(test_runs_the_tiny_gsm_sim800_connect_sequence);
+	RUN_TEST(test_losing_the_network_closes_sockets);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,144 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <cstring>
+#include "MockTinyGsm.h"
+
+uint64_t nowMicros() {
+	return VirtualClock::current().nowMicros();
+}
+
+void setUp(void) {}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_ring_buffer_is_fifo_and_bounded() {
+	RingBuffer<int, 4> ring;
+	TEST_ASSERT_TRUE(ring.empty());
+	for (int i = 0; i < 4; ++i) {
+		TEST_ASSERT_TRUE(ring.push(i));
+	}
+	TEST_ASSERT_TRUE(ring.full());
+	TEST_ASSERT_FALSE(ring.push(4));
+	int value = -1;
+	TEST_ASSERT_TRUE(ring.pop(value));
+	TEST_ASSERT_EQUAL(0, value);
+	TEST_ASSERT_EQUAL(1, *ring.front());
+	TEST_ASSERT_EQUAL_size_t(3, ring.size());
+	ring.clear();
+	TEST_ASSERT_FALSE(ring.pop(value));
+}
+
+void test_bytes_arrive_after_their_transmission_time() {
+	EmulatedUart host(9600);
+	EmulatedUart device(9600);
+	host.connect(device);
+	TEST_ASSERT_EQUAL_size_t(1, host.write('A'));
+	TEST_ASSERT_EQUAL(0, device.available());
+	TEST_ASSERT_EQUAL(-1, device.read());
+	VirtualClock::current().advance(1000);
+	TEST_ASSERT_EQUAL(0, device.available());
+	VirtualClock::current().advance(100);
+	TEST_ASSERT_EQUAL(1, device.available());
+	TEST_ASSERT_EQUAL('A', device.peek());
+	TEST_ASSERT_EQUAL('A', device.read());
+}
+
+void test_link_is_full_duplex() {
+	EmulatedUart host(115200);
+	EmulatedUart device(115200);
+	host.connect(device);
+	host.print("ping");
+	device.print("pong");
+	host.flush();
+	device.flush();
+	char received[5] = {};
+	for (int i = 0; i < 4; ++i) {
+		received[i] = (char)host.read();
+	}
+	TEST_ASSERT_EQUAL_STRING("pong", received);
+	TEST_ASSERT_EQUAL(4, device.available());
+}
+
+void test_writes_block_once_the_tx_buffer_is_full() {
+	EmulatedUart host(9600);
+	EmulatedUart device(9600);
+	host.connect(device);
+	TEST_ASSERT_EQUAL(EMULATED_UART_TX_BUFFER, host.availableForWrite());
+	uint8_t buffer[EMULATED_UART_TX_BUFFER];
+	memset(buffer, 'x', sizeof(buffer));
+	host.write(buffer, sizeof(buffer));
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)host.stats().blockedMicros);
+	TEST_ASSERT_EQUAL(0, host.availableForWrite());
+	host.write('y');
+	TEST_ASSERT_TRUE(host.stats().blockedMicros > 0);
+	TEST_ASSERT_TRUE(nowMicros() > 1000);
+}
+
+void test_flush_waits_for_the_wire_and_slow_readers_overflow() {
+	EmulatedUart host(9600);
+	EmulatedUart device(9600);
+	host.connect(device);
+	uint8_t buffer[1000];
+	memset(buffer, 'x', sizeof(buffer));
+	TEST_ASSERT_EQUAL_size_t(1000, host.write(buffer, sizeof(buffer)));
+	host.flush();
+	TEST_ASSERT_EQUAL_UINT32(1041, (uint32_t)(nowMicros() / 1000));
+	TEST_ASSERT_EQUAL(EMULATED_UART_RX_BUFFER, device.available());
+	TEST_ASSERT_EQUAL_UINT32(1000 - EMULATED_UART_RX_BUFFER, (uint32_t)device.stats().overflows);
+	TEST_ASSERT_EQUAL_UINT32(1000, (uint32_t)host.stats().bytesWritten);
+}
+
+void test_unconnected_endpoint_drops_writes() {
+	EmulatedUart lonely;
+	TEST_ASSERT_EQUAL_size_t(0, lonely.write('x'));
+	TEST_ASSERT_EQUAL_UINT32(115200, lonely.baudRate());
+}
+
+void test_at_modem_answers_over_the_wire() {
+	EmulatedUart host(115200);
+	EmulatedUart modemSide(115200);
+	host.connect(modemSide);
+	AtModem modem;
+	modem.setResponseLatency(0);
+	modem.setSignalQuality(21);
+	modem.attach(modemSide);
+	TinyGsm driver(host);
+	driver.useAtCommands();
+
+	uint64_t started = nowMicros();
+	TEST_ASSERT_TRUE(driver.init());
+	TEST_ASSERT_TRUE(nowMicros() > started);
+	TEST_ASSERT_EQUAL(21, driver.getSignalQuality());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_ring_buffer_is_fifo_and_bounded);
+	RUN_TEST(test_bytes_arrive_after_their_transmission_time);
+	RUN_TEST(test_link_is_full_duplex);
+	RUN_TEST(test_writes_block_once_the_tx_buffer_is_full);
+	RUN_TEST(test_flush_waits_for_the_wire_and_slow_readers_overflow);
+	RUN_TEST(test_unconnected_endpoint_drops_writes);
+	RUN_TEST(test_at_modem_answers_over_the_wire);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
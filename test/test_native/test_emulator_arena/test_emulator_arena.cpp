@@ -0,0 +1,183 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <sstream>
+#include "EmulatorMemory.h"
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+	int readAt(int address) { return this->mock<int>("readAt", address); }
+	int poke() { return this->mock<int>("poke"); }
+};
+
+Sensor sensor;    // Created before any arena is bound, as global mocks are.
+
+void configure() {
+	sensor.returns("sample", 1).then(2).then(3).times(4).then(5);
+	sensor.returns("readAt", 10).withArgs(7);
+	sensor.setException("poke", 3);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_meter_counts_bytes_in_use_and_peak() {
+	MemoryMeter meter;
+	void* first = meter.allocate(100);
+	void* second = meter.allocate(50);
+	TEST_ASSERT_EQUAL(150, (int)meter.inUse());
+	meter.deallocate(first, 100);
+	TEST_ASSERT_EQUAL(50, (int)meter.inUse());
+	TEST_ASSERT_EQUAL(150, (int)meter.peak());
+	TEST_ASSERT_EQUAL(2, (int)meter.allocations());
+	meter.resetPeak();
+	TEST_ASSERT_EQUAL(50, (int)meter.peak());
+	TEST_ASSERT_EQUAL(0, (int)meter.allocations());
+	meter.deallocate(second, 50);
+	TEST_ASSERT_EQUAL(0, (int)meter.inUse());
+}
+
+void test_emulators_use_the_heap_without_an_arena() {
+	TEST_ASSERT_FALSE(EmulatorMemory::bound());
+	TEST_ASSERT_EQUAL_PTR(&EmulatorMemory::heap(), EmulatorMemory::resource());
+	configure();
+	TEST_ASSERT_EQUAL_PTR(&EmulatorMemory::heap(), sensor.memory());
+	TEST_ASSERT_EQUAL(1, sensor.sample());
+}
+
+void test_global_emulator_moves_onto_the_arena() {
+	configure();
+	EmulatorArena arena;
+	TEST_ASSERT_TRUE(EmulatorMemory::bound());
+	TEST_ASSERT_EQUAL_PTR(&arena, EmulatorMemory::resource());
+	TEST_ASSERT_EQUAL(1, sensor.sample());
+	TEST_ASSERT_EQUAL_PTR(&arena, sensor.memory());
+	TEST_ASSERT_EQUAL(2, sensor.sample());
+	TEST_ASSERT_EQUAL(3, sensor.sample());
+	TEST_ASSERT_EQUAL(10, sensor.readAt(7));
+	resetEmulators();
+	arena.release();
+}
+
+void test_release_empties_emulators_and_frees_every_block() {
+	MemoryMeter upstream;
+	{
+		EmulatorArena arena(1024, &upstream);
+		configure();
+		TEST_ASSERT_EQUAL(1, sensor.sample());
+		TEST_ASSERT_EQUAL_PTR(&arena, sensor.memory());
+		TEST_ASSERT_TRUE(arena.used() > 0);
+		TEST_ASSERT_TRUE(arena.allocations() > 0);
+		TEST_ASSERT_TRUE(arena.reserved() > 0);
+		TEST_ASSERT_TRUE(upstream.inUse() == arena.reserved());
+		TEST_ASSERT_TRUE(upstream.allocations() < arena.allocations());
+
+		arena.release();
+		TEST_ASSERT_EQUAL_PTR(&EmulatorMemory::heap(), sensor.memory());
+		TEST_ASSERT_EQUAL(0, (int)arena.used());
+		TEST_ASSERT_EQUAL(0, (int)arena.allocations());
+		TEST_ASSERT_EQUAL(0, (int)arena.reserved());
+		TEST_ASSERT_EQUAL(0, (int)upstream.inUse());
+		TEST_ASSERT_EQUAL(0, sensor.sample());
+		TEST_ASSERT_TRUE(sensor.methods().empty());
+	}
+	TEST_ASSERT_EQUAL(0, (int)upstream.inUse());
+}
+
+void test_arena_is_reused_test_after_test() {
+	EmulatorArena arena;
+	for (int test = 0; test < 3; ++test) {
+		configure();
+		TEST_ASSERT_EQUAL(1, sensor.sample());
+		TEST_ASSERT_EQUAL(2, sensor.sample());
+		TEST_ASSERT_EQUAL(10, sensor.readAt(7));
+		int code = 0;
+		try {
+			sensor.poke();
+		} catch (int thrown) {
+			code = thrown;
+		}
+		TEST_ASSERT_EQUAL(3, code);
+		TEST_ASSERT_EQUAL_PTR(&arena, sensor.memory());
+		resetEmulators();
+		arena.release();
+		TEST_ASSERT_EQUAL_PTR(&EmulatorMemory::heap(), sensor.memory());
+		TEST_ASSERT_EQUAL(0, (int)arena.reserved());
+	}
+}
+
+void test_emulator_destroyed_on_the_arena_is_forgotten() {
+	EmulatorArena arena;
+	{
+		Sensor local;
+		local.returns("sample", 9);
+		TEST_ASSERT_EQUAL_PTR(&arena, local.memory());
+		TEST_ASSERT_EQUAL(9, local.sample());
+	}
+	configure();
+	TEST_ASSERT_EQUAL(1, sensor.sample());
+	arena.release();
+	TEST_ASSERT_EQUAL(0, (int)arena.reserved());
+}
+
+void test_destroying_the_arena_restores_the_previous_resource() {
+	MemoryMeter meter;
+	std::pmr::memory_resource* previous = EmulatorMemory::bind(&meter);
+	{
+		EmulatorArena arena;
+		TEST_ASSERT_EQUAL_PTR(&arena, EmulatorMemory::resource());
+		configure();
+		sensor.sample();
+	}
+	TEST_ASSERT_EQUAL_PTR(&meter, EmulatorMemory::resource());
+	TEST_ASSERT_EQUAL_PTR(&EmulatorMemory::heap(), sensor.memory());
+	EmulatorMemory::bind(previous);
+	TEST_ASSERT_FALSE(EmulatorMemory::bound());
+}
+
+void test_report_names_the_test() {
+	EmulatorArena arena(4096);
+	configure();
+	sensor.sample();
+	std::ostringstream out;
+	arena.report(out, "test_upload");
+	std::ostringstream expected;
+	expected << "Emulator memory in test_upload: " << arena.used() << " bytes peak in " << arena.allocations()
+	         << " allocations (" << arena.reserved() << " reserved)\n";
+	TEST_ASSERT_EQUAL_STRING(expected.str().c_str(), out.str().c_str());
+	arena.release();
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_meter_counts_bytes_in_use_and_peak);
+	RUN_TEST(test_emulators_use_the_heap_without_an_arena);
+	RUN_TEST(test_global_emulator_moves_onto_the_arena);
+	RUN_TEST(test_release_empties_emulators_and_frees_every_block);
+	RUN_TEST(test_arena_is_reused_test_after_test);
+	RUN_TEST(test_emulator_destroyed_on_the_arena_is_forgotten);
+	RUN_TEST(test_destroying_the_arena_restores_the_previous_resource);
+	RUN_TEST(test_report_names_the_test);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
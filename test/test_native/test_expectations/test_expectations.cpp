@@ -0,0 +1,154 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+
+class Http : public Emulator {
+public:
+	int post() { return this->mock<int>("post"); }
+	int responseStatusCode() { return this->mock<int>("responseStatusCode"); }
+	int stop() { return this->mock<int>("stop"); }
+};
+
+Http http;
+
+template<typename F>
+std::string failureOf(F call) {
+	try {
+		call();
+	} catch (const ExpectationException& e) {
+		return e.what();
+	}
+	return "";
+}
+
+void setUp(void) {
+	http.returns("post", 0);
+	http.returns("responseStatusCode", 200);
+	http.returns("stop", 0);
+}
+
+void tearDown(void) {
+	http.reset();
+	resetEmulators();
+}
+
+void test_call_beyond_times_fails_at_once() {
+	http.expect("post").times(2);
+	http.post();
+	http.post();
+	TEST_ASSERT_EQUAL_STRING("Http::post() call #3 at 0 ms: expected exactly 2 times",
+		failureOf([] { http.post(); }).c_str());
+}
+
+void test_never_fails_on_the_first_call() {
+	http.expect("stop").never();
+	VirtualClock::current().advanceMillis(1500);
+	TEST_ASSERT_EQUAL_STRING("Http::stop() call #1 at 1500 ms: expected never",
+		failureOf([] { http.stop(); }).c_str());
+}
+
+void test_before_requires_the_minimum_first() {
+	http.expect("post").times(3).before("responseStatusCode");
+	http.post();
+	http.post();
+	TEST_ASSERT_EQUAL_STRING("Http::responseStatusCode() call #1 at 0 ms: expected after post, which had been called 2 of 3 times",
+		failureOf([] { http.responseStatusCode(); }).c_str());
+}
+
+void test_before_closes_the_earlier_method() {
+	http.expect("post").atLeast(1).before("responseStatusCode");
+	http.post();
+	http.post();
+	TEST_ASSERT_EQUAL_STRING("", failureOf([] { http.responseStatusCode(); }).c_str());
+	TEST_ASSERT_EQUAL_STRING("Http::post() call #3 at 0 ms: expected before any call to responseStatusCode",
+		failureOf([] { http.post(); }).c_str());
+}
+
+void test_after_requires_a_call_to_the_other_method() {
+	http.expect("responseStatusCode").after("post");
+	TEST_ASSERT_EQUAL_STRING("Http::responseStatusCode() call #1 at 0 ms: expected after post, which had been called 0 of 1 times",
+		failureOf([] { http.responseStatusCode(); }).c_str());
+}
+
+void test_verify_reports_missing_calls() {
+	http.expect("post").times(2);
+	http.expect("stop").atMost(1);
+	http.post();
+	TEST_ASSERT_EQUAL_STRING("Http::post() called 1 time, expected exactly 2 times",
+		failureOf([] { http.verifyExpectations(); }).c_str());
+	http.post();
+	TEST_ASSERT_EQUAL_STRING("", failureOf([] { http.verifyExpectations(); }).c_str());
+}
+
+void test_at_most_allows_no_calls() {
+	http.expect("stop").atMost(1);
+	TEST_ASSERT_EQUAL_STRING("", failureOf([] { http.verifyExpectations(); }).c_str());
+	http.stop();
+	TEST_ASSERT_EQUAL_STRING("Http::stop() call #2 at 0 ms: expected at most 1 time",
+		failureOf([] { http.stop(); }).c_str());
+}
+
+void test_bounds_are_described() {
+	http.expect("post").atLeast(2).atMost(4);
+	TEST_ASSERT_EQUAL_STRING("Http::post() called 0 times, expected between 2 and 4 times",
+		failureOf([] { http.verifyExpectations(); }).c_str());
+	http.expect("post").atLeast(3);
+	TEST_ASSERT_EQUAL_STRING("Http::post() called 0 times, expected at least 3 times",
+		failureOf([] { http.verifyExpectations(); }).c_str());
+}
+
+void test_reset_clears_expectations() {
+	http.expect("stop").never();
+	http.expect("post").times(1).before("stop");
+	http.reset();
+	http.returns("post", 0);
+	http.returns("stop", 0);
+	http.stop();
+	http.post();
+	http.post();
+	TEST_ASSERT_EQUAL_STRING("", failureOf([] { http.verifyExpectations(); }).c_str());
+	http.expect("stop").never();
+	TEST_ASSERT_EQUAL_STRING("Http::stop() call #1 at 0 ms: expected never",
+		failureOf([] { http.stop(); }).c_str());
+}
+
+void test_methods_without_expectations_are_unchecked() {
+	http.expect("post").times(1);
+	for (int i = 0; i < 5; ++i) {
+		TEST_ASSERT_EQUAL(200, http.responseStatusCode());
+	}
+	http.post();
+	TEST_ASSERT_EQUAL_STRING("", failureOf([] { http.verifyExpectations(); }).c_str());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_call_beyond_times_fails_at_once);
+	RUN_TEST(test_never_fails_on_the_first_call);
+	RUN_TEST(test_before_requires_the_minimum_first);
+	RUN_TEST(test_before_closes_the_earlier_method);
+	RUN_TEST(test_after_requires_a_call_to_the_other_method);
+	RUN_TEST(test_verify_reports_missing_calls);
+	RUN_TEST(test_at_most_allows_no_calls);
+	RUN_TEST(test_bounds_are_described);
+	RUN_TEST(test_reset_clears_expectations);
+	RUN_TEST(test_methods_without_expectations_are_unchecked);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,211 @@
+// #define EMULATOR_LOG
+#define FAULT_INJECTION_QUIET
+
+#include <emulation.h>
+#include <vector>
+#include "MockClient.h"
+
+class Link : public Emulator {
+public:
+	int connect() { return this->mock<int>("connect"); }
+	int read() { return this->mock<int>("read"); }
+	bool ping() { return this->mock<bool>("ping"); }
+};
+
+Link uplink;
+MockClient client;
+VirtualClock deviceClock;
+
+std::vector<int> connectPattern(uint64_t seed, int calls) {
+	FaultInjector::setRunSeed(seed);
+	uplink.reset();
+	uplink.returns("connect", 1);
+	uplink.injectFault("connect").probability(0.05).returns(0);
+	std::vector<int> results;
+	for (int i = 0; i < calls; ++i) {
+		results.push_back(uplink.connect());
+	}
+	return results;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {
+	VirtualClock::bind(nullptr);
+	deviceClock.reset();
+	uplink.reset();
+	client.reset();
+	resetEmulators();
+}
+
+void test_same_seed_fails_the_same_calls() {
+	std::vector<int> first = connectPattern(42, 2000);
+	TEST_ASSERT_TRUE(first == connectPattern(42, 2000));
+	TEST_ASSERT_FALSE(first == connectPattern(43, 2000));
+	TEST_ASSERT_TRUE(FaultInjector::runSeed() == 43);
+	int failures = 0;
+	for (int result : first) {
+		failures += (result == 0) ? 1 : 0;
+	}
+	TEST_ASSERT_INT_WITHIN(50, 100, failures);
+}
+
+void test_fault_values_count_as_invocations() {
+	uplink.returns("connect", 1);
+	uplink.injectFault("connect").every(2).returns(0);
+	TEST_ASSERT_EQUAL(1, uplink.connect());
+	TEST_ASSERT_EQUAL(0, uplink.connect());
+	TEST_ASSERT_EQUAL(1, uplink.connect());
+	TEST_ASSERT_EQUAL(3, uplink.methods()[0].invoked);
+	TEST_ASSERT_EQUAL(2, uplink.methods()[0].consumed);
+	TEST_ASSERT_TRUE(uplink.faults().rule(0).fired() == 1);
+}
+
+void test_first_firing_rule_wins() {
+	uplink.returns("read", 7);
+	uplink.injectFault("read").onCall(3).throws(-5);
+	uplink.injectFault("read").every(10).returns(0);
+	for (int call = 1; call <= 20; ++call) {
+		int code = 0;
+		int value = -1;
+		try {
+			value = uplink.read();
+		} catch (int exception) {
+			code = exception;
+		}
+		TEST_ASSERT_EQUAL((call == 3) ? -5 : 0, code);
+		if (call != 3) {
+			TEST_ASSERT_EQUAL((call % 10 == 0) ? 0 : 7, value);
+		}
+	}
+	TEST_ASSERT_EQUAL(1, uplink.methods()[0].thrown);
+}
+
+void test_after_calls_and_limit() {
+	uplink.returns("read", 7);
+	uplink.injectFault("read").afterCalls(2).limit(2).returns(0);
+	int expected[] = { 7, 7, 0, 0, 7, 7 };
+	for (int value : expected) {
+		TEST_ASSERT_EQUAL(value, uplink.read());
+	}
+}
+
+void test_after_bytes_fails_writes() {
+	client.returns("write", (size_t)1000);
+	client.injectFault("write").afterBytes(3000).throws(99);
+	uint8_t buffer[1000] = {};
+	int written = 0;
+	int code = 0;
+	try {
+		for (int i = 0; i < 10; ++i) {
+			client.write(buffer, sizeof(buffer));
+			++written;
+		}
+	} catch (int exception) {
+		code = exception;
+	}
+	TEST_ASSERT_EQUAL(3, written);
+	TEST_ASSERT_EQUAL(99, code);
+}
+
+void test_window_of_virtual_time() {
+	VirtualClock::bind(&deviceClock);
+	uplink.returns("connect", 1);
+	uplink.injectFault("connect").between(1000, 2000).returns(0);
+	TEST_ASSERT_EQUAL(1, uplink.connect());
+	deviceClock.advanceMillis(1000);
+	TEST_ASSERT_EQUAL(0, uplink.connect());
+	deviceClock.advanceMillis(999);
+	TEST_ASSERT_EQUAL(0, uplink.connect());
+	deviceClock.advanceMillis(1);
+	TEST_ASSERT_EQUAL(1, uplink.connect());
+}
+
+void test_bursts_group_failures() {
+	FaultInjector::setRunSeed(7);
+	uplink.returns("ping", true);
+	uplink.injectFault("ping").bursts(0.02, 0.25).returns(false);
+	int failures = 0;
+	int bursts = 0;
+	bool previous = true;
+	for (int i = 0; i < 20000; ++i) {
+		bool result = uplink.ping();
+		if (!result) {
+			++failures;
+			bursts += previous ? 1 : 0;
+		}
+		previous = result;
+	}
+	// Bursts last 1 / 0.25 = 4 calls on average and fail 0.02 / 0.27 of calls.
+	TEST_ASSERT_INT_WITHIN(400, 1480, failures);
+	TEST_ASSERT_TRUE(failures > 3 * bursts && failures < 5 * bursts);
+}
+
+void test_set_exception_is_an_unconditional_rule() {
+	uplink.returns("connect", 1);
+	uplink.setException("connect", 400);
+	int code = 0;
+	try {
+		uplink.connect();
+	} catch (int exception) {
+		code = exception;
+	}
+	TEST_ASSERT_EQUAL(400, code);
+	TEST_ASSERT_EQUAL(1, uplink.exceptionThrows(0));
+	TEST_ASSERT_EQUAL(0, uplink.exceptionThrows(1));
+	TEST_ASSERT_EQUAL(1, (int)uplink.exceptions().size());
+	TEST_ASSERT_EQUAL(400, uplink.exceptions()[0].at("connect"));
+	TEST_ASSERT_TRUE(uplink.faults().rule(0).unconditional());
+	TEST_ASSERT_EQUAL(400, uplink.throwException("connect"));
+	TEST_ASSERT_EQUAL(-1, uplink.throwException("read"));
+}
+
+void test_rules_describe_themselves() {
+	uplink.setException("connect", 400);
+	uplink.injectFault("write").probability(0.5).afterBytes(1024).throws(-1);
+	uplink.injectFault("read").every(3).limit(2).returns(0);
+	TEST_ASSERT_EQUAL_STRING("400", uplink.faults().rule(0).describe().c_str());
+	TEST_ASSERT_EQUAL_STRING("p=0.500000 after 1024 bytes throws -1", uplink.faults().rule(1).describe().c_str());
+	TEST_ASSERT_EQUAL_STRING("every 3 at most 2 returns a value", uplink.faults().rule(2).describe().c_str());
+}
+
+void test_reset_removes_rules() {
+	uplink.returns("connect", 1);
+	uplink.injectFault("connect").returns(0);
+	uplink.reset();
+	uplink.returns("connect", 1);
+	TEST_ASSERT_TRUE(uplink.faults().empty());
+	TEST_ASSERT_EQUAL(1, uplink.connect());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_same_seed_fails_the_same_calls);
+	RUN_TEST(test_fault_values_count_as_invocations);
+	RUN_TEST(test_first_firing_rule_wins);
+	RUN_TEST(test_after_calls_and_limit);
+	RUN_TEST(test_after_bytes_fails_writes);
+	RUN_TEST(test_window_of_virtual_time);
+	RUN_TEST(test_bursts_group_failures);
+	RUN_TEST(test_set_exception_is_an_unconditional_rule);
+	RUN_TEST(test_rules_describe_themselves);
+	RUN_TEST(test_reset_removes_rules);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,184 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <stdexcept>
+#include <string>
+#include "FiberScheduler.h"
+
+class Blinker : public FleetDevice {
+public:
+	void setup() override { bootedAt = millis(); }
+	void loop() override {
+		if (crashAfter != 0 && loops() == crashAfter) {
+			throw std::runtime_error("stack overflow");
+		}
+		delay(1000);
+	}
+	unsigned long bootedAt = 1;
+	uint64_t crashAfter = 0;
+};
+
+void setUp(void) {}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_fibers_wake_in_virtual_time_order() {
+	FiberScheduler scheduler;
+	std::string order;
+	scheduler.spawn([&]() {
+		scheduler.sleepFor(300000);
+		order += "a";
+		scheduler.sleepFor(300000);
+		order += "c";
+	});
+	scheduler.spawn([&]() {
+		VirtualClock::wait(400000);
+		order += "b";
+	});
+	TEST_ASSERT_TRUE(scheduler.run());
+	TEST_ASSERT_EQUAL_STRING("abc", order.c_str());
+	TEST_ASSERT_EQUAL_UINT32(600, (uint32_t)scheduler.clock().nowMillis());
+	TEST_ASSERT_EQUAL_size_t(2, scheduler.stats().finished);
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)VirtualClock::current().nowMillis());
+}
+
+void test_run_stops_at_a_point_in_time_and_resumes() {
+	FiberScheduler scheduler;
+	int ticks = 0;
+	scheduler.spawn([&]() {
+		for (int i = 0; i < 10; ++i) {
+			scheduler.sleepFor(1000000);
+			++ticks;
+		}
+	});
+	TEST_ASSERT_FALSE(scheduler.run(4500));
+	TEST_ASSERT_EQUAL(4, ticks);
+	TEST_ASSERT_EQUAL_UINT32(4500, (uint32_t)scheduler.clock().nowMillis());
+	TEST_ASSERT_TRUE(scheduler.run());
+	TEST_ASSERT_EQUAL(10, ticks);
+}
+
+void test_higher_priority_runs_first() {
+	FiberScheduler scheduler;
+	std::string order;
+	scheduler.spawn([&]() { order += "l"; });
+	uint32_t high = scheduler.spawn([&]() { order += "h"; });
+	scheduler.setPriority(high, 5);
+	TEST_ASSERT_EQUAL(5, scheduler.priority(high));
+	scheduler.run();
+	TEST_ASSERT_EQUAL_STRING("hl", order.c_str());
+}
+
+void test_park_waits_for_unpark_or_timeout() {
+	FiberScheduler scheduler;
+	bool woken = false;
+	bool timedOut = true;
+	uint32_t sleeper = scheduler.spawn([&]() { woken = scheduler.park(); });
+	scheduler.spawn([&]() { timedOut = !scheduler.park(2000000); });
+	scheduler.spawn([&]() {
+		scheduler.sleepFor(1000000);
+		scheduler.unpark(sleeper);
+	});
+	TEST_ASSERT_TRUE(scheduler.run());
+	TEST_ASSERT_TRUE(woken);
+	TEST_ASSERT_TRUE(timedOut);
+	TEST_ASSERT_EQUAL_UINT32(2000, (uint32_t)scheduler.clock().nowMillis());
+}
+
+void test_await_polls_a_condition() {
+	FiberScheduler scheduler;
+	bool flag = false;
+	int result = 0;
+	scheduler.spawn([&]() { result = scheduler.await([&]() { return flag; }, 5000) ? 1 : -1; });
+	scheduler.spawn([&]() {
+		scheduler.sleepFor(2500000);
+		flag = true;
+	});
+	scheduler.run();
+	TEST_ASSERT_EQUAL(1, result);
+
+	flag = false;
+	scheduler.spawn([&]() { result = scheduler.await([&]() { return flag; }, 1000) ? 1 : -1; });
+	scheduler.run();
+	TEST_ASSERT_EQUAL(-1, result);
+}
+
+void test_seeded_order_is_reproducible() {
+	std::string orders[2];
+	for (int run = 0; run < 2; ++run) {
+		FiberScheduler scheduler;
+		scheduler.setSeed(77);
+		for (int i = 0; i < 8; ++i) {
+			scheduler.spawn([&, i]() {
+				orders[run] += (char)('a' + i);
+				scheduler.yield();
+				orders[run] += (char)('A' + i);
+			});
+		}
+		scheduler.run();
+	}
+	TEST_ASSERT_EQUAL_size_t(16, orders[0].size());
+	TEST_ASSERT_EQUAL_STRING(orders[0].c_str(), orders[1].c_str());
+}
+
+void test_killed_fibers_never_resume() {
+	FiberScheduler scheduler;
+	int steps = 0;
+	uint32_t victim = scheduler.spawn([&]() {
+		++steps;
+		scheduler.sleepFor(1000000);
+		++steps;
+	});
+	scheduler.run(500);
+	scheduler.kill(victim);
+	TEST_ASSERT_TRUE(scheduler.finished(victim));
+	scheduler.run();
+	TEST_ASSERT_EQUAL(1, steps);
+}
+
+void test_devices_loop_on_the_shared_clock() {
+	FiberScheduler scheduler;
+	std::vector<Blinker> devices(100);
+	for (auto& device : devices) {
+		scheduler.spawn(device);
+	}
+	devices[3].crashAfter = 4;
+	scheduler.run(10000);
+	TEST_ASSERT_EQUAL_UINT32(0, devices[0].bootedAt);
+	TEST_ASSERT_EQUAL_UINT32(10, (uint32_t)devices[0].loops());
+	TEST_ASSERT_TRUE(devices[3].failed());
+	TEST_ASSERT_EQUAL_UINT32(4, (uint32_t)devices[3].loops());
+	TEST_ASSERT_EQUAL_size_t(1, scheduler.stats().failed);
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_fibers_wake_in_virtual_time_order);
+	RUN_TEST(test_run_stops_at_a_point_in_time_and_resumes);
+	RUN_TEST(test_higher_priority_runs_first);
+	RUN_TEST(test_park_waits_for_unpark_or_timeout);
+	RUN_TEST(test_await_polls_a_condition);
+	RUN_TEST(test_seeded_order_is_reproducible);
+	RUN_TEST(test_killed_fibers_never_resume);
+	RUN_TEST(test_devices_loop_on_the_shared_clock);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,168 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <atomic>
+#include <stdexcept>
+#include "Fleet.h"
+#include "MockClient.h"
+#include "MockHttpClient.h"
+
+RouteTable backend;
+
+class Pinger : public FleetDevice {
+public:
+	Pinger() : http(client, "api.example.com", 80) { http.serve(backend); }
+
+	void loop() override {
+		http.get("/ping");
+		answered += (http.responseStatusCode() == 200) ? 1 : 0;
+		lastMillis = millis();
+		delay(1000);
+	}
+
+	MockClient client;
+	HttpClient http;
+	int answered = 0;
+	unsigned long lastMillis = 0;
+};
+
+class Idle : public FleetDevice {
+public:
+	void loop() override {}
+};
+
+class Faulty : public FleetDevice {
+public:
+	void setup() override { booted = true; }
+	void loop() override {
+		if (id() % 2 == 1 && loops() == 3) {
+			throw std::runtime_error("watchdog");
+		}
+		delay(100);
+	}
+	bool booted = false;
+};
+
+class Chatty : public FleetDevice {
+public:
+	void loop() override {
+		log_i("tick %u", (unsigned)id());
+		if (loops() % 10 == 9) {
+			log_e("slow");
+		}
+		delay(100);
+	}
+};
+
+void setUp(void) {
+	backend.on(HTTP_METHOD_GET, "/ping", { 200, {}, "pong", 250 });
+}
+
+void tearDown(void) {
+	backend.clear();
+	resetEmulators();
+}
+
+void test_pool_runs_every_task_to_completion() {
+	WorkStealingPool pool(4);
+	std::vector<uint32_t> tasks;
+	std::vector<std::atomic<int>> steps(100);
+	for (uint32_t i = 0; i < 100; ++i) {
+		tasks.push_back(i);
+	}
+	pool.run(tasks, [&](uint32_t task) { return ++steps[task] < (int)(task % 7) + 1; });
+	for (uint32_t i = 0; i < 100; ++i) {
+		TEST_ASSERT_EQUAL((int)(i % 7) + 1, steps[i].load());
+	}
+	TEST_ASSERT_EQUAL(4, pool.size());
+}
+
+void test_devices_run_on_their_own_clocks() {
+	Fleet fleet(4);
+	fleet.spawn<Pinger>(50);
+	FleetReport report = fleet.run(60000);
+
+	TEST_ASSERT_EQUAL_size_t(50, report.devices);
+	TEST_ASSERT_EQUAL_size_t(0, report.failures);
+	for (size_t i = 0; i < fleet.size(); ++i) {
+		Pinger& device = static_cast<Pinger&>(fleet.device(i));
+		TEST_ASSERT_EQUAL(48, device.answered);
+		TEST_ASSERT_EQUAL_UINT32(48, (uint32_t)device.loops());
+		TEST_ASSERT_EQUAL_UINT32(60000, (uint32_t)device.clock().nowMillis());
+		TEST_ASSERT_EQUAL_UINT32(47 * 1250 + 250, (uint32_t)device.lastMillis);
+	}
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)VirtualClock::current().nowMillis());
+}
+
+void test_runs_resume_where_they_stopped() {
+	Fleet fleet(2);
+	fleet.spawn<Pinger>(3);
+	fleet.run(5000);
+	FleetReport report = fleet.run(10000);
+	TEST_ASSERT_EQUAL_UINT32(4, (uint32_t)report.loops / 3);
+	TEST_ASSERT_EQUAL(8, static_cast<Pinger&>(fleet.device(2)).answered);
+}
+
+void test_idle_loops_are_charged_a_tick() {
+	Fleet fleet(1);
+	fleet.setLoopTick(10);
+	fleet.spawn<Idle>(2);
+	FleetReport report = fleet.run(1000);
+	TEST_ASSERT_EQUAL_UINT32(200, (uint32_t)report.loops);
+}
+
+void test_throwing_devices_stop_alone() {
+	Fleet fleet(3);
+	fleet.spawn<Faulty>(10);
+	FleetReport report = fleet.run(10000);
+	TEST_ASSERT_EQUAL_size_t(5, report.failures);
+	for (size_t i = 0; i < fleet.size(); ++i) {
+		Faulty& device = static_cast<Faulty&>(fleet.device(i));
+		TEST_ASSERT_TRUE(device.booted);
+		TEST_ASSERT_EQUAL(i % 2 == 1, device.failed());
+		TEST_ASSERT_EQUAL_UINT32((i % 2 == 1) ? 3 : 100, (uint32_t)device.loops());
+	}
+}
+
+void test_devices_log_into_their_own_stubs() {
+	Fleet fleet(4);
+	fleet.spawn<Chatty>(20);
+	fleet.run(10000);
+	for (size_t i = 0; i < fleet.size(); ++i) {
+		FleetDevice& device = fleet.device(i);
+		TEST_ASSERT_EQUAL(100, device.logFunctions().info.timesCalled());
+		TEST_ASSERT_EQUAL(10, device.logFunctions().error.timesCalled());
+	}
+	TEST_ASSERT_EQUAL(0, log_i_stub.timesCalled());
+	TEST_ASSERT_EQUAL(0, log_e_stub.timesCalled());
+	log_i("outside");
+	TEST_ASSERT_EQUAL(1, log_i_stub.timesCalled());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_pool_runs_every_task_to_completion);
+	RUN_TEST(test_devices_run_on_their_own_clocks);
+	RUN_TEST(test_runs_resume_where_they_stopped);
+	RUN_TEST(test_idle_loops_are_charged_a_tick);
+	RUN_TEST(test_throwing_devices_stop_alone);
+	RUN_TEST(test_devices_log_into_their_own_stubs);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
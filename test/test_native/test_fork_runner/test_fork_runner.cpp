@@ -0,0 +1,253 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include "ForkRunner.h"
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+};
+
+Sensor sensor;
+std::vector<int>* preloaded = nullptr;
+int counter = 0;
+
+/**
+ * What a nested run reports back from the process it ran in.
+ */
+struct Results {
+	int failed;
+	size_t forks;
+	size_t exits;
+	size_t exitFirst[8];
+	ForkRunner::Outcome outcomes[8];
+};
+
+Results* results = nullptr;
+std::string output;
+
+void worker_passes() {
+	TEST_ASSERT_EQUAL(1, sensor.sample());
+	TEST_ASSERT_EQUAL(1000, (int)preloaded->size());
+	TEST_ASSERT_EQUAL(999, (*preloaded)[999]);
+}
+
+void worker_starts_fresh() {
+	TEST_ASSERT_EQUAL(0, counter);
+	TEST_ASSERT_EQUAL(1000, (int)preloaded->size());
+	++counter;
+	preloaded->clear();
+}
+
+void worker_fails() {
+	TEST_FAIL_MESSAGE("expected failure");
+}
+
+void worker_ignores() {
+	TEST_IGNORE();
+}
+
+void worker_crashes() {
+	raise(SIGSEGV);
+}
+
+void worker_exits() {
+	_exit(3);
+}
+
+void worker_hangs() {
+	for (;;) {
+		usleep(1000);
+	}
+}
+
+/**
+ * Runs the tests added by `add` with a ForkRunner in a child process, so the
+ * failures of its workers stay out of this suite's totals. What it printed
+ * is left in `output`, its outcomes in `results`.
+ */
+void runNested(const std::function<void(ForkRunner&)>& add, size_t tests, unsigned workers, size_t testsPerFork, unsigned timeout = 0) {
+	std::memset(results, 0, sizeof(Results));
+	int pipeFds[2];
+	TEST_ASSERT_EQUAL(0, pipe(pipeFds));
+	std::fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		close(pipeFds[0]);
+		dup2(pipeFds[1], STDOUT_FILENO);
+		close(pipeFds[1]);
+		Unity.TestFile = nullptr;    // run() starts its own totals, as in a test program of its own.
+		ForkRunner runner(workers, testsPerFork);
+		runner.setTimeout(timeout);
+		runner.onWorkerExit([](size_t first) { results->exitFirst[__atomic_fetch_add(&results->exits, 1, __ATOMIC_RELAXED)] = first; });
+		add(runner);
+		results->failed = runner.run(__FILE__);
+		results->forks = runner.forks();
+		for (size_t i = 0; i < tests; ++i) {
+			results->outcomes[i] = runner.outcome(i);
+		}
+		std::fflush(stdout);
+		_exit(0);
+	}
+	close(pipeFds[1]);
+	output.clear();
+	char buffer[4096];
+	ssize_t got;
+	while ((got = read(pipeFds[0], buffer, sizeof(buffer))) > 0) {
+		output.append(buffer, got);
+	}
+	close(pipeFds[0]);
+	int status = 0;
+	waitpid(pid, &status, 0);
+	TEST_ASSERT_TRUE(WIFEXITED(status));
+}
+
+bool printed(const std::string& text) {
+	return output.find(text) != std::string::npos;
+}
+
+void setUp(void) {
+	sensor.returns("sample", 1);
+	counter = 0;
+}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_outcomes_of_passing_failing_and_ignored_tests() {
+	runNested([](ForkRunner& runner) {
+		FORK_TEST(runner, worker_passes);
+		FORK_TEST(runner, worker_fails);
+		FORK_TEST(runner, worker_ignores);
+	}, 3, 2, 1);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[0]);
+	TEST_ASSERT_EQUAL(ForkRunner::Failed, results->outcomes[1]);
+	TEST_ASSERT_EQUAL(ForkRunner::Ignored, results->outcomes[2]);
+	TEST_ASSERT_EQUAL(1, results->failed);
+	TEST_ASSERT_EQUAL(3, (int)results->forks);
+	TEST_ASSERT_TRUE(printed(":worker_fails:FAIL"));
+	TEST_ASSERT_TRUE(printed("expected failure"));
+}
+
+void test_every_worker_starts_from_the_snapshot() {
+	runNested([](ForkRunner& runner) {
+		FORK_TEST(runner, worker_starts_fresh);
+		FORK_TEST(runner, worker_starts_fresh);
+		FORK_TEST(runner, worker_passes);
+	}, 3, 1, 1);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[0]);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[1]);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[2]);
+	TEST_ASSERT_EQUAL(0, results->failed);
+	TEST_ASSERT_EQUAL(0, counter);
+	TEST_ASSERT_EQUAL(1000, (int)preloaded->size());
+}
+
+void test_chunked_tests_share_a_worker() {
+	runNested([](ForkRunner& runner) {
+		FORK_TEST(runner, worker_starts_fresh);
+		FORK_TEST(runner, worker_starts_fresh);
+		FORK_TEST(runner, worker_passes);
+		FORK_TEST(runner, worker_starts_fresh);
+	}, 4, 1, 3);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[0]);
+	TEST_ASSERT_EQUAL(ForkRunner::Failed, results->outcomes[1]);
+	TEST_ASSERT_EQUAL(ForkRunner::Failed, results->outcomes[2]);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[3]);
+	TEST_ASSERT_EQUAL(2, (int)results->forks);
+	TEST_ASSERT_EQUAL(2, (int)results->exits);
+	TEST_ASSERT_EQUAL(0, (int)results->exitFirst[0]);
+	TEST_ASSERT_EQUAL(3, (int)results->exitFirst[1]);
+}
+
+void test_crash_fails_only_its_test() {
+	runNested([](ForkRunner& runner) {
+		FORK_TEST(runner, worker_passes);
+		FORK_TEST(runner, worker_crashes);
+		FORK_TEST(runner, worker_passes);
+		FORK_TEST(runner, worker_exits);
+		FORK_TEST(runner, worker_passes);
+	}, 5, 1, 5);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[0]);
+	TEST_ASSERT_EQUAL(ForkRunner::Crashed, results->outcomes[1]);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[2]);
+	TEST_ASSERT_EQUAL(ForkRunner::Crashed, results->outcomes[3]);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[4]);
+	TEST_ASSERT_EQUAL(2, results->failed);
+	TEST_ASSERT_EQUAL(3, (int)results->forks);
+	TEST_ASSERT_TRUE(printed(":worker_crashes:FAIL: Crashed with signal 11 (Segmentation fault)\n"));
+	TEST_ASSERT_TRUE(printed(":worker_exits:FAIL: Exited with status 3\n"));
+	TEST_ASSERT_TRUE(printed("5 Tests 2 Failures 0 Ignored"));
+}
+
+void test_timeout_kills_a_hung_worker() {
+	runNested([](ForkRunner& runner) {
+		FORK_TEST(runner, worker_hangs);
+		FORK_TEST(runner, worker_passes);
+	}, 2, 2, 1, 1);
+	TEST_ASSERT_EQUAL(ForkRunner::TimedOut, results->outcomes[0]);
+	TEST_ASSERT_EQUAL(ForkRunner::Passed, results->outcomes[1]);
+	TEST_ASSERT_EQUAL(1, results->failed);
+	TEST_ASSERT_TRUE(printed(":worker_hangs:FAIL: Timed out after 1 s\n"));
+}
+
+void test_worker_output_is_not_interleaved() {
+	runNested([](ForkRunner& runner) {
+		for (int i = 0; i < 6; ++i) {
+			FORK_TEST(runner, worker_passes);
+		}
+	}, 6, 3, 2);
+	TEST_ASSERT_EQUAL(0, results->failed);
+	TEST_ASSERT_EQUAL(3, (int)results->forks);
+	size_t lines = 0;
+	for (size_t at = output.find(":worker_passes:PASS\n"); at != std::string::npos; at = output.find(":worker_passes:PASS\n", at + 1)) {
+		++lines;
+	}
+	TEST_ASSERT_EQUAL(6, (int)lines);
+	TEST_ASSERT_TRUE(printed("6 Tests 0 Failures 0 Ignored"));
+}
+
+void test_empty_runner_forks_nothing() {
+	runNested([](ForkRunner&) {}, 0, 2, 1);
+	TEST_ASSERT_EQUAL(0, results->failed);
+	TEST_ASSERT_EQUAL(0, (int)results->forks);
+	TEST_ASSERT_TRUE(printed("0 Tests 0 Failures 0 Ignored"));
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_outcomes_of_passing_failing_and_ignored_tests);
+	RUN_TEST(test_every_worker_starts_from_the_snapshot);
+	RUN_TEST(test_chunked_tests_share_a_worker);
+	RUN_TEST(test_crash_fails_only_its_test);
+	RUN_TEST(test_timeout_kills_a_hung_worker);
+	RUN_TEST(test_worker_output_is_not_interleaved);
+	RUN_TEST(test_empty_runner_forks_nothing);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	preloaded = new std::vector<int>(1000);
+	for (int i = 0; i < 1000; ++i) {
+		(*preloaded)[i] = i;
+	}
+	results = (Results*)mmap(nullptr, sizeof(Results), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	return runTests();
+}
+
+#endif
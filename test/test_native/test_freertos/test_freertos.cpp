@@ -0,0 +1,220 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <string>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+QueueHandle_t samples;
+SemaphoreHandle_t guard;
+EventGroupHandle_t events;
+TaskHandle_t consumerHandle;
+std::string order;
+long total = 0;
+int shared = 0;
+
+uint32_t kernelMillis() {
+	return (uint32_t)RtosKernel::current().scheduler().clock().nowMillis();
+}
+
+void producer(void*) {
+	for (long i = 1; i <= 1000; ++i) {
+		xQueueSend(samples, &i, portMAX_DELAY);
+	}
+	vTaskDelete(NULL);
+}
+
+void consumer(void*) {
+	long value;
+	while (xQueueReceive(samples, &value, pdMS_TO_TICKS(100)) == pdPASS) {
+		total += value;
+	}
+	order += "timeout";
+}
+
+void worker(void* parameter) {
+	for (int i = 0; i < 3; ++i) {
+		xSemaphoreTake(guard, portMAX_DELAY);
+		int seen = shared;
+		order += (char)(intptr_t)parameter;
+		taskYIELD();
+		shared = seen + 1;
+		xSemaphoreGive(guard);
+		vTaskDelay(0);
+	}
+}
+
+void waiter(void*) {
+	EventBits_t bits = xEventGroupWaitBits(events, 0x3, pdTRUE, pdTRUE, portMAX_DELAY);
+	order += ((bits & 0x3) == 0x3) ? "all" : "some";
+}
+
+void ticker(void*) {
+	TickType_t last = xTaskGetTickCount();
+	for (int i = 0; i < 5; ++i) {
+		vTaskDelayUntil(&last, 100);
+	}
+	xEventGroupSetBits(events, 0x2);
+}
+
+void setUp(void) {
+	RtosKernel::current().reset();
+	order.clear();
+	total = 0;
+	shared = 0;
+}
+
+void tearDown(void) {
+	RtosKernel::current().reset();
+	resetEmulators();
+}
+
+void test_queue_passes_items_between_tasks() {
+	samples = xQueueCreate(8, sizeof(long));
+	xTaskCreate(producer, "producer", 4096, nullptr, 2, nullptr);
+	xTaskCreate(consumer, "consumer", 4096, nullptr, 3, nullptr);
+	TEST_ASSERT_TRUE(RtosKernel::current().run(1000));
+	TEST_ASSERT_EQUAL(500500, total);
+	TEST_ASSERT_EQUAL_STRING("timeout", order.c_str());
+	TEST_ASSERT_EQUAL_UINT32(100, kernelMillis());
+	TEST_ASSERT_EQUAL_UINT32(2000, (uint32_t)RtosKernel::current().queueOperations());
+}
+
+void test_queue_ordering_and_capacity() {
+	samples = xQueueCreate(2, sizeof(int));
+	int value = 1;
+	TEST_ASSERT_EQUAL(pdPASS, xQueueSend(samples, &value, 0));
+	value = 2;
+	TEST_ASSERT_EQUAL(pdPASS, xQueueSendToFront(samples, &value, 0));
+	value = 3;
+	TEST_ASSERT_EQUAL(errQUEUE_FULL, xQueueSend(samples, &value, 0));
+	TEST_ASSERT_EQUAL(0, uxQueueSpacesAvailable(samples));
+	TEST_ASSERT_EQUAL(pdPASS, xQueuePeek(samples, &value, 0));
+	TEST_ASSERT_EQUAL(2, value);
+	TEST_ASSERT_EQUAL(pdPASS, xQueueReceive(samples, &value, 0));
+	TEST_ASSERT_EQUAL(2, value);
+	TEST_ASSERT_EQUAL(1, uxQueueMessagesWaiting(samples));
+	xQueueReset(samples);
+	TEST_ASSERT_EQUAL(errQUEUE_EMPTY, xQueueReceive(samples, &value, 0));
+	vQueueDelete(samples);
+
+	QueueHandle_t mailbox = xQueueCreate(1, sizeof(int));
+	value = 7;
+	xQueueOverwrite(mailbox, &value);
+	value = 8;
+	xQueueOverwrite(mailbox, &value);
+	xQueueReceive(mailbox, &value, 0);
+	TEST_ASSERT_EQUAL(8, value);
+	vQueueDelete(mailbox);
+}
+
+void test_mutex_serialises_critical_sections() {
+	guard = xSemaphoreCreateMutex();
+	xTaskCreate(worker, "a", 4096, (void*)'a', 1, nullptr);
+	xTaskCreate(worker, "b", 4096, (void*)'b', 1, nullptr);
+	TEST_ASSERT_TRUE(RtosKernel::current().run(100));
+	TEST_ASSERT_EQUAL(6, shared);
+	TEST_ASSERT_EQUAL_size_t(6, order.size());
+	TEST_ASSERT_NULL(xSemaphoreGetMutexHolder(guard));
+	vSemaphoreDelete(guard);
+}
+
+void test_counting_semaphore_counts() {
+	SemaphoreHandle_t slots = xSemaphoreCreateCounting(3, 2);
+	TEST_ASSERT_EQUAL(2, uxSemaphoreGetCount(slots));
+	TEST_ASSERT_EQUAL(pdPASS, xSemaphoreTake(slots, 0));
+	TEST_ASSERT_EQUAL(pdPASS, xSemaphoreTake(slots, 0));
+	TEST_ASSERT_EQUAL(pdFAIL, xSemaphoreTake(slots, 0));
+	TEST_ASSERT_EQUAL(pdPASS, xSemaphoreGive(slots));
+	TEST_ASSERT_EQUAL(1, uxSemaphoreGetCount(slots));
+	vSemaphoreDelete(slots);
+}
+
+void test_event_group_waits_for_all_bits() {
+	events = xEventGroupCreate();
+	xTaskCreate(waiter, "waiter", 4096, nullptr, 4, nullptr);
+	xTaskCreate(ticker, "ticker", 4096, nullptr, 1, nullptr);
+	xEventGroupSetBits(events, 0x1);
+	TEST_ASSERT_TRUE(RtosKernel::current().run(1000));
+	TEST_ASSERT_EQUAL_STRING("all", order.c_str());
+	TEST_ASSERT_EQUAL_UINT32(500, kernelMillis());
+	TEST_ASSERT_EQUAL(0, xEventGroupGetBits(events));
+	vEventGroupDelete(events);
+}
+
+void test_notification_wakes_a_blocked_task() {
+	xTaskCreate([](void*) {
+		uint32_t count = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+		order += std::to_string(count);
+	}, "sleeper", 4096, nullptr, 5, &consumerHandle);
+	xTaskCreate([](void*) {
+		vTaskDelay(50);
+		order += "give";
+		xTaskNotifyGive(consumerHandle);
+		order += "after";
+	}, "giver", 4096, nullptr, 1, nullptr);
+	TEST_ASSERT_TRUE(RtosKernel::current().run(1000));
+	TEST_ASSERT_EQUAL_STRING("give1after", order.c_str());
+}
+
+void test_suspended_task_waits_for_resume() {
+	xTaskCreate([](void*) {
+		order += "s";
+		vTaskSuspend(NULL);
+		order += "r";
+	}, "sleeper", 4096, nullptr, 2, &consumerHandle);
+	TEST_ASSERT_FALSE(RtosKernel::current().run(100));
+	TEST_ASSERT_EQUAL_STRING("s", order.c_str());
+	xTaskCreate([](void*) { vTaskResume(consumerHandle); }, "waker", 4096, nullptr, 1, nullptr);
+	TEST_ASSERT_TRUE(RtosKernel::current().run(200));
+	TEST_ASSERT_EQUAL_STRING("sr", order.c_str());
+}
+
+void test_seeded_interleavings_are_reproducible() {
+	std::string orders[2];
+	for (int run = 0; run < 2; ++run) {
+		RtosKernel::current().reset(1234);
+		order.clear();
+		guard = xSemaphoreCreateMutex();
+		xTaskCreate(worker, "a", 4096, (void*)'a', 1, nullptr);
+		xTaskCreate(worker, "b", 4096, (void*)'b', 1, nullptr);
+		xTaskCreate(worker, "c", 4096, (void*)'c', 1, nullptr);
+		RtosKernel::current().run(100);
+		orders[run] = order;
+	}
+	TEST_ASSERT_EQUAL_size_t(9, orders[0].size());
+	TEST_ASSERT_EQUAL_STRING(orders[0].c_str(), orders[1].c_str());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_queue_passes_items_between_tasks);
+	RUN_TEST(test_queue_ordering_and_capacity);
+	RUN_TEST(test_mutex_serialises_critical_sections);
+	RUN_TEST(test_counting_semaphore_counts);
+	RUN_TEST(test_event_group_waits_for_all_bits);
+	RUN_TEST(test_notification_wakes_a_blocked_task);
+	RUN_TEST(test_suspended_task_waits_for_resume);
+	RUN_TEST(test_seeded_interleavings_are_reproducible);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
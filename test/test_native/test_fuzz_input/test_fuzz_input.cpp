@@ -0,0 +1,279 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include "MockClient.h"
+#include "MockHttpClient.h"
+#include "MockTinyGsm.h"
+#include "FuzzHarness.h"
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+	bool ready() { return this->mock<bool>("ready"); }
+	std::string name() { return this->mock<std::string>("name"); }
+};
+
+Sensor sensor;
+Sensor other;
+MockClient client;
+HttpClient http(client, "example.com", 80);
+FuzzInput input;
+int reached = 0;
+
+int sampleOrCode() {
+	try {
+		return sensor.sample();
+	} catch (int code) {
+		return -code;
+	}
+}
+
+void firmware() {
+	if (http.get("/config") != 0) {
+		return;
+	}
+	if (http.responseStatusCode() != 200) {
+		return;
+	}
+	reached |= 1;
+	String body = http.responseBody();
+	if (body.length() > 1 && body[0] == 'O' && body[1] == 'K') {
+		reached |= 2;
+		uint8_t buffer[8];
+		if (client.read(buffer, sizeof(buffer)) >= 2 && buffer[0] == 0xDE && buffer[1] == 0xAD) {
+			reached |= 4;
+		}
+	}
+}
+
+FuzzHarness harness() {
+	return FuzzHarness()
+		.drive(http).drive(client)
+		.setup([]() {
+			http.returns("get", 0);
+			http.returns("responseStatusCode", 200);
+			http.returns("responseBody", String(""));
+			client.returns("read", 0);
+		})
+		.target(firmware);
+}
+
+void setUp(void) {
+	reached = 0;
+}
+
+void tearDown(void) {
+	FuzzInput::bind(nullptr);
+	input = FuzzInput();
+	sensor.reset();
+	other.reset();
+	resetEmulators();
+}
+
+void test_integers_are_little_endian() {
+	uint8_t data[] = { 0x34, 0x12, 0x78, 0x56, 0x01 };
+	input.assign(data, sizeof(data));
+	TEST_ASSERT_EQUAL_HEX16(0x1234, input.consumeIntegral<uint16_t>());
+	TEST_ASSERT_EQUAL_HEX32(0x00015678, input.consumeIntegral<uint32_t>());
+	TEST_ASSERT_EQUAL(0, (int)input.remaining());
+	TEST_ASSERT_EQUAL(0, input.consumeByte());
+}
+
+void test_strings_take_a_length_byte() {
+	uint8_t data[] = { 2, 'O', 'K', 'x', 9, 'a', 'b' };
+	input.assign(data, sizeof(data));
+	TEST_ASSERT_EQUAL_STRING("OK", input.consumeCString());
+	std::string value;
+	input.assign(data + 4, sizeof(data) - 4);
+	TEST_ASSERT_TRUE(input.decode(value));
+	TEST_ASSERT_EQUAL_STRING("ab", value.c_str());
+	TEST_ASSERT_TRUE(input.decode(value));
+	TEST_ASSERT_EQUAL_STRING("", value.c_str());
+	uint8_t wrapped[] = { FUZZ_MAX_STRING + 2, 'z' };
+	input.assign(wrapped, sizeof(wrapped));
+	TEST_ASSERT_EQUAL_STRING("z", input.consumeCString());
+}
+
+void test_selector_chooses_the_response() {
+	uint8_t data[] = { 0, 1, 2, 255 - FUZZ_FAULT_RATE, 256 - FUZZ_FAULT_RATE, 255 };
+	input.assign(data, sizeof(data));
+	TEST_ASSERT_EQUAL(FuzzInput::Configured, input.select("a"));
+	TEST_ASSERT_EQUAL(FuzzInput::Decoded, input.select("a"));
+	TEST_ASSERT_EQUAL(FuzzInput::Configured, input.select("a"));
+	TEST_ASSERT_EQUAL(FuzzInput::Decoded, input.select("a"));
+	TEST_ASSERT_EQUAL(FuzzInput::Fault, input.select("a"));
+	input.setFaultRate(0);
+	TEST_ASSERT_EQUAL(FuzzInput::Decoded, input.select("a"));
+	TEST_ASSERT_EQUAL(6, (int)input.calls());
+}
+
+void test_paths_depend_on_methods_and_responses() {
+	uint8_t configured[] = { 0 };
+	uint8_t decoded[] = { 1 };
+	input.assign(configured, 1);
+	input.select("a");
+	uint64_t first = input.path();
+	input.assign(configured, 1);
+	input.select("a");
+	TEST_ASSERT_TRUE(first == input.path());
+	input.assign(configured, 1);
+	input.select("b");
+	TEST_ASSERT_FALSE(first == input.path());
+	input.assign(decoded, 1);
+	input.select("a");
+	TEST_ASSERT_FALSE(first == input.path());
+}
+
+void test_mocked_calls_decode_the_bound_input() {
+	sensor.returns("sample", 7);
+	sensor.returns("ready", false);
+	sensor.returns("name", std::string("configured"));
+	uint8_t data[] = { 0, 1, 0x2A, 0, 0, 0, 0xFF, 0x39, 0x30, 3, 1, 3, 3, 'a', 'b', 'c' };
+	input.assign(data, sizeof(data));
+	FuzzInput::bind(&input);
+	TEST_ASSERT_EQUAL(7, sampleOrCode());
+	TEST_ASSERT_EQUAL(42, sampleOrCode());
+	TEST_ASSERT_EQUAL(-12345, sampleOrCode());
+	TEST_ASSERT_TRUE(sensor.ready());
+	TEST_ASSERT_EQUAL_STRING("abc", sensor.name().c_str());
+	TEST_ASSERT_EQUAL_STRING("configured", sensor.name().c_str());
+	TEST_ASSERT_EQUAL(2, sensor.methods()[0].invoked);
+	TEST_ASSERT_EQUAL(1, sensor.methods()[0].thrown);
+	TEST_ASSERT_EQUAL(2, sensor.methods()[2].invoked);
+}
+
+void test_only_driven_emulators_decode() {
+	sensor.returns("sample", 7);
+	other.returns("sample", 8);
+	uint8_t data[] = { 1, 5, 0, 0, 0, 1, 6, 0, 0, 0 };
+	input.assign(data, sizeof(data));
+	input.drive(&sensor);
+	FuzzInput::bind(&input);
+	TEST_ASSERT_EQUAL(8, other.sample());
+	TEST_ASSERT_EQUAL(5, sensor.sample());
+	TEST_ASSERT_EQUAL(8, other.sample());
+	TEST_ASSERT_EQUAL(6, sensor.sample());
+}
+
+void test_reads_fill_buffers_from_the_input() {
+	client.returns("read", 4);
+	http.returns("read", 16);
+	uint8_t data[] = { 0, 0xDE, 0xAD, 0xBE, 0xEF, 0, 'h', 'i' };
+	input.assign(data, sizeof(data));
+	FuzzInput::bind(&input);
+	uint8_t buffer[8] = {};
+	TEST_ASSERT_EQUAL(4, client.read(buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL_HEX8(0xDE, buffer[0]);
+	TEST_ASSERT_EQUAL_HEX8(0xEF, buffer[3]);
+	memset(buffer, 0xFF, sizeof(buffer));
+	TEST_ASSERT_EQUAL(8, http.read(buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL('h', buffer[0]);
+	TEST_ASSERT_EQUAL('i', buffer[1]);
+	TEST_ASSERT_EQUAL(0, buffer[2]);
+	FuzzInput::bind(nullptr);
+	memset(buffer, 0xFF, sizeof(buffer));
+	TEST_ASSERT_EQUAL(4, client.read(buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL_HEX8(0xFF, buffer[0]);
+}
+
+void test_tiny_gsm_sockets_read_from_the_input() {
+	TinyGsm modem(client);
+	TinyGsmClient socket(modem);
+	TEST_ASSERT_EQUAL(1, socket.connect("example.com", 80));
+	socket.feed("abc");
+	uint8_t data[] = { 0, 'x', 'y', 'z', 1, 2, 0, 0, 0, 'q', 'r', 1, 9, 0, 0, 0, 0xFF, 0x39, 0x30 };
+	input.assign(data, sizeof(data));
+	input.drive(&modem);
+	FuzzInput::bind(&input);
+	uint8_t buffer[8] = {};
+	TEST_ASSERT_EQUAL(3, socket.read(buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL('x', buffer[0]);
+	TEST_ASSERT_EQUAL('z', buffer[2]);
+	TEST_ASSERT_EQUAL(2, socket.read(buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL('q', buffer[0]);
+	TEST_ASSERT_EQUAL('r', buffer[1]);
+	TEST_ASSERT_EQUAL(9, socket.available());
+	int code = 0;
+	try {
+		socket.read(buffer, sizeof(buffer));
+	} catch (int thrown) {
+		code = thrown;
+	}
+	TEST_ASSERT_EQUAL(12345, code);
+	TEST_ASSERT_EQUAL(0, socket.available());
+	FuzzInput::bind(nullptr);
+	TEST_ASSERT_EQUAL(-1, socket.read(buffer, sizeof(buffer)));
+}
+
+void test_empty_input_takes_the_configured_path() {
+	FuzzHarness fuzz = harness();
+	fuzz.run(nullptr, 0);
+	TEST_ASSERT_EQUAL(1, reached);
+}
+
+void test_crafted_input_reaches_the_deepest_branch() {
+	FuzzHarness fuzz = harness();
+	uint8_t data[] = { 0, 0, 1, 2, 'O', 'K', 1, 8, 0, 0, 0, 0xDE, 0xAD };
+	fuzz.run(data, sizeof(data));
+	TEST_ASSERT_EQUAL(7, reached);
+	uint8_t fault[] = { 0xFF, 0x39, 0x30 };
+	fuzz.run(fault, sizeof(fault));
+	TEST_ASSERT_EQUAL(7, reached);
+}
+
+void test_fuzzing_is_reproducible_from_its_seed() {
+	FuzzHarness first = harness();
+	FuzzHarness second = harness();
+	FuzzStats a = first.fuzz(3000, 42);
+	FuzzStats b = second.fuzz(3000, 42);
+	TEST_ASSERT_TRUE(a.runs == 3000);
+	TEST_ASSERT_TRUE(a.seed == 42);
+	TEST_ASSERT_TRUE(a.paths == b.paths);
+	TEST_ASSERT_TRUE(a.corpus == b.corpus);
+	TEST_ASSERT_TRUE(a.faulted == b.faulted);
+	TEST_ASSERT_TRUE(a.paths > 3);
+}
+
+void test_mocks_behave_normally_after_a_run() {
+	FuzzHarness fuzz = harness();
+	uint8_t data[] = { 1, 0x90, 0x01, 0, 0 };
+	fuzz.run(data, sizeof(data));
+	TEST_ASSERT_NULL(FuzzInput::active());
+	resetEmulators();
+	http.returns("responseStatusCode", 404);
+	TEST_ASSERT_EQUAL(404, http.responseStatusCode());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_integers_are_little_endian);
+	RUN_TEST(test_strings_take_a_length_byte);
+	RUN_TEST(test_selector_chooses_the_response);
+	RUN_TEST(test_paths_depend_on_methods_and_responses);
+	RUN_TEST(test_mocked_calls_decode_the_bound_input);
+	RUN_TEST(test_only_driven_emulators_decode);
+	RUN_TEST(test_reads_fill_buffers_from_the_input);
+	RUN_TEST(test_tiny_gsm_sockets_read_from_the_input);
+	RUN_TEST(test_empty_input_takes_the_configured_path);
+	RUN_TEST(test_crafted_input_reaches_the_deepest_branch);
+	RUN_TEST(test_fuzzing_is_reproducible_from_its_seed);
+	RUN_TEST(test_mocks_behave_normally_after_a_run);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
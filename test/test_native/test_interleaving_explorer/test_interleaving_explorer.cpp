@@ -0,0 +1,191 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include "InterleavingExplorer.h"
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+};
+
+/**
+ * Three tasks read a shared counter, sample the sensor, then write the
+ * counter back: an update is lost whenever another task runs in between.
+ */
+class LostUpdate : public ExplorationScenario {
+public:
+	void start(RtosKernel& kernel) override {
+		sensor.returns("sample", 1);
+		xTaskCreate(racy, "a", 4096, this, 1, nullptr);
+		xTaskCreate(racy, "b", 4096, this, 1, nullptr);
+		xTaskCreate(racy, "c", 4096, this, 1, nullptr);
+	}
+	bool check() override { return counter == 6; }
+	uint64_t stateHash() override { return 1 + counter * 31 + finished; }
+
+	static void racy(void* parameter) {
+		LostUpdate* self = (LostUpdate*)parameter;
+		for (int i = 0; i < 2; ++i) {
+			int seen = self->counter;
+			int step = self->sensor.sample();
+			self->counter = seen + step;
+		}
+		++self->finished;
+	}
+
+	Sensor sensor;
+	int counter = 0;
+	int finished = 0;
+};
+
+class AtomicUpdate : public LostUpdate {
+public:
+	void start(RtosKernel& kernel) override {
+		sensor.returns("sample", 1);
+		xTaskCreate(atomic, "a", 4096, this, 1, nullptr);
+		xTaskCreate(atomic, "b", 4096, this, 1, nullptr);
+		xTaskCreate(atomic, "c", 4096, this, 1, nullptr);
+	}
+
+	static void atomic(void* parameter) {
+		AtomicUpdate* self = (AtomicUpdate*)parameter;
+		for (int i = 0; i < 2; ++i) {
+			self->counter += self->sensor.sample();
+		}
+		++self->finished;
+	}
+};
+
+class AtomicPair : public AtomicUpdate {
+public:
+	void start(RtosKernel& kernel) override {
+		sensor.returns("sample", 1);
+		xTaskCreate(atomic, "a", 4096, this, 1, nullptr);
+		xTaskCreate(atomic, "b", 4096, this, 1, nullptr);
+	}
+	bool check() override { return counter == 4; }
+};
+
+class UnhashedAtomicPair : public AtomicPair {
+public:
+	uint64_t stateHash() override { return 0; }
+};
+
+/**
+ * Two tasks wait, then read millis() and log: each run must see only its own
+ * virtual time, whichever worker it runs on.
+ */
+class TimedPair : public ExplorationScenario {
+public:
+	void start(RtosKernel& kernel) override {
+		sensor.returns("sample", 1);
+		xTaskCreate(timed, "a", 4096, this, 1, nullptr);
+		xTaskCreate(timed, "b", 4096, this, 1, nullptr);
+	}
+	bool check() override { return stamps[0] == 5 && stamps[1] == 5; }
+
+	static void timed(void* parameter) {
+		TimedPair* self = (TimedPair*)parameter;
+		int slot = self->sensor.sample() == 1 ? self->started++ : 0;
+		delay(5);
+		self->stamps[slot] = millis();
+		log_i("task %d", slot);
+	}
+
+	Sensor sensor;
+	int started = 0;
+	unsigned long stamps[2] = {};
+};
+
+void setUp(void) {}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_finds_the_lost_update() {
+	InterleavingExplorer explorer(4);
+	ExplorationResult result = explorer.explore<LostUpdate>();
+	TEST_ASSERT_TRUE(result.failed);
+	TEST_ASSERT_FALSE(result.schedule.empty());
+	TEST_ASSERT_TRUE(result.executions > 0);
+}
+
+void test_failing_schedule_replays_deterministically() {
+	InterleavingExplorer explorer(2);
+	ExplorationResult result = explorer.explore<LostUpdate>();
+	for (int i = 0; i < 3; ++i) {
+		LostUpdate scenario;
+		TEST_ASSERT_FALSE(explorer.replay(scenario, result.schedule));
+		TEST_ASSERT_TRUE(scenario.counter < 6);
+		TEST_ASSERT_EQUAL(3, scenario.finished);
+	}
+	TEST_ASSERT_FALSE(explorer.replay<LostUpdate>(result.schedule));
+}
+
+void test_correct_code_is_explored_exhaustively() {
+	InterleavingExplorer explorer(4);
+	ExplorationResult result = explorer.explore<AtomicUpdate>();
+	TEST_ASSERT_FALSE(result.failed);
+	TEST_ASSERT_TRUE(result.exhausted);
+}
+
+void test_state_hash_prunes_explored_states() {
+	InterleavingExplorer explorer(1);
+	ExplorationResult hashed = explorer.explore<AtomicPair>();
+	ExplorationResult unhashed = explorer.explore<UnhashedAtomicPair>();
+	TEST_ASSERT_TRUE(hashed.pruned > 0);
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)unhashed.pruned);
+	TEST_ASSERT_TRUE(hashed.executions < unhashed.executions);
+	TEST_ASSERT_TRUE(unhashed.exhausted);
+}
+
+void test_limits_make_the_search_bounded() {
+	InterleavingExplorer explorer(2);
+	explorer.setMaxDecisions(1);
+	TEST_ASSERT_FALSE(explorer.explore<AtomicUpdate>().exhausted);
+
+	InterleavingExplorer capped(1);
+	capped.setMaxExecutions(1);
+	ExplorationResult result = capped.explore<UnhashedAtomicPair>();
+	TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)result.executions);
+	TEST_ASSERT_FALSE(result.exhausted);
+}
+
+void test_runs_get_their_own_time_emulators() {
+	InterleavingExplorer explorer(4);
+	ExplorationResult result = explorer.explore<TimedPair>();
+	TEST_ASSERT_FALSE(result.failed);
+	TEST_ASSERT_TRUE(result.executions > 1);
+	TEST_ASSERT_EQUAL(0, millisEmulator.timesCalled());
+	TEST_ASSERT_EQUAL(0, delayEmulator.timesCalled());
+	TEST_ASSERT_EQUAL(0, log_i_stub.timesCalled());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_finds_the_lost_update);
+	RUN_TEST(test_failing_schedule_replays_deterministically);
+	RUN_TEST(test_correct_code_is_explored_exhaustively);
+	RUN_TEST(test_state_hash_prunes_explored_states);
+	RUN_TEST(test_limits_make_the_search_bounded);
+	RUN_TEST(test_runs_get_their_own_time_emulators);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,131 @@
+// #define EMULATOR_LOG
+#define EMULATOR_HISTOGRAMS
+
+#include <emulation.h>
+#include <sstream>
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+	int status() { return this->mock<int>("status"); }
+};
+
+Sensor sensor;
+VirtualClock deviceClock;
+
+const MethodProfile& profileOf(const char* name) {
+	for (const MethodProfile& method : sensor.methods()) {
+		if (method.methodName == name) {
+			return method;
+		}
+	}
+	TEST_FAIL_MESSAGE("no profile");
+	return sensor.methods()[0];
+}
+
+void setUp(void) {
+	VirtualClock::bind(&deviceClock);
+}
+
+void tearDown(void) {
+	VirtualClock::bind(nullptr);
+	deviceClock.reset();
+	sensor.reset();
+	resetEmulators();
+}
+
+void test_small_values_are_exact() {
+	for (uint64_t value : { 0ULL, 1ULL, 15ULL, 16ULL, 17ULL, 31ULL, 32ULL, 1000ULL, 123456789ULL }) {
+		LatencyHistogram histogram;
+		histogram.record(value);
+		histogram.record(value);
+		TEST_ASSERT_EQUAL_UINT32((uint32_t)value, (uint32_t)histogram.percentile(50.0));
+		TEST_ASSERT_EQUAL_UINT32((uint32_t)value, (uint32_t)histogram.min());
+		TEST_ASSERT_EQUAL_UINT32((uint32_t)value, (uint32_t)histogram.max());
+	}
+}
+
+void test_percentiles_stay_within_bucket_precision() {
+	LatencyHistogram histogram;
+	for (uint64_t value = 1; value <= 100000; ++value) {
+		histogram.record(value);
+	}
+	TEST_ASSERT_EQUAL_UINT32(100000, (uint32_t)histogram.count());
+	TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)histogram.min());
+	TEST_ASSERT_EQUAL_UINT32(100000, (uint32_t)histogram.max());
+	TEST_ASSERT_TRUE(histogram.sum() == 5000050000ULL);
+	TEST_ASSERT_UINT32_WITHIN(50000 / 16, 50000, (uint32_t)histogram.percentile(50.0));
+	TEST_ASSERT_UINT32_WITHIN(99000 / 16, 99000, (uint32_t)histogram.percentile(99.0));
+	TEST_ASSERT_EQUAL_UINT32(100000, (uint32_t)histogram.percentile(100.0));
+}
+
+void test_merge_and_reset() {
+	LatencyHistogram fast;
+	LatencyHistogram slow;
+	fast.record(10);
+	slow.record(1000);
+	slow.record(2000);
+	fast.merge(slow);
+	TEST_ASSERT_EQUAL_UINT32(3, (uint32_t)fast.count());
+	TEST_ASSERT_EQUAL_UINT32(10, (uint32_t)fast.min());
+	TEST_ASSERT_EQUAL_UINT32(2000, (uint32_t)fast.max());
+	TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)fast.bucket(10));
+	fast.reset();
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)fast.count());
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)fast.min());
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)fast.percentile(50.0));
+}
+
+void test_report_summarises_the_histogram() {
+	LatencyHistogram histogram;
+	std::ostringstream empty;
+	histogram.report(empty);
+	TEST_ASSERT_EQUAL_STRING("n=0", empty.str().c_str());
+	histogram.record(5);
+	std::ostringstream one;
+	histogram.report(one, "us");
+	TEST_ASSERT_EQUAL_STRING("n=1 min=5us mean=5us p50=5us p90=5us p99=5us max=5us", one.str().c_str());
+}
+
+void test_mocked_calls_are_timed() {
+	sensor.returns("sample", 1, 5);
+	sensor.returns("status", 0);
+	for (int i = 0; i < 100; ++i) {
+		sensor.sample();
+	}
+	sensor.status();
+
+	const MethodProfile& sample = profileOf("sample");
+	TEST_ASSERT_EQUAL_UINT32(100, (uint32_t)sample.latency.wall.count());
+	TEST_ASSERT_EQUAL_UINT32(5000, (uint32_t)sample.latency.emulated.percentile(50.0));
+	TEST_ASSERT_EQUAL_UINT32(5000, (uint32_t)sample.latency.emulated.max());
+	TEST_ASSERT_EQUAL_UINT32(500, (uint32_t)deviceClock.nowMillis());
+	TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)profileOf("status").latency.between.count());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_small_values_are_exact);
+	RUN_TEST(test_percentiles_stay_within_bucket_precision);
+	RUN_TEST(test_merge_and_reset);
+	RUN_TEST(test_report_summarises_the_histogram);
+	RUN_TEST(test_mocked_calls_are_timed);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,169 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include "MockClient.h"
+
+LinkProfile fixedProfile() {
+	LinkProfile profile;
+	profile.bandwidth = 8000;
+	profile.latency = 600;
+	profile.distribution = LATENCY_FIXED;
+	return profile;
+}
+
+uint32_t nowMillis() {
+	return (uint32_t)VirtualClock::current().nowMillis();
+}
+
+void setUp(void) {}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_open_costs_one_round_trip() {
+	LinkModel link(fixedProfile());
+	TEST_ASSERT_TRUE(link.open());
+	TEST_ASSERT_EQUAL_UINT32(1200, nowMillis());
+}
+
+void test_send_costs_serialisation_time() {
+	LinkModel link(fixedProfile());
+	TEST_ASSERT_EQUAL_size_t(1000, link.send(1000));
+	TEST_ASSERT_EQUAL_UINT32(1000, nowMillis());
+	TEST_ASSERT_EQUAL_UINT32(1000, (uint32_t)link.stats().bytesSent);
+}
+
+void test_first_read_after_a_write_waits_one_latency() {
+	LinkModel link(fixedProfile());
+	link.send(100);
+	uint32_t sent = nowMillis();
+	link.receive(100);
+	TEST_ASSERT_EQUAL_UINT32(sent + 600 + 100, nowMillis());
+	link.receive(100);
+	TEST_ASSERT_EQUAL_UINT32(sent + 600 + 200, nowMillis());
+	TEST_ASSERT_EQUAL_UINT32(nowMillis() * 1000, (uint32_t)link.stats().blockedMicros);
+	TEST_ASSERT_EQUAL_UINT32(3, (uint32_t)link.stats().transfers);
+}
+
+void test_unlimited_bandwidth_costs_nothing() {
+	LinkModel link;
+	link.send(1 << 20);
+	link.receive(1 << 20);
+	TEST_ASSERT_EQUAL_UINT32(0, nowMillis());
+	TEST_ASSERT_EQUAL_FLOAT(0.0f, (float)link.stats().goodput());
+}
+
+void test_uniform_latency_stays_within_jitter() {
+	LinkProfile profile;
+	profile.latency = 500;
+	profile.jitter = 100;
+	profile.distribution = LATENCY_UNIFORM;
+	LinkModel link(profile, 99);
+	for (int i = 0; i < 50; ++i) {
+		uint32_t before = nowMillis();
+		link.send(1);
+		link.receive(1);
+		uint32_t latency = nowMillis() - before;
+		TEST_ASSERT_GREATER_OR_EQUAL(399, latency);
+		TEST_ASSERT_LESS_OR_EQUAL(600, latency);
+	}
+}
+
+void test_same_seed_gives_same_timing() {
+	LinkProfile profile = fixedProfile();
+	profile.jitter = 250;
+	profile.distribution = LATENCY_NORMAL;
+	profile.dropRate = 0.1;
+	LinkModel first(profile, 1234);
+	LinkModel second(profile, 1234);
+	for (int i = 0; i < 20; ++i) {
+		first.send(64);
+		first.receive(64);
+		second.send(64);
+		second.receive(64);
+	}
+	TEST_ASSERT_EQUAL_UINT32((uint32_t)first.stats().blockedMicros, (uint32_t)second.stats().blockedMicros);
+	TEST_ASSERT_EQUAL_UINT32((uint32_t)first.stats().drops, (uint32_t)second.stats().drops);
+	TEST_ASSERT_EQUAL_UINT32(1234, (uint32_t)first.seed());
+}
+
+void test_drops_charge_retransmissions_until_reset() {
+	LinkProfile profile;
+	profile.dropRate = 1.0;
+	profile.retransmit = 1000;
+	LinkModel link(profile);
+	TEST_ASSERT_EQUAL_size_t(0, link.send(10));
+	TEST_ASSERT_TRUE(link.isReset());
+	TEST_ASSERT_EQUAL_UINT32(8, (uint32_t)link.stats().drops);
+	TEST_ASSERT_EQUAL_UINT32(8000, nowMillis());
+	TEST_ASSERT_EQUAL_size_t(0, link.receive(10));
+	TEST_ASSERT_TRUE(link.open());
+	TEST_ASSERT_FALSE(link.isReset());
+}
+
+void test_reset_rate_fails_the_handshake() {
+	LinkProfile profile;
+	profile.resetRate = 1.0;
+	LinkModel link(profile);
+	TEST_ASSERT_FALSE(link.open());
+	TEST_ASSERT_TRUE(link.isReset());
+	TEST_ASSERT_EQUAL_UINT32(1, (uint32_t)link.stats().resets);
+}
+
+void test_reset_clears_statistics() {
+	LinkModel link(fixedProfile());
+	link.send(100);
+	link.reset();
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)link.stats().transfers);
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)link.stats().bytesSent);
+}
+
+void test_mock_client_traffic_is_metered() {
+	LinkModel link(fixedProfile());
+	MockClient client;
+	client.attachLink(link);
+	client.returns("connect", 1).returns("write", (size_t)500).returns("read", 250);
+	uint8_t buffer[500] = {};
+
+	TEST_ASSERT_EQUAL(1, client.connect("api.example.com", 443));
+	TEST_ASSERT_EQUAL_size_t(500, client.write(buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL(250, client.read(buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL_UINT32(1200 + 500 + 600 + 250, nowMillis());
+
+	client.detachLink();
+	client.write(buffer, sizeof(buffer));
+	TEST_ASSERT_EQUAL_UINT32(500, (uint32_t)link.stats().bytesSent);
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_open_costs_one_round_trip);
+	RUN_TEST(test_send_costs_serialisation_time);
+	RUN_TEST(test_first_read_after_a_write_waits_one_latency);
+	RUN_TEST(test_unlimited_bandwidth_costs_nothing);
+	RUN_TEST(test_uniform_latency_stays_within_jitter);
+	RUN_TEST(test_same_seed_gives_same_timing);
+	RUN_TEST(test_drops_charge_retransmissions_until_reset);
+	RUN_TEST(test_reset_rate_fails_the_handshake);
+	RUN_TEST(test_reset_clears_statistics);
+	RUN_TEST(test_mock_client_traffic_is_metered);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
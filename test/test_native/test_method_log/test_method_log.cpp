@@ -0,0 +1,144 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include "MethodLog.h"
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+	int calibrate() { return this->mock<int>("calibrate"); }
+};
+
+Sensor sensor;
+std::string base = (std::filesystem::temp_directory_path() / "emulation_method_log").string();
+
+std::string slurp(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	std::ostringstream content;
+	content << file.rdbuf();
+	return content.str();
+}
+
+void exercise() {
+	sensor.returns("sample", 1).then(2).then(3);
+	sensor.returns("say \"hi\"", 0);
+	sensor.returns("calibrate", 0);
+	sensor.setException("calibrate", 7);
+	sensor.sample();
+	sensor.sample();
+	try {
+		sensor.calibrate();
+	} catch (int) {}
+}
+
+void setUp(void) {
+	exercise();
+}
+
+void tearDown(void) {
+	for (const char* extension : { ".json", ".csv", ".bin", ".log" }) {
+		std::filesystem::remove(base + extension);
+	}
+	sensor.reset();
+	resetEmulators();
+}
+
+void test_json_log_is_an_array_of_records() {
+	{
+		MethodLog log((base + ".json").c_str(), MethodLog::Json);
+		log.write(sensor.methods(), "test_one");
+		log.write(sensor.methods(), "line\nbreak");
+		TEST_ASSERT_EQUAL_UINT32(6, (uint32_t)log.records());
+	}
+	std::string json = slurp(base + ".json");
+	TEST_ASSERT_EQUAL('[', json.front());
+	TEST_ASSERT_EQUAL_STRING("\n]\n", json.substr(json.size() - 3).c_str());
+	TEST_ASSERT_TRUE(json.find("{\"test\": \"test_one\", \"method\": \"sample\", \"invoked\": 2, \"consumed\": 2, \"unconsumed\": 1, \"thrown\": 0, \"delay_ms\": 0}") != std::string::npos);
+	TEST_ASSERT_TRUE(json.find("\"method\": \"say \\\"hi\\\"\"") != std::string::npos);
+	TEST_ASSERT_TRUE(json.find("\"test\": \"line\\u000abreak\"") != std::string::npos);
+	TEST_ASSERT_TRUE(json.find("\"method\": \"calibrate\", \"invoked\": 0, \"consumed\": 0, \"unconsumed\": 1, \"thrown\": 1") != std::string::npos);
+}
+
+void test_empty_json_log_is_an_empty_array() {
+	{
+		MethodLog log((base + ".json").c_str(), MethodLog::Json);
+	}
+	TEST_ASSERT_EQUAL_STRING("[]\n", slurp(base + ".json").c_str());
+}
+
+void test_csv_log_has_a_header_and_quoted_names() {
+	{
+		MethodLog log((base + ".csv").c_str(), MethodLog::Csv);
+		log.write(sensor.methods(), "test_one");
+	}
+	std::string csv = slurp(base + ".csv");
+	TEST_ASSERT_EQUAL(0, csv.find("test,method,invoked,consumed,unconsumed,thrown,delay_ms\n"));
+	TEST_ASSERT_TRUE(csv.find("\n\"test_one\",\"sample\",2,2,1,0,0\n") != std::string::npos);
+	TEST_ASSERT_TRUE(csv.find("\"say \"\"hi\"\"\"") != std::string::npos);
+}
+
+void test_binary_log_starts_with_its_header() {
+	{
+		MethodLog log((base + ".bin").c_str(), MethodLog::Binary);
+		log.write(sensor.methods(), "t");
+	}
+	std::string binary = slurp(base + ".bin");
+	TEST_ASSERT_EQUAL_MEMORY("EMLG", binary.data(), 4);
+	TEST_ASSERT_EQUAL(METHOD_LOG_VERSION, (uint8_t)binary[4]);
+	const char* record = binary.data() + 12;
+	TEST_ASSERT_EQUAL(1, (uint8_t)record[0]);
+	TEST_ASSERT_EQUAL('t', record[2]);
+	TEST_ASSERT_EQUAL(6, (uint8_t)record[3]);
+	TEST_ASSERT_EQUAL_MEMORY("sample", record + 5, 6);
+	TEST_ASSERT_EQUAL(2, (uint8_t)record[11]);
+}
+
+void test_text_dump_appends_to_one_file() {
+	MethodLog log;
+	log.dumpMethodProfiles(sensor.methods(), base.c_str());
+	log.dumpMethodProfiles(sensor.methods(), "ignored");
+	log.close();
+	std::string text = slurp(base + ".log");
+	TEST_ASSERT_EQUAL(0, text.find("Method: sample() [invoked 2 times] with 3 return values\n"));
+	TEST_ASSERT_TRUE(text.find("Method: calibrate() [invoked 0 times] with 1 return value, threw 1\n") != std::string::npos);
+	TEST_ASSERT_EQUAL_UINT32(6, (uint32_t)log.records());
+	TEST_ASSERT_FALSE(std::filesystem::exists("ignored.log"));
+}
+
+void test_unwritable_path_fails_to_open() {
+	MethodLog log;
+	TEST_ASSERT_FALSE(log.open("/nonexistent/profiles.csv", MethodLog::Csv));
+	log.write(sensor.methods(), "test_one");
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)log.records());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_json_log_is_an_array_of_records);
+	RUN_TEST(test_empty_json_log_is_an_empty_array);
+	RUN_TEST(test_csv_log_has_a_header_and_quoted_names);
+	RUN_TEST(test_binary_log_starts_with_its_header);
+	RUN_TEST(test_text_dump_appends_to_one_file);
+	RUN_TEST(test_unwritable_path_fails_to_open);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
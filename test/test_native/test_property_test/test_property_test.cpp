@@ -0,0 +1,232 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <sstream>
+#include "PropertyTest.h"
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+	int16_t quality() { return this->mock<int16_t>("quality"); }
+	String name() { return this->mock<String>("name"); }
+};
+
+struct Device {
+	Sensor sensor;
+	Sensor modem;
+};
+
+std::vector<int> values(const std::vector<int>& candidates) {
+	return candidates;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_range_shrinks_towards_zero() {
+	Gen<int> gen = Gen<int>::range(-10, 100);
+	TEST_ASSERT_TRUE(gen.shrink(80) == values({ 0, 40, 79 }));
+	TEST_ASSERT_TRUE(gen.shrink(-3) == values({ 0, -1, -2 }));
+	TEST_ASSERT_TRUE(gen.shrink(1) == values({ 0 }));
+	TEST_ASSERT_TRUE(gen.shrink(0).empty());
+	TEST_ASSERT_TRUE(Gen<int>::range(5, 9).shrink(9) == values({ 5, 7, 8 }));
+}
+
+void test_one_of_shrinks_towards_the_first() {
+	Gen<int> gen = Gen<int>::oneOf({ 200, 404, 500 });
+	TEST_ASSERT_TRUE(gen.shrink(500) == values({ 200, 404 }));
+	TEST_ASSERT_TRUE(gen.shrink(200).empty());
+	SeededRandom random(1);
+	for (int i = 0; i < 50; ++i) {
+		int value = gen.generate(random, nullptr);
+		TEST_ASSERT_TRUE(value == 200 || value == 404 || value == 500);
+	}
+}
+
+void test_walk_stays_within_its_step() {
+	Gen<int> gen = Gen<int>::walk(0, 31, 4);
+	SeededRandom random(3);
+	int previous = gen.generate(random, nullptr);
+	for (int i = 0; i < 200; ++i) {
+		int value = gen.generate(random, &previous);
+		TEST_ASSERT_INT_WITHIN(4, previous, value);
+		TEST_ASSERT_TRUE(value >= 0 && value <= 31);
+		previous = value;
+	}
+}
+
+void test_holding_property_runs_every_case() {
+	PropertyTest<Device> property(2);
+	property.forAll("sensor", &Device::sensor, "sample", Gen<int>::range(0, 99), 1, 8);
+	property.setCases(300);
+	property.setSeed(7);
+	PropertyResult result = property.check([](Device& device) { return device.sensor.sample() < 100; });
+	TEST_ASSERT_FALSE(result.failed);
+	TEST_ASSERT_TRUE(result.cases == 300);
+	std::ostringstream out;
+	result.report(out);
+	TEST_ASSERT_EQUAL_STRING("Property held for 300 cases, seed 0x0000000000000007\n", out.str().c_str());
+}
+
+void test_failing_value_shrinks_to_the_boundary() {
+	PropertyTest<Device> property(2);
+	property.forAll("sensor", &Device::sensor, "sample", Gen<int>::range(0, 200), 1, 8);
+	property.setSeed(12345);
+	PropertyResult result = property.check([](Device& device) {
+		for (int i = 0; i < 5; ++i) {
+			if (device.sensor.sample() >= 100) {
+				return false;
+			}
+		}
+		return true;
+	});
+	TEST_ASSERT_TRUE(result.failed);
+	TEST_ASSERT_TRUE(result.shrinks > 0);
+	TEST_ASSERT_EQUAL_STRING("  sensor.returns(\"sample\", 100);\n", result.counterexample.c_str());
+}
+
+void test_counterexample_replays_with_times() {
+	PropertyTest<Device> property(2);
+	property.forAll("sensor", &Device::sensor, "sample", Gen<int>::oneOf({ 200, 500 }), 1, 8);
+	property.setSeed(99);
+	auto retriesTwice = [](Device& device) {
+		int first = device.sensor.sample();
+		int second = device.sensor.sample();
+		int third = device.sensor.sample();
+		return !(first == 500 && second == 500 && third == 200);
+	};
+	PropertyResult result = property.check(retriesTwice);
+	TEST_ASSERT_TRUE(result.failed);
+	TEST_ASSERT_EQUAL_STRING("  sensor.returns(\"sample\", 500).times(2).then(200);\n", result.counterexample.c_str());
+	Device device;
+	device.sensor.returns("sample", 500).times(2).then(200);
+	TEST_ASSERT_FALSE(retriesTwice(device));
+}
+
+void test_same_seed_finds_the_same_case() {
+	PropertyTest<Device> property(3);
+	property.forAll("sensor", &Device::sensor, "sample", Gen<int>::oneOf({ 200, 404, 500, -1 }), 1, 6)
+	        .forAll("modem", &Device::modem, "quality", Gen<int16_t>::walk(0, 31, 4), 1, 10);
+	property.setSeed(12345);
+	auto upload = [](Device& device) {
+		int failures = 0;
+		for (int attempt = 0; attempt < 5; ++attempt) {
+			int16_t quality = device.modem.quality();
+			int status = device.sensor.sample();
+			if (status == 200) {
+				return true;
+			}
+			if (status == 500 && quality < 5 && ++failures == 2) {
+				return false;
+			}
+		}
+		return true;
+	};
+	PropertyResult first = property.check(upload);
+	PropertyResult second = property.check(upload);
+	TEST_ASSERT_TRUE(first.failed);
+	TEST_ASSERT_TRUE(first.cases == second.cases);
+	TEST_ASSERT_EQUAL_STRING(first.counterexample.c_str(), second.counterexample.c_str());
+	TEST_ASSERT_EQUAL_STRING(
+		"  sensor.returns(\"sample\", 500);\n"
+		"  modem.returns(\"quality\", (short)0);\n",
+		first.counterexample.c_str());
+}
+
+void test_exceptions_fail_the_property() {
+	PropertyTest<Device> property(1);
+	property.forAll("sensor", &Device::sensor, "sample", Gen<int>::range(0, 10), 1, 3);
+	property.setSeed(5);
+	PropertyResult result = property.check([](Device& device) {
+		if (device.sensor.sample() > 3) {
+			throw 7;
+		}
+		return true;
+	});
+	TEST_ASSERT_TRUE(result.failed);
+	TEST_ASSERT_EQUAL_STRING("exception code 7", result.error.c_str());
+	TEST_ASSERT_EQUAL_STRING("  sensor.returns(\"sample\", 4);\n", result.counterexample.c_str());
+	std::ostringstream out;
+	result.report(out);
+	TEST_ASSERT_TRUE(out.str().find("seed 0x0000000000000005, shrunk in ") != std::string::npos);
+	TEST_ASSERT_TRUE(out.str().find(" tries: exception code 7\n  sensor.returns(\"sample\", 4);\n") != std::string::npos);
+}
+
+void test_strings_are_quoted_in_counterexamples() {
+	PropertyTest<Device> property(1);
+	property.forAll("modem", &Device::modem, "name", Gen<String>([](SeededRandom& random, const String*) {
+		return String(random.chance(0.5) ? "Vodafone" : "E\"E\n");
+	}), 1, 3);
+	property.setSeed(11);
+	PropertyResult result = property.check([](Device& device) { return device.modem.name() != String("E\"E\n"); });
+	TEST_ASSERT_TRUE(result.failed);
+	TEST_ASSERT_EQUAL_STRING("  modem.returns(\"name\", String(\"E\\\"E\\n\"));\n", result.counterexample.c_str());
+}
+
+void test_shrinking_stops_at_the_limit() {
+	PropertyTest<Device> property(1);
+	property.forAll("sensor", &Device::sensor, "sample", Gen<int>::range(0, 100000), 1, 1);
+	property.setSeed(2);
+	property.setMaxShrinks(3);
+	PropertyResult result = property.check([](Device& device) { return device.sensor.sample() < 10; });
+	TEST_ASSERT_TRUE(result.failed);
+	TEST_ASSERT_TRUE(result.shrinks == 3);
+	TEST_ASSERT_TRUE(result.counterexample != "  sensor.returns(\"sample\", 10);\n");
+}
+
+void test_every_case_gets_fresh_emulators() {
+	PropertyTest<Device> property(4);
+	property.setSeed(11);
+	property.setCases(300);
+	property.forAll("sensor", &Device::sensor, "sample", Gen<int>::range(0, 50));
+	PropertyResult result = property.check([](Device& d) {
+		bool fresh = d.modem.methods().empty();
+		d.modem.returns("quality", (int16_t)7);
+		delay(d.sensor.sample());
+		unsigned long now = millis();
+		log_w("sampled");
+		LogFunctionEmulators* log = LogFunctionEmulators::bound();
+		return fresh && d.modem.quality() == 7 && now == VirtualClock::current().nowMillis()
+			&& log != nullptr && log->warning.timesCalled() == 1;
+	});
+	TEST_ASSERT_FALSE(result.failed);
+	TEST_ASSERT_EQUAL(0, millisEmulator.timesCalled());
+	TEST_ASSERT_EQUAL(0, delayEmulator.timesCalled());
+	TEST_ASSERT_EQUAL(0, log_w_stub.timesCalled());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_range_shrinks_towards_zero);
+	RUN_TEST(test_one_of_shrinks_towards_the_first);
+	RUN_TEST(test_walk_stays_within_its_step);
+	RUN_TEST(test_holding_property_runs_every_case);
+	RUN_TEST(test_failing_value_shrinks_to_the_boundary);
+	RUN_TEST(test_counterexample_replays_with_times);
+	RUN_TEST(test_same_seed_finds_the_same_case);
+	RUN_TEST(test_exceptions_fail_the_property);
+	RUN_TEST(test_strings_are_quoted_in_counterexamples);
+	RUN_TEST(test_shrinking_stops_at_the_limit);
+	RUN_TEST(test_every_case_gets_fresh_emulators);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
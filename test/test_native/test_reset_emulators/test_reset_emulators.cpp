@@ -0,0 +1,165 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <cstdlib>
+#include <new>
+
+size_t allocations = 0;
+
+void* operator new(size_t size) {
+	++allocations;
+	void* block = malloc(size);
+	if (block == nullptr) {
+		throw std::bad_alloc();
+	}
+	return block;
+}
+
+void operator delete(void* block) noexcept {
+	free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+	free(block);
+}
+
+class Server : public Emulator {
+public:
+	int connect() { return this->mock<int>("connect"); }
+	int get(const char* path, int port) { return this->mock<int>("get", path, port); }
+	std::string banner() { return this->mock<std::string>("banner"); }
+	int write() { return this->mock<int>("write"); }
+
+	void reset() override {
+		++resets;
+		Emulator::reset();
+	}
+
+	int resets = 0;
+};
+
+Server server;
+
+void configure() {
+	server.returns("connect", 1).then(2).then(3);
+	server.returns("get", 200);
+	server.returns("get", 404).withArgs("/missing", 80);
+	server.returns("get", 301).withArgPrefix("/old/");
+	server.setException("write", 4);
+	server.expect("write").never();
+}
+
+void setUp(void) {}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_reset_all_marks_every_emulator_stale() {
+	configure();
+	Server other;
+	TEST_ASSERT_FALSE(server.stale());
+	Emulator::resetAll();
+	TEST_ASSERT_TRUE(server.stale());
+	TEST_ASSERT_TRUE(other.stale());
+	TEST_ASSERT_TRUE(server.methods().empty());
+}
+
+void test_next_use_resets_a_stale_emulator() {
+	configure();
+	server.connect();
+	int resets = server.resets;
+	Emulator::resetAll();
+	TEST_ASSERT_EQUAL(resets, server.resets);
+	TEST_ASSERT_EQUAL(0, server.connect());
+	TEST_ASSERT_EQUAL(resets + 1, server.resets);
+	TEST_ASSERT_FALSE(server.stale());
+	TEST_ASSERT_TRUE(server.methods().empty());
+	TEST_ASSERT_TRUE(server.faults().empty());
+	TEST_ASSERT_EQUAL(0, server.write());
+}
+
+void test_configuring_a_stale_emulator_starts_afresh() {
+	configure();
+	server.connect();
+	Emulator::resetAll();
+	server.returns("connect", 7);
+	TEST_ASSERT_EQUAL(1, (int)server.methods().size());
+	TEST_ASSERT_EQUAL(7, server.connect());
+	TEST_ASSERT_EQUAL(7, server.connect());
+	TEST_ASSERT_EQUAL(0, server.get("/missing", 80));
+	TEST_ASSERT_EQUAL_STRING("", server.banner().c_str());
+	server.returns("get", 200);
+	TEST_ASSERT_EQUAL(200, server.get("/missing", 80));
+	TEST_ASSERT_EQUAL(200, server.get("/old/page", 80));
+}
+
+void test_reconfiguring_after_a_reset_does_not_allocate() {
+	configure();
+	server.connect();
+	server.get("/missing", 80);
+	Emulator::resetAll();
+	configure();
+	server.connect();
+	server.get("/missing", 80);
+	Emulator::resetAll();
+	size_t before = allocations;
+	for (int i = 0; i < 10; ++i) {
+		configure();
+		TEST_ASSERT_EQUAL(1, server.connect());
+		TEST_ASSERT_EQUAL(404, server.get("/missing", 80));
+		TEST_ASSERT_EQUAL(301, server.get("/old/page", 80));
+		Emulator::resetAll();
+	}
+	TEST_ASSERT_EQUAL(0, (int)(allocations - before));
+}
+
+void test_stubs_read_as_reset_without_being_used() {
+	log_d("value %d", 1);
+	TEST_ASSERT_EQUAL(1, log_d_stub.timesCalled());
+	resetEmulators();
+	TEST_ASSERT_EQUAL(0, log_d_stub.timesCalled());
+	TEST_ASSERT_FALSE(log_d_stub.wasCalled());
+	log_d("next %d", 2);
+	TEST_ASSERT_EQUAL(1, log_d_stub.timesCalled());
+	TEST_ASSERT_EQUAL_STRING("next %d", log_d_stub.getArguments().resolve<const char*>(0, 0));
+}
+
+void test_reset_emulators_restarts_time() {
+	millisEmulator.setTimeIncrement(10);
+	millis();
+	millis();
+	VirtualClock::current().advanceMillis(500);
+	TEST_ASSERT_EQUAL_UINT32(530, millis());
+	resetEmulators();
+	TEST_ASSERT_EQUAL_UINT32(0, VirtualClock::current().nowMillis());
+	TEST_ASSERT_EQUAL_UINT32(10, millis());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_reset_all_marks_every_emulator_stale);
+	RUN_TEST(test_next_use_resets_a_stale_emulator);
+	RUN_TEST(test_configuring_a_stale_emulator_starts_afresh);
+	RUN_TEST(test_reconfiguring_after_a_reset_does_not_allocate);
+	RUN_TEST(test_stubs_read_as_reset_without_being_used);
+	RUN_TEST(test_reset_emulators_restarts_time);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
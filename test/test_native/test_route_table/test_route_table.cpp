@@ -0,0 +1,136 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <stdexcept>
+#include "MockClient.h"
+#include "MockHttpClient.h"
+
+RouteTable routes;
+
+void setUp(void) {}
+
+void tearDown(void) {
+	routes.clear();
+	resetEmulators();
+}
+
+void test_matches_literal_and_parameter_segments() {
+	routes.on(HTTP_METHOD_GET, "/config", { 200 });
+	routes.on(HTTP_METHOD_POST, "/devices/:id/readings", { 201 });
+	TEST_ASSERT_EQUAL(200, routes.match("GET", "/config")->status);
+	TEST_ASSERT_EQUAL(201, routes.match("POST", "/devices/42/readings")->status);
+	TEST_ASSERT_NULL(routes.match("GET", "/devices/42/readings"));
+	TEST_ASSERT_NULL(routes.match("POST", "/devices/42"));
+	TEST_ASSERT_NULL(routes.match("GET", "/config/extra"));
+}
+
+void test_ignores_query_strings_and_repeated_slashes() {
+	routes.on(HTTP_METHOD_GET, "/config", { 200 });
+	TEST_ASSERT_NOT_NULL(routes.match("GET", "/config?version=2&a=b"));
+	TEST_ASSERT_NOT_NULL(routes.match("GET", "//config/"));
+}
+
+void test_prefers_literal_over_parameter() {
+	routes.on(HTTP_METHOD_GET, "/devices/:id", { 200 });
+	routes.on(HTTP_METHOD_GET, "/devices/self", { 202 });
+	TEST_ASSERT_EQUAL(202, routes.match("GET", "/devices/self")->status);
+	TEST_ASSERT_EQUAL(200, routes.match("GET", "/devices/7")->status);
+}
+
+void test_backtracks_to_parameter_when_literal_branch_has_no_route() {
+	routes.on(HTTP_METHOD_POST, "/devices/:id/readings", { 201 });
+	routes.on(HTTP_METHOD_GET, "/devices/self/status", { 202 });
+	TEST_ASSERT_EQUAL(201, routes.match("POST", "/devices/self/readings")->status);
+	TEST_ASSERT_EQUAL(202, routes.match("GET", "/devices/self/status")->status);
+	TEST_ASSERT_NULL(routes.match("GET", "/devices/7/status"));
+}
+
+void test_wildcard_matches_the_rest_of_the_path() {
+	routes.on(HTTP_METHOD_GET, "/static/*", { 203 });
+	routes.on(HTTP_METHOD_GET, "/*", { 299 });
+	TEST_ASSERT_EQUAL(203, routes.match("GET", "/static/css/site.css")->status);
+	TEST_ASSERT_EQUAL(299, routes.match("GET", "/devices/7/readings")->status);
+	TEST_ASSERT_NULL(routes.match("POST", "/static/a"));
+}
+
+void test_wildcard_must_be_the_last_segment() {
+	bool thrown = false;
+	try {
+		routes.on(HTTP_METHOD_GET, "/files/*/meta", { 200 });
+	} catch (const std::invalid_argument&) {
+		thrown = true;
+	}
+	TEST_ASSERT_TRUE(thrown);
+	TEST_ASSERT_EQUAL_size_t(0, routes.size());
+	routes.on(HTTP_METHOD_GET, "/files/*/", { 200 });
+	TEST_ASSERT_NOT_NULL(routes.match("GET", "/files/a/b"));
+}
+
+void test_registering_twice_replaces_the_response() {
+	routes.on(HTTP_METHOD_GET, "/config", { 200 });
+	routes.on(HTTP_METHOD_GET, "/config", { 500 });
+	TEST_ASSERT_EQUAL_size_t(1, routes.size());
+	TEST_ASSERT_EQUAL(500, routes.match("GET", "/config")->status);
+}
+
+void test_resolve_falls_back_to_otherwise() {
+	TEST_ASSERT_EQUAL(404, routes.resolve("GET", "/missing").status);
+	routes.otherwise({ 503, {}, "down" });
+	TEST_ASSERT_EQUAL(503, routes.resolve("GET", "/missing").status);
+	routes.clear();
+	TEST_ASSERT_EQUAL(404, routes.resolve("GET", "/missing").status);
+}
+
+void test_http_client_serves_routes_with_latency() {
+	routes.on(HTTP_METHOD_GET, "/config", { 200, { { "Content-Type", "application/json" } }, "{}", 120 });
+	routes.on(HTTP_METHOD_POST, "/devices/:id/readings", { 201, {}, "", 350 });
+	MockClient client;
+	HttpClient http(client, "api.example.com", 80);
+	http.serve(routes);
+
+	TEST_ASSERT_EQUAL(0, http.get("/config"));
+	TEST_ASSERT_EQUAL(200, http.responseStatusCode());
+	TEST_ASSERT_TRUE(http.headerAvailable());
+	TEST_ASSERT_EQUAL_STRING("Content-Type", http.readHeaderName().c_str());
+	TEST_ASSERT_EQUAL_STRING("application/json", http.readHeaderValue().c_str());
+	TEST_ASSERT_FALSE(http.headerAvailable());
+	TEST_ASSERT_EQUAL(2, http.contentLength());
+	TEST_ASSERT_EQUAL_STRING("{}", http.responseBody().c_str());
+
+	http.post("/devices/42/readings");
+	TEST_ASSERT_EQUAL(201, http.responseStatusCode());
+	http.del("/devices/42");
+	TEST_ASSERT_EQUAL(404, http.responseStatusCode());
+	TEST_ASSERT_EQUAL_UINT32(470, (uint32_t)VirtualClock::current().nowMillis());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_matches_literal_and_parameter_segments);
+	RUN_TEST(test_ignores_query_strings_and_repeated_slashes);
+	RUN_TEST(test_prefers_literal_over_parameter);
+	RUN_TEST(test_backtracks_to_parameter_when_literal_branch_has_no_route);
+	RUN_TEST(test_wildcard_matches_the_rest_of_the_path);
+	RUN_TEST(test_wildcard_must_be_the_last_segment);
+	RUN_TEST(test_registering_twice_replaces_the_response);
+	RUN_TEST(test_resolve_falls_back_to_otherwise);
+	RUN_TEST(test_http_client_serves_routes_with_latency);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
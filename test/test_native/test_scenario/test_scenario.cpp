@@ -0,0 +1,235 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include "Scenario.h"
+
+enum Registration { REG_SEARCHING = 2, REG_HOME = 1 };
+
+class Modem : public Emulator {
+public:
+	int16_t signalQuality() { return this->mock<int16_t>("signalQuality"); }
+	bool isConnected() { return this->mock<bool>("isConnected"); }
+	Registration registration() { return this->mock<Registration>("registration"); }
+	uint32_t baud() { return this->mock<uint32_t>("baud"); }
+	double voltage() { return this->mock<double>("voltage"); }
+	bool init() { return this->mock<bool>("init"); }
+};
+
+class Http : public Emulator {
+public:
+	int status() { return this->mock<int>("status"); }
+	String body() { return this->mock<String>("body"); }
+};
+
+Modem modem;
+Http http;
+
+const char* registered = R"({
+  "modem": {
+    "signalQuality": { "returns": 21, "type": "int16_t" },
+    "isConnected": [false, { "value": true, "times": 3 }],
+    "registration": { "returns": "REG_HOME", "type": "Registration" },
+    "baud": { "returns": 9600, "times": 2, "then": [115200], "type": "uint32_t" },
+    "voltage": 3.7,
+    "init": { "throws": 7 }
+  },
+  "http": {
+    "status": [{ "value": 503, "times": 2 }, 200],
+    "body": "OK é\n"
+  }
+})";
+
+std::string scenarioPath = (std::filesystem::temp_directory_path() / "emulation_scenario.json").string();
+
+void write(const std::string& path, const std::string& json) {
+	std::ofstream file(path, std::ios::binary);
+	file << json;
+}
+
+std::string failure(const std::string& json) {
+	try {
+		Scenario::parse(json, "bad.json");
+	} catch (const ScenarioException& e) {
+		return e.msg_;
+	}
+	return "";
+}
+
+void setUp(void) {
+	Scenario::defineType<Registration>("Registration", { { "REG_HOME", REG_HOME }, { "REG_SEARCHING", REG_SEARCHING } });
+}
+
+void tearDown(void) {
+	resetEmulators();
+}
+
+void test_roles_and_methods() {
+	Scenario scenario = Scenario::parse(registered);
+	TEST_ASSERT_TRUE(scenario.has("modem"));
+	TEST_ASSERT_TRUE(scenario.has("http"));
+	TEST_ASSERT_FALSE(scenario.has("gps"));
+	TEST_ASSERT_EQUAL(6, (int)scenario.methods("modem"));
+	TEST_ASSERT_EQUAL(2, (int)scenario.methods("http"));
+	TEST_ASSERT_EQUAL(0, (int)scenario.methods("gps"));
+}
+
+void test_attach_configures_sequences_and_types() {
+	Scenario scenario = Scenario::parse(registered);
+	scenario.attach("modem", modem);
+	scenario.attach("http", http);
+	TEST_ASSERT_EQUAL(21, modem.signalQuality());
+	TEST_ASSERT_FALSE(modem.isConnected());
+	TEST_ASSERT_TRUE(modem.isConnected());
+	TEST_ASSERT_TRUE(modem.isConnected());
+	TEST_ASSERT_TRUE(modem.isConnected());
+	TEST_ASSERT_TRUE(modem.isConnected());
+	TEST_ASSERT_EQUAL(REG_HOME, modem.registration());
+	TEST_ASSERT_EQUAL(9600, modem.baud());
+	TEST_ASSERT_EQUAL(9600, modem.baud());
+	TEST_ASSERT_EQUAL(115200, modem.baud());
+	TEST_ASSERT_TRUE(modem.voltage() == 3.7);
+	TEST_ASSERT_EQUAL(503, http.status());
+	TEST_ASSERT_EQUAL(503, http.status());
+	TEST_ASSERT_EQUAL(200, http.status());
+	TEST_ASSERT_EQUAL(200, http.status());
+	TEST_ASSERT_EQUAL_STRING("OK \xc3\xa9\n", http.body().c_str());
+}
+
+void test_throws_sets_an_exception() {
+	Scenario::parse(registered).attach("modem", modem);
+	int code = 0;
+	try {
+		modem.init();
+	} catch (int thrown) {
+		code = thrown;
+	}
+	TEST_ASSERT_EQUAL(7, code);
+}
+
+void test_attached_profiles_can_be_extended() {
+	Scenario scenario = Scenario::parse(R"({ "http": { "status": [{ "value": 503, "times": 1 }, 200] } })");
+	scenario.attach("http", http);
+	http.then(404);
+	TEST_ASSERT_EQUAL(503, http.status());
+	TEST_ASSERT_EQUAL(200, http.status());
+	TEST_ASSERT_EQUAL(404, http.status());
+	resetEmulators();
+
+	scenario.attach("http", http);
+	TEST_ASSERT_EQUAL(503, http.status());
+	TEST_ASSERT_EQUAL(200, http.status());
+	TEST_ASSERT_EQUAL(200, http.status());
+}
+
+void test_shared_sequences_need_a_value() {
+	RetVal value(1, 200);
+	bool rejected = false;
+	try {
+		http.returnsShared("status", &value, 0);
+	} catch (const std::invalid_argument&) {
+		rejected = true;
+	}
+	TEST_ASSERT_TRUE(rejected);
+	TEST_ASSERT_EQUAL(0, http.status());
+}
+
+void test_load_parses_each_file_once() {
+	write(scenarioPath, registered);
+	const Scenario& first = Scenario::load(scenarioPath);
+	write(scenarioPath, R"({ "other": { "status": 1 } })");
+	const Scenario& second = Scenario::load(scenarioPath);
+	TEST_ASSERT_EQUAL_PTR(&first, &second);
+	TEST_ASSERT_TRUE(second.has("modem"));
+	TEST_ASSERT_FALSE(second.has("other"));
+	for (int test = 0; test < 3; ++test) {
+		second.attach("http", http);
+		TEST_ASSERT_EQUAL(503, http.status());
+		resetEmulators();
+	}
+	std::filesystem::remove(scenarioPath);
+}
+
+void test_failed_load_is_not_cached() {
+	std::string path = scenarioPath + ".retry";
+	std::filesystem::remove(path);
+	std::string message;
+	try {
+		Scenario::load(path);
+	} catch (const ScenarioException& e) {
+		message = e.msg_;
+	}
+	TEST_ASSERT_EQUAL_STRING(("Cannot read scenario " + path).c_str(), message.c_str());
+
+	write(path, "{ \"http\": { \"status\": [ } }");
+	message = "";
+	try {
+		Scenario::load(path);
+	} catch (const ScenarioException& e) {
+		message = e.msg_;
+	}
+	TEST_ASSERT_EQUAL_STRING((path + ":1:25: expected a value").c_str(), message.c_str());
+
+	write(path, "{ \"http\": { \"status\": 201 } }");
+	Scenario::load(path).attach("http", http);
+	TEST_ASSERT_EQUAL(201, http.status());
+	std::filesystem::remove(path);
+}
+
+void test_errors_name_their_position() {
+	TEST_ASSERT_EQUAL_STRING("bad.json:1:17: expected a value", failure("{\"m\": {\"f\": [1, }}").c_str());
+	TEST_ASSERT_EQUAL_STRING("bad.json:1:1: expected an object of roles", failure("[1]").c_str());
+	TEST_ASSERT_EQUAL_STRING("bad.json:1:16: unknown key x for f", failure("{\"m\":{\"f\":{\"x\":1}}}").c_str());
+	TEST_ASSERT_EQUAL_STRING("bad.json:2:14: 70000 is out of range",
+		failure("{\"m\": {\"f\":\n {\"returns\": 70000, \"type\": \"int16_t\"}}}").c_str());
+	TEST_ASSERT_EQUAL_STRING("bad.json:1:35: unknown type Nope, see Scenario::defineType()",
+		failure("{\"m\": {\"f\": {\"returns\": 1, \"type\":\"Nope\"}}}").c_str());
+	TEST_ASSERT_EQUAL_STRING("bad.json:1:25: unknown name REG_ROAMING",
+		failure("{\"m\": {\"f\": {\"returns\": \"REG_ROAMING\", \"type\": \"Registration\"}}}").c_str());
+	TEST_ASSERT_EQUAL_STRING("bad.json:1:16: unexpected end of scenario", failure("{\"m\": {\"f\": \"OK").c_str());
+	TEST_ASSERT_EQUAL_STRING("bad.json:1:11: unexpected text after the scenario", failure("{\"m\": {}} x").c_str());
+}
+
+void test_attach_unknown_role_fails() {
+	Scenario scenario = Scenario::parse(registered, "registered.json");
+	std::string message;
+	try {
+		scenario.attach("gps", modem);
+	} catch (const ScenarioException& e) {
+		message = e.msg_;
+	}
+	TEST_ASSERT_EQUAL_STRING("registered.json: no role gps", message.c_str());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_roles_and_methods);
+	RUN_TEST(test_attach_configures_sequences_and_types);
+	RUN_TEST(test_throws_sets_an_exception);
+	RUN_TEST(test_attached_profiles_can_be_extended);
+	RUN_TEST(test_shared_sequences_need_a_value);
+	RUN_TEST(test_load_parses_each_file_once);
+	RUN_TEST(test_failed_load_is_not_cached);
+	RUN_TEST(test_errors_name_their_position);
+	RUN_TEST(test_attach_unknown_role_fails);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,175 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <filesystem>
+#include <sstream>
+#include "ScenarioCoverage.h"
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+	std::string name() { return this->mock<std::string>("name"); }
+};
+
+Sensor sensor;
+ScenarioCoverage coverage;
+std::string path = (std::filesystem::temp_directory_path() / "emulation_coverage.tsv").string();
+
+void setUp(void) {}
+
+void tearDown(void) {
+	coverage.clear();
+	std::filesystem::remove(path);
+	sensor.reset();
+	resetEmulators();
+}
+
+void test_returns_comes_before_then() {
+	sensor.returns("sample", 1).then(2).then(3);
+	TEST_ASSERT_EQUAL(1, sensor.sample());
+	TEST_ASSERT_EQUAL(2, sensor.sample());
+	TEST_ASSERT_EQUAL(3, sensor.sample());
+	TEST_ASSERT_EQUAL(3, sensor.sample());
+}
+
+void test_times_repeats_the_value_it_follows() {
+	sensor.returns("sample", 1).times(3).then(2).then(3).times(2).then(4);
+	int expected[] = { 1, 1, 1, 2, 3, 3, 4, 4, 4, 4 };
+	for (int value : expected) {
+		TEST_ASSERT_EQUAL(value, sensor.sample());
+	}
+	const MethodProfile& method = sensor.methods()[0];
+	TEST_ASSERT_EQUAL(10, method.invoked);
+	TEST_ASSERT_EQUAL(10, method.consumed);
+	TEST_ASSERT_EQUAL(1, std::any_cast<int>(method.retVal.second));
+	TEST_ASSERT_EQUAL(3, (int)method.then.size());
+}
+
+void test_returned_values_are_marked() {
+	sensor.returns("sample", 1).then(2).then(3);
+	sensor.sample();
+	const MethodProfile& method = sensor.methods()[0];
+	TEST_ASSERT_TRUE(retValReturned(method, 0));
+	TEST_ASSERT_FALSE(retValReturned(method, 1));
+	TEST_ASSERT_FALSE(retValReturned(method, 2));
+	TEST_ASSERT_FALSE(retValReturned(method, 64));
+}
+
+void test_wrong_type_throws_no_return_value() {
+	sensor.returns("name", 5);
+	bool threw = false;
+	try {
+		sensor.name();
+	} catch (const NoReturnValueException&) {
+		threw = true;
+	}
+	TEST_ASSERT_TRUE(threw);
+	TEST_ASSERT_EQUAL(0, sensor.methods()[0].consumed);
+}
+
+void test_record_lists_every_configured_value() {
+	sensor.returns("sample", 5).then(6).then(7);
+	sensor.returns("name", std::string("x"));
+	sensor.setException("sample", 9);
+	sensor.setException("other", 3);
+	try {
+		sensor.sample();
+	} catch (int) {}
+	coverage.record("test_a", sensor);
+	const std::vector<ScenarioCoverage::Entry>& entries = coverage.entries();
+	TEST_ASSERT_EQUAL(6, (int)entries.size());
+	TEST_ASSERT_EQUAL_STRING("Sensor", entries[0].emulator.c_str());
+	TEST_ASSERT_EQUAL_STRING("returns", entries[0].position.c_str());
+	TEST_ASSERT_EQUAL_STRING("then[2]", entries[2].position.c_str());
+	TEST_ASSERT_EQUAL_STRING("7", entries[2].value.c_str());
+	TEST_ASSERT_EQUAL_STRING("\"x\"", entries[3].value.c_str());
+	TEST_ASSERT_EQUAL_STRING("exception", entries[4].position.c_str());
+	TEST_ASSERT_TRUE(entries[4].consumed);
+	TEST_ASSERT_FALSE(entries[5].consumed);
+	TEST_ASSERT_EQUAL(1, (int)coverage.consumed());
+	TEST_ASSERT_EQUAL(5, (int)coverage.dead().size());
+}
+
+void test_report_aggregates_over_tests() {
+	sensor.returns("sample", 5).then(6);
+	sensor.sample();
+	coverage.record("test_a", sensor, "probe");
+	sensor.reset();
+	sensor.returns("sample", 5).then(6);
+	sensor.sample();
+	sensor.sample();
+	coverage.record("test_b", sensor, "probe");
+	std::ostringstream out;
+	coverage.report(out);
+	TEST_ASSERT_EQUAL_STRING(
+		"Scenario coverage: 3 of 4 configured values consumed (75%) over 2 tests\n"
+		"Dead configuration by test:\n"
+		"  test_a  probe::sample  then[1] = 6\n",
+		out.str().c_str());
+}
+
+void test_report_lists_values_no_test_consumed() {
+	sensor.returns("sample", 5).then(6);
+	coverage.record("test_a", sensor);
+	coverage.record("test_b", sensor);
+	std::ostringstream out;
+	coverage.report(out, false);
+	TEST_ASSERT_EQUAL_STRING(
+		"Scenario coverage: 0 of 4 configured values consumed (0%) over 2 tests\n"
+		"Never consumed in any test:\n"
+		"  Sensor::sample  returns = 5  (configured in 2 tests)\n"
+		"  Sensor::sample  then[1] = 6  (configured in 2 tests)\n",
+		out.str().c_str());
+}
+
+void test_saved_shards_merge() {
+	sensor.returns("name", std::string("tab\there"));
+	sensor.name();
+	coverage.record("test_a", sensor);
+	TEST_ASSERT_TRUE(coverage.save(path.c_str()));
+	ScenarioCoverage merged;
+	TEST_ASSERT_TRUE(merged.load(path.c_str()));
+	TEST_ASSERT_TRUE(merged.load(path.c_str()));
+	TEST_ASSERT_FALSE(merged.load("/nonexistent/coverage.tsv"));
+	TEST_ASSERT_EQUAL(2, (int)merged.entries().size());
+	TEST_ASSERT_EQUAL(2, (int)merged.consumed());
+	TEST_ASSERT_EQUAL_STRING("\"tab here\"", merged.entries()[1].value.c_str());
+}
+
+void test_stale_emulators_record_nothing() {
+	sensor.returns("sample", 5);
+	resetEmulators();
+	coverage.record("test_a", sensor);
+	TEST_ASSERT_EQUAL(0, (int)coverage.entries().size());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_returns_comes_before_then);
+	RUN_TEST(test_times_repeats_the_value_it_follows);
+	RUN_TEST(test_returned_values_are_marked);
+	RUN_TEST(test_wrong_type_throws_no_return_value);
+	RUN_TEST(test_record_lists_every_configured_value);
+	RUN_TEST(test_report_aggregates_over_tests);
+	RUN_TEST(test_report_lists_values_no_test_consumed);
+	RUN_TEST(test_saved_shards_merge);
+	RUN_TEST(test_stale_emulators_record_nothing);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
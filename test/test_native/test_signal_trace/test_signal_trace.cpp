@@ -0,0 +1,134 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include <filesystem>
+#include <fstream>
+#include "MockClient.h"
+#include "MockTinyGsm.h"
+
+std::string csvPath = (std::filesystem::temp_directory_path() / "emulation_signal_trace.csv").string();
+std::string binPath = (std::filesystem::temp_directory_path() / "emulation_signal_trace.bin").string();
+
+void writeTrace(long samples) {
+	std::ofstream csv(csvPath);
+	csv << "time,csq,reg" << std::endl;
+	csv << "# recorded on device 42" << std::endl;
+	for (long i = 0; i < samples; ++i) {
+		csv << (1700000000L + i * 10) << "," << (i % 32) << "," << ((i % 7 == 3) ? 2 : 1) << std::endl;
+	}
+}
+
+void setUp(void) {
+	writeTrace(5000);
+}
+
+void tearDown(void) {
+	std::filesystem::remove(csvPath);
+	std::filesystem::remove(binPath);
+	resetEmulators();
+}
+
+void test_opens_csv_and_rebases_time() {
+	SignalTrace trace;
+	TEST_ASSERT_TRUE(trace.open(csvPath.c_str()));
+	TEST_ASSERT_EQUAL_size_t(5000, trace.size());
+	TEST_ASSERT_EQUAL_UINT32(49990000, (uint32_t)trace.duration());
+	TEST_ASSERT_EQUAL(0, trace.at(0).csq);
+	TEST_ASSERT_EQUAL(1, trace.at(0).registration);
+	TEST_ASSERT_EQUAL(1, trace.at(0).gprs);
+}
+
+void test_sample_holds_until_the_next_one() {
+	SignalTrace trace;
+	trace.open(csvPath.c_str());
+	TEST_ASSERT_EQUAL(5, trace.at(50000).csq);
+	TEST_ASSERT_EQUAL(5, trace.at(59999).csq);
+	TEST_ASSERT_EQUAL(6, trace.at(60000).csq);
+	TEST_ASSERT_EQUAL(2, trace.at(30000).registration);
+	TEST_ASSERT_EQUAL(0, trace.at(30000).gprs);
+}
+
+void test_lookups_may_go_backwards_and_past_the_end() {
+	SignalTrace trace;
+	trace.open(csvPath.c_str());
+	TEST_ASSERT_EQUAL(4999 % 32, trace.at(100000000).csq);
+	TEST_ASSERT_EQUAL(3, trace.at(30000).csq);
+	TEST_ASSERT_EQUAL(4000 % 32, trace.at(40000000).csq);
+	TEST_ASSERT_EQUAL(1, trace.at(10000).csq);
+}
+
+void test_compiled_trace_matches_csv() {
+	TEST_ASSERT_TRUE(SignalTrace::compile(csvPath.c_str(), binPath.c_str()));
+	SignalTrace csv;
+	SignalTrace binary;
+	csv.open(csvPath.c_str());
+	TEST_ASSERT_TRUE(binary.open(binPath.c_str()));
+	TEST_ASSERT_EQUAL_size_t(csv.size(), binary.size());
+	for (uint64_t ms : { 0ULL, 5ULL, 30000ULL, 1234567ULL, 49990000ULL, 70000ULL, 99999999ULL }) {
+		TEST_ASSERT_EQUAL(csv.at(ms).csq, binary.at(ms).csq);
+		TEST_ASSERT_EQUAL(csv.at(ms).registration, binary.at(ms).registration);
+	}
+}
+
+void test_missing_file_fails_to_open() {
+	SignalTrace trace;
+	TEST_ASSERT_FALSE(trace.open("/nonexistent/trace.csv"));
+	TEST_ASSERT_EQUAL_size_t(0, trace.size());
+}
+
+void test_modem_replays_against_virtual_time() {
+	SignalTrace trace;
+	trace.open(csvPath.c_str());
+	MockClient serial;
+	TinyGsm modem(serial);
+	modem.returns("getSignalQuality", (int16_t)99);
+	modem.replay(trace);
+
+	TEST_ASSERT_EQUAL(0, modem.getSignalQuality());
+	TEST_ASSERT_TRUE(modem.isNetworkConnected());
+	VirtualClock::current().advanceMillis(30000);
+	TEST_ASSERT_EQUAL(3, modem.getSignalQuality());
+	TEST_ASSERT_FALSE(modem.isNetworkConnected());
+	TEST_ASSERT_FALSE(modem.isGprsConnected());
+
+	modem.stopReplay();
+	TEST_ASSERT_EQUAL(99, modem.getSignalQuality());
+}
+
+void test_replay_can_start_at_an_offset() {
+	SignalTrace trace;
+	trace.open(csvPath.c_str());
+	MockClient serial;
+	TinyGsm modem(serial);
+	modem.replay(trace, 100000);
+	TEST_ASSERT_EQUAL(10, modem.getSignalQuality());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_opens_csv_and_rebases_time);
+	RUN_TEST(test_sample_holds_until_the_next_one);
+	RUN_TEST(test_lookups_may_go_backwards_and_past_the_end);
+	RUN_TEST(test_compiled_trace_matches_csv);
+	RUN_TEST(test_missing_file_fails_to_open);
+	RUN_TEST(test_modem_replays_against_virtual_time);
+	RUN_TEST(test_replay_can_start_at_an_offset);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,121 @@
+// #define EMULATOR_LOG
+#define SLEEP_LEDGER_QUIET
+
+#include <emulation.h>
+#include <cstdio>
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+};
+
+Sensor sensor;
+SleepLedger& ledger = SleepLedger::instance();
+
+std::string reportOf(size_t rows = SLEEP_LEDGER_REPORT_ROWS) {
+	FILE* out = tmpfile();
+	ledger.report(out, rows);
+	std::string text(ftell(out), '\0');
+	rewind(out);
+	size_t got = fread(&text[0], 1, text.size(), out);
+	fclose(out);
+	text.resize(got);
+	return text;
+}
+
+void setUp(void) {
+	ledger.reset();
+}
+
+void tearDown(void) {
+	VirtualClock::bind(nullptr);
+	sensor.reset();
+	resetEmulators();
+}
+
+void test_mocked_delays_are_charged_to_the_running_test() {
+	sensor.returns("sample", 1, 10);
+	sensor.sample();
+	sensor.sample();
+	uint64_t slept = ledger.slept("test_mocked_delays_are_charged_to_the_running_test");
+	TEST_ASSERT_TRUE(slept >= 20000);
+	TEST_ASSERT_TRUE(slept == ledger.slept());
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)ledger.slept("test_other"));
+	TEST_ASSERT_TRUE(reportOf().find("test_mocked_delays_are_charged_to_the_running_test  Sensor::sample  x2\n") != std::string::npos);
+}
+
+void test_emulated_delay_is_charged() {
+	delay(5);
+	TEST_ASSERT_TRUE(ledger.slept("test_emulated_delay_is_charged") >= 5000);
+	TEST_ASSERT_TRUE(reportOf().find("::delay  x1\n") != std::string::npos);
+}
+
+void test_waits_on_a_bound_clock_cost_nothing() {
+	VirtualClock deviceClock;
+	VirtualClock::bind(&deviceClock);
+	sensor.returns("sample", 1, 1000);
+	sensor.sample();
+	delay(60000);
+	TEST_ASSERT_EQUAL_UINT32(61000, deviceClock.nowMillis());
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)ledger.slept());
+	TEST_ASSERT_EQUAL_STRING("", reportOf().c_str());
+}
+
+void test_zero_length_sleeps_are_skipped() {
+	sensor.returns("sample", 1);
+	sensor.sample();
+	SleepLedger::sleep(0, "Sensor", "sample");
+	TEST_ASSERT_EQUAL_STRING("", reportOf().c_str());
+}
+
+void test_report_ranks_longest_first() {
+	ledger.charge("test_fast", "Sensor", "sample", 100000);
+	ledger.charge("test_slow", "Sensor", "sample", 2000000);
+	ledger.charge("test_slow", "Modem", "connect", 1000000);
+	ledger.charge("", "Sensor", "sample", 500000);
+	TEST_ASSERT_TRUE(3600000 == ledger.slept());
+	TEST_ASSERT_TRUE(3000000 == ledger.slept("test_slow"));
+	TEST_ASSERT_EQUAL_STRING(
+		"Host sleep by test (3.60 s total)\n"
+		"      3.00 s   test_slow\n"
+		"      0.50 s   (outside a test)\n"
+		"Host sleep by test, emulator and method\n"
+		"      2.00 s   test_slow  Sensor::sample  x1\n"
+		"      1.00 s   test_slow  Modem::connect  x1\n",
+		reportOf(2).c_str());
+}
+
+void test_reset_forgets_everything() {
+	ledger.charge("test_slow", "Sensor", "sample", 1000);
+	ledger.reset();
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)ledger.slept());
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)ledger.slept("test_slow"));
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_mocked_delays_are_charged_to_the_running_test);
+	RUN_TEST(test_emulated_delay_is_charged);
+	RUN_TEST(test_waits_on_a_bound_clock_cost_nothing);
+	RUN_TEST(test_zero_length_sleeps_are_skipped);
+	RUN_TEST(test_report_ranks_longest_first);
+	RUN_TEST(test_reset_forgets_everything);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
@@ -0,0 +1,206 @@
+// #define EMULATOR_LOG
+
+#include <emulation.h>
+#include "MockClient.h"
+#include "MockTinyGsm.h"
+
+MockClient serial;
+TinyGsm modem(serial);
+
+/**
+ * Scripts the modem and reads it as firmware does before opening a socket.
+ */
+void registered(bool attached = true) {
+	modem.returns("isNetworkConnected", true);
+	modem.returns("isGprsConnected", attached);
+	modem.returns("getSignalQuality", (int16_t)30);
+	modem.isNetworkConnected();
+	modem.isGprsConnected();
+	modem.getSignalQuality();
+}
+
+void setUp(void) {
+	modem.setRadioTechnology(MOCK_RAT_LTE_M);
+}
+
+void tearDown(void) {
+	modem.reset();
+	resetEmulators();
+}
+
+void test_connect_needs_a_data_context() {
+	registered(false);
+	TinyGsmClient socket(modem);
+	TEST_ASSERT_EQUAL(0, socket.connect("api.example.com", 80));
+	TEST_ASSERT_EQUAL(0, socket.connected());
+}
+
+void test_connect_costs_a_round_trip() {
+	registered();
+	TinyGsmClient socket(modem);
+	TEST_ASSERT_EQUAL(1, socket.connect("api.example.com", 80));
+	TEST_ASSERT_EQUAL(1, socket.connected());
+	TEST_ASSERT_TRUE(VirtualClock::current().nowMillis() > 0);
+}
+
+void test_written_bytes_are_kept() {
+	registered();
+	TinyGsmClient socket(modem);
+	socket.connect("api.example.com", 80);
+	TEST_ASSERT_EQUAL_size_t(5, socket.write((const uint8_t*)"hello", 5));
+	TEST_ASSERT_EQUAL_size_t(1, socket.write('!'));
+	TEST_ASSERT_EQUAL_STRING("hello!", socket.sent().c_str());
+	socket.clearSent();
+	TEST_ASSERT_EQUAL_STRING("", socket.sent().c_str());
+}
+
+void test_fed_bytes_are_read() {
+	registered();
+	TinyGsmClient socket(modem);
+	socket.connect("api.example.com", 80);
+	socket.feed("OK\r\n");
+	TEST_ASSERT_EQUAL(4, socket.available());
+	TEST_ASSERT_EQUAL('O', socket.peek());
+	TEST_ASSERT_EQUAL('O', socket.read());
+	uint8_t buffer[8] = {};
+	TEST_ASSERT_EQUAL(3, socket.read(buffer, sizeof(buffer)));
+	TEST_ASSERT_EQUAL_MEMORY("K\r\n", buffer, 3);
+	TEST_ASSERT_EQUAL(-1, socket.read());
+}
+
+void test_losing_registration_drops_the_socket() {
+	registered();
+	TinyGsmClient socket(modem);
+	socket.connect("api.example.com", 80);
+	modem.reset();
+	modem.returns("isNetworkConnected", false);
+	TEST_ASSERT_EQUAL(1, socket.connected());
+	TEST_ASSERT_FALSE(modem.isNetworkConnected());
+	TEST_ASSERT_EQUAL_size_t(0, socket.write((const uint8_t*)"x", 1));
+	TEST_ASSERT_EQUAL(0, socket.connected());
+	TEST_ASSERT_FALSE((bool)socket);
+}
+
+void test_pushed_state_drops_the_socket() {
+	registered();
+	TinyGsmClient socket(modem);
+	socket.connect("api.example.com", 80);
+	ModemState state = modem.networkState();
+	state.gprs = false;
+	modem.setNetworkState(state);
+	TEST_ASSERT_EQUAL(0, socket.connected());
+	TEST_ASSERT_EQUAL(0, socket.connect("api.example.com", 80));
+}
+
+void test_transfers_consume_no_scripted_values() {
+	modem.returns("isNetworkConnected", true).then(false);
+	modem.returns("isGprsConnected", true);
+	TinyGsmClient socket(modem);
+	TEST_ASSERT_EQUAL(1, socket.connect("api.example.com", 80));
+	socket.feed("HTTP/1.1 200 OK\r\n");
+	uint8_t buffer[32];
+	TEST_ASSERT_EQUAL_size_t(4, socket.write((const uint8_t*)"GET ", 4));
+	while (socket.available() > 0) {
+		socket.read(buffer, 4);
+	}
+	TEST_ASSERT_EQUAL(1, socket.connected());
+	for (auto& method : modem.methods()) {
+		TEST_ASSERT_EQUAL(0, method.invoked);
+	}
+	TEST_ASSERT_TRUE(modem.isNetworkConnected());
+	TEST_ASSERT_FALSE(modem.isNetworkConnected());
+}
+
+void test_unscripted_modem_keeps_the_socket_open() {
+	TinyGsmClient socket(modem);
+	TEST_ASSERT_EQUAL(1, socket.connect("api.example.com", 80));
+	TEST_ASSERT_EQUAL_size_t(3, socket.write((const uint8_t*)"abc", 3));
+	TEST_ASSERT_EQUAL(1, socket.connected());
+}
+
+void test_signal_changes_rebuild_the_link() {
+	modem.returns("getSignalQuality", (int16_t)30).times(2).then((int16_t)6);
+	modem.getSignalQuality();
+	TinyGsmClient socket(modem);
+	socket.connect("api.example.com", 80);
+	uint32_t version = modem.stateVersion();
+	modem.getSignalQuality();
+	TEST_ASSERT_EQUAL_UINT32(version, modem.stateVersion());
+	modem.getSignalQuality();
+	TEST_ASSERT_EQUAL_UINT32(version + 1, modem.stateVersion());
+	TEST_ASSERT_EQUAL(6, modem.networkState().csq);
+	modem.setRadioTechnology(MOCK_RAT_GSM);
+	TEST_ASSERT_EQUAL_UINT32(version + 2, modem.stateVersion());
+	TEST_ASSERT_EQUAL(1, socket.connected());
+}
+
+void test_reset_restores_the_default_state() {
+	registered(false);
+	TEST_ASSERT_FALSE(modem.networkState().gprs);
+	resetEmulators();
+	const ModemState& state = modem.networkState();
+	TEST_ASSERT_TRUE(state.registered);
+	TEST_ASSERT_TRUE(state.gprs);
+	TEST_ASSERT_EQUAL(20, state.csq);
+}
+
+void test_stop_closes_the_socket() {
+	registered();
+	TinyGsmClient socket(modem, 2);
+	socket.connect("api.example.com", 80);
+	socket.stop();
+	TEST_ASSERT_EQUAL(0, socket.connected());
+	TEST_ASSERT_EQUAL(2, socket.mux());
+}
+
+void test_weak_signal_slows_the_link() {
+	LinkProfile strong = TinyGsmClient::profileFor(MOCK_RAT_GPRS, 30);
+	LinkProfile weak = TinyGsmClient::profileFor(MOCK_RAT_GPRS, 5);
+	LinkProfile unknown = TinyGsmClient::profileFor(MOCK_RAT_GPRS, 99);
+	TEST_ASSERT_EQUAL_UINT32(40000, strong.bandwidth);
+	TEST_ASSERT_EQUAL_UINT32(600, strong.latency);
+	TEST_ASSERT_TRUE(weak.bandwidth < strong.bandwidth);
+	TEST_ASSERT_TRUE(weak.latency > strong.latency);
+	TEST_ASSERT_TRUE(weak.dropRate > strong.dropRate);
+	TEST_ASSERT_TRUE(unknown.bandwidth <= weak.bandwidth);
+}
+
+void test_radio_technology_sets_throughput() {
+	TEST_ASSERT_TRUE(TinyGsmClient::profileFor(MOCK_RAT_LTE_M, 30).bandwidth > TinyGsmClient::profileFor(MOCK_RAT_GSM, 30).bandwidth);
+	TEST_ASSERT_TRUE(TinyGsmClient::profileFor(MOCK_RAT_NB_IOT, 30).latency > TinyGsmClient::profileFor(MOCK_RAT_UMTS, 30).latency);
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_connect_needs_a_data_context);
+	RUN_TEST(test_connect_costs_a_round_trip);
+	RUN_TEST(test_written_bytes_are_kept);
+	RUN_TEST(test_fed_bytes_are_read);
+	RUN_TEST(test_losing_registration_drops_the_socket);
+	RUN_TEST(test_pushed_state_drops_the_socket);
+	RUN_TEST(test_transfers_consume_no_scripted_values);
+	RUN_TEST(test_unscripted_modem_keeps_the_socket_open);
+	RUN_TEST(test_signal_changes_rebuild_the_link);
+	RUN_TEST(test_reset_restores_the_default_state);
+	RUN_TEST(test_stop_closes_the_socket);
+	RUN_TEST(test_weak_signal_slows_the_link);
+	RUN_TEST(test_radio_technology_sets_throughput);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif
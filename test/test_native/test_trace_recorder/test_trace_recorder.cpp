@@ -0,0 +1,164 @@
+// #define EMULATOR_LOG
+#define TRACE_CHUNK_SIZE 256
+
+#include <emulation.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+class Sensor : public Emulator {
+public:
+	int sample() { return this->mock<int>("sample"); }
+};
+
+Sensor sensor;
+VirtualClock deviceClock;
+std::string path = (std::filesystem::temp_directory_path() / "emulation_trace.json").string();
+
+std::string slurp() {
+	std::ifstream file(path, std::ios::binary);
+	std::ostringstream content;
+	content << file.rdbuf();
+	return content.str();
+}
+
+bool contains(const std::string& text, const std::string& part) {
+	return text.find(part) != std::string::npos;
+}
+
+void setUp(void) {
+	VirtualClock::bind(&deviceClock);
+}
+
+void tearDown(void) {
+	TraceRecorder::bind(nullptr);
+	VirtualClock::bind(nullptr);
+	deviceClock.reset();
+	std::filesystem::remove(path);
+	sensor.reset();
+	resetEmulators();
+}
+
+void test_mocked_calls_are_complete_events_on_virtual_time() {
+	sensor.returns("sample", 1, 5);
+	{
+		TraceRecorder trace(path.c_str());
+		TraceRecorder::bind(&trace);
+		sensor.sample();
+		sensor.sample();
+		TEST_ASSERT_EQUAL_UINT32(4, (uint32_t)trace.events());
+	}
+	std::string json = slurp();
+	TEST_ASSERT_EQUAL_STRING("\n]\n", json.substr(json.size() - 3).c_str());
+	TEST_ASSERT_TRUE(contains(json, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"device 1\"}}"));
+	TEST_ASSERT_TRUE(contains(json, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Sensor #1\"}}"));
+	TEST_ASSERT_TRUE(contains(json, "{\"name\":\"sample\",\"cat\":\"mock\",\"ph\":\"X\",\"ts\":0,\"pid\":1,\"tid\":1,\"dur\":5000}"));
+	TEST_ASSERT_TRUE(contains(json, "{\"name\":\"sample\",\"cat\":\"mock\",\"ph\":\"X\",\"ts\":5000,\"pid\":1,\"tid\":1,\"dur\":5000}"));
+}
+
+void test_delays_are_recorded_on_their_own_track() {
+	TraceRecorder trace(path.c_str());
+	TraceRecorder::bind(&trace);
+	delay(250);
+	trace.close();
+	TEST_ASSERT_TRUE(contains(slurp(), "\"cat\":\"delay\",\"ph\":\"X\",\"ts\":0,\"pid\":1,\"tid\":1,\"dur\":250000}"));
+}
+
+void test_instants_and_counters_carry_their_values() {
+	TraceRecorder trace(path.c_str());
+	TraceRecorder::bind(&trace);
+	deviceClock.advanceMillis(3);
+	trace.instant(&sensor, "Sensor", "state", "say \"hi\"\n", "code", -7);
+	trace.counter(&sensor, "Sensor", "registration", 5);
+	trace.close();
+	std::string json = slurp();
+	TEST_ASSERT_TRUE(contains(json, "{\"name\":\"say \\\"hi\\\"\\u000a\",\"cat\":\"state\",\"ph\":\"i\",\"ts\":3000,\"pid\":1,\"tid\":1,\"s\":\"t\",\"args\":{\"code\":-7}}"));
+	TEST_ASSERT_TRUE(contains(json, "{\"name\":\"Sensor #1 registration\",\"cat\":\"state\",\"ph\":\"C\",\"ts\":3000,\"pid\":1,\"tid\":1,\"args\":{\"value\":5}}"));
+}
+
+void test_injected_faults_are_instants() {
+	sensor.returns("sample", 1);
+	sensor.setException("sample", 9);
+	TraceRecorder trace(path.c_str());
+	TraceRecorder::bind(&trace);
+	int code = 0;
+	try {
+		sensor.sample();
+	} catch (int exception) {
+		code = exception;
+	}
+	TEST_ASSERT_EQUAL(9, code);
+	trace.close();
+	TEST_ASSERT_TRUE(contains(slurp(), "\"name\":\"sample\",\"cat\":\"fault\",\"ph\":\"i\",\"ts\":0,\"pid\":1,\"tid\":1,\"s\":\"t\",\"args\":{\"code\":9}}"));
+}
+
+void test_each_clock_is_a_process_and_each_instance_a_track() {
+	Sensor other;
+	TraceRecorder trace(path.c_str());
+	TraceRecorder::bind(&trace);
+	trace.instant(&sensor, "Sensor", "state", "a");
+	trace.instant(&other, "Sensor", "state", "b");
+	VirtualClock::bind(nullptr);
+	trace.instant(&sensor, "Sensor", "state", "c");
+	trace.close();
+	std::string json = slurp();
+	TEST_ASSERT_TRUE(contains(json, "\"name\":\"b\",\"cat\":\"state\",\"ph\":\"i\",\"ts\":0,\"pid\":1,\"tid\":2"));
+	TEST_ASSERT_TRUE(contains(json, "\"pid\":2,\"tid\":0,\"args\":{\"name\":\"emulation\"}"));
+	TEST_ASSERT_TRUE(contains(json, "\"name\":\"c\",\"cat\":\"state\",\"ph\":\"i\",\"ts\":0,\"pid\":2,\"tid\":3"));
+}
+
+void test_full_chunks_are_written_before_close() {
+	TraceRecorder trace(path.c_str());
+	TraceRecorder::bind(&trace);
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)trace.bytesWritten());
+	for (int i = 0; i < 20; ++i) {
+		trace.instant(&sensor, "Sensor", "state", "tick");
+	}
+	uint64_t written = trace.bytesWritten();
+	TEST_ASSERT_TRUE(written >= TRACE_CHUNK_SIZE);
+	TEST_ASSERT_EQUAL_UINT32((uint32_t)written, (uint32_t)slurp().size());
+	trace.close();
+	TEST_ASSERT_EQUAL_UINT32((uint32_t)trace.bytesWritten(), (uint32_t)slurp().size());
+}
+
+void test_nothing_is_recorded_unless_bound() {
+	sensor.returns("sample", 1);
+	TraceRecorder trace(path.c_str());
+	sensor.sample();
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)trace.events());
+	TEST_ASSERT_NULL(TraceRecorder::bind(&trace));
+	TEST_ASSERT_EQUAL_PTR(&trace, TraceRecorder::active());
+	trace.close();
+	sensor.sample();
+	TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)trace.events());
+	TEST_ASSERT_EQUAL_STRING("[\n]\n", slurp().c_str());
+}
+
+int runTests() {
+	UNITY_BEGIN();
+	RUN_TEST(test_mocked_calls_are_complete_events_on_virtual_time);
+	RUN_TEST(test_delays_are_recorded_on_their_own_track);
+	RUN_TEST(test_instants_and_counters_carry_their_values);
+	RUN_TEST(test_injected_faults_are_instants);
+	RUN_TEST(test_each_clock_is_a_process_and_each_instance_a_track);
+	RUN_TEST(test_full_chunks_are_written_before_close);
+	RUN_TEST(test_nothing_is_recorded_unless_bound);
+	return UNITY_END();
+}
+
+#if defined(ARDUINO)
+#include <Arduino.h>
+
+void setup() {
+	runTests();
+}
+
+void loop() {}
+
+#else
+
+int main(int argc, char **argv) {
+	return runTests();
+}
+
+#endif